@@ -3,6 +3,17 @@
 #include <QSignalSpy>
 
 #include "libsoro/sensordataparser.h"
+#include "libsoro/channel.h"
+#include "libsoro/latencyhistogram.h"
+#include "libsoro/bandwidthestimator.h"
+#include "libsoro/streamstarttiming.h"
+#include "libsoro/mediacontrolmessage.h"
+#include "libsoro/packetring.h"
+#include "libsoro/recordingindex.h"
+#include "libsoro/localrecordingsettings.h"
+#include "libsoro/capturemode.h"
+#include "libsoro/bitratecontroller.h"
+#include "libsoro/videoclient.h"
 
 using namespace Soro;
 
@@ -15,6 +26,16 @@ public:
 
 private Q_SLOTS:
     void testSensorDataRecorder();
+    void testLatencyHistogram();
+    void testMultipathFailover();
+    void testVideoFormatSelection();
+    void testVideoFormatSerialization();
+    void testBitrateController();
+    void testCaptureModeSelection();
+    void testStreamStartTiming();
+    void testMediaControlMessage();
+    void testPacketRing();
+    void testRecordingIndex();
 };
 
 SoroTests::SoroTests()
@@ -88,6 +109,401 @@ void SoroTests::testSensorDataRecorder()
     spyErr.clear();
 }
 
+void SoroTests::testLatencyHistogram()
+{
+    LatencyHistogram histogram;
+    QVERIFY(histogram.getCount() == 0);
+    QVERIFY(histogram.getPercentile(50) == 0);
+
+    /* 90 fast samples and 10 slow ones
+     */
+    for (int i = 0; i < 90; i++) histogram.record(3);
+    for (int i = 0; i < 10; i++) histogram.record(1000);
+
+    QVERIFY(histogram.getCount() == 100);
+    QVERIFY(histogram.getMax() == 1000);
+    QVERIFY(histogram.getBucketCount(2) == 90);     // [2, 4)
+    QVERIFY(histogram.getBucketCount(10) == 10);    // [512, 1024)
+    QVERIFY(histogram.getPercentile(50) == 4);
+    QVERIFY(histogram.getPercentile(90) == 4);
+    QVERIFY(histogram.getPercentile(99) == 1024);
+
+    /* Samples past the last bucket are clamped into it
+     */
+    histogram.record((qint64)1 << 40);
+    QVERIFY(histogram.getBucketCount(LATENCY_HISTOGRAM_BUCKETS - 1) == 1);
+    QVERIFY(histogram.getPercentile(100) == ((qint64)1 << 40));
+
+    histogram.reset();
+    QVERIFY(histogram.getCount() == 0);
+    QVERIFY(histogram.getMax() == 0);
+}
+
+void SoroTests::testMultipathFailover()
+{
+    /* Two paths over loopback, 127.0.0.2 stands in for a second interface
+     */
+    Channel *server = Channel::createServer(this, 47391, "MultipathTest", Channel::UdpProtocol, QHostAddress("127.0.0.1"));
+    Channel *client = Channel::createClient(this, SocketAddress(QHostAddress("127.0.0.1"), 47391), "MultipathTest",
+                                            Channel::UdpProtocol, QHostAddress("127.0.0.1"));
+    QVERIFY(server->addPath(QHostAddress("127.0.0.2")));
+    QVERIFY(client->addPath(QHostAddress("127.0.0.2"), SocketAddress(QHostAddress("127.0.0.2"), 47391)));
+    QStringList received;
+    connect(server, &Channel::messageReceived, [&received](const char *message, Channel::MessageSize size) {
+        received.append(QString::fromLatin1(message, size - 1));
+    });
+    server->open();
+    client->open();
+    QTRY_VERIFY_WITH_TIMEOUT(client->getState() == Channel::ConnectedState, 5000);
+    QTRY_VERIFY_WITH_TIMEOUT(server->getPathStatistics().value(1).up && client->getPathStatistics().value(1).up, 5000);
+
+    /* Every message goes out on both paths, and is only delivered once
+     */
+    received.clear();
+    quint64 downBefore0 = server->getPathStatistics()[0].messagesDown;
+    quint64 downBefore1 = server->getPathStatistics()[1].messagesDown;
+    QVERIFY(client->sendMessage("one", 4));
+    QTRY_VERIFY_WITH_TIMEOUT((server->getPathStatistics()[0].messagesDown > downBefore0)
+            && (server->getPathStatistics()[1].messagesDown > downBefore1), 5000);
+    QCOMPARE(received, QStringList() << "one");
+
+    /* With one path dropped, messages still arrive over the other, once
+     */
+    QVERIFY(client->setPathEnabled(1, false));
+    QVERIFY(!client->getPathStatistics()[1].up);
+    received.clear();
+    QVERIFY(client->sendMessage("two", 4));
+    QTRY_COMPARE_WITH_TIMEOUT(received.count(), 1, 5000);
+    QTRY_VERIFY_WITH_TIMEOUT(!server->getPathStatistics()[1].up, 5000);
+    QVERIFY(client->sendMessage("three", 6));
+    QTRY_COMPARE_WITH_TIMEOUT(received.count(), 2, 5000);
+    QCOMPARE(received, QStringList() << "two" << "three");
+    QCOMPARE(client->getState(), Channel::ConnectedState);
+
+    delete client;
+    delete server;
+}
+
+void SoroTests::testVideoFormatSelection()
+{
+    QList<VideoFormat> candidates;
+    candidates << VideoFormat(VideoFormat::Encoding_H264, VideoFormat::Resolution_640x360, 800000);
+    candidates << VideoFormat(VideoFormat::Encoding_H264, VideoFormat::Resolution_176_144, 150000);
+    candidates << VideoFormat(VideoFormat::Encoding_H264, VideoFormat::Resolution_1280x720, 2500000);
+
+    /* Picks the largest format that fits with headroom
+     */
+    QVERIFY(BandwidthEstimator::selectVideoFormat(4000000, 0.3, candidates).getBitrate() == 2500000);
+    QVERIFY(BandwidthEstimator::selectVideoFormat(3000000, 0.3, candidates).getBitrate() == 800000);
+
+    /* Capacity is split between streams
+     */
+    QVERIFY(BandwidthEstimator::selectVideoFormat(4000000, 0.3, candidates, 2).getBitrate() == 800000);
+
+    /* Falls back to the smallest format if nothing fits or capacity is unknown
+     */
+    QVERIFY(BandwidthEstimator::selectVideoFormat(100000, 0.3, candidates).getBitrate() == 150000);
+    QVERIFY(BandwidthEstimator::selectVideoFormat(-1, 0.3, candidates).getBitrate() == 150000);
+}
+
+void SoroTests::testVideoFormatSerialization()
+{
+    VideoFormat format(VideoFormat::Encoding_H264, VideoFormat::Resolution_1280x720, 2000000, 15, VideoFormat::StereoMode_SideBySide);
+    format.setKeyframeInterval(30);
+
+    VideoFormat copy;
+    copy.deserialize(format.serialize());
+    QVERIFY(copy == format);
+    QVERIFY(copy.getEncoderBitrate() == 1000000);
+
+    /* Serials from before the keyframe interval was added are still accepted
+     */
+    QString serial = format.serialize();
+    copy.deserialize(serial.left(serial.lastIndexOf('_')));
+    QVERIFY(copy.getKeyframeInterval() == 0);
+    QVERIFY(copy.getBitrate() == 2000000);
+
+    /* Local recording settings carry a format and a directory that may contain the separator
+     */
+    LocalRecordingSettings local;
+    QVERIFY(!local.isEnabled());
+    local.format = format;
+    local.directory = "/media/rover;1/recordings";
+    local.cpuBudget = 150;
+    local.segmentBytes = 3LL * 1024 * 1024 * 1024;
+    LocalRecordingSettings localCopy;
+    localCopy.deserialize(local.serialize());
+    QVERIFY(localCopy.isEnabled());
+    QVERIFY(localCopy.format == format);
+    QVERIFY(localCopy.directory == local.directory);
+    QVERIFY(localCopy.cpuBudget == 150);
+    QVERIFY(localCopy.segmentBytes == local.segmentBytes);
+    localCopy.deserialize("");
+    QVERIFY(!localCopy.isEnabled());
+}
+
+void SoroTests::testBitrateController()
+{
+    VideoClient client(1, SocketAddress(QHostAddress::LocalHost, 47400), QHostAddress::LocalHost);
+    BitrateController controller(&client, nullptr);
+    int changes = 0;
+    quint32 lastBitrate = 0;
+    connect(&controller, &BitrateController::targetChanged, [&](BitrateController*, quint32 bitrate, quint32) {
+        changes++;
+        lastBitrate = bitrate;
+    });
+
+    controller.setFormat(VideoFormat(VideoFormat::Encoding_H264, VideoFormat::Resolution_1280x720, 2000000, 30));
+    QVERIFY(controller.isActive());
+    QVERIFY(controller.getTargetBitrate() == 2000000);
+    QVERIFY(controller.getTargetFramerate() == 0);
+
+    /* Loss backs off multiplicatively, then holds for two intervals
+     */
+    controller.update(2000000, 10, 5, -1);
+    QVERIFY(controller.getTargetBitrate() == 1700000);
+    QVERIFY(changes == 1);
+    QVERIFY(lastBitrate == 1700000);
+    controller.update(2000000, 10, 5, -1);
+    QVERIFY(controller.getTargetBitrate() == 1700000);
+    QVERIFY(changes == 1);
+
+    /* The next decrease starts from what is actually getting through, and lowers the framerate
+     */
+    controller.update(1000000, 10, 5, -1);
+    QVERIFY(controller.getTargetBitrate() == 850000);
+    QVERIFY(controller.getTargetFramerate() == 15);
+    QVERIFY(changes == 2);
+
+    /* Increase is additive, after three clean intervals
+     */
+    controller.update(850000, 0, 1, -1);
+    controller.update(850000, 0, 1, -1);
+    QVERIFY(controller.getTargetBitrate() == 850000);
+    controller.update(850000, 0, 1, -1);
+    QVERIFY(controller.getTargetBitrate() == 900000);
+    QVERIFY(changes == 3);
+
+    /* Sustained congestion stops at the minimum, a tenth of the format bitrate
+     */
+    for (int i = 0; i < 40; i++) {
+        controller.update(0, 20, 5, -1);
+    }
+    QVERIFY(controller.getTargetBitrate() == 200000);
+    QVERIFY(controller.getTargetFramerate() == 10);
+    QVERIFY(lastBitrate == 200000);
+
+    /* Nothing changes once stopped
+     */
+    controller.stop();
+    int stoppedChanges = changes;
+    for (int i = 0; i < 10; i++) {
+        controller.update(2000000, 0, 1, -1);
+    }
+    QVERIFY(controller.getTargetBitrate() == 200000);
+    QVERIFY(changes == stoppedChanges);
+}
+
+void SoroTests::testCaptureModeSelection()
+{
+    QList<CaptureMode> modes;
+    CaptureMode mode;
+    mode.pixelFormat = "YUYV";
+    mode.width = 1280; mode.height = 720;
+    mode.framerate = 10; modes << mode;
+    mode.framerate = 30; modes << mode;
+    mode.pixelFormat = "MJPG";
+    modes << mode;
+    mode.width = 640; mode.height = 360;
+    mode.framerate = 60; modes << mode;
+
+    /* A camera compressing in the right encoding is passed through, if allowed
+     */
+    VideoFormat mjpeg(VideoFormat::Encoding_MJPEG, VideoFormat::Resolution_1280x720, 2000000, 30);
+    QVERIFY(CaptureMode::select(modes, mjpeg, true).serialize() == "MJPG_1280_720_30");
+    QVERIFY(CaptureMode::select(modes, mjpeg, false).serialize() == "YUYV_1280_720_30");
+
+    /* Otherwise the lowest raw framerate that is enough, at the size streamed
+     */
+    VideoFormat h264(VideoFormat::Encoding_H264, VideoFormat::Resolution_1280x720, 2000000, 5);
+    QVERIFY(CaptureMode::select(modes, h264, true).serialize() == "YUYV_1280_720_10");
+    QVERIFY(!CaptureMode::select(modes, VideoFormat(VideoFormat::Encoding_H264, VideoFormat::Resolution_640x360, 800000), true).isValid());
+
+    CaptureMode copy;
+    copy.deserialize(modes[2].serialize());
+    QVERIFY(copy.isPassthroughFor(mjpeg));
+    QVERIFY(copy.createGstCaps() == "image/jpeg,width=1280,height=720,framerate=30/1");
+    copy.deserialize("garbage");
+    QVERIFY(!copy.isValid());
+}
+
+void SoroTests::testStreamStartTiming()
+{
+    StreamStartTiming timing;
+    QVERIFY(!timing.isStarted());
+    timing.mark(STREAMSTART_PHASE_PUNCH);
+    QVERIFY(!timing.hasPhase(STREAMSTART_PHASE_PUNCH));
+
+    /* Each phase is timed from the previous mark
+     */
+    timing.start();
+    QTest::qWait(50);
+    timing.mark(STREAMSTART_PHASE_PUNCH);
+    QTest::qWait(20);
+    timing.mark(STREAMSTART_PHASE_STREAMER);
+
+    QVERIFY(timing.getPhases() == QStringList() << STREAMSTART_PHASE_PUNCH << STREAMSTART_PHASE_STREAMER);
+    QVERIFY(timing.getPhaseTime(STREAMSTART_PHASE_PUNCH) >= 50);
+    QVERIFY(timing.getPhaseTime(STREAMSTART_PHASE_STREAMER) >= 20);
+    QVERIFY(timing.getTotalTime() == timing.getPhaseTime(STREAMSTART_PHASE_PUNCH) + timing.getPhaseTime(STREAMSTART_PHASE_STREAMER));
+    QVERIFY(timing.getPhaseTime(STREAMSTART_PHASE_CONTROL) == -1);
+
+    /* Starting again clears the last stream's phases
+     */
+    timing.start();
+    QVERIFY(timing.getPhases().isEmpty());
+    QVERIFY(timing.getTotalTime() == 0);
+}
+
+void SoroTests::testMediaControlMessage()
+{
+    /* Binary messages round trip with their fields
+     */
+    QByteArray message;
+    QDataStream out(&message, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::BigEndian);
+    MediaControlMessage::Stats stats;
+    stats.bitrate = 1500000;
+    stats.packetLoss = 3;
+    stats.jitter = 4200;
+    stats.reordered = 2;
+    stats.framerate = 30;
+    stats.keyframeInterval = 60;
+    MediaControlMessage::writeHeader(out, MediaControlMessage::Opcode_Stats);
+    MediaControlMessage::writeStats(out, stats);
+    QVERIFY(message.size() == MediaControlMessage::HeaderSize + 16);
+
+    QDataStream in(message);
+    in.setByteOrder(QDataStream::BigEndian);
+    bool legacy = true;
+    QVERIFY(MediaControlMessage::readHeader(in, &legacy) == MediaControlMessage::Opcode_Stats);
+    QVERIFY(!legacy);
+    MediaControlMessage::Stats readStats = MediaControlMessage::readStats(in);
+    QVERIFY(readStats.bitrate == 1500000);
+    QVERIFY(readStats.packetLoss == 3);
+    QVERIFY(readStats.jitter == 4200);
+    QVERIFY(readStats.framerate == 30);
+    QVERIFY(readStats.keyframeInterval == 60);
+
+    /* Version 1 stats leave the newer fields empty
+     */
+    QDataStream v1In(message.left(MediaControlMessage::HeaderSize + 10));
+    v1In.setByteOrder(QDataStream::BigEndian);
+    MediaControlMessage::readHeader(v1In);
+    readStats = MediaControlMessage::readStats(v1In);
+    QVERIFY(readStats.bitrate == 1500000);
+    QVERIFY(readStats.framerate == 0);
+
+    /* Messages from older peers are tagged with a QString
+     */
+    QByteArray legacyMessage;
+    QDataStream legacyOut(&legacyMessage, QIODevice::WriteOnly);
+    legacyOut << QString("Streaming") << QString("format");
+    QDataStream legacyIn(legacyMessage);
+    QVERIFY(MediaControlMessage::readHeader(legacyIn, &legacy) == MediaControlMessage::Opcode_Streaming);
+    QVERIFY(legacy);
+    QString payload;
+    legacyIn >> payload;
+    QVERIFY(payload == "format");
+
+    QByteArray unknown;
+    QDataStream unknownOut(&unknown, QIODevice::WriteOnly);
+    unknownOut << QString("hello");
+    QDataStream unknownIn(unknown);
+    QVERIFY(MediaControlMessage::readHeader(unknownIn) == MediaControlMessage::Opcode_Invalid);
+}
+
+void SoroTests::testPacketRing()
+{
+    PacketRing ring(4);
+    QSignalSpy spy(&ring, &PacketRing::packetsAvailable);
+    QByteArray packet;
+
+    /* Readers only see packets pushed after they were added
+     */
+    ring.push("a");
+    int reader1 = ring.addReader();
+    int reader2 = ring.addReader();
+    QVERIFY(!ring.read(reader1, packet));
+    QByteArray b("b");
+    ring.push(b);
+    ring.push("c");
+    ring.publish();
+    ring.publish();
+    QVERIFY(spy.count() == 1);
+
+    /* Each reader gets the same shared packets
+     */
+    QVERIFY(ring.read(reader1, packet));
+    QVERIFY(packet == "b");
+    QVERIFY(packet.constData() == b.constData());
+    QVERIFY(ring.read(reader1, packet));
+    QVERIFY(packet == "c");
+    QVERIFY(!ring.read(reader1, packet));
+    QVERIFY(ring.read(reader2, packet));
+    QVERIFY(packet == "b");
+
+    /* A reader that falls behind skips to the oldest packet held
+     */
+    for (int i = 0; i < 6; i++) {
+        ring.push(QByteArray::number(i));
+    }
+    QVERIFY(ring.read(reader2, packet));
+    QVERIFY(packet == "2");
+    QVERIFY(ring.getDropped(reader2) == 3);
+    QVERIFY(ring.getDropped(reader1) == 0);
+
+    ring.removeReader(reader1);
+    ring.removeReader(reader2);
+    QVERIFY(!ring.hasReaders());
+    QVERIFY(!ring.read(reader1, packet));
+}
+
+void SoroTests::testRecordingIndex()
+{
+    QTemporaryDir dir;
+    QString path = dir.path() + "/test.idx";
+    RecordingIndex index;
+    QVERIFY(index.open(path));
+
+    /* Keyframes are indexed at the end of the data written before them, and only
+     * every RECORDINGINDEX_MIN_INTERVAL except at the start of a segment
+     */
+    index.beginSegment();
+    index.addKeyframe(1000, 0);
+    index.addBytes(100);
+    index.addKeyframe(1100, 100);
+    index.addKeyframe(1000 + RECORDINGINDEX_MIN_INTERVAL, RECORDINGINDEX_MIN_INTERVAL);
+    index.seek(0);
+    index.addBytes(10);
+    index.beginSegment();
+    index.addKeyframe(1600, 600);
+    index.close();
+
+    QVector<RecordingIndexEntry> entries = RecordingIndex::load(path);
+    QVERIFY(entries.size() == 3);
+    QVERIFY(entries[0].segment == 0 && entries[0].offset == 0);
+    QVERIFY(entries[1].segment == 0 && entries[1].offset == 100 && entries[1].wallTime == 1000 + RECORDINGINDEX_MIN_INTERVAL);
+    QVERIFY(entries[2].segment == 1 && entries[2].offset == 0 && entries[2].streamTime == 600);
+
+    /* Finds the last keyframe at or before a time
+     */
+    QVERIFY(RecordingIndex::find(entries, 999) == -1);
+    QVERIFY(RecordingIndex::find(entries, 1000) == 0);
+    QVERIFY(RecordingIndex::find(entries, 1599) == 1);
+    QVERIFY(RecordingIndex::find(entries, 5000) == 2);
+}
+
 QTEST_GUILESS_MAIN(SoroTests)
 
 #include "tst_sorotests.moc"
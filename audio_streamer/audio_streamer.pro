@@ -32,12 +32,8 @@ PRECOMPILED_DIR = $$BUILD_DIR
 TEMPLATE = app
 
 SOURCES += \
-    audiostreamer.cpp \
     main.cpp
 
-HEADERS += \
-    audiostreamer.h
-
 INCLUDEPATH += $$PWD/..
 INCLUDEPATH += $$PWD/../..
 
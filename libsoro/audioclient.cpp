@@ -50,4 +50,8 @@ void AudioClient::onServerDisconnectedInternal() {
     _format.setEncoding(AudioFormat::Encoding_Null);
 }
 
+int AudioClient::getRtpClockRate() const {
+    return AUDIOFORMAT_RTP_CLOCK_RATE;
+}
+
 } // namespace Soro
@@ -29,6 +29,7 @@ protected:
     void onServerErrorMessageInternal() Q_DECL_OVERRIDE;
     void onServerConnectedInternal();
     void onServerDisconnectedInternal();
+    int getRtpClockRate() const Q_DECL_OVERRIDE;
 };
 
 } // namespace Soro
@@ -62,6 +62,15 @@ QString AudioFormat::createGstFileRecordingArgs(QString fileName) const {
     }
 }
 
+QString AudioFormat::createGstParserArgs() const {
+    switch (_encoding) {
+    case Encoding_AC3:
+        return "ac3parse";
+    default:
+        return "";
+    }
+}
+
 void AudioFormat::setEncoding(AudioFormat::Encoding encoding) {
     _encoding = encoding;
 }
@@ -109,8 +118,8 @@ QString AudioFormat::createGstEncodingArgs() const {
 QString AudioFormat::createGstDecodingArgs(DecodingType type) const {
     switch (_encoding) {
     case Encoding_AC3:
-        return QString("application/x-rtp,media=audio,clock-rate=44100,encoding-name=AC3 ! "
-                        " ! rtpac3depay")
+        return QString("application/x-rtp,media=audio,clock-rate=%1,encoding-name=AC3 ! "
+                        " ! rtpac3depay").arg(QString::number(AUDIOFORMAT_RTP_CLOCK_RATE))
                 + ((type != DecodingType_RtpDecodeOnly) ?
                         " ! a52dec" : "");
     default:
@@ -4,6 +4,9 @@
 #include <QtCore>
 #include "mediaformat.h"
 
+// RTP timestamp clock rate of audio streams, the sample rate AC3 is payloaded at
+#define AUDIOFORMAT_RTP_CLOCK_RATE 44100
+
 namespace Soro {
 
 class AudioFormat: public MediaFormat {
@@ -26,6 +29,7 @@ public:
     QString createGstDecodingArgs(DecodingType type=DecodingType_Full) const Q_DECL_OVERRIDE;
     QString getEncodingName() const Q_DECL_OVERRIDE;
     QString createGstFileRecordingArgs(QString fileName) const Q_DECL_OVERRIDE;
+    QString createGstParserArgs() const Q_DECL_OVERRIDE;
     QString getFileExtension() const Q_DECL_OVERRIDE;
 
     AudioFormat::Encoding getEncoding() const;
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bandwidthestimator.h"
+#include "logger.h"
+
+#define LOG_TAG "BandwidthEstimator"
+
+// Probe trains are sent every PROBE_INTERVAL ms, each with PROBE_COUNT packets of PROBE_SIZE bytes
+#define PROBE_INTERVAL 5000
+#define PROBE_COUNT 16
+#define PROBE_SIZE 500
+// Number of probe results and observed rate samples (one per second) kept
+#define PROBE_HISTORY 5
+#define OBSERVED_HISTORY 10
+
+namespace Soro {
+
+BandwidthEstimator::BandwidthEstimator(Channel *probeChannel, QObject *parent) : QObject(parent) {
+    _probeChannel = probeChannel;
+    connect(_probeChannel, &Channel::probeTrainReceived, this, &BandwidthEstimator::probeTrainReceived);
+    START_TIMER(_probeTimerId, PROBE_INTERVAL);
+    START_TIMER(_observeTimerId, 1000);
+}
+
+void BandwidthEstimator::addPassiveSource(MediaClient *client) {
+    _mediaSources.append(QPointer<MediaClient>(client));
+}
+
+void BandwidthEstimator::addPassiveSource(Channel *channel) {
+    _channelSources.append(QPointer<Channel>(channel));
+}
+
+void BandwidthEstimator::timerEvent(QTimerEvent *e) {
+    if (e->timerId() == _probeTimerId) {
+        if (_probeChannel->getState() == Channel::ConnectedState) {
+            _probeChannel->requestProbeTrain(PROBE_COUNT, PROBE_SIZE);
+        }
+    }
+    else if (e->timerId() == _observeTimerId) {
+        qint64 rate = 0;
+        foreach (QPointer<MediaClient> client, _mediaSources) {
+            if (client) rate += client->getBitrate();
+        }
+        foreach (QPointer<Channel> channel, _channelSources) {
+            if (channel) rate += channel->getBitsPerSecondDown();
+        }
+        _observedSamples.append(rate);
+        while (_observedSamples.size() > OBSERVED_HISTORY) _observedSamples.removeFirst();
+        updateEstimate();
+    }
+    else {
+        QObject::timerEvent(e);
+    }
+}
+
+void BandwidthEstimator::probeTrainReceived(qint64 bitsPerSecond, int lossPercent) {
+    LOG_D(LOG_TAG, "Probe train measured " + QString::number(bitsPerSecond) + "bps with "
+          + QString::number(lossPercent) + "% loss");
+    _probeSamples.append(bitsPerSecond);
+    while (_probeSamples.size() > PROBE_HISTORY) _probeSamples.removeFirst();
+    _probeLoss = lossPercent;
+    updateEstimate();
+}
+
+qint64 BandwidthEstimator::getProbeCapacity() const {
+    if (_probeSamples.isEmpty()) return -1;
+    // Median of recent trains, a single train is easily skewed by cross traffic
+    QList<qint64> sorted = _probeSamples;
+    std::sort(sorted.begin(), sorted.end());
+    qint64 median = sorted.at(sorted.size() / 2);
+    // A lossy train means the link is already saturated at the probed rate
+    return median * (100 - _probeLoss) / 100;
+}
+
+qint64 BandwidthEstimator::getObservedRate() const {
+    qint64 peak = -1;
+    foreach (qint64 sample, _observedSamples) {
+        if (sample > peak) peak = sample;
+    }
+    return peak;
+}
+
+qint64 BandwidthEstimator::getCapacity() const {
+    return _capacity;
+}
+
+void BandwidthEstimator::updateEstimate() {
+    qint64 probe = getProbeCapacity();
+    qint64 observed = getObservedRate();
+    // Whatever is actually arriving is a lower bound on what the link can carry
+    qint64 capacity = qMax(probe, observed > 0 ? observed : (qint64)-1);
+    if (capacity != _capacity) {
+        _capacity = capacity;
+        emit estimateUpdated(_capacity);
+    }
+}
+
+VideoFormat BandwidthEstimator::selectVideoFormat(qint64 capacity, double headroom, const QList<VideoFormat> &candidates, int streams) {
+    if (candidates.isEmpty()) return VideoFormat();
+    qint64 budget = capacity > 0 ? (qint64)(capacity * (1.0 - headroom)) / qMax(1, streams) : 0;
+    int best = -1;
+    int lowest = 0;
+    for (int i = 0; i < candidates.size(); i++) {
+        quint32 bitrate = candidates.at(i).getBitrate();
+        if ((bitrate <= budget) && ((best < 0) || (bitrate > candidates.at(best).getBitrate()))) {
+            best = i;
+        }
+        if (bitrate < candidates.at(lowest).getBitrate()) {
+            lowest = i;
+        }
+    }
+    return candidates.at(best >= 0 ? best : lowest);
+}
+
+} // namespace Soro
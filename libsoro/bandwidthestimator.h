@@ -0,0 +1,68 @@
+#ifndef SORO_BANDWIDTHESTIMATOR_H
+#define SORO_BANDWIDTHESTIMATOR_H
+
+#include <QtCore>
+
+#include "soro_global.h"
+#include "constants.h"
+#include "channel.h"
+#include "mediaclient.h"
+#include "videoformat.h"
+
+namespace Soro {
+
+/* Estimates the capacity of the link from the rover using two sources:
+ *
+ * - Active: probe trains requested over a UDP channel. The other side sends a burst of
+ *   back to back packets, and their dispersion on arrival gives the bottleneck capacity.
+ * - Passive: the rate actually being received on media clients and channels, which is a
+ *   lower bound on capacity.
+ */
+class LIBSORO_EXPORT BandwidthEstimator : public QObject {
+    Q_OBJECT
+public:
+    explicit BandwidthEstimator(Channel *probeChannel, QObject *parent = nullptr);
+
+    void addPassiveSource(MediaClient *client);
+    void addPassiveSource(Channel *channel);
+
+    /* Gets the estimated link capacity in bits per second, or -1 if
+     * nothing has been measured yet
+     */
+    qint64 getCapacity() const;
+
+    qint64 getProbeCapacity() const;
+    qint64 getObservedRate() const;
+
+    /* Chooses the format with the highest bitrate that fits in the capacity, leaving
+     * the specified fraction (0-1) of headroom, split evenly between a number of streams.
+     * If none fit, the format with the lowest bitrate is returned.
+     */
+    static VideoFormat selectVideoFormat(qint64 capacity, double headroom, const QList<VideoFormat> &candidates, int streams = 1);
+
+signals:
+    void estimateUpdated(qint64 bitsPerSecond);
+
+protected:
+    void timerEvent(QTimerEvent *e);
+
+private:
+    Channel *_probeChannel;
+    QList<QPointer<MediaClient>> _mediaSources;
+    QList<QPointer<Channel>> _channelSources;
+    QList<qint64> _probeSamples;
+    QList<qint64> _observedSamples;
+    int _probeLoss = 0;
+    qint64 _capacity = -1;
+    int _probeTimerId = TIMER_INACTIVE;
+    int _observeTimerId = TIMER_INACTIVE;
+
+    void updateEstimate();
+
+private slots:
+    void probeTrainReceived(qint64 bitsPerSecond, int lossPercent);
+};
+
+} // namespace Soro
+
+#endif // SORO_BANDWIDTHESTIMATOR_H
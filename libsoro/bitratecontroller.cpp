@@ -0,0 +1,170 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bitratecontroller.h"
+#include "logger.h"
+
+#define LOG_TAG "BitrateController"
+
+// Number of RTT samples (one per second) the baseline is taken from
+#define RTT_HISTORY 30
+// RTT is considered inflated when above baseline * factor + margin (ms)
+#define RTT_INFLATION_FACTOR 1.5
+#define RTT_INFLATION_MARGIN 20
+// Jitter (ms) above which the link is considered congested
+#define JITTER_CONGESTED 30
+// Loss percentages at or above which the link is congested, and below which it is clean
+#define LOSS_CONGESTED 5
+#define LOSS_CLEAN 2
+// Decrease is multiplicative, and is followed by a hold of some intervals so its effect can be seen
+#define DECREASE_FACTOR 0.85
+#define DECREASE_HOLD 2
+// Increase is additive after some clean intervals
+#define INCREASE_AFTER 3
+#define INCREASE_STEP 50000
+// Smallest change in bitrate (percent) worth sending to the rover
+#define MIN_CHANGE_PERCENT 5
+
+namespace Soro {
+
+BitrateController::BitrateController(MediaClient *client, Channel *rttChannel, QObject *parent) : QObject(parent) {
+    _client = client;
+    _rttChannel = rttChannel;
+}
+
+void BitrateController::setFormat(const VideoFormat &format) {
+    _format = format;
+    if (format.getGstEncoderBitrateProperty().isEmpty() || (format.getEncoderBitrate() == 0)) {
+        LOG_I(LOG_TAG, "Format " + format.toHumanReadableString() + " has no bitrate control, not adapting it");
+        stop();
+        return;
+    }
+    _maxBitrate = format.getEncoderBitrate();
+    _minBitrate = qMax<quint32>(_maxBitrate / 10, 100000);
+    _minBitrate = qMin(_minBitrate, _maxBitrate);
+    _target = _maxBitrate;
+    _maxFramerate = format.getFramerate() > 0 ? format.getFramerate() : 30;
+    _framerate = 0;
+    _lastSentTarget = _target;
+    _lastSentFramerate = 0;
+    _rttSamples.clear();
+    _smoothedRtt = -1;
+    _cleanIntervals = 0;
+    _holdIntervals = 0;
+    _active = true;
+    KILL_TIMER(_updateTimerId);
+    START_TIMER(_updateTimerId, 1000);
+    LOG_I(LOG_TAG, "Adapting stream " + QString::number(_client->getMediaId()) + " between "
+          + QString::number(_minBitrate) + " and " + QString::number(_maxBitrate) + "bps");
+}
+
+void BitrateController::stop() {
+    _active = false;
+    KILL_TIMER(_updateTimerId);
+}
+
+bool BitrateController::isActive() const {
+    return _active;
+}
+
+MediaClient* BitrateController::getClient() const {
+    return _client;
+}
+
+quint32 BitrateController::getTargetBitrate() const {
+    if (_format.getEncoderBitrate() == 0) return _target;
+    // Scale back up to the total for the format (both halves of a stereo stream)
+    return (quint32)((quint64)_target * _format.getBitrate() / _format.getEncoderBitrate());
+}
+
+quint32 BitrateController::getTargetFramerate() const {
+    return _framerate;
+}
+
+void BitrateController::timerEvent(QTimerEvent *e) {
+    if (e->timerId() == _updateTimerId) {
+        if (_client->getState() == MediaClient::StreamingState) {
+            update(_client->getBitrate(), _client->getPacketLoss(), _client->getJitter(),
+                   _rttChannel->getState() == Channel::ConnectedState ? _rttChannel->getLastRtt() : -1);
+        }
+    }
+    else {
+        QObject::timerEvent(e);
+    }
+}
+
+void BitrateController::update(qint64 receivedBps, int lossPercent, double jitterMs, int rttMs) {
+    if (!_active) return;
+
+    bool queueing = false;
+    if (rttMs >= 0) {
+        _rttSamples.append(rttMs);
+        while (_rttSamples.size() > RTT_HISTORY) _rttSamples.removeFirst();
+        _smoothedRtt = _smoothedRtt < 0 ? rttMs : _smoothedRtt + (rttMs - _smoothedRtt) / 8.0;
+        int baseline = *std::min_element(_rttSamples.begin(), _rttSamples.end());
+        queueing = _smoothedRtt > baseline * RTT_INFLATION_FACTOR + RTT_INFLATION_MARGIN;
+    }
+
+    qint64 target = _target;
+    if (_holdIntervals > 0) _holdIntervals--;
+
+    if ((lossPercent >= LOSS_CONGESTED) || (jitterMs > JITTER_CONGESTED) || queueing) {
+        _cleanIntervals = 0;
+        if (_holdIntervals == 0) {
+            // Back off below what is actually getting through
+            qint64 base = receivedBps > 0 ? qMin<qint64>(_target, receivedBps) : _target;
+            target = (qint64)(base * DECREASE_FACTOR);
+            _holdIntervals = DECREASE_HOLD;
+            LOG_D(LOG_TAG, "Congestion on stream " + QString::number(_client->getMediaId()) + " (loss "
+                  + QString::number(lossPercent) + "%, jitter " + QString::number(jitterMs) + "ms, rtt "
+                  + QString::number(rttMs) + "ms)");
+        }
+    }
+    else if (lossPercent < LOSS_CLEAN) {
+        if (++_cleanIntervals >= INCREASE_AFTER) {
+            target += qMax<qint64>(_target / 20, INCREASE_STEP);
+        }
+    }
+
+    _target = (quint32)qBound<qint64>(_minBitrate, target, _maxBitrate);
+
+    // Fewer frames at low bitrates so each one still looks reasonable
+    if (_target < _maxBitrate / 4) {
+        _framerate = qMax<quint32>(_maxFramerate / 3, 5);
+    }
+    else if (_target < _maxBitrate / 2) {
+        _framerate = qMax<quint32>(_maxFramerate / 2, 5);
+    }
+    else {
+        _framerate = 0;
+    }
+
+    publishTarget();
+}
+
+void BitrateController::publishTarget() {
+    quint32 change = _target > _lastSentTarget ? _target - _lastSentTarget : _lastSentTarget - _target;
+    bool significant = ((quint64)change * 100 >= (quint64)_lastSentTarget * MIN_CHANGE_PERCENT)
+            || ((_target == _maxBitrate) && (_lastSentTarget != _maxBitrate))
+            || ((_target == _minBitrate) && (_lastSentTarget != _minBitrate));
+    if (significant || (_framerate != _lastSentFramerate)) {
+        _lastSentTarget = _target;
+        _lastSentFramerate = _framerate;
+        emit targetChanged(this, getTargetBitrate(), _framerate);
+    }
+}
+
+} // namespace Soro
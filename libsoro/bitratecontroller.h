@@ -0,0 +1,85 @@
+#ifndef SORO_BITRATECONTROLLER_H
+#define SORO_BITRATECONTROLLER_H
+
+#include <QtCore>
+
+#include "soro_global.h"
+#include "constants.h"
+#include "channel.h"
+#include "mediaclient.h"
+#include "videoformat.h"
+
+namespace Soro {
+
+/* Closed loop bitrate controller for a single running video stream.
+ *
+ * Once a second it looks at what the MediaClient is receiving (rate, RTP loss and jitter)
+ * and at the RTT trend of a channel on the same link. Loss, rising jitter, or RTT climbing
+ * above its baseline (queues building) cause a multiplicative decrease below the received rate,
+ * and a clean link causes a slow additive increase back towards the format's bitrate.
+ * At low bitrates the framerate is lowered as well so each frame keeps enough bits.
+ *
+ * The controller only computes targets, they must be sent to the rover's VideoServer
+ * by connecting to targetChanged().
+ */
+class LIBSORO_EXPORT BitrateController : public QObject {
+    Q_OBJECT
+public:
+    explicit BitrateController(MediaClient *client, Channel *rttChannel, QObject *parent = nullptr);
+
+    /* Starts controlling a stream that was started with this format. Its bitrate and
+     * framerate are the ceiling the controller will never go above.
+     */
+    void setFormat(const VideoFormat &format);
+
+    /* Stops controlling the stream, for instance when it ends
+     */
+    void stop();
+
+    bool isActive() const;
+    MediaClient* getClient() const;
+
+    /* Gets the current target as a total bitrate for the format (see VideoFormat::setBitrate())
+     * and a maximum framerate, 0 if not limited
+     */
+    quint32 getTargetBitrate() const;
+    quint32 getTargetFramerate() const;
+
+    /* Feeds one interval of measurements to the controller. This is called internally once a second,
+     * it is public so the control law can be driven directly.
+     */
+    void update(qint64 receivedBps, int lossPercent, double jitterMs, int rttMs);
+
+signals:
+    void targetChanged(BitrateController *controller, quint32 bitrate, quint32 framerate);
+
+protected:
+    void timerEvent(QTimerEvent *e);
+
+private:
+    MediaClient *_client;
+    Channel *_rttChannel;
+    VideoFormat _format;
+    bool _active = false;
+    int _updateTimerId = TIMER_INACTIVE;
+
+    // All bitrates here are per encoder, which is what is seen on the wire
+    quint32 _maxBitrate = 0;
+    quint32 _minBitrate = 0;
+    quint32 _target = 0;
+    quint32 _maxFramerate = 0;
+    quint32 _framerate = 0;
+    quint32 _lastSentTarget = 0;
+    quint32 _lastSentFramerate = 0;
+
+    QList<int> _rttSamples;
+    double _smoothedRtt = -1;
+    int _cleanIntervals = 0;
+    int _holdIntervals = 0;
+
+    void publishTarget();
+};
+
+} // namespace Soro
+
+#endif // SORO_BITRATECONTROLLER_H
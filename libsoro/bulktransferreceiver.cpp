@@ -0,0 +1,214 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bulktransferreceiver.h"
+#include "logger.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QStorageInfo>
+#include <QCryptographicHash>
+
+#define LOG_TAG "BulkTransferReceiver"
+
+namespace Soro {
+
+BulkTransferReceiver::BulkTransferReceiver(Channel *channel, QString directory, QObject *parent) : QObject(parent) {
+    _channel = channel;
+    _directory = directory;
+}
+
+BulkTransferReceiver::~BulkTransferReceiver() {
+    abort();
+}
+
+QString BulkTransferReceiver::getDirectory() const {
+    return _directory;
+}
+
+void BulkTransferReceiver::handleMessage(SharedMessageType type, QDataStream &stream) {
+    qint32 id;
+    stream >> id;
+    switch (type) {
+    case SharedMessage_BulkTransferOffer: {
+        QString category;
+        QString name;
+        qint64 size;
+        stream >> category;
+        stream >> name;
+        stream >> size;
+        offerReceived(id, category, name, size);
+        break;
+    }
+    case SharedMessage_BulkTransferChunk: {
+        qint64 offset;
+        QByteArray data;
+        quint16 checksum;
+        stream >> offset;
+        stream >> data;
+        stream >> checksum;
+        chunkReceived(id, offset, data, checksum);
+        break;
+    }
+    case SharedMessage_BulkTransferEnd: {
+        QByteArray hash;
+        stream >> hash;
+        endReceived(id, hash);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void BulkTransferReceiver::offerReceived(qint32 id, QString category, QString name, qint64 size) {
+    abort();
+
+    // Only ever write inside our own directory, whatever the sender asks for
+    category = QFileInfo(category).fileName();
+    name = QFileInfo(name).fileName();
+    if (category.isEmpty() || name.isEmpty() || (size < 0)) {
+        LOG_W(LOG_TAG, "Got offer for an invalid file, refusing it");
+        sendResult(id, false);
+        return;
+    }
+    QString directory = _directory + "/" + category;
+    if (!QDir().mkpath(directory)) {
+        LOG_E(LOG_TAG, "Cannot create " + directory + ", refusing " + name);
+        sendResult(id, false);
+        return;
+    }
+
+    QString path = directory + "/" + name;
+    QString partPath = path + ".part";
+    QFileInfo existing(path);
+    if (existing.exists()) {
+        if (existing.size() >= size) {
+            // Already have it
+            sendAck(id, -1, false);
+            return;
+        }
+        // The file has grown since it was last sent, continue after what we have
+        QFile::remove(partPath);
+        QFile::rename(path, partPath);
+    }
+    if (QFileInfo(partPath).size() > size) {
+        // Left from a different file of the same name
+        QFile::remove(partPath);
+    }
+    if (QStorageInfo(directory).bytesAvailable() - (size - QFileInfo(partPath).size()) < BULKTRANSFERRECEIVER_RESERVE) {
+        LOG_W(LOG_TAG, "Not enough space to receive " + name + ", refusing it");
+        sendResult(id, false);
+        return;
+    }
+
+    _file.setFileName(partPath);
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        LOG_E(LOG_TAG, "Cannot open " + partPath + ": " + _file.errorString());
+        sendResult(id, false);
+        return;
+    }
+    _id = id;
+    _path = path;
+    _size = size;
+    _written = _file.size();
+    _lastAck = _written;
+    _rewindSent = false;
+    LOG_I(LOG_TAG, "Receiving " + path + " (" + QString::number(size) + " bytes"
+          + (_written > 0 ? ", resuming at " + QString::number(_written) : QString("")) + ")");
+    sendAck(id, _written, false);
+}
+
+void BulkTransferReceiver::chunkReceived(qint32 id, qint64 offset, const QByteArray &data, quint16 checksum) {
+    if ((id != _id) || !_file.isOpen()) return;
+    if ((offset != _written) || (qChecksum(data.constData(), data.size()) != checksum)
+            || (_written + data.size() > _size)) {
+        // Ask the sender to go back once, then wait for the chunk we need
+        if (!_rewindSent) {
+            sendAck(id, _written, true);
+            _rewindSent = true;
+        }
+        return;
+    }
+    if (_file.write(data) != data.size()) {
+        LOG_E(LOG_TAG, "Cannot write " + _file.fileName() + ": " + _file.errorString());
+        abort();
+        sendResult(id, false);
+        return;
+    }
+    _written += data.size();
+    _rewindSent = false;
+    if (_written - _lastAck >= BULKTRANSFER_ACK_INTERVAL) {
+        sendAck(id, _written, false);
+        _lastAck = _written;
+    }
+}
+
+void BulkTransferReceiver::endReceived(qint32 id, const QByteArray &expectedHash) {
+    if ((id != _id) || !_file.isOpen()) return;
+    _file.close();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    QFile file(_file.fileName());
+    bool ok = (_written == _size) && file.open(QIODevice::ReadOnly) && hash.addData(&file)
+            && (hash.result() == expectedHash);
+    file.close();
+
+    if (ok) {
+        QFile::remove(_path);
+        ok = QFile::rename(_file.fileName(), _path);
+    }
+    if (ok) {
+        LOG_I(LOG_TAG, "Received " + _path);
+        emit fileReceived(_path);
+    }
+    else {
+        // Start over from nothing next time, whatever is here can't be trusted
+        LOG_W(LOG_TAG, "Verifying " + _path + " failed, discarding it");
+        QFile::remove(_file.fileName());
+    }
+    _id = 0;
+    sendResult(id, ok);
+}
+
+void BulkTransferReceiver::sendAck(qint32 id, qint64 offset, bool rewind) {
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    stream << static_cast<qint32>(SharedMessage_BulkTransferAck);
+    stream << id;
+    stream << offset;
+    stream << rewind;
+    _channel->sendMessage(message);
+}
+
+void BulkTransferReceiver::sendResult(qint32 id, bool ok) {
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    stream << static_cast<qint32>(SharedMessage_BulkTransferResult);
+    stream << id;
+    stream << ok;
+    _channel->sendMessage(message);
+}
+
+void BulkTransferReceiver::abort() {
+    // Whatever was written is kept as a .part file, so the transfer can resume
+    if (_file.isOpen()) {
+        _file.close();
+    }
+    _id = 0;
+}
+
+} // namespace Soro
@@ -0,0 +1,63 @@
+#ifndef SORO_BULKTRANSFERRECEIVER_H
+#define SORO_BULKTRANSFERRECEIVER_H
+
+#include <QObject>
+#include <QFile>
+#include <QDataStream>
+
+#include "soro_global.h"
+#include "enums.h"
+#include "channel.h"
+#include "bulktransfersender.h"
+
+// Free space kept when accepting a file
+#define BULKTRANSFERRECEIVER_RESERVE (512LL * 1024 * 1024)
+
+namespace Soro {
+
+/* Receives files sent by a BulkTransferSender on the other side of a shared channel.
+ *
+ * Each file is written to <directory>/<category>/<name>.part and renamed once its hash has
+ * been checked. Whatever part of a file is already here, finished or not, is kept and the
+ * sender is told to continue after it, so interrupted transfers and files that grow
+ * (such as logs) only send what is new.
+ */
+class LIBSORO_EXPORT BulkTransferReceiver : public QObject {
+    Q_OBJECT
+public:
+    explicit BulkTransferReceiver(Channel *channel, QString directory, QObject *parent = 0);
+    ~BulkTransferReceiver();
+
+    /* Handles a bulk transfer message from the sender. The message type has already
+     * been read from the stream.
+     */
+    void handleMessage(SharedMessageType type, QDataStream &stream);
+
+    QString getDirectory() const;
+
+signals:
+    void fileReceived(QString path);
+
+private:
+    Channel *_channel;
+    QString _directory;
+
+    qint32 _id = 0;
+    QString _path;
+    QFile _file;
+    qint64 _size = 0;
+    qint64 _written = 0;
+    qint64 _lastAck = 0;
+    bool _rewindSent = false;
+
+    void offerReceived(qint32 id, QString category, QString name, qint64 size);
+    void chunkReceived(qint32 id, qint64 offset, const QByteArray &data, quint16 checksum);
+    void endReceived(qint32 id, const QByteArray &hash);
+    void sendAck(qint32 id, qint64 offset, bool rewind);
+    void sendResult(qint32 id, bool ok);
+    void abort();
+};
+
+} // namespace Soro
+
+#endif // SORO_BULKTRANSFERRECEIVER_H
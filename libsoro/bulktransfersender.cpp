@@ -0,0 +1,298 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bulktransfersender.h"
+#include "logger.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QCryptographicHash>
+
+#define LOG_TAG "BulkTransferSender"
+
+namespace Soro {
+
+BulkTransferSender::BulkTransferSender(Channel *channel, QObject *parent) : QObject(parent) {
+    _channel = channel;
+    connect(_channel, &Channel::stateChanged, this, &BulkTransferSender::channelStateChanged);
+    START_TIMER(_pumpTimerId, BULKTRANSFER_PUMP_INTERVAL);
+}
+
+void BulkTransferSender::addDirectory(QString path, QString category) {
+    _directories.append(qMakePair(path, category));
+    // Look at the new directory on the next pump
+    _scanTimer.invalidate();
+}
+
+void BulkTransferSender::setPaused(bool paused) {
+    if (paused == _paused) return;
+    _paused = paused;
+    LOG_I(LOG_TAG, paused ? "Transfers paused" : "Transfers resumed");
+    if (!paused) {
+        // Anything recorded while paused is ready to go now
+        _scanTimer.invalidate();
+        _tokenTimer.restart();
+        _responseTimer.restart();
+    }
+}
+
+bool BulkTransferSender::isPaused() const {
+    return _paused;
+}
+
+void BulkTransferSender::setRate(int bytesPerSecond) {
+    _rate = qMax(bytesPerSecond, BULKTRANSFER_CHUNK_SIZE);
+}
+
+int BulkTransferSender::getPendingCount() const {
+    return _pending.size() + (_state != IdleTransferState ? 1 : 0);
+}
+
+void BulkTransferSender::scan() {
+    _scanTimer.restart();
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (const QPair<QString, QString> &directory : _directories) {
+        QFileInfoList files = QDir(directory.first).entryInfoList(QDir::Files | QDir::Readable, QDir::Time | QDir::Reversed);
+        foreach (QFileInfo info, files) {
+            QString path = info.absoluteFilePath();
+            if ((info.size() == 0) || _failed.contains(path)) continue;
+            if (_sent.value(path, -1) == info.size()) continue;
+            if ((_state != IdleTransferState) && (_current.path == path)) continue;
+            if (now - info.lastModified().toMSecsSinceEpoch() < BULKTRANSFER_SETTLE_TIME) continue;
+            bool queued = false;
+            for (int i = 0; i < _pending.size(); i++) {
+                if (_pending[i].path == path) {
+                    _pending[i].size = info.size();
+                    queued = true;
+                    break;
+                }
+            }
+            if (!queued) {
+                PendingFile file;
+                file.path = path;
+                file.category = directory.second;
+                file.size = info.size();
+                _pending.append(file);
+            }
+        }
+    }
+}
+
+void BulkTransferSender::offerNext() {
+    while (!_pending.isEmpty()) {
+        _current = _pending.takeFirst();
+        _file.setFileName(_current.path);
+        if (_file.open(QIODevice::ReadOnly)) break;
+        LOG_W(LOG_TAG, "Cannot open " + _current.path + ", skipping it");
+        _failed.insert(_current.path);
+    }
+    if (!_file.isOpen()) return;
+
+    _id = _nextId++;
+    _state = OfferedTransferState;
+    _sentOffset = 0;
+    _ackedOffset = 0;
+    _responseTimer.restart();
+
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    stream << static_cast<qint32>(SharedMessage_BulkTransferOffer);
+    stream << _id;
+    stream << _current.category;
+    stream << QFileInfo(_current.path).fileName();
+    stream << _current.size;
+    _channel->sendMessage(message);
+}
+
+void BulkTransferSender::sendChunks() {
+    // Refill the token bucket, holding at most one window's worth so a pause
+    // doesn't turn into a burst
+    _tokens = qMin<double>(_tokens + (double)_rate * _tokenTimer.restart() / 1000.0, BULKTRANSFER_WINDOW);
+
+    char buffer[BULKTRANSFER_CHUNK_SIZE];
+    while ((_sentOffset < _current.size)
+           && (_sentOffset - _ackedOffset + BULKTRANSFER_CHUNK_SIZE <= BULKTRANSFER_WINDOW)
+           && (_tokens >= BULKTRANSFER_CHUNK_SIZE)) {
+        int length = (int)qMin<qint64>(BULKTRANSFER_CHUNK_SIZE, _current.size - _sentOffset);
+        if (!_file.seek(_sentOffset) || (_file.read(buffer, length) != length)) {
+            LOG_E(LOG_TAG, "Cannot read " + _current.path + ": " + _file.errorString());
+            finishTransfer(false);
+            return;
+        }
+
+        QByteArray message;
+        QDataStream stream(&message, QIODevice::WriteOnly);
+        stream << static_cast<qint32>(SharedMessage_BulkTransferChunk);
+        stream << _id;
+        stream << _sentOffset;
+        stream << QByteArray::fromRawData(buffer, length);
+        stream << qChecksum(buffer, length);
+        if (!_channel->sendMessage(message)) return;
+
+        _sentOffset += length;
+        _tokens -= length;
+    }
+    if (_sentOffset >= _current.size) {
+        sendEnd();
+    }
+}
+
+void BulkTransferSender::sendEnd() {
+    // Hash exactly what was offered, even if the file has grown since
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    qint64 remaining = _current.size;
+    _file.seek(0);
+    while (remaining > 0) {
+        QByteArray data = _file.read(qMin<qint64>(remaining, 64 * 1024));
+        if (data.isEmpty()) {
+            LOG_E(LOG_TAG, "Cannot read " + _current.path + " to verify it: " + _file.errorString());
+            finishTransfer(false);
+            return;
+        }
+        hash.addData(data);
+        remaining -= data.size();
+    }
+
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    stream << static_cast<qint32>(SharedMessage_BulkTransferEnd);
+    stream << _id;
+    stream << hash.result();
+    _channel->sendMessage(message);
+
+    _state = FinishedTransferState;
+    _responseTimer.restart();
+}
+
+void BulkTransferSender::finishTransfer(bool ok) {
+    if (ok) {
+        LOG_I(LOG_TAG, "Transferred " + _current.path + " (" + QString::number(_current.size) + " bytes)");
+        _sent.insert(_current.path, _current.size);
+        emit fileTransferred(_current.path);
+    }
+    else {
+        // Not tried again until the next connection
+        _failed.insert(_current.path);
+    }
+    _file.close();
+    _state = IdleTransferState;
+    _id = 0;
+}
+
+void BulkTransferSender::handleMessage(SharedMessageType type, QDataStream &stream) {
+    qint32 id;
+    stream >> id;
+    if ((id != _id) || (_state == IdleTransferState)) {
+        // Left over from a transfer that was restarted
+        return;
+    }
+    _responseTimer.restart();
+
+    switch (type) {
+    case SharedMessage_BulkTransferAck: {
+        qint64 offset;
+        bool rewind;
+        stream >> offset;
+        stream >> rewind;
+        if (_state == OfferedTransferState) {
+            if ((offset < 0) || (offset > _current.size)) {
+                // The receiver already has the whole file
+                LOG_I(LOG_TAG, "Receiver already has " + _current.path);
+                finishTransfer(true);
+                break;
+            }
+            if (offset > 0) {
+                LOG_I(LOG_TAG, "Resuming " + _current.path + " at " + QString::number(offset) + " bytes");
+            }
+            _sentOffset = offset;
+            _ackedOffset = offset;
+            _state = SendingTransferState;
+            _tokenTimer.restart();
+        }
+        else if (rewind && (offset <= _sentOffset)) {
+            // A chunk was lost or damaged, go back to where the receiver is
+            LOG_W(LOG_TAG, "Resending " + _current.path + " from " + QString::number(offset) + " bytes");
+            _sentOffset = offset;
+            _ackedOffset = offset;
+            _state = SendingTransferState;
+        }
+        else {
+            _ackedOffset = qMax(_ackedOffset, qMin(offset, _sentOffset));
+        }
+        break;
+    }
+    case SharedMessage_BulkTransferResult: {
+        bool ok;
+        stream >> ok;
+        if (!ok) {
+            LOG_W(LOG_TAG, "Receiver did not accept " + _current.path);
+        }
+        finishTransfer(ok);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void BulkTransferSender::channelStateChanged(Channel::State state) {
+    if (state == Channel::ConnectedState) {
+        // Anything that failed may work with a new connection, and the receiver will
+        // say what it already has
+        _failed.clear();
+        _scanTimer.invalidate();
+    }
+    else if (_state != IdleTransferState) {
+        // In flight messages are lost, the file is offered again on the next connection
+        _pending.prepend(_current);
+        _file.close();
+        _state = IdleTransferState;
+        _id = 0;
+    }
+}
+
+void BulkTransferSender::timerEvent(QTimerEvent *e) {
+    if (e->timerId() == _pumpTimerId) {
+        if (_paused || (_channel->getState() != Channel::ConnectedState)) return;
+
+        switch (_state) {
+        case IdleTransferState:
+            if (!_scanTimer.isValid() || _scanTimer.hasExpired(BULKTRANSFER_SCAN_INTERVAL)) {
+                scan();
+            }
+            offerNext();
+            break;
+        case SendingTransferState:
+            sendChunks();
+            // fall through to check for a stalled receiver
+        default:
+            if (_responseTimer.hasExpired(BULKTRANSFER_RESPONSE_TIMEOUT)) {
+                LOG_W(LOG_TAG, "Receiver stopped responding, offering " + _current.path + " again");
+                _pending.prepend(_current);
+                _file.close();
+                _state = IdleTransferState;
+                _id = 0;
+            }
+            break;
+        }
+    }
+    else {
+        QObject::timerEvent(e);
+    }
+}
+
+} // namespace Soro
@@ -0,0 +1,135 @@
+#ifndef SORO_BULKTRANSFERSENDER_H
+#define SORO_BULKTRANSFERSENDER_H
+
+#include <QObject>
+#include <QFile>
+#include <QHash>
+#include <QSet>
+#include <QList>
+#include <QElapsedTimer>
+#include <QDataStream>
+#include <QTimerEvent>
+
+#include "soro_global.h"
+#include "constants.h"
+#include "enums.h"
+#include "channel.h"
+
+// File data carried by one chunk message, which must fit in Channel::MAX_MESSAGE_LENGTH
+// along with its header (type, transfer ID, offset, length and checksum)
+#define BULKTRANSFER_CHUNK_SIZE 448
+// Most data sent but not yet acknowledged, which bounds how long live messages
+// can be queued behind a transfer on the same channel
+#define BULKTRANSFER_WINDOW (16 * 1024)
+// How often the receiver acknowledges what it has written
+#define BULKTRANSFER_ACK_INTERVAL (4 * 1024)
+// Default rate limit, in bytes per second
+#define BULKTRANSFER_DEFAULT_RATE (32 * 1024)
+// How often the sender sends the next chunks
+#define BULKTRANSFER_PUMP_INTERVAL 50
+// How often the sender looks for new files while idle
+#define BULKTRANSFER_SCAN_INTERVAL 30000
+// Files changed more recently than this are still being written, and are not sent yet
+#define BULKTRANSFER_SETTLE_TIME 10000
+// The transfer is restarted if the receiver says nothing for this long
+#define BULKTRANSFER_RESPONSE_TIMEOUT 15000
+
+namespace Soro {
+
+/* Sends files to the other side of a shared channel in the background, to be
+ * received by a BulkTransferReceiver.
+ *
+ * Every file in the watched directories is offered once it has stopped changing. The
+ * receiver answers with how much of the file it already holds, so a transfer cut off by a
+ * lost connection or a restart resumes where it stopped, and files it already has are skipped.
+ * Data is sent in small checksummed chunks with a limited window and rate, so a transfer
+ * never fills the channel ahead of live traffic, and is verified with a hash of the whole
+ * file at the end.
+ *
+ * Files are only ever read, they stay where they are once transferred.
+ */
+class LIBSORO_EXPORT BulkTransferSender : public QObject {
+    Q_OBJECT
+public:
+    explicit BulkTransferSender(Channel *channel, QObject *parent = 0);
+
+    /* Sends every file in a directory. Files are stored on the receiving side in a
+     * directory of the same category.
+     */
+    void addDirectory(QString path, QString category);
+
+    /* Stops sending until unpaused, for instance while a test is being recorded
+     * and the link should be left to live data
+     */
+    void setPaused(bool paused);
+    bool isPaused() const;
+
+    /* Sets the most bytes per second the transfer may send
+     */
+    void setRate(int bytesPerSecond);
+
+    /* Handles a bulk transfer message from the receiver. The message type has already
+     * been read from the stream.
+     */
+    void handleMessage(SharedMessageType type, QDataStream &stream);
+
+    /* Gets the number of files known to still need sending
+     */
+    int getPendingCount() const;
+
+signals:
+    void fileTransferred(QString path);
+
+protected:
+    void timerEvent(QTimerEvent *e);
+
+private:
+    enum TransferState {
+        IdleTransferState,
+        OfferedTransferState,
+        SendingTransferState,
+        FinishedTransferState
+    };
+
+    struct PendingFile {
+        QString path;
+        QString category;
+        qint64 size;
+    };
+
+    Channel *_channel;
+    QList<QPair<QString, QString>> _directories;
+    QList<PendingFile> _pending;
+    // Size each file had when the receiver confirmed it, so it is sent again if it grows
+    QHash<QString, qint64> _sent;
+    // Files that failed this session
+    QSet<QString> _failed;
+    bool _paused = false;
+    int _rate = BULKTRANSFER_DEFAULT_RATE;
+    int _pumpTimerId = TIMER_INACTIVE;
+    QElapsedTimer _scanTimer;
+
+    TransferState _state = IdleTransferState;
+    qint32 _nextId = 1;
+    qint32 _id = 0;
+    PendingFile _current;
+    QFile _file;
+    qint64 _sentOffset = 0;
+    qint64 _ackedOffset = 0;
+    double _tokens = 0;
+    QElapsedTimer _tokenTimer;
+    QElapsedTimer _responseTimer;
+
+    void scan();
+    void offerNext();
+    void sendChunks();
+    void sendEnd();
+    void finishTransfer(bool ok);
+
+private slots:
+    void channelStateChanged(Channel::State state);
+};
+
+} // namespace Soro
+
+#endif // SORO_BULKTRANSFERSENDER_H
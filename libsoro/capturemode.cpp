@@ -0,0 +1,212 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "capturemode.h"
+#include "videoformat.h"
+
+#include <QStringList>
+
+#ifdef Q_OS_LINUX
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/videodev2.h>
+#endif
+
+namespace Soro {
+
+/* Gets the gstreamer name of a raw V4L2 pixel format, or an empty string
+ * for formats that are not worth capturing raw
+ */
+static QString rawGstFormat(QString fourcc) {
+    if (fourcc == "YUYV") return "YUY2";
+    if (fourcc == "UYVY") return "UYVY";
+    if (fourcc == "NV12") return "NV12";
+    if (fourcc == "YU12") return "I420";
+    if (fourcc == "GREY") return "GRAY8";
+    return "";
+}
+
+bool CaptureMode::isValid() const {
+    return !pixelFormat.isEmpty() && (width > 0) && (height > 0);
+}
+
+bool CaptureMode::isCompressed() const {
+    return (pixelFormat == "MJPG") || (pixelFormat == "H264");
+}
+
+bool CaptureMode::isPassthroughFor(const VideoFormat &format) const {
+    if (!isValid() || ((int)format.getWidth() != width) || ((int)format.getHeight() != height)) {
+        return false;
+    }
+    return ((pixelFormat == "MJPG") && (format.getEncoding() == VideoFormat::Encoding_MJPEG))
+            || ((pixelFormat == "H264") && (format.getEncoding() == VideoFormat::Encoding_H264));
+}
+
+QString CaptureMode::createGstCaps() const {
+    QString caps;
+    if (pixelFormat == "MJPG") {
+        caps = "image/jpeg";
+    }
+    else if (pixelFormat == "H264") {
+        caps = "video/x-h264,stream-format=byte-stream";
+    }
+    else {
+        caps = "video/x-raw,format=" + rawGstFormat(pixelFormat);
+    }
+    caps += QString(",width=%1,height=%2").arg(QString::number(width), QString::number(height));
+    if (framerate > 0) {
+        caps += QString(",framerate=%1/1").arg(QString::number(framerate));
+    }
+    return caps;
+}
+
+QString CaptureMode::serialize() const {
+    return QString("%1_%2_%3_%4").arg(
+                pixelFormat,
+                QString::number(width),
+                QString::number(height),
+                QString::number(framerate));
+}
+
+void CaptureMode::deserialize(QString serial) {
+    QStringList items = serial.split('_');
+    if (items.size() < 4) {
+        *this = CaptureMode();
+        return;
+    }
+    pixelFormat = items[0];
+    width = items[1].toInt();
+    height = items[2].toInt();
+    framerate = items[3].toInt();
+}
+
+CaptureMode CaptureMode::select(const QList<CaptureMode> &modes, const VideoFormat &format, bool allowPassthrough) {
+    if (format.getStereoMode() != VideoFormat::StereoMode_None) {
+        // Side by side frames are put together from scaled halves anyway
+        return CaptureMode();
+    }
+    CaptureMode best;
+    int bestRank = 0;
+    foreach (const CaptureMode &mode, modes) {
+        if ((mode.width != (int)format.getWidth()) || (mode.height != (int)format.getHeight())) continue;
+
+        int rank;
+        if (allowPassthrough && mode.isPassthroughFor(format)) {
+            // H.264 can't have frames dropped, so the camera must run at the right rate
+            if ((format.getFramerate() > 0) && (mode.framerate != (int)format.getFramerate())) continue;
+            rank = 2;
+        }
+        else if (!mode.isCompressed() && !rawGstFormat(mode.pixelFormat).isEmpty()) {
+            rank = 1;
+        }
+        else {
+            continue;
+        }
+
+        bool better = rank > bestRank;
+        if ((rank == bestRank) && (mode.pixelFormat == best.pixelFormat)) {
+            if (format.getFramerate() > 0) {
+                // Lowest framerate that videorate can bring down to the one asked for
+                bool enough = mode.framerate >= (int)format.getFramerate();
+                bool bestEnough = best.framerate >= (int)format.getFramerate();
+                better = (enough && (!bestEnough || (mode.framerate < best.framerate)))
+                        || (!enough && !bestEnough && (mode.framerate > best.framerate));
+            }
+            else {
+                better = mode.framerate > best.framerate;
+            }
+        }
+        if (better) {
+            best = mode;
+            bestRank = rank;
+        }
+    }
+    return best;
+}
+
+#ifdef Q_OS_LINUX
+
+static QString fourccToString(quint32 fourcc) {
+    QString str;
+    for (int i = 0; i < 4; i++) {
+        str += QChar((char)((fourcc >> (i * 8)) & 0xFF));
+    }
+    return str.trimmed();
+}
+
+static void probeIntervals(int fd, quint32 pixelFormat, quint32 width, quint32 height, QList<CaptureMode> &modes) {
+    CaptureMode mode;
+    mode.pixelFormat = fourccToString(pixelFormat);
+    mode.width = width;
+    mode.height = height;
+
+    v4l2_frmivalenum interval;
+    memset(&interval, 0, sizeof(interval));
+    interval.pixel_format = pixelFormat;
+    interval.width = width;
+    interval.height = height;
+    for (interval.index = 0; ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &interval) == 0; interval.index++) {
+        v4l2_fract fraction = interval.type == V4L2_FRMIVAL_TYPE_DISCRETE ? interval.discrete : interval.stepwise.min;
+        if (fraction.numerator > 0) {
+            mode.framerate = (fraction.denominator + fraction.numerator / 2) / fraction.numerator;
+            modes.append(mode);
+        }
+        // Stepwise intervals are only listed by their fastest rate
+        if (interval.type != V4L2_FRMIVAL_TYPE_DISCRETE) break;
+    }
+    if (interval.index == 0) {
+        // The driver doesn't list framerates
+        mode.framerate = 0;
+        modes.append(mode);
+    }
+}
+
+#endif
+
+QList<CaptureMode> CaptureMode::probe(QString device) {
+    QList<CaptureMode> modes;
+#ifdef Q_OS_LINUX
+    int fd = open(device.toLocal8Bit().constData(), O_RDWR | O_NONBLOCK);
+    if (fd < 0) return modes;
+
+    v4l2_fmtdesc format;
+    memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    for (format.index = 0; ioctl(fd, VIDIOC_ENUM_FMT, &format) == 0; format.index++) {
+        v4l2_frmsizeenum size;
+        memset(&size, 0, sizeof(size));
+        size.pixel_format = format.pixelformat;
+        for (size.index = 0; ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size) == 0; size.index++) {
+            if (size.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+                probeIntervals(fd, format.pixelformat, size.discrete.width, size.discrete.height, modes);
+            }
+            else {
+                // Rare for USB cameras, only the largest size is listed
+                probeIntervals(fd, format.pixelformat, size.stepwise.max_width, size.stepwise.max_height, modes);
+                break;
+            }
+        }
+    }
+    close(fd);
+#else
+    Q_UNUSED(device);
+#endif
+    return modes;
+}
+
+} // namespace Soro
@@ -0,0 +1,56 @@
+#ifndef SORO_CAPTUREMODE_H
+#define SORO_CAPTUREMODE_H
+
+#include <QString>
+#include <QList>
+
+#include "soro_global.h"
+
+namespace Soro {
+
+class VideoFormat;
+
+/* One of the formats a V4L2 camera can capture in: a pixel format (as its fourcc, such as
+ * MJPG, H264 or YUYV), a frame size and a framerate
+ */
+struct LIBSORO_EXPORT CaptureMode {
+    QString pixelFormat;
+    int width = 0;
+    int height = 0;
+    int framerate = 0;
+
+    bool isValid() const;
+
+    /* Returns true for MJPEG and H.264, which the camera compresses itself
+     */
+    bool isCompressed() const;
+
+    /* Returns true if frames in this mode can be sent as they are for a stream of the given
+     * format, without decoding or encoding them
+     */
+    bool isPassthroughFor(const VideoFormat &format) const;
+
+    /* Creates the caps that make a v4l2src capture in this mode
+     */
+    QString createGstCaps() const;
+
+    QString serialize() const;
+    void deserialize(QString serial);
+
+    /* Picks the mode that needs the least work to stream the given format: one the camera
+     * already compresses in the right encoding if passthrough is allowed, otherwise a raw mode
+     * at the right size so no scaling is needed. The framerate is the lowest one that is at
+     * least the format's, or the highest if it has none. Returns an invalid mode if no mode
+     * avoids scaling, in which case the camera should be left to negotiate.
+     */
+    static CaptureMode select(const QList<CaptureMode> &modes, const VideoFormat &format, bool allowPassthrough);
+
+    /* Lists the modes a V4L2 device supports, with one entry for each pixel format,
+     * frame size and framerate. Returns an empty list if the device cannot be queried.
+     */
+    static QList<CaptureMode> probe(QString device);
+};
+
+} // namespace Soro
+
+#endif // SORO_CAPTUREMODE_H
@@ -18,6 +18,10 @@
 #include "logger.h"
 #include "confloader.h"
 #include "util.h"
+#include "sockettuning.h"
+#include "kerneldatagramreader.h"
+
+#include <QElapsedTimer>
 
 //rough rate at which handshakes are sent when trying to establish a UDP connection
 #define HANDSHAKE_FREQUENCY 250
@@ -31,6 +35,17 @@
 #define SENT_LOG_CAP 300
 //delay after an error when a reconnect will be tried
 #define RECOVERY_DELAY 1000
+//busy poll time (us) and receive buffer size (bytes) used in low latency mode. The
+//buffer is kept small so stale drive packets are dropped rather than queued.
+#define LOW_LATENCY_BUSY_POLL 50
+#define LOW_LATENCY_RCVBUF 16384
+//a path of a multipath channel is considered down after this long without a message (ms),
+//and each percent of loss on a path counts as this many ms of RTT when choosing one
+#define MULTIPATH_PATH_TIMEOUT 1000
+#define MULTIPATH_LOSS_PENALTY 10
+//probe trains: payload is train number (4), index (2), count (2)
+#define PROBE_HEADER_SIZE 8
+#define PROBE_MAX_COUNT 64
 
 //Tags for writing the configuration file
 #define CONFIG_TAG_SERVER_ADDRESS "serveraddress"
@@ -50,6 +65,28 @@
 
 namespace Soro {
 
+/* All channel timing is taken from a monotonic clock, so RTT and timeouts
+ * are not affected by the system clock being adjusted
+ */
+static QElapsedTimer createMonotonicClock() {
+    QElapsedTimer clock;
+    clock.start();
+    return clock;
+}
+
+static const QElapsedTimer &monotonicClock() {
+    static const QElapsedTimer clock = createMonotonicClock();
+    return clock;
+}
+
+static inline qint64 monotonicMSecs() {
+    return monotonicClock().elapsed();
+}
+
+static inline qint64 monotonicNSecs() {
+    return monotonicClock().nsecsElapsed();
+}
+
 Channel::Channel(QObject *parent) : QObject(parent) { }
 
 Channel* Channel::createClient(QObject *parent, SocketAddress serverAddress, QString name, Protocol protocol,
@@ -81,7 +118,26 @@ Channel* Channel::createServer(QObject *parent, quint16 port, QString name, Prot
     return c;
 }
 
+Channel* Channel::createMultiPeerServer(QObject *parent, quint16 port, QString name, Protocol protocol,
+                 QHostAddress hostAddress) {
+    Channel *c = new Channel(parent);
+    c->_serverAddress.host = QHostAddress::Any;
+    c->_serverAddress.port = port;
+    c->_protocol = protocol;
+    c->_isServer = true;
+    c->_isMultiPeer = true;
+    c->_hostAddress.host = hostAddress;
+    c->_name = name;
+
+    c->init();
+
+    return c;
+}
+
 Channel::~Channel() {
+    //nobody should hear from a channel that is being destroyed
+    clearPeers(false);
+    qDeleteAll(_paths);
     if (_sentTimeLog != nullptr) {
         delete [] _sentTimeLog;
     }
@@ -97,7 +153,7 @@ Channel::~Channel() {
 
 void Channel::init() {  //PRIVATE
     //log tag for debugging
-    LOG_TAG = _name + (_isServer ? "(S)" : "(C)");
+    LOG_TAG = _name + (_isMultiPeer ? "(M)" : (_isServer ? "(S)" : "(C)"));
 
     //format the name as a UTF8 byte array
     QByteArray toUtf8 = _name.toUtf8();
@@ -117,6 +173,9 @@ void Channel::init() {  //PRIVATE
         _socket = _udpSocket = new QUdpSocket(this);
         _socket->setSocketOption(QAbstractSocket::LowDelayOption, _lowDelaySocketOption);
         connect(_socket, &QAbstractSocket::readyRead, this, &Channel::udpReadyRead);
+        //with kernel timestamps on, datagrams are read through this instead
+        _kernelReader = new KernelDatagramReader(this);
+        connect(_kernelReader, &KernelDatagramReader::readyRead, this, &Channel::udpReadyRead);
         connect(_socket, static_cast<void (QAbstractSocket::*)(QAbstractSocket::SocketError)>(&QAbstractSocket::error), this, &Channel::connectionErrorInternal);
     }
     else if (_isServer) {
@@ -160,7 +219,7 @@ void Channel::open() {
             LOG_I(LOG_TAG, "Attempting to bind to an available port on " + _hostAddress.host.toString());
         }
         if (_tcpServer != nullptr) {
-            _tcpServer->setMaxPendingConnections(1);
+            _tcpServer->setMaxPendingConnections(_isMultiPeer ? _maxPeers : 1);
         }
         //start the connection procedure
         resetConnection();
@@ -184,7 +243,7 @@ void Channel::resetConnectionVars() {   //PRIVATE
     _lastRtt = -1;
     _lastAckSendTime = 0;
     _lastAckReceiveTime = 0;
-    _connectionEstablishedTime = QDateTime::currentMSecsSinceEpoch();
+    _connectionEstablishedTime = monotonicMSecs();
     _nextSendID = 1;
     _messagesDown = 0;
     _messagesUp = 0;
@@ -193,6 +252,8 @@ void Channel::resetConnectionVars() {   //PRIVATE
     _dataRateUp = 0;
     _dataRateDown = 0;
     _sentTimeLogIndex = 0;
+    _multipathHighestID = 0;
+    _multipathSeenMask = 0;
 }
 
 void Channel::resetConnection() {   //PRIVATE
@@ -202,6 +263,7 @@ void Channel::resetConnection() {   //PRIVATE
     KILL_TIMER(_handshakeTimerID);
     KILL_TIMER(_resetTcpTimerID);
     KILL_TIMER(_resetTimerID);
+    clearPeers();
     if (_isServer) {
         setPeerAddress(SocketAddress(QHostAddress::Null, 0));
     }
@@ -228,9 +290,13 @@ void Channel::resetConnection() {   //PRIVATE
     }
     else if (_udpSocket != nullptr) {
         LOG_D(LOG_TAG, "Cancelling any previous UDP operations...");
+        _kernelReader->detach();
         _udpSocket->abort();
         _udpSocket->bind(_hostAddress.host, _hostAddress.port);
         if (!_udpSocket->isOpen()) _udpSocket->open(QIODevice::ReadWrite);
+        configureKernelTimestamps();
+        configureLowLatency();
+        resetPaths();
         if (!_isServer) START_TIMER(_handshakeTimerID, HANDSHAKE_FREQUENCY);
         LOG_I(LOG_TAG, "Bound to UDP port " + QString::number(_udpSocket->localPort()));
     }
@@ -245,14 +311,24 @@ void Channel::resetConnection() {   //PRIVATE
             newTcpClient();
         }
     }
+    if (_isMultiPeer) {
+        //A multi-peer server monitors all of its sessions from a single timer
+        START_TIMER(_connectionMonitorTimerID, (int)(HEARTBEAT_INTERVAL / 3.1415926));
+    }
 
     setChannelState(ConnectingState, false);
 }
 
 void Channel::timerEvent(QTimerEvent *e) {  //PROTECTED
     int id = e->timerId();
-    if (id == _connectionMonitorTimerID) {
-        qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if ((id == _connectionMonitorTimerID) && _isMultiPeer) {
+        monitorPeers();
+    }
+    else if (id == _connectionMonitorTimerID) {
+        qint64 now = monotonicMSecs();
+        if (!_paths.isEmpty()) {
+            maintainPaths(now);
+        }
         //check for a stale connection (several seconds without a message)
         if (now - _lastReceiveTime >= IDLE_CONNECTION_TIMEOUT) {
             LOG_E(LOG_TAG, "Peer has stopped responding, dropping connection");
@@ -320,6 +396,21 @@ void Channel::tcpConnected() {  //PRIVATE SLOT
 }
 
 void Channel::newTcpClient() {  //PRIVATE SLOT
+    if (_isMultiPeer) {
+        while (_tcpServer->hasPendingConnections()) {
+            QTcpSocket *socket = _tcpServer->nextPendingConnection();
+            if (_peers.size() >= _maxPeers) {
+                LOG_W(LOG_TAG, "Rejecting TCP peer " + socket->peerAddress().toString() + ", peer table is full");
+                socket->abort();
+                socket->deleteLater();
+                continue;
+            }
+            PeerSession *session = addPeer(SocketAddress(socket->peerAddress(), socket->peerPort()), socket);
+            //the server side sends its handshake as soon as the TCP connection is up, same as single peer mode
+            sendToPeer(session, _nameUtf8, (MessageSize)_nameUtf8Size, MSGTYPE_SERVER_HANDSHAKE);
+        }
+        return;
+    }
     if (_tcpSocket != nullptr) {
         _tcpSocket->abort();
         if (_tcpSocket->isOpen()) {
@@ -357,6 +448,9 @@ void Channel::close() {
 void Channel::close(Channel::State closeState) {   //PRIVATE
     if ((_state == ConnectedState) || (_state == ConnectingState)) {
         LOG_W(LOG_TAG, "Closing channel in state " + QString::number(closeState));
+        if (_kernelReader) {
+            _kernelReader->detach();
+        }
         if (_socket) {
             _socket->abort();
         }
@@ -367,6 +461,10 @@ void Channel::close(Channel::State closeState) {   //PRIVATE
         KILL_TIMER(_resetTcpTimerID);
         KILL_TIMER(_resetTimerID);
         KILL_TIMER(_handshakeTimerID);
+        clearPeers();
+        foreach (Path *path, _paths) {
+            if (path->socket) path->socket->abort();
+        }
         resetConnectionVars();
 
         setChannelState(closeState, false);
@@ -381,6 +479,15 @@ void Channel::close(Channel::State closeState) {   //PRIVATE
 void Channel::connectionErrorInternal(QAbstractSocket::SocketError err) { //PRIVATE SLOT
     emit connectionError(err);
     LOG_E(LOG_TAG, "Connection Error: " + _socket->errorString());
+    for (int i = 1; i < _paths.size(); i++) {
+        if (_paths[i]->up) {
+            //another path is still carrying the connection, the primary socket will
+            //be rebound the next time the connection resets
+            LOG_W(LOG_TAG, "Primary path failed, continuing on the remaining paths");
+            _paths[0]->up = false;
+            return;
+        }
+    }
     //Attempt to reconnect after RECOVERY_DELAY
     //we should NOT directly call resetConnectio() here as that could
     //potentially force an error loop
@@ -392,7 +499,12 @@ void Channel::serverErrorInternal(QAbstractSocket::SocketError err) { //PRIVATE
     LOG_E(LOG_TAG, "Server Error: " + _tcpServer->errorString());
     //don't automatically kill the connection if it's still active, only the listening server
     //experienced the error
-    if (_tcpSocket == nullptr || _tcpSocket->state() != QAbstractSocket::ConnectedState) {
+    if (_isMultiPeer) {
+        if (_peers.isEmpty()) {
+            START_TIMER(_resetTimerID, RECOVERY_DELAY);
+        }
+    }
+    else if (_tcpSocket == nullptr || _tcpSocket->state() != QAbstractSocket::ConnectedState) {
         START_TIMER(_resetTimerID, RECOVERY_DELAY);
     }
 }
@@ -405,15 +517,20 @@ void Channel::serverErrorInternal(QAbstractSocket::SocketError err) { //PRIVATE
 
 void Channel::udpReadyRead() {  //PRIVATE SLOT
     LOG_D(LOG_TAG, "udpReadyRead() called");
+    if (_isMultiPeer) {
+        multiPeerUdpReadyRead();
+        return;
+    }
     SocketAddress address;
     MessageID ID;
     MessageType type;
     qint64 status;
-    while (_udpSocket->hasPendingDatagrams()) {
+    while (hasPendingUdpDatagrams()) {
         //read in a datagram
-        status = _udpSocket->readDatagram(_receiveBuffer, MAX_MESSAGE_LENGTH, &address.host, &address.port);
+        status = readUdpDatagram(_receiveBuffer, MAX_MESSAGE_LENGTH, &address);
         if (status < 0) {
-            //an error occurred reading from the socket, the onSocketError slot will handle it
+            //no datagrams were left, or an error occurred reading from the socket
+            //which the onSocketError slot will handle
             return;
         }
         _receiveBufferLength = status;
@@ -431,6 +548,10 @@ void Channel::udpReadyRead() {  //PRIVATE SLOT
         }
         _bytesDown += status;
         ID = Util::deserialize<MessageID>(_receiveBuffer + 1);
+        if (!_paths.isEmpty() && (type != MSGTYPE_CLIENT_HANDSHAKE) && (type != MSGTYPE_SERVER_HANDSHAKE)) {
+            notePathReceive(_paths[0], type, ID, _receiveBuffer + UDP_HEADER_SIZE);
+            if (isMultipathDuplicate(ID)) continue;
+        }
         processBufferedMessage(type, ID, _receiveBuffer + UDP_HEADER_SIZE, _receiveBufferLength - UDP_HEADER_SIZE, address);
     }
 }
@@ -469,6 +590,7 @@ void Channel::tcpReadyRead() {  //PRIVATE SLOT
                 _bytesDown += length;
                 MessageType type = static_cast<MessageType>(_receiveBuffer[sizeof(MessageSize)]);
                 MessageID ID = Util::deserialize<MessageID>(_receiveBuffer + sizeof(MessageSize) + 1);
+                setReceiveTime(monotonicNSecs());
                 processBufferedMessage(type, ID, _receiveBuffer + TCP_HEADER_SIZE, _receiveBufferLength - TCP_HEADER_SIZE, _peerAddress);
                 _receiveBufferLength = 0;
             }
@@ -477,13 +599,26 @@ void Channel::tcpReadyRead() {  //PRIVATE SLOT
 }
 
 void Channel::processBufferedMessage(MessageType type, MessageID ID, const char *message, MessageSize size, const SocketAddress &address) {
+    if ((type == MSGTYPE_PROBE) || (type == MSGTYPE_PROBE_REQUEST)) {
+        //probes are measured separately and don't count as normal traffic or affect IDs
+        if (_state == ConnectedState) {
+            _lastReceiveTime = _receiveTime;
+            if (type == MSGTYPE_PROBE) {
+                processProbe(message, size);
+            }
+            else if (size >= 4) {
+                sendProbeTrain(Util::deserialize<quint16>(message), Util::deserialize<quint16>(message + 2));
+            }
+        }
+        return;
+    }
     switch (type) {
     case MSGTYPE_NORMAL:
         //normal data packet
         //check the packet sequence ID
         if ((ID > _lastReceiveID) | !_dropOldPackets){
             LOG_D(LOG_TAG, "Received normal packet " + QString::number(ID));
-            _lastReceiveTime = QDateTime::currentMSecsSinceEpoch();
+            _lastReceiveTime = _receiveTime;
             _receivedPackets++;
             _droppedPackets += ID - _lastReceiveID + 1;
             _lastReceiveID = ID;
@@ -500,7 +635,7 @@ void Channel::processBufferedMessage(MessageType type, MessageID ID, const char
                 setPeerAddress(address);
                 KILL_TIMER(_handshakeTimerID);
                 KILL_TIMER(_resetTcpTimerID);
-                _lastReceiveTime = QDateTime::currentMSecsSinceEpoch();
+                _lastReceiveTime = _receiveTime;
                 _lastReceiveID = ID;
                 _wasConnected = true;
                 START_TIMER(_connectionMonitorTimerID, (int)(HEARTBEAT_INTERVAL / 3.1415926));
@@ -525,7 +660,7 @@ void Channel::processBufferedMessage(MessageType type, MessageID ID, const char
                     //send a handshake back in UDP server mode
                     sendHandshake();
                 }
-                _lastReceiveTime = QDateTime::currentMSecsSinceEpoch();
+                _lastReceiveTime = _receiveTime;
                 _lastReceiveID = ID;
                 _wasConnected = true;
                 START_TIMER(_connectionMonitorTimerID, (int)(HEARTBEAT_INTERVAL / 3.1415926));
@@ -541,7 +676,7 @@ void Channel::processBufferedMessage(MessageType type, MessageID ID, const char
     case MSGTYPE_HEARTBEAT:
         LOG_D(LOG_TAG, "Received heartbeat packet " + QString::number(ID));
         //no reason to update or check _lastReceiveID
-        _lastReceiveTime = QDateTime::currentMSecsSinceEpoch();
+        _lastReceiveTime = _receiveTime;
         break;
     default:
         LOG_E(LOG_TAG, "Peer sent a message with an invalid header (type=" + QString::number(type) + ")");
@@ -549,7 +684,7 @@ void Channel::processBufferedMessage(MessageType type, MessageID ID, const char
         return;
     case MSGTYPE_ACK:
         LOG_D(LOG_TAG, "Received ack packet " + QString::number(ID));
-        _lastReceiveTime = QDateTime::currentMSecsSinceEpoch();
+        _lastReceiveTime = _receiveTime;
         int time = _lastReceiveTime - _lastAckReceiveTime;
         _lastAckReceiveTime = _lastReceiveTime;
         if (time != 0) {
@@ -558,23 +693,16 @@ void Channel::processBufferedMessage(MessageType type, MessageID ID, const char
         }
         _bytesUp = 0;
         _bytesDown = 0;
-        MessageID ackID = Util::deserialize<MessageID>(message);
-        if (ackID >= _nextSendID) break;
-        int logIndex = _sentTimeLogIndex - (_nextSendID - ackID);
-        if (logIndex < 0) {
-            if (logIndex < -SENT_LOG_CAP) {
-                LOG_W(LOG_TAG, "Received ack for message that had already been discarded from the log, consider increasing SentLogCap in configuration");
-                break;
-            }
-            logIndex += SENT_LOG_CAP;
+        int rtt = rttForAck(Util::deserialize<MessageID>(message), _lastReceiveTime);
+        if (rtt >= 0) {
+            _lastRtt = rtt;
         }
-        _lastRtt = _lastReceiveTime - _sentTimeLog[logIndex];
         break;
     }
     _messagesDown++;
     //If we have reached _statisticsInterval without acking a received packet,
     //send one so the other side can calculate RTT
-    if (_sendAcks && (QDateTime::currentMSecsSinceEpoch() - _lastAckSendTime >= STATISTICS_INTERVAL)) {
+    if (_sendAcks && (_receiveTime - _lastAckSendTime >= STATISTICS_INTERVAL)) {
         _lastAckSendTime = _lastReceiveTime;
         char* ack = new char[sizeof(MessageID)];
         Util::serialize<MessageID>(ack, ID);
@@ -582,6 +710,28 @@ void Channel::processBufferedMessage(MessageType type, MessageID ID, const char
     }
 }
 
+inline void Channel::setReceiveTime(qint64 nsecs) {    //PRIVATE
+    _receiveTimeNs = nsecs;
+    _receiveTime = nsecs / 1000000;
+}
+
+int Channel::rttForAck(MessageID ackID, qint64 receiveTime) const { //PRIVATE
+    return rttFromLog(_sentTimeLog, _sentTimeLogIndex, _nextSendID, ackID, receiveTime);
+}
+
+int Channel::rttFromLog(const qint64 *log, int logIndex, MessageID nextID, MessageID ackID, qint64 receiveTime) const { //PRIVATE
+    if (ackID >= nextID) return -1;
+    logIndex -= nextID - ackID;
+    if (logIndex < 0) {
+        if (logIndex < -SENT_LOG_CAP) {
+            LOG_W(LOG_TAG, "Received ack for message that had already been discarded from the log, consider increasing SentLogCap in configuration");
+            return -1;
+        }
+        logIndex += SENT_LOG_CAP;
+    }
+    return receiveTime - log[logIndex];
+}
+
 inline bool Channel::compareHandshake(const char *message, MessageSize size)  const { //PRIVATE
     if ((int)size != _nameUtf8Size) return false; //size + 1 to account for \0
     return strncmp(_nameUtf8, message, _nameUtf8Size) == 0;
@@ -602,6 +752,13 @@ inline void Channel::sendHeartbeat() {   //PRIVATE SLOT
 }
 
 bool Channel::sendMessage(const char *message, MessageSize size) {
+    if (_isMultiPeer) {
+        if (size > MAX_MESSAGE_LENGTH) {
+            LOG_W(LOG_TAG, "Attempted to send a message that is too long, it will be truncated");
+            size = MAX_MESSAGE_LENGTH;
+        }
+        return broadcastInternal(message, size, MSGTYPE_NORMAL, nullptr) > 0;
+    }
     if (_state == ConnectedState) {
         if (size > MAX_MESSAGE_LENGTH) {
             LOG_W(LOG_TAG, "Attempted to send a message that is too long, it will be truncated");
@@ -623,7 +780,12 @@ bool Channel::sendMessage(const char *message, MessageSize size, MessageType typ
             _sendBuffer[0] = static_cast<char>(type);
             Util::serialize<MessageID>(_sendBuffer + 1, _nextSendID);
             memcpy(_sendBuffer + sizeof(MessageID) + 1, message, (size_t)size);
-            status = _udpSocket->writeDatagram(_sendBuffer, size + UDP_HEADER_SIZE, _peerAddress.host, _peerAddress.port);
+            if (_paths.isEmpty()) {
+                status = _udpSocket->writeDatagram(_sendBuffer, size + UDP_HEADER_SIZE, _peerAddress.host, _peerAddress.port);
+            }
+            else {
+                status = sendMultipath(_sendBuffer, size + UDP_HEADER_SIZE, type);
+            }
         }
         else {
             PacketWrapper *wrapper = new PacketWrapper;
@@ -670,7 +832,7 @@ bool Channel::sendMessage(const char *message, MessageSize size, MessageType typ
     //log statistics and increment _nextSendID
     _messagesUp++;
     _bytesUp += status;
-    _lastSendTime = QDateTime::currentMSecsSinceEpoch();
+    _lastSendTime = monotonicMSecs();
     _sentTimeLog[_sentTimeLogIndex] = _lastSendTime;
     _nextSendID++;
     _sentTimeLogIndex++;
@@ -697,6 +859,49 @@ bool Channel::isServer() const {
     return _isServer;
 }
 
+bool Channel::isMultiPeer() const {
+    return _isMultiPeer;
+}
+
+int Channel::getPeerCount() const {
+    int count = 0;
+    foreach (PeerSession *session, _peers) {
+        if (session->verified) count++;
+    }
+    return count;
+}
+
+QList<SocketAddress> Channel::getPeers() const {
+    QList<SocketAddress> peers;
+    foreach (PeerSession *session, _peers) {
+        if (session->verified) peers.append(session->address);
+    }
+    return peers;
+}
+
+Channel::PeerStatistics Channel::getPeerStatistics(const SocketAddress &peer) const {
+    PeerStatistics stats;
+    stats.address = SocketAddress(QHostAddress::Null, 0);
+    PeerSession *session = _peers.value(peer, nullptr);
+    if (session && session->verified) {
+        stats.address = session->address;
+        stats.connectionEstablishedTime = session->connectionEstablishedTime;
+        stats.lastRtt = session->lastRtt;
+        stats.messagesUp = session->messagesUp;
+        stats.messagesDown = session->messagesDown;
+        stats.bitsPerSecondUp = session->dataRateUp;
+        stats.bitsPerSecondDown = session->dataRateDown;
+    }
+    return stats;
+}
+
+void Channel::setMaxPeers(int maxPeers) {
+    _maxPeers = maxPeers;
+    if (_tcpServer != nullptr && _isMultiPeer) {
+        _tcpServer->setMaxPendingConnections(_maxPeers);
+    }
+}
+
 Soro::SocketAddress Channel::getPeerAddress() const {
     return _peerAddress;
 }
@@ -717,7 +922,7 @@ int Channel::getUdpDroppedPacketsPercent() {
 
 int Channel::getConnectionUptime() const {
     if (_state == ConnectedState) {
-        return (QDateTime::currentMSecsSinceEpoch() - _connectionEstablishedTime) / 1000;
+        return (monotonicMSecs() - _connectionEstablishedTime) / 1000;
     }
     return -1;
 }
@@ -785,4 +990,818 @@ void Channel::setLowDelaySocketOption(bool lowDelay) {
     }
 }
 
+void Channel::setUseKernelTimestamps(bool useKernelTimestamps) {
+#ifdef Q_OS_LINUX
+    _useKernelTimestamps = useKernelTimestamps;
+    if (!useKernelTimestamps && _kernelReader && _kernelReader->isAttached()) {
+        //the socket is only read through QUdpSocket again once it is rebound
+        _kernelReader->detach();
+        if ((_state == ConnectedState) || (_state == ConnectingState)) {
+            resetConnection();
+            return;
+        }
+    }
+    configureKernelTimestamps();
+#else
+    if (useKernelTimestamps) {
+        LOG_W(LOG_TAG, "Kernel receive timestamps are only supported on Linux");
+    }
+#endif
+}
+
+int Channel::getReceiveSchedulingLatency() const {
+    return _schedulingLatency;
+}
+
+quint32 Channel::getKernelDroppedPackets() const {
+    return _kernelDroppedPackets;
+}
+
+int Channel::getReceiveBufferUsage() const {
+    if (_udpSocket == nullptr) return -1;
+    return SocketTuning::getReceiveBufferUsage(_udpSocket->socketDescriptor());
+}
+
+void Channel::setLowLatencyMode(bool lowLatency) {
+    if (_protocol != UdpProtocol) {
+        LOG_W(LOG_TAG, "Low latency mode is only supported on UDP channels");
+        return;
+    }
+    _lowLatencyMode = lowLatency;
+    if (lowLatency) {
+        // Wake-up latency is measured from the kernel receive timestamp
+        setUseKernelTimestamps(true);
+    }
+    configureLowLatency();
+}
+
+const LatencyHistogram& Channel::getWakeupLatencyHistogram() const {
+    return _wakeupLatency;
+}
+
+void Channel::resetWakeupLatencyHistogram() {
+    _wakeupLatency.reset();
+}
+
+/*  Kernel receive timestamps and low latency mode
+ ***************************************************************************
+ ***************************************************************************
+ ***************************************************************************/
+
+void Channel::configureKernelTimestamps() { //PRIVATE
+    if ((_udpSocket == nullptr) || (_udpSocket->socketDescriptor() == -1)) return;
+    if (!SocketTuning::setKernelTimestamps(_udpSocket->socketDescriptor(), _useKernelTimestamps) && _useKernelTimestamps) {
+        LOG_W(LOG_TAG, "Could not enable kernel timestamps on UDP socket, falling back to userspace receive times");
+        _useKernelTimestamps = false;
+    }
+    if (_useKernelTimestamps && !_kernelReader->isAttached() && !_kernelReader->attach(_udpSocket)) {
+        LOG_W(LOG_TAG, "Could not read UDP socket directly, falling back to userspace receive times");
+        SocketTuning::setKernelTimestamps(_udpSocket->socketDescriptor(), false);
+        _useKernelTimestamps = false;
+    }
+}
+
+void Channel::configureLowLatency() {   //PRIVATE
+    if ((_udpSocket == nullptr) || (_udpSocket->socketDescriptor() == -1) || !_lowLatencyMode) return;
+    if (!SocketTuning::applyLowLatencyOptions(_udpSocket->socketDescriptor(), LOW_LATENCY_BUSY_POLL, LOW_LATENCY_RCVBUF)) {
+        LOG_W(LOG_TAG, "Not all low latency socket options could be applied (SO_BUSY_POLL may require CAP_NET_ADMIN)");
+    }
+}
+
+bool Channel::hasPendingUdpDatagrams() const {  //PRIVATE
+    //the kernel reader finds out there are none left when a read fails
+    return _kernelReader->isAttached() || _udpSocket->hasPendingDatagrams();
+}
+
+qint64 Channel::readUdpDatagram(char *data, qint64 maxSize, SocketAddress *address) {   //PRIVATE
+    if (!_kernelReader->isAttached()) {
+        setReceiveTime(monotonicNSecs());
+        return _udpSocket->readDatagram(data, maxSize, &address->host, &address->port);
+    }
+    //the datagram and its kernel receive info are read in one call
+    qint64 status = _kernelReader->readDatagram(data, maxSize, address);
+    setReceiveTime(monotonicNSecs());
+    if (status < 0) return status;
+    qint64 latencyNs = _kernelReader->getLastLatency();
+    if (latencyNs >= 0) {
+        // Move the receive time back on the monotonic clock by how long the datagram sat in the socket
+        setReceiveTime(monotonicNSecs() - latencyNs);
+        // smoothed scheduling latency in microseconds
+        _schedulingLatency = (_schedulingLatency * 7 + (int)(latencyNs / 1000)) / 8;
+        if (_lowLatencyMode) {
+            _wakeupLatency.record(latencyNs / 1000);
+        }
+    }
+    quint32 dropped = _kernelReader->getDroppedPackets();
+    if (dropped != _kernelDroppedPackets) {
+        LOG_W(LOG_TAG, "Kernel dropped " + QString::number(dropped - _kernelDroppedPackets)
+              + " datagrams, socket receive buffer is full");
+        _kernelDroppedPackets = dropped;
+    }
+    return status;
+}
+
+/*  Bandwidth probing
+ ***************************************************************************
+ ***************************************************************************
+ ***************************************************************************/
+
+bool Channel::requestProbeTrain(int count, int packetSize) {
+    if ((_state != ConnectedState) || _isMultiPeer) return false;
+    count = qBound(2, count, PROBE_MAX_COUNT);
+    packetSize = qBound(PROBE_HEADER_SIZE, packetSize, (int)MAX_MESSAGE_LENGTH);
+    char request[4];
+    Util::serialize<quint16>(request, (quint16)count);
+    Util::serialize<quint16>(request + 2, (quint16)packetSize);
+    return sendMessage(request, sizeof(request), MSGTYPE_PROBE_REQUEST);
+}
+
+void Channel::sendProbeTrain(int count, int packetSize) {   //PRIVATE
+    count = qBound(2, count, PROBE_MAX_COUNT);
+    packetSize = qBound(PROBE_HEADER_SIZE, packetSize, (int)MAX_MESSAGE_LENGTH);
+    char probe[MAX_MESSAGE_LENGTH];
+    char packet[MAX_MESSAGE_LENGTH + TCP_HEADER_SIZE];
+    memset(probe, 0, packetSize);
+    _nextProbeTrain++;
+    Util::serialize<quint32>(probe, _nextProbeTrain);
+    Util::serialize<quint16>(probe + 6, (quint16)count);
+    //send the whole train back to back so the receiver sees it at the bottleneck rate
+    for (int i = 0; i < count; i++) {
+        Util::serialize<quint16>(probe + 4, (quint16)i);
+        //probes carry the current ID without consuming it, like path heartbeats they must not leave gaps
+        int length = writePacket(packet, probe, (MessageSize)packetSize, MSGTYPE_PROBE, _nextSendID);
+        qint64 status;
+        if (_protocol == UdpProtocol) {
+            status = _paths.isEmpty() ? _udpSocket->writeDatagram(packet, length, _peerAddress.host, _peerAddress.port)
+                                      : sendMultipath(packet, length, MSGTYPE_PROBE);
+        }
+        else if (_tcpSocket != nullptr) {
+            status = _tcpSocket->write(packet, length);
+        }
+        else {
+            break;
+        }
+        if (status > 0) _bytesUp += status;
+    }
+    if (_tcpSocket != nullptr) {
+        _tcpSocket->flush();
+    }
+}
+
+void Channel::processProbe(const char *message, MessageSize size) {   //PRIVATE
+    if (size < PROBE_HEADER_SIZE) return;
+    quint32 train = Util::deserialize<quint32>(message);
+    quint16 index = Util::deserialize<quint16>(message + 4);
+    quint16 count = Util::deserialize<quint16>(message + 6);
+    if ((train != _probeTrain) || (_probeReceived == 0)) {
+        //start of a new train, the first packet only marks the start time
+        _probeTrain = train;
+        _probeReceived = 1;
+        _probeBytes = 0;
+        _probeFirstIndex = index;
+        _probeStartTime = _receiveTimeNs;
+        _probeEndTime = _receiveTimeNs;
+        return;
+    }
+    _probeReceived++;
+    _probeBytes += size + (_protocol == UdpProtocol ? UDP_HEADER_SIZE : TCP_HEADER_SIZE);
+    _probeEndTime = _receiveTimeNs;
+    if (index == count - 1) {
+        qint64 elapsed = _probeEndTime - _probeStartTime;
+        int expected = count - _probeFirstIndex;
+        int lost = expected - _probeReceived;
+        _probeReceived = 0;
+        if ((elapsed <= 0) || (expected < 2)) return;
+        qint64 bitsPerSecond = (qint64)_probeBytes * 8 * 1000000000 / elapsed;
+        emit probeTrainReceived(bitsPerSecond, lost * 100 / expected);
+    }
+}
+
+/*  Multipath
+ ***************************************************************************
+ ***************************************************************************
+ ***************************************************************************/
+
+bool Channel::addPath(QHostAddress localAddress, SocketAddress remoteAddress) {
+    if ((_protocol != UdpProtocol) || _isMultiPeer) {
+        LOG_E(LOG_TAG, "Multipath is only supported on single peer UDP channels");
+        return false;
+    }
+    if (_state != ReadyState) {
+        LOG_E(LOG_TAG, "addPath() must be called before open()");
+        return false;
+    }
+    if (!_isServer && (remoteAddress.host == QHostAddress::Null)) {
+        LOG_E(LOG_TAG, "A multipath client must specify the server address for each path");
+        return false;
+    }
+    if (_paths.isEmpty()) {
+        //path 0 represents the primary socket
+        Path *primary = new Path;
+        primary->localAddress = _hostAddress.host;
+        _paths.append(primary);
+    }
+    Path *path = new Path;
+    path->localAddress = localAddress;
+    path->remoteAddress = _isServer ? SocketAddress(QHostAddress::Null, 0) : remoteAddress;
+    path->socket = new QUdpSocket(this);
+    connect(path->socket, &QUdpSocket::readyRead, this, [this, path]() {
+        multipathReadyRead(path);
+    });
+    connect(path->socket, static_cast<void (QUdpSocket::*)(QUdpSocket::SocketError)>(&QUdpSocket::error), this, [this, path]() {
+        //a failed path is rebound by maintainPaths(), the connection carries on over the others
+        LOG_W(LOG_TAG, "Error on path " + path->localAddress.toString() + ": " + path->socket->errorString());
+    });
+    _paths.append(path);
+    LOG_I(LOG_TAG, "Added path from " + localAddress.toString()
+          + (_isServer ? "" : " to " + remoteAddress.toString()));
+    return true;
+}
+
+void Channel::setMultipathMode(MultipathMode mode) {
+    _multipathMode = mode;
+}
+
+bool Channel::setPathEnabled(int index, bool enabled) {
+    if ((index <= 0) || (index >= _paths.size())) return false;
+    Path *path = _paths[index];
+    if (path->enabled == enabled) return true;
+    path->enabled = enabled;
+    path->verified = false;
+    if (enabled) {
+        //maintainPaths() binds it and makes it join again
+        LOG_I(LOG_TAG, "Path " + QString::number(index) + " enabled");
+        return true;
+    }
+    path->socket->abort();
+    LOG_I(LOG_TAG, "Path " + QString::number(index) + " disabled");
+    if (path->up) {
+        path->up = false;
+        path->lastRtt = -1;
+        emit pathStateChanged(index, false);
+    }
+    return true;
+}
+
+QList<Channel::PathStatistics> Channel::getPathStatistics() const {
+    QList<PathStatistics> list;
+    for (int i = 0; i < _paths.size(); i++) {
+        PathStatistics stats;
+        stats.localAddress = _paths[i]->localAddress;
+        stats.remoteAddress = i == 0 ? _peerAddress : _paths[i]->remoteAddress;
+        stats.up = _paths[i]->up;
+        stats.lastRtt = _paths[i]->lastRtt;
+        stats.lossPercent = _paths[i]->lossPercent;
+        stats.messagesDown = _paths[i]->messagesDown;
+        list.append(stats);
+    }
+    return list;
+}
+
+void Channel::resetPaths() {    //PRIVATE
+    for (int i = 0; i < _paths.size(); i++) {
+        Path *path = _paths[i];
+        path->verified = false;
+        path->up = false;
+        path->lastRtt = -1;
+        path->lossPercent = -1;
+        path->windowReceived = 0;
+        if (_isServer && (i > 0)) {
+            path->remoteAddress = SocketAddress(QHostAddress::Null, 0);
+        }
+        if (path->socket) {
+            path->socket->abort();
+            if (!path->enabled) continue;
+            if (path->socket->bind(path->localAddress, _isServer ? _serverAddress.port : 0)) {
+                path->socket->open(QIODevice::ReadWrite);
+                LOG_I(LOG_TAG, "Path " + QString::number(i) + " bound to " + path->localAddress.toString()
+                      + ":" + QString::number(path->socket->localPort()));
+            }
+            else {
+                LOG_W(LOG_TAG, "Could not bind path " + QString::number(i) + " to " + path->localAddress.toString());
+            }
+        }
+    }
+}
+
+bool Channel::writeToPath(Path *path, const char *packet, int length) { //PRIVATE
+    SocketAddress remote = path->socket ? path->remoteAddress : _peerAddress;
+    QUdpSocket *socket = path->socket ? path->socket : _udpSocket;
+    if ((remote.host == QHostAddress::Null) || (socket->state() != QAbstractSocket::BoundState)) {
+        return false;
+    }
+    if (socket->writeDatagram(packet, length, remote.host, remote.port) <= 0) {
+        return false;
+    }
+    path->lastSendTime = monotonicMSecs();
+    return true;
+}
+
+qint64 Channel::sendMultipath(const char *packet, int length, MessageType type) {  //PRIVATE
+    bool handshake = (type == MSGTYPE_CLIENT_HANDSHAKE) || (type == MSGTYPE_SERVER_HANDSHAKE);
+    int best = ((type == MSGTYPE_NORMAL) && (_multipathMode == FailoverMultipath)) ? getBestPath() : -1;
+    bool sent = false;
+    for (int i = 0; i < _paths.size(); i++) {
+        Path *path = _paths[i];
+        bool verified = i == 0 ? (_state == ConnectedState) : path->verified;
+        //handshakes also go out on paths that are not verified yet so they can join
+        if (!handshake && !verified) continue;
+        if ((best >= 0) && (i != best)) continue;
+        sent |= writeToPath(path, packet, length);
+    }
+    return sent ? length : -1;
+}
+
+int Channel::getBestPath() const {  //PRIVATE
+    int best = -1;
+    int bestScore = 0;
+    for (int i = 0; i < _paths.size(); i++) {
+        Path *path = _paths[i];
+        if (!path->up) continue;
+        //paths with an unknown RTT are only used if nothing better is available
+        int score = (path->lastRtt >= 0 ? path->lastRtt : IDLE_CONNECTION_TIMEOUT)
+                + (path->lossPercent > 0 ? path->lossPercent * MULTIPATH_LOSS_PENALTY : 0);
+        if ((best < 0) || (score < bestScore)) {
+            best = i;
+            bestScore = score;
+        }
+    }
+    //fall back to sending on all paths if none are known to be up
+    return best;
+}
+
+bool Channel::isMultipathDuplicate(MessageID ID) {  //PRIVATE
+    if (ID > _multipathHighestID) {
+        MessageID shift = ID - _multipathHighestID;
+        _multipathSeenMask = shift >= 64 ? 0 : _multipathSeenMask << shift;
+        _multipathSeenMask |= 1;
+        _multipathHighestID = ID;
+        return false;
+    }
+    MessageID offset = _multipathHighestID - ID;
+    if (offset >= 64) {
+        //too old to tell, let the normal ID checks decide
+        return false;
+    }
+    quint64 bit = (quint64)1 << offset;
+    if (_multipathSeenMask & bit) return true;
+    _multipathSeenMask |= bit;
+    return false;
+}
+
+void Channel::notePathReceive(Path *path, MessageType type, MessageID ID, const char *message) {   //PRIVATE
+    path->lastReceiveTime = _receiveTime;
+    path->messagesDown++;
+    if (path->windowReceived == 0) {
+        path->windowFirstID = ID;
+    }
+    path->windowReceived++;
+    if (ID > path->windowLastID) path->windowLastID = ID;
+    if (type == MSGTYPE_ACK) {
+        int rtt = rttForAck(Util::deserialize<MessageID>(message), _receiveTime);
+        if (rtt >= 0) path->lastRtt = rtt;
+    }
+    if (!path->up && (path->socket == nullptr ? _state == ConnectedState : path->verified)) {
+        path->up = true;
+        LOG_I(LOG_TAG, "Path " + QString::number(_paths.indexOf(path)) + " is up");
+        emit pathStateChanged(_paths.indexOf(path), true);
+    }
+}
+
+void Channel::maintainPaths(qint64 now) {   //PRIVATE
+    bool computeLoss = now - _lastPathMaintenanceTime >= STATISTICS_INTERVAL;
+    if (computeLoss) _lastPathMaintenanceTime = now;
+    for (int i = 0; i < _paths.size(); i++) {
+        Path *path = _paths[i];
+        if (path->up && (now - path->lastReceiveTime >= MULTIPATH_PATH_TIMEOUT)) {
+            path->up = false;
+            path->lastRtt = -1;
+            LOG_W(LOG_TAG, "Path " + QString::number(i) + " is down");
+            emit pathStateChanged(i, false);
+        }
+        if (computeLoss) {
+            if ((_multipathMode == DuplicateMultipath) && (path->windowReceived > 0)) {
+                //every path carries every message, so gaps in the IDs seen on a path are losses
+                quint64 expected = path->windowLastID - path->windowFirstID + 1;
+                path->lossPercent = 100 - (int)qMin((quint64)100, path->windowReceived * 100 / expected);
+            }
+            path->windowReceived = 0;
+        }
+        if ((i == 0) || !path->enabled) continue;
+        if (path->socket->state() != QAbstractSocket::BoundState) {
+            //try to bring a failed interface back
+            if (path->socket->bind(path->localAddress, _isServer ? _serverAddress.port : 0)) {
+                path->socket->open(QIODevice::ReadWrite);
+            }
+            continue;
+        }
+        if (path->verified && !path->up && (now - path->lastReceiveTime >= IDLE_CONNECTION_TIMEOUT)) {
+            //make the path join again, the peer may have a new address on it
+            path->verified = false;
+        }
+        if (!path->verified && !_isServer) {
+            char packet[UDP_HEADER_SIZE + 64];
+            int length = writePacket(packet, _nameUtf8, (MessageSize)_nameUtf8Size, MSGTYPE_CLIENT_HANDSHAKE, _nextSendID);
+            if (writeToPath(path, packet, length)) logSentMessage();
+        }
+        else if (path->verified && (now - path->lastSendTime >= HEARTBEAT_INTERVAL)) {
+            //keep idle paths measured, in failover mode they may not carry any normal traffic
+            char packet[UDP_HEADER_SIZE];
+            int length = writePacket(packet, "", 0, MSGTYPE_HEARTBEAT, _nextSendID);
+            if (writeToPath(path, packet, length)) logSentMessage();
+        }
+    }
+}
+
+void Channel::multipathReadyRead(Path *path) {  //PRIVATE
+    SocketAddress address;
+    qint64 status;
+    while (path->socket->hasPendingDatagrams()) {
+        setReceiveTime(monotonicNSecs());
+        status = path->socket->readDatagram(_receiveBuffer, MAX_MESSAGE_LENGTH + UDP_HEADER_SIZE, &address.host, &address.port);
+        if (status < UDP_HEADER_SIZE) continue;
+        MessageType type = static_cast<MessageType>(_receiveBuffer[0]);
+        MessageID ID = Util::deserialize<MessageID>(_receiveBuffer + 1);
+        const char *message = _receiveBuffer + UDP_HEADER_SIZE;
+        MessageSize size = status - UDP_HEADER_SIZE;
+
+        //handshakes on an extra path only register that path, the connection itself
+        //is established and reset over the primary path
+        if (_isServer && (type == MSGTYPE_CLIENT_HANDSHAKE)) {
+            if (!compareHandshake(message, size)) continue;
+            path->remoteAddress = address;
+            path->verified = true;
+            path->lastReceiveTime = _receiveTime;
+            char packet[UDP_HEADER_SIZE + 64];
+            int length = writePacket(packet, _nameUtf8, (MessageSize)_nameUtf8Size, MSGTYPE_SERVER_HANDSHAKE, _nextSendID);
+            if (writeToPath(path, packet, length)) logSentMessage();
+            continue;
+        }
+        if (address != path->remoteAddress) continue;
+        if (type == MSGTYPE_SERVER_HANDSHAKE) {
+            if (!_isServer && compareHandshake(message, size)) {
+                if (!path->verified) {
+                    LOG_I(LOG_TAG, "Path " + QString::number(_paths.indexOf(path)) + " joined the connection");
+                }
+                path->verified = true;
+                path->lastReceiveTime = _receiveTime;
+            }
+            continue;
+        }
+        if (!path->verified) continue;
+        notePathReceive(path, type, ID, message);
+        if ((_state != ConnectedState) || isMultipathDuplicate(ID)) continue;
+        _bytesDown += status;
+        processBufferedMessage(type, ID, message, size, _peerAddress);
+    }
+}
+
+/*  Multi-peer server mode
+ ***************************************************************************
+ ***************************************************************************
+ ***************************************************************************/
+
+int Channel::writePacket(char *buffer, const char *message, MessageSize size, MessageType type, MessageID ID) const {    //PRIVATE
+    if (_protocol == UdpProtocol) {
+        buffer[0] = static_cast<char>(type);
+        Util::serialize<MessageID>(buffer + 1, ID);
+        memcpy(buffer + UDP_HEADER_SIZE, message, (size_t)size);
+        return size + UDP_HEADER_SIZE;
+    }
+    MessageSize newSize = size + TCP_HEADER_SIZE;
+    Util::serialize<MessageSize>(buffer, newSize);
+    buffer[sizeof(MessageSize)] = static_cast<char>(type);
+    Util::serialize<MessageID>(buffer + sizeof(MessageSize) + 1, ID);
+    memcpy(buffer + TCP_HEADER_SIZE, message, (size_t)size);
+    return newSize;
+}
+
+bool Channel::writeToPeer(PeerSession *session, const char *packet, int length) { //PRIVATE
+    qint64 status;
+    if (_protocol == UdpProtocol) {
+        status = _udpSocket->writeDatagram(packet, length, session->address.host, session->address.port);
+    }
+    else if (session->tcpSocket != nullptr) {
+        status = session->tcpSocket->write(packet, length);
+    }
+    else {
+        return false;
+    }
+    if (status <= 0) {
+        LOG_W(LOG_TAG, "Could not send message to peer " + session->address.toString() + " (status=" + QString::number(status) + ")");
+        return false;
+    }
+    session->messagesUp++;
+    session->bytesUp += status;
+    return true;
+}
+
+void Channel::logSentMessage() {   //PRIVATE
+    _lastSendTime = monotonicMSecs();
+    _sentTimeLog[_sentTimeLogIndex] = _lastSendTime;
+    _messagesUp++;
+    _nextSendID++;
+    _sentTimeLogIndex++;
+    if (_sentTimeLogIndex >= SENT_LOG_CAP) {
+        _sentTimeLogIndex = 0;
+    }
+}
+
+void Channel::logPeerSentMessage(PeerSession *session) {   //PRIVATE
+    _lastSendTime = monotonicMSecs();
+    session->sentTimeLog[session->sentTimeLogIndex] = _lastSendTime;
+    _messagesUp++;
+    session->nextSendID++;
+    session->sentTimeLogIndex++;
+    if (session->sentTimeLogIndex >= SENT_LOG_CAP) {
+        session->sentTimeLogIndex = 0;
+    }
+}
+
+bool Channel::sendToPeer(PeerSession *session, const char *message, MessageSize size, MessageType type) { //PRIVATE
+    int length = writePacket(_sendBuffer, message, size, type, session->nextSendID);
+    if (!writeToPeer(session, _sendBuffer, length)) return false;
+    _bytesUp += length;
+    logPeerSentMessage(session);
+    return true;
+}
+
+int Channel::broadcastInternal(const char *message, MessageSize size, MessageType type, PeerSession *exclude) {  //PRIVATE
+    if (_peers.isEmpty()) return 0;
+    //frame the message once, then only rewrite the ID for each peer
+    int length = writePacket(_sendBuffer, message, size, type, 0);
+    char *id = _sendBuffer + (_protocol == UdpProtocol ? 1 : sizeof(MessageSize) + 1);
+    int count = 0;
+    foreach (PeerSession *session, _peers) {
+        if (!session->verified || (session == exclude)) continue;
+        Util::serialize<MessageID>(id, session->nextSendID);
+        if (writeToPeer(session, _sendBuffer, length)) {
+            logPeerSentMessage(session);
+            count++;
+        }
+    }
+    _bytesUp += length * count;
+    return count;
+}
+
+bool Channel::sendMessageToPeer(const SocketAddress &peer, const char *message, MessageSize size) {
+    if (!_isMultiPeer) {
+        LOG_E(LOG_TAG, "sendMessageToPeer() called on a channel that is not a multi-peer server");
+        return false;
+    }
+    PeerSession *session = _peers.value(peer, nullptr);
+    if (!session || !session->verified) {
+        return false;
+    }
+    if (size > MAX_MESSAGE_LENGTH) {
+        LOG_W(LOG_TAG, "Attempted to send a message that is too long, it will be truncated");
+        size = MAX_MESSAGE_LENGTH;
+    }
+    return sendToPeer(session, message, size, MSGTYPE_NORMAL);
+}
+
+int Channel::broadcastMessage(const char *message, MessageSize size, const SocketAddress &exclude) {
+    if (!_isMultiPeer) {
+        LOG_E(LOG_TAG, "broadcastMessage() called on a channel that is not a multi-peer server");
+        return 0;
+    }
+    if (size > MAX_MESSAGE_LENGTH) {
+        LOG_W(LOG_TAG, "Attempted to send a message that is too long, it will be truncated");
+        size = MAX_MESSAGE_LENGTH;
+    }
+    return broadcastInternal(message, size, MSGTYPE_NORMAL, _peers.value(exclude, nullptr));
+}
+
+Channel::PeerSession* Channel::addPeer(const SocketAddress &address, QTcpSocket *tcpSocket) {  //PRIVATE
+    PeerSession *session = new PeerSession;
+    session->address = address;
+    session->tcpSocket = tcpSocket;
+    session->connectionEstablishedTime = monotonicMSecs();
+    session->lastReceiveTime = session->connectionEstablishedTime;
+    session->sentTimeLog.fill(0, SENT_LOG_CAP);
+    _peers.insert(address, session);
+    if (tcpSocket) {
+        _tcpPeers.insert(tcpSocket, session);
+        tcpSocket->setSocketOption(QAbstractSocket::LowDelayOption, _lowDelaySocketOption);
+        connect(tcpSocket, &QAbstractSocket::readyRead, this, [this, tcpSocket]() {
+            PeerSession *session = _tcpPeers.value(tcpSocket, nullptr);
+            if (session) multiPeerTcpReadyRead(session);
+        });
+        connect(tcpSocket, &QAbstractSocket::disconnected, this, [this, tcpSocket]() {
+            PeerSession *session = _tcpPeers.value(tcpSocket, nullptr);
+            if (session) {
+                LOG_I(LOG_TAG, "TCP peer " + session->address.toString() + " has disconnected");
+                removePeer(session);
+            }
+        });
+    }
+    LOG_I(LOG_TAG, "Peer " + address.toString() + " added to session table (" + QString::number(_peers.size()) + " sessions)");
+    return session;
+}
+
+void Channel::removePeer(PeerSession *session, bool notify) {    //PRIVATE
+    _peers.remove(session->address);
+    if (session->tcpSocket) {
+        _tcpPeers.remove(session->tcpSocket);
+        disconnect(session->tcpSocket, 0, this, 0);
+        session->tcpSocket->abort();
+        //we may be inside one of this socket's signals
+        session->tcpSocket->deleteLater();
+    }
+    bool wasVerified = session->verified;
+    SocketAddress address = session->address;
+    delete session;
+    if (wasVerified && notify) {
+        LOG_I(LOG_TAG, "Peer " + address.toString() + " removed from session table");
+        emit peerDisconnected(address);
+        if (getPeerCount() == 0) {
+            setChannelState(ConnectingState, false);
+        }
+    }
+}
+
+void Channel::clearPeers(bool notify) {    //PRIVATE
+    while (!_peers.isEmpty()) {
+        removePeer(_peers.begin().value(), notify);
+    }
+}
+
+void Channel::monitorPeers() {  //PRIVATE
+    qint64 now = monotonicMSecs();
+    QList<PeerSession*> stale;
+    foreach (PeerSession *session, _peers) {
+        if (now - session->lastReceiveTime >= IDLE_CONNECTION_TIMEOUT) {
+            stale.append(session);
+        }
+    }
+    foreach (PeerSession *session, stale) {
+        LOG_E(LOG_TAG, "Peer " + session->address.toString() + " has stopped responding, dropping it");
+        removePeer(session);
+    }
+    if (now - _lastSendTime >= HEARTBEAT_INTERVAL) {
+        //one heartbeat is framed and written to every peer
+        broadcastInternal("\0", 0, MSGTYPE_HEARTBEAT, nullptr);
+    }
+}
+
+void Channel::multiPeerUdpReadyRead() { //PRIVATE
+    SocketAddress address;
+    qint64 status;
+    while (hasPendingUdpDatagrams()) {
+        status = readUdpDatagram(_receiveBuffer, MAX_MESSAGE_LENGTH + UDP_HEADER_SIZE, &address);
+        if (status < 0) {
+            //no datagrams were left, or an error occurred reading from the socket
+            //which the onSocketError slot will handle
+            return;
+        }
+        if (status < UDP_HEADER_SIZE) continue;
+        MessageType type = static_cast<MessageType>(_receiveBuffer[0]);
+        PeerSession *session = _peers.value(address, nullptr);
+        if (!session) {
+            if (type != MSGTYPE_CLIENT_HANDSHAKE) {
+                LOG_D(LOG_TAG, "Received non-handshake UDP packet from unknown peer");
+                continue;
+            }
+            if (_peers.size() >= _maxPeers) {
+                LOG_W(LOG_TAG, "Ignoring handshake from " + address.toString() + ", peer table is full");
+                continue;
+            }
+            session = addPeer(address, nullptr);
+        }
+        session->bytesDown += status;
+        _bytesDown += status;
+        MessageID ID = Util::deserialize<MessageID>(_receiveBuffer + 1);
+        processPeerMessage(session, type, ID, _receiveBuffer + UDP_HEADER_SIZE, status - UDP_HEADER_SIZE);
+    }
+}
+
+void Channel::multiPeerTcpReadyRead(PeerSession *session) { //PRIVATE
+    QTcpSocket *socket = session->tcpSocket;
+    qint64 status;
+    while (socket->bytesAvailable() > 0) {
+        if (session->receiveBufferLength < TCP_HEADER_SIZE) {
+            status = socket->read(session->receiveBuffer + session->receiveBufferLength, TCP_HEADER_SIZE - session->receiveBufferLength);
+            if (status < 0) return;
+            session->receiveBufferLength += status;
+        }
+        if (session->receiveBufferLength >= TCP_HEADER_SIZE) {
+            MessageSize length = Util::deserialize<MessageSize>(session->receiveBuffer);
+            if ((length > MAX_MESSAGE_LENGTH + TCP_HEADER_SIZE) || (length < TCP_HEADER_SIZE)) {
+                LOG_W(LOG_TAG, "TCP peer " + session->address.toString() + " sent a message with an invalid header (length=" + QString::number(length) + ")");
+                removePeer(session);
+                return;
+            }
+            status = socket->read(session->receiveBuffer + session->receiveBufferLength, length - session->receiveBufferLength);
+            if (status < 0) {
+                session->receiveBufferLength = 0;
+                return;
+            }
+            session->receiveBufferLength += status;
+            if (session->receiveBufferLength == length) {
+                session->bytesDown += length;
+                _bytesDown += length;
+                MessageType type = static_cast<MessageType>(session->receiveBuffer[sizeof(MessageSize)]);
+                MessageID ID = Util::deserialize<MessageID>(session->receiveBuffer + sizeof(MessageSize) + 1);
+                session->receiveBufferLength = 0;
+                setReceiveTime(monotonicNSecs());
+                processPeerMessage(session, type, ID, session->receiveBuffer + TCP_HEADER_SIZE, length - TCP_HEADER_SIZE);
+                //processing may have removed the session
+                if (!_tcpPeers.contains(socket)) return;
+            }
+        }
+    }
+}
+
+void Channel::processPeerMessage(PeerSession *session, MessageType type, MessageID ID, const char *message, MessageSize size) {   //PRIVATE
+    qint64 now = _receiveTime;
+    switch (type) {
+    case MSGTYPE_NORMAL:
+        if (!session->verified) {
+            LOG_D(LOG_TAG, "Received normal packet from unverified peer " + session->address.toString());
+            return;
+        }
+        if ((ID > session->lastReceiveID) | !_dropOldPackets) {
+            session->lastReceiveTime = now;
+            session->lastReceiveID = ID;
+            _messagesDown++;
+            SocketAddress address = session->address;
+            emit peerMessageReceived(address, message, size);
+            emit messageReceived(message, size);
+            //the session may have been removed by a slot connected to the signals above
+            if (!_peers.contains(address)) return;
+        }
+        break;
+    case MSGTYPE_CLIENT_HANDSHAKE:
+        LOG_D(LOG_TAG, "Received client handshake packet " + QString::number(ID) + " from " + session->address.toString());
+        if (compareHandshake(message, size)) {
+            bool isNew = !session->verified;
+            session->verified = true;
+            session->lastReceiveTime = now;
+            session->lastReceiveID = ID;
+            if (isNew) {
+                session->connectionEstablishedTime = now;
+            }
+            if (_protocol == UdpProtocol) {
+                //the client keeps sending handshakes until it gets a response, so always respond
+                sendToPeer(session, _nameUtf8, (MessageSize)_nameUtf8Size, MSGTYPE_SERVER_HANDSHAKE);
+            }
+            if (isNew) {
+                _wasConnected = true;
+                LOG_I(LOG_TAG, "Peer " + session->address.toString() + " has connected ("
+                      + QString::number(getPeerCount()) + " peers)");
+                if (_state != ConnectedState) {
+                    _connectionEstablishedTime = now;
+                    setChannelState(ConnectedState, false);
+                }
+                emit peerConnected(session->address);
+            }
+        }
+        else {
+            LOG_W(LOG_TAG, "Received client handshake with invalid channel name from " + session->address.toString());
+            if (!session->verified) removePeer(session);
+        }
+        return; //don't calculate statistics on handshake messages
+    case MSGTYPE_HEARTBEAT:
+        session->lastReceiveTime = now;
+        break;
+    case MSGTYPE_ACK: {
+        session->lastReceiveTime = now;
+        int time = now - session->lastAckReceiveTime;
+        session->lastAckReceiveTime = now;
+        if (time != 0) {
+            session->dataRateUp = (session->bytesUp * (100000 / time)) / 100;
+            session->dataRateDown = (session->bytesDown * (100000 / time)) / 100;
+        }
+        session->bytesUp = 0;
+        session->bytesDown = 0;
+        int rtt = rttFromLog(session->sentTimeLog.constData(), session->sentTimeLogIndex, session->nextSendID,
+                             Util::deserialize<MessageID>(message), now);
+        if (rtt >= 0) {
+            session->lastRtt = rtt;
+            _lastRtt = rtt;
+        }
+        break;
+    }
+    case MSGTYPE_SERVER_HANDSHAKE:
+    case MSGTYPE_PROBE:
+    case MSGTYPE_PROBE_REQUEST:
+        //valid types that carry nothing for a peer session
+        LOG_D(LOG_TAG, "Ignoring message type " + QString::number(type) + " from peer " + session->address.toString());
+        return;
+    default:
+        LOG_E(LOG_TAG, "Peer " + session->address.toString() + " sent a message with an invalid header (type=" + QString::number(type) + ")");
+        removePeer(session);
+        return;
+    }
+    if (!session->verified) return;
+    session->messagesDown++;
+    //ack each peer individually so it can calculate its own RTT
+    if (_sendAcks && (now - session->lastAckSendTime >= STATISTICS_INTERVAL)) {
+        session->lastAckSendTime = now;
+        char ack[sizeof(MessageID)];
+        Util::serialize<MessageID>(ack, ID);
+        sendToPeer(session, ack, sizeof(MessageID), MSGTYPE_ACK);
+    }
+}
+
 }
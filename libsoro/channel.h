@@ -7,9 +7,12 @@
 #include "soro_global.h"
 #include "constants.h"
 #include "socketaddress.h"
+#include "latencyhistogram.h"
 
 namespace Soro {
 
+class KernelDatagramReader;
+
 /* The Channel class is the core networking component in the Sooner Rover project.
  *
  * Channels abstract over message-based internet communication in a super easy way,
@@ -37,6 +40,12 @@ namespace Soro {
  * The ID field uniquely identifies all messages sent by this endpoint. The ID value
  * increases (newer messages have higher IDs), so they also function an a sequence number
  * in UDP mode.
+ *
+ * A server channel normally accepts exactly one peer. A channel created with createMultiPeerServer()
+ * instead keeps a session table keyed by peer address, and serves every connected peer from
+ * the same socket (or TCP listener) and the same set of timers. Messages sent with sendMessage()
+ * are framed once and written to every peer, and the ID counter and sent time log are shared
+ * between peers so a broadcast does not need to be reserialized for each one.
  */
 class LIBSORO_EXPORT Channel: public QObject {
     Q_OBJECT
@@ -53,6 +62,8 @@ private:
     static const MessageType MSGTYPE_SERVER_HANDSHAKE = 2;
     static const MessageType MSGTYPE_HEARTBEAT = 3;
     static const MessageType MSGTYPE_ACK = 4;
+    static const MessageType MSGTYPE_PROBE = 5;
+    static const MessageType MSGTYPE_PROBE_REQUEST = 6;
 
     static const MessageSize TCP_HEADER_SIZE = sizeof(MessageSize) + sizeof(MessageID) + 1;
     static const MessageSize UDP_HEADER_SIZE = sizeof(MessageID) + 1;
@@ -82,6 +93,24 @@ public:
                     //This is usually do to invalid configuration (specifying an unbindable port or host)
     };
 
+    /* How messages are sent when a UDP channel has more than one path
+     */
+    enum MultipathMode {
+        DuplicateMultipath, //Every message is sent on every verified path, duplicates are dropped on receive
+        FailoverMultipath   //Normal messages only use the best path, control messages use every path
+    };
+
+    /* Statistics for one path of a multipath channel. Path 0 is always the primary socket.
+     */
+    struct PathStatistics {
+        QHostAddress localAddress;
+        SocketAddress remoteAddress;
+        bool up = false;
+        int lastRtt = -1;
+        int lossPercent = -1;
+        quint64 messagesDown = 0;
+    };
+
     //The maximum size of a sent message (the header may make the actual message
     //slighty larger)
     static const MessageSize MAX_MESSAGE_LENGTH = 500;
@@ -91,6 +120,12 @@ public:
     static Channel* createServer(QObject *parent, quint16 port, QString name, Protocol protocol,
              QHostAddress hostAddress = QHostAddress::Any);
 
+    /* Creates a new channel to act as the server end point for communication with
+     * any number of clients at once. All peers share a single socket and timer set.
+     */
+    static Channel* createMultiPeerServer(QObject *parent, quint16 port, QString name, Protocol protocol,
+             QHostAddress hostAddress = QHostAddress::Any);
+
     /* Creates a new channel to act as the client end point for communication
      */
     static Channel* createClient(QObject *parent, SocketAddress serverAddress, QString name, Protocol protocol,
@@ -106,10 +141,44 @@ public:
      */
     Channel::Protocol getProtocol() const;
 
-    /* Gets the address of the currently connected peer
+    /* Statistics for one peer of a multi-peer server channel
+     */
+    struct PeerStatistics {
+        SocketAddress address;
+        qint64 connectionEstablishedTime = 0;
+        int lastRtt = -1;
+        quint64 messagesUp = 0;
+        quint64 messagesDown = 0;
+        int bitsPerSecondUp = 0;
+        int bitsPerSecondDown = 0;
+    };
+
+    /* Gets the address of the currently connected peer. For a multi-peer server
+     * this will always be null, use getPeers() instead.
      */
     SocketAddress getPeerAddress() const;
 
+    /* Returns true if this channel was created with createMultiPeerServer()
+     */
+    bool isMultiPeer() const;
+
+    /* Gets the number of verified peers connected to a multi-peer server
+     */
+    int getPeerCount() const;
+
+    /* Gets the addresses of all verified peers connected to a multi-peer server
+     */
+    QList<SocketAddress> getPeers() const;
+
+    /* Gets the statistics for a connected peer of a multi-peer server. If the peer is
+     * not connected, the returned address will be null.
+     */
+    PeerStatistics getPeerStatistics(const SocketAddress &peer) const;
+
+    /* Sets the maximum number of peers a multi-peer server will accept (default 64)
+     */
+    void setMaxPeers(int maxPeers);
+
     /* Opens the channel and attempts to connect. This may not have an
      * immediate effect if the channel is receiving its configuration from
      * a network resource
@@ -128,6 +197,15 @@ public:
         return sendMessage(message.constData(), message.size());
     }
 
+    /* Sends a message to a single peer of a multi-peer server
+     */
+    bool sendMessageToPeer(const SocketAddress &peer, const char *message, Channel::MessageSize size);
+
+    /* Sends a message to every peer of a multi-peer server except the one specified.
+     * Returns the number of peers the message was written to.
+     */
+    int broadcastMessage(const char *message, Channel::MessageSize size, const SocketAddress &exclude);
+
     /* Returns true if this channel object acts as the server side
      */
     bool isServer() const;
@@ -169,6 +247,63 @@ public:
 
     void setLowDelaySocketOption(bool lowDelay);
 
+    /* Uses kernel receive timestamps (SO_TIMESTAMPNS) for UDP datagrams instead of the time the
+     * event loop got to them, and enables kernel drop reporting (SO_RXQ_OVFL). Linux only.
+     */
+    void setUseKernelTimestamps(bool useKernelTimestamps);
+
+    /* Gets the smoothed time in microseconds between the kernel receiving a datagram and
+     * this channel processing it. Only measured when kernel timestamps are enabled.
+     */
+    int getReceiveSchedulingLatency() const;
+
+    /* Gets the number of datagrams the kernel has dropped because the socket receive
+     * buffer was full. Only measured when kernel timestamps are enabled.
+     */
+    quint32 getKernelDroppedPackets() const;
+
+    /* Gets the percentage of the UDP socket receive buffer that is currently in use,
+     * or -1 if it cannot be determined
+     */
+    int getReceiveBufferUsage() const;
+
+    /* Enables low latency mode on a UDP channel. This sets busy polling and a small receive buffer on
+     * the socket, enables kernel timestamps and records wake-up latency (kernel receive to processing)
+     * in a histogram.
+     */
+    void setLowLatencyMode(bool lowLatency);
+
+    /* Gets the wake-up latency histogram recorded in low latency mode
+     */
+    const LatencyHistogram& getWakeupLatencyHistogram() const;
+    void resetWakeupLatencyHistogram();
+
+    /* Adds an extra path to a UDP channel, bound to another local address (usually a second
+     * network interface). A client must specify the server's address on that path; a server
+     * binds to its port on the local address and learns the client's address from its handshake.
+     * Must be called before open(). The connection itself is established over the primary path,
+     * after which it survives the loss of any one path without reconnecting.
+     */
+    bool addPath(QHostAddress localAddress, SocketAddress remoteAddress = SocketAddress(QHostAddress::Null, 0));
+
+    void setMultipathMode(Channel::MultipathMode mode);
+
+    /* Takes an extra path out of use (closing its socket) or puts it back, for example when its
+     * interface is known to be bad. The primary path (0) cannot be disabled.
+     */
+    bool setPathEnabled(int path, bool enabled);
+
+    /* Gets the statistics for every path, including the primary one, or an empty
+     * list if this channel has no extra paths
+     */
+    QList<Channel::PathStatistics> getPathStatistics() const;
+
+    /* Asks the other side to send a train of back to back probe packets, which is used to
+     * estimate the bottleneck capacity of the link in that direction. The result is reported
+     * through the probeTrainReceived() signal. Only meaningful on UDP channels.
+     */
+    bool requestProbeTrain(int count, int packetSize);
+
     /* Returns true if this channel is or was connected to a peer
      * at some point
      */
@@ -183,6 +318,30 @@ private:
         qint64 len;
     };
 
+    // Per-peer session state for multi-peer server mode
+    struct PeerSession {
+        SocketAddress address;
+        QTcpSocket *tcpSocket = nullptr;
+        char receiveBuffer[1024];
+        MessageSize receiveBufferLength = 0;
+        bool verified = false;
+        MessageID lastReceiveID = 0;
+        MessageID nextSendID = 1;   //IDs are counted per peer, so a unicast leaves no gap at the others
+        QVector<qint64> sentTimeLog;
+        int sentTimeLogIndex = 0;
+        qint64 connectionEstablishedTime = 0;
+        qint64 lastReceiveTime = 0;
+        qint64 lastAckSendTime = 0;
+        qint64 lastAckReceiveTime = 0;
+        quint64 messagesUp = 0;
+        quint64 messagesDown = 0;
+        quint64 bytesUp = 0;
+        quint64 bytesDown = 0;
+        int dataRateUp = 0;
+        int dataRateDown = 0;
+        int lastRtt = -1;
+    };
+
     char _receiveBuffer[1024];  //buffer for received messages
     char _sendBuffer[1024]; //buffer for constructing messages to send
     MessageSize _receiveBufferLength; //length of currently stored data in the receive buffer
@@ -213,15 +372,20 @@ private:
     Protocol _protocol; //Protocol used by the channel (UDP or TCP)
 
     bool _isServer;         //Holders for configuration preferences
+    bool _isMultiPeer = false;
+    int _maxPeers = 64;
     bool _dropOldPackets = true;
     bool _sendAcks = true;
     int _lowDelaySocketOption = false;
+    bool _useKernelTimestamps = false;
+    bool _lowLatencyMode = false;
     bool _configured = false;
     bool _wasConnected = false;
 
     QTcpSocket *_tcpSocket = nullptr; //Currently active TCP socket
     QTcpServer *_tcpServer = nullptr; //Currently active TCP server (for registering TCP clients)
     QUdpSocket *_udpSocket = nullptr; //Currently active UDP socket
+    KernelDatagramReader *_kernelReader = nullptr; //Reads the UDP socket when kernel timestamps are used
     QAbstractSocket *_socket = nullptr;   //Pointer to either the TCP or UDP socket, depending on the configuration
 
     MessageID _nextSendID; //ID to mark the next message with
@@ -235,15 +399,56 @@ private:
     int _dataRateUp;
     int _dataRateDown;
 
+    qint64 _receiveTime = 0;    //Receive time (monotonic) of the message currently being processed
+    qint64 _receiveTimeNs = 0;
+    int _schedulingLatency = 0;
+    quint32 _kernelDroppedPackets = 0;
+    LatencyHistogram _wakeupLatency;
+
+    QHash<SocketAddress, PeerSession*> _peers; //Session table for multi-peer server mode
+    QHash<QTcpSocket*, PeerSession*> _tcpPeers;
+
     int _connectionMonitorTimerID = TIMER_INACTIVE;  //Timer ID's for repeatedly executed tasks and watchdogs
     int _handshakeTimerID = TIMER_INACTIVE;
     int _resetTimerID = TIMER_INACTIVE;
     int _resetTcpTimerID = TIMER_INACTIVE;
 
-    qint64 _lastReceiveTime = QDateTime::currentMSecsSinceEpoch(); //Last time a message was received
-    qint64 _lastSendTime = QDateTime::currentMSecsSinceEpoch();
-    qint64 _lastAckReceiveTime = QDateTime::currentMSecsSinceEpoch();
-    qint64 _lastAckSendTime = QDateTime::currentMSecsSinceEpoch();
+    // State for one path of a multipath channel
+    struct Path {
+        QUdpSocket *socket = nullptr;   //null for the primary path, which uses _udpSocket
+        QHostAddress localAddress;
+        SocketAddress remoteAddress = SocketAddress(QHostAddress::Null, 0);
+        bool enabled = true;
+        bool verified = false;
+        bool up = false;
+        qint64 lastReceiveTime = 0;
+        qint64 lastSendTime = 0;
+        int lastRtt = -1;
+        int lossPercent = -1;
+        quint64 messagesDown = 0;
+        quint64 windowReceived = 0;     //Loss window, in peer message IDs
+        MessageID windowFirstID = 0;
+        MessageID windowLastID = 0;
+    };
+
+    QList<Path*> _paths;    //Empty unless addPath() has been called
+    MultipathMode _multipathMode = DuplicateMultipath;
+    MessageID _multipathHighestID = 0;  //Duplicate detection window for multipath receive
+    quint64 _multipathSeenMask = 0;
+    qint64 _lastPathMaintenanceTime = 0;
+
+    quint32 _nextProbeTrain = 0;    //Probe train state
+    quint32 _probeTrain = 0;
+    int _probeReceived = 0;
+    int _probeBytes = 0;
+    int _probeFirstIndex = 0;
+    qint64 _probeStartTime = 0;
+    qint64 _probeEndTime = 0;
+
+    qint64 _lastReceiveTime = 0; //Last time a message was received (monotonic)
+    qint64 _lastSendTime = 0;
+    qint64 _lastAckReceiveTime = 0;
+    qint64 _lastAckSendTime = 0;
 
     inline void setChannelState(State state, bool forceUpdate);  //Internal method to set the channel status and
                                                           //emit the statusChanged signal
@@ -282,6 +487,71 @@ private:
 
     void setName(QString name); //sets the name of the channel
 
+    int writePacket(char *buffer, const char *message, MessageSize size, MessageType type, MessageID ID) const;
+                                                        //Frames a message into buffer, returns the framed length
+
+    bool writeToPeer(PeerSession *session, const char *packet, int length); //Writes an already framed packet to one peer
+
+    void configureKernelTimestamps();   //Applies the kernel timestamp socket options to the UDP socket
+
+    void configureLowLatency(); //Applies the low latency socket options
+
+    bool hasPendingUdpDatagrams() const;   //True if the UDP socket may have datagrams to read
+
+    qint64 readUdpDatagram(char *data, qint64 maxSize, SocketAddress *address);
+                                                        //Reads a datagram and sets the receive time from it
+
+    inline void setReceiveTime(qint64 nsecs);  //Sets the receive time of the message being processed
+
+    int rttForAck(MessageID ackID, qint64 receiveTime) const;  //Looks up the sent time of an acked message
+
+    int rttFromLog(const qint64 *log, int logIndex, MessageID nextID, MessageID ackID, qint64 receiveTime) const;
+
+    qint64 sendMultipath(const char *packet, int length, MessageType type); //Writes a framed packet to the paths
+                                                                            //selected by the multipath mode
+
+    bool writeToPath(Path *path, const char *packet, int length);
+
+    int getBestPath() const;    //Index of the path normal messages should use in failover mode
+
+    bool isMultipathDuplicate(MessageID ID);
+
+    void notePathReceive(Path *path, MessageType type, MessageID ID, const char *message);
+
+    void resetPaths();  //Rebinds extra path sockets and clears their state
+
+    void maintainPaths(qint64 now); //Per-path heartbeats, handshakes, liveness and loss, called by the monitor timer
+
+    void multipathReadyRead(Path *path);
+
+    void sendProbeTrain(int count, int packetSize);
+
+    void processProbe(const char *message, MessageSize size);   //Times a received probe packet, reports the train once its last packet arrives
+
+    void logSentMessage();  //Records the send time of the current ID and advances it
+
+    void logPeerSentMessage(PeerSession *session);  //Same for a peer's own ID and log
+
+    bool sendToPeer(PeerSession *session, const char *message, MessageSize size, MessageType type);
+                                                        //Frames and sends a message to one peer of a multi-peer server
+
+    int broadcastInternal(const char *message, MessageSize size, MessageType type, PeerSession *exclude);
+                                                        //Frames a message once and sends it to all verified peers
+
+    void processPeerMessage(PeerSession *session, MessageType type, MessageID ID,
+                                const char *message, MessageSize size);  //Processes a message from a multi-peer session
+
+    PeerSession* addPeer(const SocketAddress &address, QTcpSocket *tcpSocket);  //Adds a new session to the peer table
+
+    void removePeer(PeerSession *session, bool notify = true);  //Removes a session from the peer table and cleans it up, notify=false emits no signals
+
+    void clearPeers(bool notify = true);  //Removes all peer sessions
+
+    void monitorPeers();    //Drops stale peers and sends heartbeats, called by the connection monitor timer
+
+    void multiPeerUdpReadyRead();
+    void multiPeerTcpReadyRead(PeerSession *session);
+
 private slots:
     void udpReadyRead();
     void tcpReadyRead();
@@ -311,6 +581,23 @@ signals: //Always public
 
     void connectionError(QAbstractSocket::SocketError err);
 
+    /* Signals emitted by a multi-peer server when a peer completes its handshake,
+     * disconnects or times out, and when a message is received from a specific peer.
+     * messageReceived() is also emitted for every received message.
+     */
+    void peerConnected(const SocketAddress &peer);
+    void peerDisconnected(const SocketAddress &peer);
+    void peerMessageReceived(const SocketAddress &peer, const char *message, Channel::MessageSize size);
+
+    /* Signal emitted when one path of a multipath channel goes up or down
+     */
+    void pathStateChanged(int path, bool up);
+
+    /* Signal emitted when a requested probe train has been received, with the estimated
+     * capacity of the link and the percent of the train that was lost
+     */
+    void probeTrainReceived(qint64 bitsPerSecond, int lossPercent);
+
 protected:
     void timerEvent(QTimerEvent *);
 
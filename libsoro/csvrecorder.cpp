@@ -19,6 +19,7 @@
 
 #include <QCoreApplication>
 #include <QDir>
+#include <QFile>
 
 #define LOG_TAG "CsvRecorder"
 
@@ -41,6 +42,8 @@ void CsvDataSeries::update(QVariant value) {
 
 CsvRecorder::CsvRecorder(QObject *parent) : QObject(parent) {
     _updateInterval = 100;
+    _writer = new StorageWriter(this);
+    connect(_writer, &StorageWriter::error, this, &CsvRecorder::writerError);
 }
 
 bool CsvRecorder::startLog(QDateTime loggedStartTime) {
@@ -58,22 +61,19 @@ bool CsvRecorder::startLog(QDateTime loggedStartTime) {
 
     _logStartTime = loggedStartTime.toMSecsSinceEpoch();
     filePath += "/" + QString::number(_logStartTime) + ".csv";
-    _file = new QFile(filePath, this);
 
-    if (_file->exists()) {
+    if (QFile::exists(filePath)) {
         LOG_W(LOG_TAG, "File \'" + filePath + "\' already exists, overwriting it");
     }
-    if (_file->open(QIODevice::WriteOnly)) {
-        _fileStream = new QTextStream(_file);
+    if (_writer->open(filePath)) {
+        _filePath = filePath;
         // Write header to file
-        *_fileStream << "Recording started at " << loggedStartTime.toString() << "\n";
-        *_fileStream << "Rows in this file were updated every " << _updateInterval << " milleseconds\n";
-        *_fileStream << "\n";
-
-        foreach (const CsvDataSeries* column, _columns) {
-            *_fileStream << column->getSeriesName() << "," << column->getSeriesName() << " (timestamp),";
-        }
-        *_fileStream << "\n";
+        QString header;
+        header += "Recording started at " + loggedStartTime.toString() + "\n";
+        header += "Rows in this file were updated every " + QString::number(_updateInterval) + " milleseconds\n";
+        header += "\n";
+        header += getColumnHeader() + "\n";
+        _writer->write(header.toUtf8());
 
         LOG_I(LOG_TAG, "Starting log " + QString::number(_logStartTime));
         START_TIMER(_updateTimerId, _updateInterval);
@@ -83,8 +83,6 @@ bool CsvRecorder::startLog(QDateTime loggedStartTime) {
     }
     // could not open the file
     LOG_E(LOG_TAG, "Unable to open the specified logfile for write access (" + filePath + ")");
-    delete _file;
-    _file = nullptr;
     _logStartTime = 0;
     return false;
 }
@@ -92,15 +90,9 @@ bool CsvRecorder::startLog(QDateTime loggedStartTime) {
 void CsvRecorder::stopLog() {
     if (_isRecording) {
         KILL_TIMER(_updateTimerId);
-        delete _fileStream;
-        _fileStream = nullptr;
         LOG_I(LOG_TAG, "Ending log " + QString::number(_logStartTime));
-
-        if (_file->isOpen()) {
-            _file->close();
-        }
-        delete _file;
-        _file = nullptr;
+        _writer->close();
+        _filePath = "";
         _isRecording = false;
         _logStartTime = 0;
         emit logStopped();
@@ -115,6 +107,26 @@ const QList<const CsvDataSeries*>& CsvRecorder::getColumns() const {
     return _columns;
 }
 
+QString CsvRecorder::getFilePath() const {
+    return _filePath;
+}
+
+void CsvRecorder::writerError(QString message) {
+    if (_isRecording) {
+        LOG_E(LOG_TAG, "Cannot write log, stopping it: " + message);
+        stopLog();
+        emit logFailed(message);
+    }
+}
+
+QString CsvRecorder::getColumnHeader() const {
+    QString header;
+    foreach (const CsvDataSeries* column, _columns) {
+        header += column->getSeriesName() + "," + column->getSeriesName() + " (timestamp),";
+    }
+    return header;
+}
+
 void CsvRecorder::setUpdateInterval(int interval) {
     if (_isRecording) {
         LOG_E(LOG_TAG, "Cannot change update interval while recording");
@@ -157,17 +169,23 @@ void CsvRecorder::clearColumns() {
 void CsvRecorder::timerEvent(QTimerEvent *e) {
     QObject::timerEvent(e);
 
-    if ((e->timerId() == _updateTimerId) && _fileStream) {
+    if ((e->timerId() == _updateTimerId) && _isRecording) {
+        QString row;
         foreach (const CsvDataSeries *column, _columns) {
             if ((_columnDataTimestamps.value(column) != column->getValueTime()) || column->shouldKeepOldValues()) {
-                *_fileStream << column->getValue().toString() << "," << (column->getValueTime() - _logStartTime) << ",";
+                row += column->getValue().toString() + "," + QString::number(column->getValueTime() - _logStartTime) + ",";
                 _columnDataTimestamps.insert(column, column->getValueTime());
             }
             else {
-                *_fileStream << ",,";
+                row += ",,";
             }
         }
-        *_fileStream << "\n";
+        if (!_writer->write((row + "\n").toUtf8())) {
+            // A dropped row would leave a silent gap in the log
+            writerError("The disk cannot keep up with the log");
+            return;
+        }
+        emit rowRecorded(row);
     }
 }
 
@@ -3,12 +3,11 @@
 
 #include <QDateTime>
 #include <QObject>
-#include <QFile>
-#include <QTextStream>
 #include <QTimerEvent>
 
 #include "soro_global.h"
 #include "constants.h"
+#include "storagewriter.h"
 
 namespace Soro {
 
@@ -49,6 +48,14 @@ public:
     int getUpdateInterval() const;
     const QList<const CsvDataSeries*>& getColumns() const;
 
+    /* Gets the row of column names written at the top of the log
+     */
+    QString getColumnHeader() const;
+
+    /* Gets the path of the current log file, or an empty string if not recording
+     */
+    QString getFilePath() const;
+
 public slots:
     /* Starts logging data in the specified file, and calculates all timestamps offset from
      * the provided start time.
@@ -62,18 +69,27 @@ public slots:
 signals:
     void logStarted(QDateTime loggedStartTime);
     void logStopped();
+    /* Emitted with each row as it is written to the log, without its line ending
+     */
+    void rowRecorded(QString row);
+    /* Emitted when the log can't be written any more and has been stopped
+     */
+    void logFailed(QString message);
 
 protected:
     void timerEvent(QTimerEvent *e);
 
+private slots:
+    void writerError(QString message);
+
 private:
     QList<const CsvDataSeries*> _columns;
     QHash<const CsvDataSeries*, qint64> _columnDataTimestamps;
     int _updateTimerId = TIMER_INACTIVE;
-    QTextStream *_fileStream = nullptr;
-    QString _logDir;
+    // Rows are written from a background thread, so a busy disk doesn't stall the timer
+    StorageWriter *_writer;
+    QString _filePath;
     int _updateInterval;
-    QFile *_file = nullptr;
     qint64 _logStartTime;
     bool _isRecording=false;
 };
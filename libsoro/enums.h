@@ -55,7 +55,13 @@ enum SharedMessageType {
     SharedMessage_Research_RoverDriveOverrideEnd,
 	SharedMessage_Research_StopAllCameraStreams,
     SharedMessage_Research_StartDataRecording,
-    SharedMessage_Research_StopDataRecording
+    SharedMessage_Research_StopDataRecording,
+    SharedMessage_Research_AdjustVideoStream,
+    SharedMessage_BulkTransferOffer,
+    SharedMessage_BulkTransferAck,
+    SharedMessage_BulkTransferChunk,
+    SharedMessage_BulkTransferEnd,
+    SharedMessage_BulkTransferResult
 };
 
 enum RoverSubsystemState {
@@ -0,0 +1,454 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "forwardingengine.h"
+#include "logger.h"
+
+#include <QThread>
+#include <QVector>
+#include <QVarLengthArray>
+#include <QMutexLocker>
+
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_TAG "ForwardingEngine"
+
+// sendmmsg() accepts at most UIO_MAXIOV datagrams per call
+#define FORWARDING_MAX_SEND 1024
+// How long the thread waits for packets before checking whether it should exit
+#define FORWARDING_POLL_TIMEOUT 500
+// Room for the receive timestamp and dropped packet counter of each datagram
+#define FORWARDING_CONTROL_SIZE (CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(quint32)))
+
+namespace Soro {
+
+struct ForwardingDestination {
+    sockaddr_storage address;
+    socklen_t length;
+};
+
+/* A socket being forwarded. The buffer is only used by the engine thread,
+ * everything else is guarded by the engine's mutex.
+ */
+struct ForwardingStream {
+    int handle = -1;
+    int fd = -1;
+    int family = AF_INET;
+    bool removed = false;
+    char *buffer = nullptr;
+    QVector<ForwardingDestination> destinations;
+
+    // Kernel receive queue drop counter, as of the last packet read
+    quint32 overflows = 0;
+    bool overflowsKnown = false;
+
+    // Counters for the current statistics interval
+    qint64 received = 0;
+    qint64 sent = 0;
+    qint64 dropped = 0;
+    qint64 latencyTotal = 0;
+    qint64 latencySamples = 0;
+    qint64 latencyMax = 0;
+};
+
+static bool toDestination(const SocketAddress &address, int family, ForwardingDestination &out) {
+    memset(&out.address, 0, sizeof(out.address));
+    bool isIPv4 = false;
+    quint32 ipv4 = address.host.toIPv4Address(&isIPv4);
+    if (family == AF_INET) {
+        if (!isIPv4) return false;
+        sockaddr_in *in = reinterpret_cast<sockaddr_in*>(&out.address);
+        in->sin_family = AF_INET;
+        in->sin_port = htons(address.port);
+        in->sin_addr.s_addr = htonl(ipv4);
+        out.length = sizeof(sockaddr_in);
+    }
+    else {
+        sockaddr_in6 *in6 = reinterpret_cast<sockaddr_in6*>(&out.address);
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(address.port);
+        if (isIPv4) {
+            // Qt binds QHostAddress::Any as a dual stack socket, which needs IPv4 mapped addresses
+            quint32 networkOrder = htonl(ipv4);
+            in6->sin6_addr.s6_addr[10] = 0xFF;
+            in6->sin6_addr.s6_addr[11] = 0xFF;
+            memcpy(in6->sin6_addr.s6_addr + 12, &networkOrder, sizeof(networkOrder));
+        }
+        else {
+            Q_IPV6ADDR ipv6 = address.host.toIPv6Address();
+            memcpy(in6->sin6_addr.s6_addr, ipv6.c, sizeof(ipv6.c));
+        }
+        out.length = sizeof(sockaddr_in6);
+    }
+    return true;
+}
+
+static QVector<ForwardingDestination> toDestinations(const QList<SocketAddress> &addresses, int family) {
+    QVector<ForwardingDestination> destinations;
+    foreach (SocketAddress address, addresses) {
+        ForwardingDestination destination;
+        if (toDestination(address, family, destination)) {
+            destinations.append(destination);
+        }
+        else {
+            LOG_E(LOG_TAG, "Cannot forward to " + address.toString() + " from an IPv4 socket");
+        }
+    }
+    return destinations;
+}
+
+static qint64 realtimeMicroseconds() {
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (qint64)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* Waits on every stream's socket and forwards whatever arrives
+ */
+class ForwardingEngineThread : public QThread {
+public:
+    ForwardingEngineThread(ForwardingEngine *engine) : _engine(engine) { }
+
+    void stop() {
+        _stopping.store(1);
+    }
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    ForwardingEngine *_engine;
+    QAtomicInt _stopping;
+
+    void forward(ForwardingStream *stream);
+};
+
+void ForwardingEngineThread::run() {
+    QVector<pollfd> fds;
+    QVector<ForwardingStream*> active;
+    while (!_stopping.load()) {
+        fds.clear();
+        active.clear();
+        pollfd wake;
+        wake.fd = _engine->_wakeFd;
+        wake.events = POLLIN;
+        wake.revents = 0;
+        fds.append(wake);
+        {
+            QMutexLocker locker(&_engine->_mutex);
+            foreach (ForwardingStream *stream, _engine->_streams) {
+                if (stream->removed) continue;
+                pollfd fd;
+                fd.fd = stream->fd;
+                fd.events = POLLIN;
+                fd.revents = 0;
+                fds.append(fd);
+                active.append(stream);
+            }
+        }
+
+        if (poll(fds.data(), fds.size(), FORWARDING_POLL_TIMEOUT) > 0) {
+            if (fds[0].revents & POLLIN) {
+                quint64 value;
+                ssize_t result = ::read(_engine->_wakeFd, &value, sizeof(value));
+                Q_UNUSED(result);
+            }
+            for (int i = 0; i < active.size(); i++) {
+                if (fds[i + 1].revents & POLLIN) {
+                    forward(active[i]);
+                }
+            }
+        }
+
+        // Removed streams are only freed here, once this thread is no longer using them
+        QMutexLocker locker(&_engine->_mutex);
+        QMutableHashIterator<int, ForwardingStream*> it(_engine->_streams);
+        while (it.hasNext()) {
+            it.next();
+            if (it.value()->removed) {
+                ::close(it.value()->fd);
+                delete [] it.value()->buffer;
+                delete it.value();
+                it.remove();
+            }
+        }
+    }
+}
+
+void ForwardingEngineThread::forward(ForwardingStream *stream) {
+    mmsghdr messages[FORWARDING_BATCH_SIZE];
+    iovec vectors[FORWARDING_BATCH_SIZE];
+    char control[FORWARDING_BATCH_SIZE][FORWARDING_CONTROL_SIZE];
+    qint64 arrivals[FORWARDING_BATCH_SIZE];
+
+    memset(messages, 0, sizeof(messages));
+    for (int i = 0; i < FORWARDING_BATCH_SIZE; i++) {
+        vectors[i].iov_base = stream->buffer + i * FORWARDING_MAX_PACKET_SIZE;
+        vectors[i].iov_len = FORWARDING_MAX_PACKET_SIZE;
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_control = control[i];
+        messages[i].msg_hdr.msg_controllen = sizeof(control[i]);
+    }
+
+    int count = recvmmsg(stream->fd, messages, FORWARDING_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+    if (count <= 0) return;
+
+    qint64 dropped = 0;
+    quint32 overflows = 0;
+    bool overflowsKnown = false;
+    QList<QByteArray> packets;
+    QVector<qint64> packetArrivals;
+    packets.reserve(count);
+    packetArrivals.reserve(count);
+    for (int i = 0; i < count; i++) {
+        arrivals[i] = -1;
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&messages[i].msg_hdr); cmsg; cmsg = CMSG_NXTHDR(&messages[i].msg_hdr, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET) continue;
+            if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                timespec arrival;
+                memcpy(&arrival, CMSG_DATA(cmsg), sizeof(arrival));
+                arrivals[i] = (qint64)arrival.tv_sec * 1000000 + arrival.tv_nsec / 1000;
+            }
+            else if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+                memcpy(&overflows, CMSG_DATA(cmsg), sizeof(overflows));
+                overflowsKnown = true;
+            }
+        }
+        if (messages[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            // Too large to forward intact
+            vectors[i].iov_len = 0;
+            dropped++;
+            continue;
+        }
+        vectors[i].iov_len = messages[i].msg_len;
+        packets.append(QByteArray(reinterpret_cast<const char*>(vectors[i].iov_base), messages[i].msg_len));
+        packetArrivals.append(arrivals[i]);
+    }
+
+    QVector<ForwardingDestination> destinations;
+    {
+        QMutexLocker locker(&_engine->_mutex);
+        destinations = stream->destinations;
+    }
+
+    // Queue every packet to every destination, then send them together
+    QVarLengthArray<mmsghdr, 256> out;
+    const ForwardingDestination *targets = destinations.constData();
+    for (int d = 0; d < destinations.size(); d++) {
+        for (int i = 0; i < count; i++) {
+            if (vectors[i].iov_len == 0) continue;
+            mmsghdr message;
+            memset(&message, 0, sizeof(message));
+            message.msg_hdr.msg_name = const_cast<sockaddr_storage*>(&targets[d].address);
+            message.msg_hdr.msg_namelen = targets[d].length;
+            message.msg_hdr.msg_iov = &vectors[i];
+            message.msg_hdr.msg_iovlen = 1;
+            out.append(message);
+        }
+    }
+
+    int next = 0;
+    int sent = 0;
+    while (next < out.size()) {
+        int result = sendmmsg(stream->fd, out.data() + next, qMin(out.size() - next, FORWARDING_MAX_SEND), 0);
+        if (result > 0) {
+            next += result;
+            sent += result;
+        }
+        else if (errno == EINTR) {
+            continue;
+        }
+        else if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == ENOBUFS)) {
+            // Send buffer is full, the rest of this batch is lost
+            dropped += out.size() - next;
+            break;
+        }
+        else {
+            // Only this destination refused the datagram
+            dropped++;
+            next++;
+        }
+    }
+    qint64 now = realtimeMicroseconds();
+
+    {
+        QMutexLocker locker(&_engine->_mutex);
+        stream->received += count;
+        stream->sent += sent;
+        stream->dropped += dropped;
+        if (overflowsKnown) {
+            if (stream->overflowsKnown) {
+                stream->dropped += (quint32)(overflows - stream->overflows);
+            }
+            stream->overflows = overflows;
+            stream->overflowsKnown = true;
+        }
+        if (sent > 0) {
+            for (int i = 0; i < count; i++) {
+                if (arrivals[i] < 0) continue;
+                qint64 latency = qMax<qint64>(0, now - arrivals[i]);
+                stream->latencyTotal += latency;
+                stream->latencySamples++;
+                stream->latencyMax = qMax(stream->latencyMax, latency);
+            }
+        }
+    }
+
+    if (!packets.isEmpty()) {
+        emit _engine->packetsReceived(stream->handle, packets, packetArrivals);
+    }
+}
+
+ForwardingEngine::ForwardingEngine(QObject *parent) : QObject(parent) {
+    qRegisterMetaType<QList<QByteArray>>("QList<QByteArray>");
+    qRegisterMetaType<QVector<qint64>>("QVector<qint64>");
+    _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wakeFd < 0) {
+        LOG_E(LOG_TAG, "Cannot create eventfd: " + QString(strerror(errno)));
+    }
+    _thread = new ForwardingEngineThread(this);
+    _thread->start();
+    START_TIMER(_statsTimerId, FORWARDING_STATS_INTERVAL);
+}
+
+ForwardingEngine::~ForwardingEngine() {
+    KILL_TIMER(_statsTimerId);
+    _thread->stop();
+    wake();
+    _thread->wait();
+    delete _thread;
+    foreach (ForwardingStream *stream, _streams) {
+        ::close(stream->fd);
+        delete [] stream->buffer;
+        delete stream;
+    }
+    if (_wakeFd >= 0) {
+        ::close(_wakeFd);
+    }
+}
+
+void ForwardingEngine::wake() {
+    quint64 value = 1;
+    ssize_t result = ::write(_wakeFd, &value, sizeof(value));
+    Q_UNUSED(result);
+}
+
+int ForwardingEngine::addStream(qintptr socketDescriptor, QList<SocketAddress> destinations) {
+    int fd = ::dup(socketDescriptor);
+    if (fd < 0) {
+        LOG_E(LOG_TAG, "Cannot duplicate socket descriptor: " + QString(strerror(errno)));
+        return -1;
+    }
+    sockaddr_storage local;
+    socklen_t length = sizeof(local);
+    if (getsockname(fd, reinterpret_cast<sockaddr*>(&local), &length) < 0) {
+        LOG_E(LOG_TAG, "Cannot get socket address: " + QString(strerror(errno)));
+        ::close(fd);
+        return -1;
+    }
+    // Ask for the kernel arrival time and receive queue drop count of every datagram
+    int on = 1;
+    if ((setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) ||
+            (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) < 0)) {
+        LOG_W(LOG_TAG, "Cannot enable socket timestamps, latency and drops will not be reported");
+    }
+
+    ForwardingStream *stream = new ForwardingStream;
+    stream->fd = fd;
+    stream->family = local.ss_family;
+    stream->buffer = new char[FORWARDING_BATCH_SIZE * FORWARDING_MAX_PACKET_SIZE];
+    stream->destinations = toDestinations(destinations, stream->family);
+
+    int handle;
+    {
+        QMutexLocker locker(&_mutex);
+        handle = _nextHandle++;
+        stream->handle = handle;
+        _streams.insert(handle, stream);
+        _stats.insert(handle, Stats());
+    }
+    wake();
+    LOG_I(LOG_TAG, "Forwarding stream " + QString::number(handle) + " to " + QString::number(destinations.size()) + " destinations");
+    return handle;
+}
+
+void ForwardingEngine::setDestinations(int stream, QList<SocketAddress> destinations) {
+    QMutexLocker locker(&_mutex);
+    ForwardingStream *forwardingStream = _streams.value(stream, nullptr);
+    if (forwardingStream && !forwardingStream->removed) {
+        forwardingStream->destinations = toDestinations(destinations, forwardingStream->family);
+    }
+}
+
+void ForwardingEngine::removeStream(int stream) {
+    {
+        QMutexLocker locker(&_mutex);
+        ForwardingStream *forwardingStream = _streams.value(stream, nullptr);
+        if (!forwardingStream) return;
+        forwardingStream->removed = true;
+        _stats.remove(stream);
+    }
+    wake();
+    LOG_I(LOG_TAG, "Stopped forwarding stream " + QString::number(stream));
+}
+
+ForwardingEngine::Stats ForwardingEngine::getStats(int stream) const {
+    QMutexLocker locker(&_mutex);
+    return _stats.value(stream);
+}
+
+void ForwardingEngine::timerEvent(QTimerEvent *e) {
+    QObject::timerEvent(e);
+    if (e->timerId() == _statsTimerId) {
+        QStringList lossy;
+        {
+            QMutexLocker locker(&_mutex);
+            foreach (ForwardingStream *stream, _streams) {
+                if (stream->removed) continue;
+                Stats stats;
+                stats.received = stream->received;
+                stats.sent = stream->sent;
+                stats.dropped = stream->dropped;
+                stats.averageLatency = stream->latencySamples > 0 ? stream->latencyTotal / stream->latencySamples : 0;
+                stats.maxLatency = stream->latencyMax;
+                _stats.insert(stream->handle, stats);
+                if (stats.dropped > 0) {
+                    lossy.append(QString::number(stream->handle) + " (" + QString::number(stats.dropped) + ")");
+                }
+                stream->received = 0;
+                stream->sent = 0;
+                stream->dropped = 0;
+                stream->latencyTotal = 0;
+                stream->latencySamples = 0;
+                stream->latencyMax = 0;
+            }
+        }
+        if (!lossy.isEmpty()) {
+            LOG_W(LOG_TAG, "Dropped packets while forwarding streams " + lossy.join(", "));
+        }
+        emit statsUpdated();
+    }
+}
+
+} // namespace Soro
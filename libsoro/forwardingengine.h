@@ -0,0 +1,92 @@
+#ifndef SORO_FORWARDINGENGINE_H
+#define SORO_FORWARDINGENGINE_H
+
+#include <QObject>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QMutex>
+#include <QByteArray>
+#include <QTimerEvent>
+
+#include "socketaddress.h"
+#include "constants.h"
+#include "soro_global.h"
+
+// Most datagrams read from one socket with a single recvmmsg() call
+#define FORWARDING_BATCH_SIZE 16
+#define FORWARDING_MAX_PACKET_SIZE 65536
+// How often forwarding statistics are collected
+#define FORWARDING_STATS_INTERVAL 1000
+
+namespace Soro {
+
+struct ForwardingStream;
+class ForwardingEngineThread;
+
+/* Relays UDP media streams to any number of destinations from a dedicated thread,
+ * so forwarding busy streams doesn't compete with the GUI thread. Datagrams are read
+ * and sent in batches with recvmmsg()/sendmmsg(), so relaying a batch to every
+ * destination of a stream costs two system calls instead of one per packet per
+ * destination.
+ *
+ * Every packet received is also delivered through packetsReceived(), in batches,
+ * so the owner of the socket can still keep its statistics.
+ */
+class LIBSORO_EXPORT ForwardingEngine : public QObject {
+    Q_OBJECT
+public:
+    struct Stats {
+        // Packets received over the last interval
+        qint64 received = 0;
+        // Datagrams sent over the last interval, counting each destination
+        qint64 sent = 0;
+        // Packets dropped by the kernel receive queue or failed sends over the last interval
+        qint64 dropped = 0;
+        // Time from a packet's arrival on the socket until it was sent on, in microseconds
+        qint64 averageLatency = 0;
+        qint64 maxLatency = 0;
+    };
+
+    explicit ForwardingEngine(QObject *parent = 0);
+    ~ForwardingEngine();
+
+    /* Starts reading the given socket on the engine's thread and forwarding every datagram
+     * to the destinations. The descriptor is duplicated, so the caller keeps ownership of its
+     * socket but should no longer read from it. Returns a handle for the stream, or -1 on failure.
+     */
+    int addStream(qintptr socketDescriptor, QList<SocketAddress> destinations);
+    void setDestinations(int stream, QList<SocketAddress> destinations);
+    void removeStream(int stream);
+
+    /* Gets the forwarding statistics of a stream over the last interval
+     */
+    ForwardingEngine::Stats getStats(int stream) const;
+
+signals:
+    /* Emitted from the engine's thread with each batch of packets read from a stream, along with
+     * the kernel's arrival time of each packet in microseconds since the epoch, or -1 if unknown
+     */
+    void packetsReceived(int stream, QList<QByteArray> packets, QVector<qint64> arrivals);
+    void statsUpdated();
+
+protected:
+    void timerEvent(QTimerEvent *e);
+
+private:
+    friend class ForwardingEngineThread;
+
+    mutable QMutex _mutex;
+    QHash<int, ForwardingStream*> _streams;
+    QHash<int, ForwardingEngine::Stats> _stats;
+    ForwardingEngineThread *_thread;
+    int _wakeFd = -1;
+    int _nextHandle = 0;
+    int _statsTimerId = TIMER_INACTIVE;
+
+    void wake();
+};
+
+} // namespace Soro
+
+#endif // SORO_FORWARDINGENGINE_H
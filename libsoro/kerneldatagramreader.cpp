@@ -0,0 +1,73 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kerneldatagramreader.h"
+#include "sockettuning.h"
+
+namespace Soro {
+
+KernelDatagramReader::KernelDatagramReader(QObject *parent) : QObject(parent) { }
+
+KernelDatagramReader::~KernelDatagramReader() {
+    detach();
+}
+
+bool KernelDatagramReader::attach(QUdpSocket *socket) {
+    detach();
+    // The notifier watches its own descriptor, so it doesn't collide with the QUdpSocket's
+    _fd = SocketTuning::duplicateDescriptor(socket->socketDescriptor());
+    if (_fd == -1) return false;
+    _notifier = new QSocketNotifier(_fd, QSocketNotifier::Read, this);
+    connect(_notifier, &QSocketNotifier::activated, this, &KernelDatagramReader::readyRead);
+    _lastLatency = -1;
+    return true;
+}
+
+void KernelDatagramReader::detach() {
+    if (_notifier) {
+        _notifier->setEnabled(false);
+        delete _notifier;
+        _notifier = nullptr;
+    }
+    if (_fd != -1) {
+        // Otherwise the duplicate keeps the socket (and its port) open
+        SocketTuning::closeDescriptor(_fd);
+        _fd = -1;
+    }
+}
+
+bool KernelDatagramReader::isAttached() const {
+    return _fd != -1;
+}
+
+qint64 KernelDatagramReader::readDatagram(char *data, qint64 maxSize, SocketAddress *address) {
+    if (_fd == -1) return -1;
+    _lastLatency = -1;
+    return SocketTuning::receiveWithKernelInfo(_fd, data, maxSize,
+                                               address ? &address->host : nullptr,
+                                               address ? &address->port : nullptr,
+                                               &_lastLatency, &_droppedPackets);
+}
+
+qint64 KernelDatagramReader::getLastLatency() const {
+    return _lastLatency;
+}
+
+quint32 KernelDatagramReader::getDroppedPackets() const {
+    return _droppedPackets;
+}
+
+} // namespace Soro
@@ -0,0 +1,56 @@
+#ifndef SORO_KERNELDATAGRAMREADER_H
+#define SORO_KERNELDATAGRAMREADER_H
+
+#include <QObject>
+#include <QUdpSocket>
+#include <QSocketNotifier>
+
+#include "soro_global.h"
+#include "socketaddress.h"
+
+namespace Soro {
+
+/* Reads datagrams from a QUdpSocket's descriptor directly, so each datagram and its kernel
+ * receive info come from one recvmsg call instead of a peek followed by a read. Kernel
+ * timestamps must be enabled on the socket with SocketTuning::setKernelTimestamps().
+ *
+ * While attached the socket must only be read through this reader, and it must be detached
+ * before the socket is closed or rebound. The QUdpSocket stops reporting datagrams once it
+ * sees they are read elsewhere, so it only reads again after it is rebound.
+ */
+class LIBSORO_EXPORT KernelDatagramReader : public QObject {
+    Q_OBJECT
+public:
+    explicit KernelDatagramReader(QObject *parent = 0);
+    ~KernelDatagramReader();
+
+    bool attach(QUdpSocket *socket);
+    void detach();
+    bool isAttached() const;
+
+    /* Reads the next pending datagram, returns -1 once there are none left
+     */
+    qint64 readDatagram(char *data, qint64 maxSize, SocketAddress *address);
+
+    /* Gets how long the last datagram read waited in the socket in nanoseconds,
+     * or -1 if the kernel did not say
+     */
+    qint64 getLastLatency() const;
+
+    /* Gets the socket's cumulative count of datagrams dropped by the kernel
+     */
+    quint32 getDroppedPackets() const;
+
+signals:
+    void readyRead();
+
+private:
+    qintptr _fd = -1;
+    QSocketNotifier *_notifier = nullptr;
+    qint64 _lastLatency = -1;
+    quint32 _droppedPackets = 0;
+};
+
+} // namespace Soro
+
+#endif // SORO_KERNELDATAGRAMREADER_H
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "latencyhistogram.h"
+
+namespace Soro {
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::reset() {
+    memset(_buckets, 0, sizeof(_buckets));
+    _count = 0;
+    _sum = 0;
+    _max = 0;
+}
+
+void LatencyHistogram::record(qint64 micros) {
+    if (micros < 0) micros = 0;
+    int bucket = 0;
+    while ((bucket < LATENCY_HISTOGRAM_BUCKETS - 1) && (micros >= getBucketUpperBound(bucket))) {
+        bucket++;
+    }
+    _buckets[bucket]++;
+    _count++;
+    _sum += micros;
+    if (micros > _max) _max = micros;
+}
+
+quint64 LatencyHistogram::getCount() const {
+    return _count;
+}
+
+qint64 LatencyHistogram::getMax() const {
+    return _max;
+}
+
+qint64 LatencyHistogram::getMean() const {
+    return _count > 0 ? _sum / (qint64)_count : 0;
+}
+
+qint64 LatencyHistogram::getPercentile(double percentile) const {
+    if (_count == 0) return 0;
+    quint64 target = (quint64)qCeil(_count * qBound(0.0, percentile, 100.0) / 100.0);
+    if (target == 0) target = 1;
+    quint64 seen = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        seen += _buckets[i];
+        if (seen >= target) {
+            // The last bucket is open ended
+            return i == LATENCY_HISTOGRAM_BUCKETS - 1 ? _max : getBucketUpperBound(i);
+        }
+    }
+    return _max;
+}
+
+quint64 LatencyHistogram::getBucketCount(int bucket) const {
+    if ((bucket < 0) || (bucket >= LATENCY_HISTOGRAM_BUCKETS)) return 0;
+    return _buckets[bucket];
+}
+
+qint64 LatencyHistogram::getBucketUpperBound(int bucket) {
+    return (qint64)1 << bucket;
+}
+
+QString LatencyHistogram::toString() const {
+    QString str = "n=" + QString::number(_count)
+            + ",mean=" + QString::number(getMean()) + "us"
+            + ",p50<=" + QString::number(getPercentile(50)) + "us"
+            + ",p99<=" + QString::number(getPercentile(99)) + "us"
+            + ",max=" + QString::number(_max) + "us [";
+    bool first = true;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        if (_buckets[i] == 0) continue;
+        if (!first) str += ",";
+        str += "<" + QString::number(getBucketUpperBound(i)) + ":" + QString::number(_buckets[i]);
+        first = false;
+    }
+    return str + "]";
+}
+
+} // namespace Soro
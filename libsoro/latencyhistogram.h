@@ -0,0 +1,51 @@
+#ifndef SORO_LATENCYHISTOGRAM_H
+#define SORO_LATENCYHISTOGRAM_H
+
+#include <QtCore>
+
+#include "soro_global.h"
+
+#define LATENCY_HISTOGRAM_BUCKETS 24
+
+namespace Soro {
+
+/* Histogram of latency samples in microseconds. Buckets are powers of two
+ * (bucket n holds samples in [2^(n-1), 2^n) us), so recording is cheap enough
+ * to be done for every received packet.
+ */
+class LIBSORO_EXPORT LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(qint64 micros);
+    void reset();
+
+    quint64 getCount() const;
+    qint64 getMax() const;
+    qint64 getMean() const;
+
+    /* Gets the upper bound in microseconds of the bucket containing the
+     * given percentile (0-100) of samples
+     */
+    qint64 getPercentile(double percentile) const;
+
+    /* Gets the number of samples in a bucket
+     */
+    quint64 getBucketCount(int bucket) const;
+
+    /* Gets the upper bound in microseconds of a bucket
+     */
+    static qint64 getBucketUpperBound(int bucket);
+
+    QString toString() const;
+
+private:
+    quint64 _buckets[LATENCY_HISTOGRAM_BUCKETS];
+    quint64 _count;
+    qint64 _sum;
+    qint64 _max;
+};
+
+} // namespace Soro
+
+#endif // SORO_LATENCYHISTOGRAM_H
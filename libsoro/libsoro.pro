@@ -12,7 +12,7 @@
 ## See the License for the specific language governing permissions and
 ## limitations under the License.
 
-QT += core network
+QT += core network concurrent
 QT -= gui
 
 CONFIG += c++11
@@ -56,7 +56,24 @@ SOURCES += \
     audioformat.cpp \
     csvrecorder.cpp \
     sensordataparser.cpp \
-    gpscsvseries.cpp
+    gpscsvseries.cpp \
+    latencyhistogram.cpp \
+    sockettuning.cpp \
+    kerneldatagramreader.cpp \
+    bandwidthestimator.cpp \
+    bitratecontroller.cpp \
+    streamerpool.cpp \
+    streamstarttiming.cpp \
+    mediacontrolmessage.cpp \
+    packetring.cpp \
+    forwardingengine.cpp \
+    recordingindex.cpp \
+    storagewriter.cpp \
+    storagemanager.cpp \
+    localrecordingsettings.cpp \
+    bulktransfersender.cpp \
+    bulktransferreceiver.cpp \
+    capturemode.cpp
 
 HEADERS += \
     latlng.h \
@@ -91,4 +108,22 @@ HEADERS += \
     audioformat.h \
     csvrecorder.h \
     sensordataparser.h \
-    gpscsvseries.h
+    gpscsvseries.h \
+    latencyhistogram.h \
+    sockettuning.h \
+    kerneldatagramreader.h \
+    bandwidthestimator.h \
+    bitratecontroller.h \
+    streamerpool.h \
+    mediastreamengine.h \
+    streamstarttiming.h \
+    mediacontrolmessage.h \
+    packetring.h \
+    forwardingengine.h \
+    recordingindex.h \
+    storagewriter.h \
+    storagemanager.h \
+    localrecordingsettings.h \
+    bulktransfersender.h \
+    bulktransferreceiver.h \
+    capturemode.h
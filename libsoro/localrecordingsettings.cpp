@@ -0,0 +1,51 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "localrecordingsettings.h"
+
+#include <QStringList>
+
+namespace Soro {
+
+bool LocalRecordingSettings::isEnabled() const {
+    return format.isUseable() && !directory.isEmpty();
+}
+
+QString LocalRecordingSettings::serialize() const {
+    // The directory goes last, so it can contain the separator
+    return format.serialize() + ";"
+            + QString::number(cpuBudget) + ";"
+            + QString::number(segmentSeconds) + ";"
+            + QString::number(segmentBytes) + ";"
+            + QString::number(reserveBytes) + ";"
+            + directory;
+}
+
+void LocalRecordingSettings::deserialize(QString serial) {
+    QStringList items = serial.split(';');
+    if (items.size() < 6) {
+        directory = "";
+        return;
+    }
+    format.deserialize(items[0]);
+    cpuBudget = items[1].toInt();
+    segmentSeconds = items[2].toInt();
+    segmentBytes = items[3].toLongLong();
+    reserveBytes = items[4].toLongLong();
+    directory = QStringList(items.mid(5)).join(';');
+}
+
+} // namespace Soro
@@ -0,0 +1,36 @@
+#ifndef SORO_LOCALRECORDINGSETTINGS_H
+#define SORO_LOCALRECORDINGSETTINGS_H
+
+#include <QString>
+
+#include "videoformat.h"
+#include "soro_global.h"
+
+namespace Soro {
+
+/* Settings for recording a camera on the rover at a higher quality than it is streamed,
+ * passed from a VideoServer to its streamer along with the stream's own format
+ */
+struct LIBSORO_EXPORT LocalRecordingSettings {
+    // Format of the recording, which ignores stereo mode
+    VideoFormat format;
+    // Directory the segments and their index are written to
+    QString directory;
+    // Most CPU time the streamer may use while recording before the recording framerate is
+    // lowered, in percent of one core
+    int cpuBudget = 100;
+    // Limits after which a new segment is started, 0 for no limit
+    int segmentSeconds = 300;
+    qint64 segmentBytes = 1024LL * 1024 * 1024;
+    // Free space the recording stops short of
+    qint64 reserveBytes = 512LL * 1024 * 1024;
+
+    bool isEnabled() const;
+
+    QString serialize() const;
+    void deserialize(QString serial);
+};
+
+} // namespace Soro
+
+#endif // SORO_LOCALRECORDINGSETTINGS_H
@@ -20,6 +20,9 @@
 
 #include "mbedchannel.h"
 #include "util.h"
+#ifdef QT_CORE_LIB
+#   include "sockettuning.h"
+#endif
 
 #define MSG_TYPE_NORMAL 1
 #define MSG_TYPE_LOG 2
@@ -27,6 +30,8 @@
 #define MSG_TYPE_HEARTBEAT 4
 #define IDLE_CONNECTION_TIMEOUT 2000
 #define MAX_PACKET_LEN 1024
+#define LOW_LATENCY_BUSY_POLL 50
+#define LOW_LATENCY_RCVBUF 16384
 
 namespace Soro {
 
@@ -48,8 +53,18 @@ void MbedChannel::socketError(QAbstractSocket::SocketError err) {
 void MbedChannel::socketReadyRead() {
     qint64 length;
     SocketAddress peer;
-    while (_socket->hasPendingDatagrams()) {
-        length = _socket->readDatagram(_buffer, MAX_PACKET_LEN, &peer.host, &peer.port);
+    while (_kernelReader->isAttached() || _socket->hasPendingDatagrams()) {
+        if (_kernelReader->isAttached()) {
+            // In low latency mode the datagram and its kernel timestamp are read together
+            length = _kernelReader->readDatagram(_buffer, MAX_PACKET_LEN, &peer);
+            if (length < 0) break;
+            if (_kernelReader->getLastLatency() >= 0) {
+                _wakeupLatency.record(_kernelReader->getLastLatency() / 1000);
+            }
+        }
+        else {
+            length = _socket->readDatagram(_buffer, MAX_PACKET_LEN, &peer.host, &peer.port);
+        }
         if (peer.port != _host.port) continue; // Port must be the same on both sides
         if (_buffer[0] == '\0') {
             //'\0' is the message header for the server
@@ -110,10 +125,12 @@ void MbedChannel::resetConnection() {
     setChannelState(ConnectingState);
     _lastReceiveId = 0;
     _active = false;
+    _kernelReader->detach();
     _socket->abort();
     if (_socket->bind(_host.host, _host.port)) {
         LOG_I(LOG_TAG, "Listening on UDP port " + _host.toString());
         _socket->open(QIODevice::ReadWrite);
+        configureLowLatency();
     }
     else {
         LOG_E(LOG_TAG, "Failed to bind to " + _host.toString());
@@ -124,16 +141,19 @@ MbedChannel::MbedChannel(SocketAddress host, unsigned char mbedId, QObject *pare
     _host = host;
     _buffer = new char[MAX_PACKET_LEN];
     _socket = new QUdpSocket(this);
+    _kernelReader = new KernelDatagramReader(this);
     _mbedId = static_cast<char>(mbedId);
     LOG_TAG = "Mbed(" + QString::number(mbedId) + ")";
     LOG_I(LOG_TAG, "Creating new mbed channel");
     connect(_socket, &QUdpSocket::readyRead, this, &MbedChannel::socketReadyRead);
+    connect(_kernelReader, &KernelDatagramReader::readyRead, this, &MbedChannel::socketReadyRead);
     connect(_socket, static_cast<void (QUdpSocket::*)(QUdpSocket::SocketError)>(&QUdpSocket::error), this, &MbedChannel::socketError);
     resetConnection();
     START_TIMER(_watchdogTimerId, IDLE_CONNECTION_TIMEOUT);
 }
 
 MbedChannel::~MbedChannel() {
+    _kernelReader->detach();
     _socket->abort();
     delete _socket;
     delete _buffer;
@@ -149,6 +169,35 @@ void MbedChannel::sendMessage(const char *message, int length) {
     }
 }
 
+void MbedChannel::setLowLatencyMode(bool lowLatency) {
+    _lowLatencyMode = lowLatency;
+    if (!lowLatency && _kernelReader->isAttached()) {
+        // The socket is only read through QUdpSocket again once it is rebound
+        resetConnection();
+        return;
+    }
+    configureLowLatency();
+}
+
+void MbedChannel::configureLowLatency() {
+    if (!_lowLatencyMode || (_socket->socketDescriptor() == -1)) return;
+    if (!SocketTuning::applyLowLatencyOptions(_socket->socketDescriptor(), LOW_LATENCY_BUSY_POLL, LOW_LATENCY_RCVBUF)) {
+        LOG_W(LOG_TAG, "Not all low latency socket options could be applied (SO_BUSY_POLL may require CAP_NET_ADMIN)");
+    }
+    if (!SocketTuning::setKernelTimestamps(_socket->socketDescriptor(), true)
+            || (!_kernelReader->isAttached() && !_kernelReader->attach(_socket))) {
+        LOG_W(LOG_TAG, "Could not enable kernel timestamps, wake-up latency will not be recorded");
+    }
+}
+
+const LatencyHistogram& MbedChannel::getWakeupLatencyHistogram() const {
+    return _wakeupLatency;
+}
+
+void MbedChannel::resetWakeupLatencyHistogram() {
+    _wakeupLatency.reset();
+}
+
 void MbedChannel::timerEvent(QTimerEvent *e) {
     QObject::timerEvent(e);
     if (e->timerId() == _watchdogTimerId) {
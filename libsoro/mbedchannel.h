@@ -12,6 +12,8 @@
 #   include "soro_global.h"
 #   include "socketaddress.h"
 #   include "logger.h"
+#   include "latencyhistogram.h"
+#   include "kerneldatagramreader.h"
 #endif
 #ifdef TARGET_LPC1768
 #   include "mbed.h"
@@ -50,6 +52,7 @@ public:
 private:
     QString LOG_TAG;
     QUdpSocket *_socket;
+    KernelDatagramReader *_kernelReader;
     SocketAddress _host;
     SocketAddress _mbed;
     State _state;
@@ -60,7 +63,10 @@ private:
     unsigned int _nextSendId = 0;
     int _watchdogTimerId = TIMER_INACTIVE;
     int _resetConnectionTimerId = TIMER_INACTIVE;
+    bool _lowLatencyMode = false;
+    LatencyHistogram _wakeupLatency;
     void setChannelState(MbedChannel::State state);
+    void configureLowLatency();
 
 private slots:
     void socketError(QAbstractSocket::SocketError err);
@@ -78,6 +84,15 @@ public:
      */
     void sendMessage(const char *message, int length);
 
+    /* Enables low latency mode, see Channel::setLowLatencyMode()
+     */
+    void setLowLatencyMode(bool lowLatency);
+
+    /* Gets the wake-up latency histogram recorded in low latency mode
+     */
+    const LatencyHistogram& getWakeupLatencyHistogram() const;
+    void resetWakeupLatencyHistogram();
+
 signals:
     /* Emitted when we get a message from the mbed
      */
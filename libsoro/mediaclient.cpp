@@ -16,10 +16,26 @@
 
 #include "mediaclient.h"
 
+#include <QtEndian>
+
+#include <time.h>
+
 #include "logger.h"
 
+// RTP timestamp clock rate of all video payloads
+#define RTP_VIDEO_CLOCK_RATE 90000
+// Hole punch datagrams are sent immediately, then at this interval doubling up to the maximum
+#define PUNCH_INTERVAL_INITIAL 20
+#define PUNCH_INTERVAL_MAX 320
+
 namespace Soro {
 
+static qint64 realtimeMicroseconds() {
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (qint64)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
 MediaClient::MediaClient(QString logTag, int mediaId, SocketAddress server, QHostAddress host, QObject *parent)
     : QObject(parent) {
 
@@ -33,6 +49,7 @@ MediaClient::MediaClient(QString logTag, int mediaId, SocketAddress server, QHos
     _mediaSocket = new QUdpSocket(this);
 
     _buffer = new char[65536];
+    _packetRing = new PacketRing(PACKETRING_DEFAULT_CAPACITY, this);
 
     connect(_controlChannel, &Channel::messageReceived, this, &MediaClient::controlMessageReceived);
 
@@ -64,6 +81,7 @@ MediaClient::~MediaClient() {
         delete _controlChannel;
     }
     if (_mediaSocket) {
+        stopReceiving();
         disconnect(_mediaSocket, 0, 0, 0);
         if (_mediaSocket->isOpen()) _mediaSocket->close();
         delete _mediaSocket;
@@ -75,12 +93,68 @@ void MediaClient::addForwardingAddress(SocketAddress address) {
         if (existing == address) return;
     }
     _forwardAddresses.append(address);
+    if (_forwardingHandle >= 0) {
+        _forwardingEngine->setDestinations(_forwardingHandle, _forwardAddresses);
+    }
+    else if (_forwardingEngine && (_state == StreamingState)) {
+        // Move the running stream over to the engine
+        startReceiving();
+    }
 }
 
 void MediaClient::removeForwardingAddress(SocketAddress address) {
     int index = _forwardAddresses.indexOf(address);
     if (index >= 0) {
         _forwardAddresses.removeAt(index);
+        if (_forwardingHandle >= 0) {
+            _forwardingEngine->setDestinations(_forwardingHandle, _forwardAddresses);
+        }
+    }
+}
+
+PacketRing* MediaClient::getPacketRing() const {
+    return _packetRing;
+}
+
+void MediaClient::setForwardingEngine(ForwardingEngine *engine) {
+    bool streaming = (_state == StreamingState);
+    if (streaming) stopReceiving();
+    if (_forwardingEngine) {
+        disconnect(_forwardingEngine, 0, this, 0);
+    }
+    _forwardingEngine = engine;
+    if (_forwardingEngine) {
+        connect(_forwardingEngine, &ForwardingEngine::packetsReceived, this, &MediaClient::forwardedPacketsReceived);
+        connect(_forwardingEngine, &QObject::destroyed, this, [this]() {
+            // The engine closes its copy of the socket, this one keeps working
+            _forwardingEngine = nullptr;
+            _forwardingHandle = -1;
+        });
+    }
+    if (streaming) startReceiving();
+}
+
+void MediaClient::startReceiving() {
+    if (_forwardingEngine && !_forwardAddresses.isEmpty()) {
+        if (_forwardingHandle >= 0) return;
+        // Take anything already waiting before the engine starts reading the socket
+        disconnect(_mediaSocket, &QUdpSocket::readyRead, this, &MediaClient::mediaSocketReadyRead);
+        mediaSocketReadyRead();
+        _forwardingHandle = _forwardingEngine->addStream(_mediaSocket->socketDescriptor(), _forwardAddresses);
+        if (_forwardingHandle >= 0) return;
+        LOG_W(LOG_TAG, "Could not hand stream to the forwarding engine, forwarding it from this thread");
+    }
+    mediaSocketReadyRead();
+    connect(_mediaSocket, &QUdpSocket::readyRead, this, &MediaClient::mediaSocketReadyRead, Qt::UniqueConnection);
+}
+
+void MediaClient::stopReceiving() {
+    disconnect(_mediaSocket, &QUdpSocket::readyRead, 0, 0);
+    if (_forwardingHandle >= 0) {
+        _forwardingEngine->removeStream(_forwardingHandle);
+        _forwardingHandle = -1;
+        // Qt stops watching a UDP socket nobody reads from, and only watches it again after a read
+        _mediaSocket->readDatagram(_buffer, 65536);
     }
 }
 
@@ -89,88 +163,331 @@ void MediaClient::controlMessageReceived(const char *message, Channel::MessageSi
     QByteArray byteArray = QByteArray::fromRawData(message, size);
     QDataStream stream(byteArray);
     stream.setByteOrder(QDataStream::BigEndian);
-    QString messageType;
-    stream >> messageType;
-    LOG_E(LOG_TAG, "Got message: " + messageType);
-    if (messageType.compare("start", Qt::CaseInsensitive) == 0) {
+    bool legacy;
+    MediaControlMessage::Opcode opcode = MediaControlMessage::readHeader(stream, &legacy);
+    // Only answer in binary once the server has shown it understands it
+    _serverBinary = !legacy;
+    switch (opcode) {
+    case MediaControlMessage::Opcode_Start:
         LOG_I(LOG_TAG, "Server has notified us of a new media stream");
-        disconnect(_mediaSocket, &QUdpSocket::readyRead, 0, 0);
-        START_TIMER(_punchTimerId, 100);
+        stopReceiving();
+        if (_punchTimerId == TIMER_INACTIVE) {
+            // Not a retry of the start message we are already answering
+            _startTiming.start();
+        }
+        _awaitingFirstPacket = false;
+        sendPunch();
+        KILL_TIMER(_punchTimerId);
+        _punchInterval = PUNCH_INTERVAL_INITIAL;
+        START_TIMER(_punchTimerId, _punchInterval);
         onServerStartMessageInternal();
         setState(ConnectedState);
-    }
-    else if (messageType.compare("streaming", Qt::CaseInsensitive) == 0) {
+        break;
+    case MediaControlMessage::Opcode_Streaming:
         // we were successful and are now receiving a media stream
         LOG_I(LOG_TAG, "Server has confirmed our address and should begin streaming");
         _errorString = ""; // clear error string since we have an active connection;
-        mediaSocketReadyRead();
-        connect(_mediaSocket, &QUdpSocket::readyRead, this, &MediaClient::mediaSocketReadyRead);
-        KILL_TIMER(_punchTimerId);
+        if (_startTiming.isStarted() && !_startTiming.hasPhase(STREAMSTART_PHASE_CONFIRM)) {
+            _startTiming.mark(STREAMSTART_PHASE_CONFIRM);
+            _awaitingFirstPacket = true;
+        }
+        // Read the configuration first, the statistics depend on the encoding
         onServerStreamingMessageInternal(stream);
+        resetRtpStatistics();
+        // The server sends this again when it changes a running stream in place
+        startReceiving();
+        KILL_TIMER(_punchTimerId);
+        if (_state == StreamingState) {
+            emit streamChanged(this);
+        }
         setState(StreamingState);
-    }
-    else if (messageType.compare("eos", Qt::CaseInsensitive) == 0) {
+        break;
+    case MediaControlMessage::Opcode_Eos:
         LOG_I(LOG_TAG, "Got EOS message from server");
         KILL_TIMER(_punchTimerId);
-        disconnect(_mediaSocket, &QUdpSocket::readyRead, 0, 0);
+        stopReceiving();
         _lastBitrate = 0;
         onServerEosMessageInternal();
         setState(ConnectedState);
-    }
-    else if (messageType.compare("error", Qt::CaseInsensitive) == 0) {
+        break;
+    case MediaControlMessage::Opcode_Error:
         stream >> _errorString;
         LOG_I(LOG_TAG, "Got error message from server: " + _errorString);
-        disconnect(_mediaSocket, &QUdpSocket::readyRead, 0, 0);
+        stopReceiving();
         _lastBitrate = 0;
         KILL_TIMER(_punchTimerId);
         onServerErrorMessageInternal();
         setState(ConnectedState);
-    }
-    else {
+        break;
+    default:
         LOG_E(LOG_TAG, "Got unknown message from media server");
+        break;
     }
 }
 
 void MediaClient::mediaSocketReadyRead() {
     qint64 size;
+    const char *data;
+    QByteArray packet;
     while (_mediaSocket->hasPendingDatagrams()) {
-        size = _mediaSocket->readDatagram(_buffer, 65536);
-        // update bit total
-        _bitCount += size * 8;
+        if (_packetRing->hasReaders()) {
+            // Read straight into a shared buffer so local consumers don't need their own copy
+            packet = QByteArray(qMax<qint64>(_mediaSocket->pendingDatagramSize(), 0), Qt::Uninitialized);
+            size = _mediaSocket->readDatagram(packet.data(), packet.size());
+            if (size > 0) {
+                packet.resize(size);
+                _packetRing->push(packet);
+            }
+            data = packet.constData();
+        }
+        else {
+            size = _mediaSocket->readDatagram(_buffer, 65536);
+            data = _buffer;
+        }
+        processPacket(data, size, realtimeMicroseconds());
         // forward the datagram to all specified addresses
         foreach (SocketAddress address, _forwardAddresses) {
-            _mediaSocket->writeDatagram(_buffer, size, address.host, address.port);
+            _mediaSocket->writeDatagram(data, size, address.host, address.port);
         }
     }
+    _packetRing->publish();
+}
+
+void MediaClient::forwardedPacketsReceived(int stream, QList<QByteArray> packets, QVector<qint64> arrivals) {
+    if (stream != _forwardingHandle) return;
+    // The engine has already forwarded these
+    bool ring = _packetRing->hasReaders();
+    qint64 delivered = realtimeMicroseconds();
+    for (int i = 0; i < packets.size(); i++) {
+        const QByteArray &packet = packets[i];
+        if (ring) _packetRing->push(packet);
+        // A batch is delivered at once, only the kernel's stamps show when each packet arrived
+        qint64 arrival = (i < arrivals.size()) && (arrivals[i] >= 0) ? arrivals[i] : delivered;
+        processPacket(packet.constData(), packet.size(), arrival);
+    }
+    _packetRing->publish();
+}
+
+void MediaClient::processPacket(const char *packet, qint64 size, qint64 arrival) {
+    if (_awaitingFirstPacket && (size > 0)) {
+        _awaitingFirstPacket = false;
+        _startTiming.mark(STREAMSTART_PHASE_FIRST_PACKET);
+        LOG_I(LOG_TAG, "Stream started in " + _startTiming.toString());
+    }
+    // update bit total
+    _bitCount += size * 8;
+    updateRtpStatistics(packet, size, arrival);
 }
 
 void MediaClient::timerEvent(QTimerEvent *e) {
     QObject::timerEvent(e);
     if (e->timerId() == _punchTimerId) {
         LOG_I(LOG_TAG, "punch timer tick");
-        // send data to the the server so it can figure out our address
-        QByteArray message;
-        QDataStream stream(&message, QIODevice::WriteOnly);
-        stream << QString("soro_media");
-        stream << _mediaId;
-        _mediaSocket->writeDatagram(message.constData(), message.size(), _server.host, _server.port);
+        sendPunch();
+        if (_punchInterval < PUNCH_INTERVAL_MAX) {
+            _punchInterval *= 2;
+            KILL_TIMER(_punchTimerId);
+            START_TIMER(_punchTimerId, _punchInterval);
+        }
     }
     else if (e->timerId() == _calculateBitrateTimerId) {
         // this timer runs twice per second to calculate the bitrate received by the client
         _lastBitrate = _bitCount;
         _bitCount = 0;
+        // packet loss over this interval
+        qint64 expected = _rtpExtendedMaxSeq - _rtpIntervalBaseSeq;
+        if (_rtpStarted && (expected > 0)) {
+            _lastPacketLoss = (int)(qMax<qint64>(0, expected - _rtpIntervalReceived) * 100 / expected);
+        }
+        else {
+            _lastPacketLoss = 0;
+        }
+        _rtpIntervalBaseSeq = _rtpExtendedMaxSeq;
+        _rtpIntervalReceived = 0;
+        _lastReordered = _rtpIntervalReordered;
+        _rtpIntervalReordered = 0;
+        _lastFramerate = _rtpIntervalFrames;
+        _rtpIntervalFrames = 0;
+        if (_receiverReports && (_state == StreamingState)) {
+            sendStats();
+        }
+    }
+}
+
+void MediaClient::sendPunch() {
+    // send data to the the server so it can figure out our address
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    MediaControlMessage::writeHeader(stream, MediaControlMessage::Opcode_Punch, !_serverBinary);
+    stream << _mediaId;
+    _mediaSocket->writeDatagram(message.constData(), message.size(), _server.host, _server.port);
+}
+
+void MediaClient::sendControlMessage(const QByteArray& message) {
+    _controlChannel->sendMessage(message.constData(), message.size());
+}
+
+MediaControlMessage::Stats MediaClient::getStats() const {
+    MediaControlMessage::Stats stats;
+    stats.bitrate = _lastBitrate;
+    stats.packetLoss = _lastPacketLoss;
+    stats.jitter = (quint32)(getJitter() * 1000);
+    stats.reordered = qMin(_lastReordered, 0xFFFF);
+    stats.framerate = _lastFramerate;
+    stats.keyframeInterval = qMax(_lastKeyframeInterval, 0);
+    return stats;
+}
+
+void MediaClient::setReceiverReportsEnabled(bool enabled) {
+    _receiverReports = enabled;
+}
+
+bool MediaClient::sendStats() {
+    if (!_serverBinary || (_controlChannel->getState() != Channel::ConnectedState)) return false;
+    MediaControlMessage::Stats stats = getStats();
+
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::BigEndian);
+    MediaControlMessage::writeHeader(stream, MediaControlMessage::Opcode_Stats);
+    MediaControlMessage::writeStats(stream, stats);
+    sendControlMessage(message);
+    return true;
+}
+
+bool MediaClient::requestReconfigure(quint32 bitrate, quint32 framerate) {
+    if (!_serverBinary || (_controlChannel->getState() != Channel::ConnectedState)) return false;
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::BigEndian);
+    MediaControlMessage::writeHeader(stream, MediaControlMessage::Opcode_Reconfigure);
+    stream << bitrate << framerate;
+    sendControlMessage(message);
+    return true;
+}
+
+bool MediaClient::isServerBinaryProtocol() const {
+    return _serverBinary;
+}
+
+/* Gets the size of an RTP packet's header, skipping the CSRC list and header extension
+ * to find the payload
+ */
+static int rtpHeaderSize(const uchar *data, qint64 size) {
+    int headerSize = 12 + (data[0] & 0x0F) * 4;
+    if ((data[0] & 0x10) && (size >= headerSize + 4)) {
+        headerSize += 4 + qFromBigEndian<quint16>(data + headerSize + 2) * 4;
+    }
+    return headerSize;
+}
+
+bool MediaClient::isKeyframePacket(const char *packet, qint64 size) const {
+    const uchar *data = reinterpret_cast<const uchar*>(packet);
+    if ((size < 12) || ((data[0] >> 6) != 2)) return false;
+    int headerSize = rtpHeaderSize(data, size);
+    return (size > headerSize) && isKeyframe(data + headerSize, size - headerSize);
+}
+
+void MediaClient::updateRtpStatistics(const char *packet, qint64 size, qint64 arrival) {
+    const uchar *data = reinterpret_cast<const uchar*>(packet);
+    // RTP version 2 with a full fixed header
+    if ((size < 12) || ((data[0] >> 6) != 2)) return;
+
+    quint16 seq = qFromBigEndian<quint16>(data + 2);
+    quint32 timestamp = qFromBigEndian<quint32>(data + 4);
+    // Both the arrival time and the timestamp wrap in RTP units, so only their difference is kept
+    quint64 clockRate = getRtpClockRate();
+    quint32 arrivalUnits = (quint32)((quint64)(arrival / 1000000) * clockRate + (quint64)(arrival % 1000000) * clockRate / 1000000);
+    qint32 transit = (qint32)(arrivalUnits - timestamp);
+
+    int headerSize = rtpHeaderSize(data, size);
+
+    if (!_rtpStarted) {
+        _rtpStarted = true;
+        _rtpMaxSeq = seq;
+        _rtpExtendedMaxSeq = 0;
+        _rtpIntervalBaseSeq = -1;
+        _rtpIntervalReceived = 1;
+        _rtpLastTransit = transit;
+        _rtpJitter = 0;
+        _rtpFrameTimestamp = timestamp;
+        _rtpIntervalFrames = 1;
+        _rtpFrameIsKeyframe = false;
+        _rtpSeenKeyframe = false;
+        _rtpFramesSinceKeyframe = 0;
+    }
+    else {
+        qint16 delta = (qint16)(seq - _rtpMaxSeq);
+        if (delta > 0) {
+            _rtpMaxSeq = seq;
+            _rtpExtendedMaxSeq += delta;
+            // Every packet of a frame has the same timestamp
+            if (timestamp != _rtpFrameTimestamp) {
+                _rtpFrameTimestamp = timestamp;
+                _rtpIntervalFrames++;
+                _rtpFramesSinceKeyframe++;
+                _rtpFrameIsKeyframe = false;
+            }
+        }
+        else {
+            _rtpIntervalReordered++;
+        }
+        _rtpIntervalReceived++;
+
+        double d = qAbs((double)(qint32)((quint32)transit - (quint32)_rtpLastTransit));
+        _rtpLastTransit = transit;
+        _rtpJitter += (d - _rtpJitter) / 16.0;
     }
+
+    if (!_rtpFrameIsKeyframe && (size > headerSize) && isKeyframe(data + headerSize, size - headerSize)) {
+        _rtpFrameIsKeyframe = true;
+        if (_rtpSeenKeyframe) {
+            _lastKeyframeInterval = _rtpFramesSinceKeyframe;
+        }
+        _rtpSeenKeyframe = true;
+        _rtpFramesSinceKeyframe = 0;
+    }
+}
+
+int MediaClient::getRtpClockRate() const {
+    return RTP_VIDEO_CLOCK_RATE;
+}
+
+bool MediaClient::isKeyframe(const uchar *payload, int size) const {
+    Q_UNUSED(payload);
+    Q_UNUSED(size);
+    return false;
+}
+
+void MediaClient::resetRtpStatistics() {
+    _rtpStarted = false;
+    _rtpJitter = 0;
+    _lastPacketLoss = 0;
+    _rtpIntervalReceived = 0;
+    _rtpIntervalReordered = 0;
+    _lastReordered = 0;
+    _rtpIntervalFrames = 0;
+    _lastFramerate = 0;
+    _lastKeyframeInterval = -1;
 }
 
 void MediaClient::controlChannelStateChanged(Channel::State state) {
     switch (state) {
-    case Channel::ConnectedState:
+    case Channel::ConnectedState: {
+        // Let the server know we understand binary control messages, older servers ignore this
+        QByteArray message;
+        QDataStream stream(&message, QIODevice::WriteOnly);
+        stream.setByteOrder(QDataStream::BigEndian);
+        MediaControlMessage::writeHeader(stream, MediaControlMessage::Opcode_Hello);
+        sendControlMessage(message);
         setState(ConnectedState);
         onServerConnectedInternal();
         break;
+    }
     default:
+        _serverBinary = false;
         setState(ConnectingState);
-        disconnect(_mediaSocket, &QUdpSocket::readyRead, 0, 0);
+        stopReceiving();
         KILL_TIMER(_punchTimerId);
         onServerDisconnectedInternal();
         break;
@@ -197,10 +514,34 @@ SocketAddress MediaClient::getHostAddress() const {
     return SocketAddress(_mediaSocket->localAddress(), _mediaSocket->localPort());
 }
 
+const StreamStartTiming& MediaClient::getStartTiming() const {
+    return _startTiming;
+}
+
 int MediaClient::getBitrate() const {
     return _lastBitrate;
 }
 
+int MediaClient::getPacketLoss() const {
+    return _lastPacketLoss;
+}
+
+double MediaClient::getJitter() const {
+    return _rtpJitter * 1000.0 / getRtpClockRate();
+}
+
+int MediaClient::getReorderedPackets() const {
+    return _lastReordered;
+}
+
+int MediaClient::getFramerate() const {
+    return _lastFramerate;
+}
+
+int MediaClient::getKeyframeInterval() const {
+    return _lastKeyframeInterval;
+}
+
 void MediaClient::setState(State state) {
     if (_state != state) {
         _state = state;
@@ -6,10 +6,15 @@
 #include <QDataStream>
 #include <QByteArray>
 #include <QList>
+#include <QElapsedTimer>
 
 #include "channel.h"
 #include "socketaddress.h"
 #include "mediaformat.h"
+#include "streamstarttiming.h"
+#include "mediacontrolmessage.h"
+#include "packetring.h"
+#include "forwardingengine.h"
 
 #include "soro_global.h"
 
@@ -32,6 +37,17 @@ public:
     void addForwardingAddress(SocketAddress address);
     void removeForwardingAddress(SocketAddress address);
 
+    /* Gets the ring every received packet is placed in while it has readers. Local
+     * consumers should read from this instead of using a localhost forwarding address.
+     */
+    PacketRing* getPacketRing() const;
+
+    /* Hands the media socket to a forwarding engine whenever the stream has forwarding
+     * addresses, so relaying it happens off this thread. Received packets still reach the
+     * packet ring and statistics, in batches.
+     */
+    void setForwardingEngine(ForwardingEngine *engine);
+
     SocketAddress getServerAddress() const;
     SocketAddress getHostAddress() const;
     MediaClient::State getState() const;
@@ -39,9 +55,65 @@ public:
     QString getErrorString() const;
     int getBitrate() const;
 
+    /* Gets the percentage of RTP packets lost over the last second
+     */
+    int getPacketLoss() const;
+
+    /* Gets the RTP interarrival jitter (RFC 3550) in milliseconds
+     */
+    double getJitter() const;
+
+    /* Gets the number of RTP packets that arrived out of order over the last second
+     */
+    int getReorderedPackets() const;
+
+    /* Gets the number of frames received over the last second
+     */
+    int getFramerate() const;
+
+    /* Gets the number of frames between the last two keyframes, or -1 if
+     * two keyframes have not been seen yet
+     */
+    int getKeyframeInterval() const;
+
+    /* Returns true if an RTP packet of this stream starts or belongs to a keyframe
+     */
+    bool isKeyframePacket(const char *packet, qint64 size) const;
+
+    /* Gets all of the above as they would be reported to the server
+     */
+    MediaControlMessage::Stats getStats() const;
+
+    /* Sets whether the receiver statistics are sent to the server every second
+     * while streaming, if it supports them
+     */
+    void setReceiverReportsEnabled(bool enabled);
+
+    /* Gets how long each phase of starting the current or last stream took
+     */
+    const StreamStartTiming& getStartTiming() const;
+
+    /* Returns true if the server understands binary control messages, and so
+     * can be sent stats and reconfiguration requests
+     */
+    bool isServerBinaryProtocol() const;
+
+    /* Sends the current receiver statistics to the server. Returns false if the server
+     * does not support it.
+     */
+    bool sendStats();
+
+    /* Asks the server to change the running stream's bitrate and framerate (0 to leave
+     * the framerate as is). Returns false if the server does not support it.
+     */
+    bool requestReconfigure(quint32 bitrate, quint32 framerate);
+
 signals:
     void stateChanged(MediaClient *client, MediaClient::State state);
     void nameChanged(MediaClient *client, QString name);
+    /* Emitted when the server changes the configuration of a stream that is already running
+     */
+    void streamChanged(MediaClient *client);
 
 private:
     QString LOG_TAG;
@@ -53,18 +125,56 @@ private:
     QUdpSocket *_mediaSocket;
     Channel *_controlChannel;
     int _punchTimerId = TIMER_INACTIVE;
+    int _punchInterval = 0;
+    bool _awaitingFirstPacket = false;
+    StreamStartTiming _startTiming;
+    bool _serverBinary = false;
+    bool _receiverReports = false;
     int _calculateBitrateTimerId = TIMER_INACTIVE;
     QList<SocketAddress> _forwardAddresses;
+    PacketRing *_packetRing;
+    ForwardingEngine *_forwardingEngine = nullptr;
+    int _forwardingHandle = -1;
     long _bitCount = 0;
     int _lastBitrate = 0;
     QString _errorString = "";
 
+    // RTP statistics
+    bool _rtpStarted = false;
+    quint16 _rtpMaxSeq = 0;
+    qint64 _rtpExtendedMaxSeq = 0;
+    qint64 _rtpIntervalBaseSeq = 0;
+    int _rtpIntervalReceived = 0;
+    qint32 _rtpLastTransit = 0;
+    double _rtpJitter = 0;
+    int _lastPacketLoss = 0;
+    int _rtpIntervalReordered = 0;
+    int _lastReordered = 0;
+    quint32 _rtpFrameTimestamp = 0;
+    int _rtpIntervalFrames = 0;
+    int _lastFramerate = 0;
+    bool _rtpFrameIsKeyframe = false;
+    bool _rtpSeenKeyframe = false;
+    int _rtpFramesSinceKeyframe = 0;
+    int _lastKeyframeInterval = -1;
+
     void setState(State state);
+    /* Arrival times are in microseconds since the epoch, so kernel timestamps and
+     * packets read directly can be compared
+     */
+    void updateRtpStatistics(const char *packet, qint64 size, qint64 arrival);
+    void processPacket(const char *packet, qint64 size, qint64 arrival);
+    void startReceiving();
+    void stopReceiving();
+    void resetRtpStatistics();
     void setCameraName(QString name);
+    void sendPunch();
+    void sendControlMessage(const QByteArray& message);
 
 private slots:
     void controlMessageReceived(const char *message, Channel::MessageSize size);
     void mediaSocketReadyRead();
+    void forwardedPacketsReceived(int stream, QList<QByteArray> packets, QVector<qint64> arrivals);
     void controlChannelStateChanged(Channel::State state);
 
 protected:
@@ -72,6 +182,16 @@ protected:
 
     MediaClient(QString logTag, int mediaId, SocketAddress server, QHostAddress host, QObject *parent = 0);
 
+    /* Called with the RTP payload of each new packet, should return true if it
+     * starts or belongs to a keyframe of the stream's encoding
+     */
+    virtual bool isKeyframe(const uchar *payload, int size) const;
+
+    /* Gets the clock rate of the stream's RTP timestamps, which jitter is measured in.
+     * The default is the 90kHz clock of video payloads.
+     */
+    virtual int getRtpClockRate() const;
+
     virtual void onServerStreamingMessageInternal(QDataStream& stream)=0;
     virtual void onServerStartMessageInternal()=0;
     virtual void onServerEosMessageInternal()=0;
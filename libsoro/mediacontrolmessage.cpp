@@ -0,0 +1,84 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mediacontrolmessage.h"
+
+namespace Soro {
+namespace MediaControlMessage {
+
+QString getLegacyTag(Opcode opcode) {
+    switch (opcode) {
+    case Opcode_Start: return "start";
+    case Opcode_Streaming: return "streaming";
+    case Opcode_Eos: return "eos";
+    case Opcode_Error: return "error";
+    case Opcode_Punch: return "soro_media";
+    default: return "";
+    }
+}
+
+void writeHeader(QDataStream& stream, Opcode opcode, bool legacy) {
+    if (legacy) {
+        stream << getLegacyTag(opcode);
+    }
+    else {
+        stream << Magic << Version << static_cast<quint8>(opcode);
+    }
+}
+
+Opcode readHeader(QDataStream& stream, bool *isLegacy) {
+    char first;
+    if (stream.device()->peek(&first, 1) != 1) return Opcode_Invalid;
+
+    if (static_cast<quint8>(first) == Magic) {
+        if (isLegacy) *isLegacy = false;
+        quint8 magic, version, opcode;
+        stream >> magic >> version >> opcode;
+        // Newer versions only append fields, so anything from version 1 on is readable
+        if ((stream.status() != QDataStream::Ok) || (version < 1)) return Opcode_Invalid;
+        if ((opcode < Opcode_Hello) || (opcode > Opcode_Reconfigure)) return Opcode_Invalid;
+        return static_cast<Opcode>(opcode);
+    }
+
+    if (isLegacy) *isLegacy = true;
+    QString tag;
+    stream >> tag;
+    for (int opcode = Opcode_Hello; opcode <= Opcode_Reconfigure; opcode++) {
+        QString legacyTag = getLegacyTag(static_cast<Opcode>(opcode));
+        if (!legacyTag.isEmpty() && (tag.compare(legacyTag, Qt::CaseInsensitive) == 0)) {
+            return static_cast<Opcode>(opcode);
+        }
+    }
+    return Opcode_Invalid;
+}
+
+void writeStats(QDataStream& stream, const Stats& stats) {
+    stream << stats.bitrate << stats.packetLoss << stats.jitter;
+    stream << stats.reordered << stats.framerate << stats.keyframeInterval;
+}
+
+Stats readStats(QDataStream& stream) {
+    Stats stats;
+    memset(&stats, 0, sizeof(stats));
+    stream >> stats.bitrate >> stats.packetLoss >> stats.jitter;
+    if (!stream.atEnd()) {
+        stream >> stats.reordered >> stats.framerate >> stats.keyframeInterval;
+    }
+    return stats;
+}
+
+} // namespace MediaControlMessage
+} // namespace Soro
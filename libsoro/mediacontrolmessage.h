@@ -0,0 +1,84 @@
+#ifndef SORO_MEDIACONTROLMESSAGE_H
+#define SORO_MEDIACONTROLMESSAGE_H
+
+#include <QtCore>
+
+#include "soro_global.h"
+
+namespace Soro {
+
+/* Defines the control messages exchanged between a MediaServer and a MediaClient.
+ *
+ * A message is a 3 byte header (magic, version, opcode) followed by fixed layout big endian
+ * fields for that opcode. Older peers tag their messages with a serialized QString instead
+ * ("start", "streaming", "eos", "error", and "soro_media" on the UDP punch). A serialized QString
+ * begins with its 32 bit length, so its first byte can never be the magic byte, and readHeader()
+ * accepts either form.
+ *
+ * The client announces it understands this protocol with a Hello message when its control
+ * channel connects. Until then the server keeps using the QString tags, and the client only uses
+ * binary messages once the server has sent it one.
+ */
+namespace MediaControlMessage {
+
+    const quint8 Magic = 0xB5;
+    const quint8 Version = 2;
+    const int HeaderSize = 3;
+
+    enum Opcode {
+        Opcode_Invalid = 0,
+        /* Client -> server: the client understands this protocol
+         */
+        Opcode_Hello = 1,
+        /* Server -> client: a stream is starting, punch the UDP media port
+         */
+        Opcode_Start = 2,
+        /* Server -> client: followed by the stream configuration of the server subclass
+         */
+        Opcode_Streaming = 3,
+        Opcode_Eos = 4,
+        /* Server -> client: followed by the QString error message
+         */
+        Opcode_Error = 5,
+        /* Client -> server over UDP: followed by the qint32 media ID
+         */
+        Opcode_Punch = 6,
+        /* Client -> server: receiver statistics for the stream, see writeStats()
+         */
+        Opcode_Stats = 7,
+        /* Client -> server: quint32 bitrate and quint32 framerate to change the running stream to
+         */
+        Opcode_Reconfigure = 8
+    };
+
+    /* Receiver statistics carried by Opcode_Stats. Fields after jitter were added
+     * in version 2 and read as 0 from older clients.
+     */
+    struct Stats {
+        quint32 bitrate;            // bits/s received
+        quint16 packetLoss;         // percent of packets lost over the last second
+        quint32 jitter;             // microseconds
+        quint16 reordered;          // packets received out of order over the last second
+        quint16 framerate;          // frames received over the last second
+        quint16 keyframeInterval;   // frames between the last two keyframes
+    };
+
+    /* Writes the header for a message, or the QString tag for it if legacy is true
+     */
+    LIBSORO_EXPORT void writeHeader(QDataStream& stream, Opcode opcode, bool legacy = false);
+
+    /* Reads the header of either form of message. Returns Opcode_Invalid if the message is not
+     * recognized, and sets isLegacy to whether it was tagged with a QString.
+     */
+    LIBSORO_EXPORT Opcode readHeader(QDataStream& stream, bool *isLegacy = nullptr);
+
+    LIBSORO_EXPORT void writeStats(QDataStream& stream, const Stats& stats);
+    LIBSORO_EXPORT Stats readStats(QDataStream& stream);
+
+    /* Gets the QString tag an opcode had in the original protocol, or an empty string if it is new
+     */
+    LIBSORO_EXPORT QString getLegacyTag(Opcode opcode);
+}
+}
+
+#endif // SORO_MEDIACONTROLMESSAGE_H
@@ -25,6 +25,8 @@ public:
     virtual QString createGstDecodingArgs(DecodingType type=DecodingType_Full) const=0;
     virtual QString getEncodingName() const=0;
     virtual QString createGstFileRecordingArgs(QString fileName) const=0;
+    /* Creates the parser that prepares the depayloaded stream for a muxer */
+    virtual QString createGstParserArgs() const=0;
     virtual QString getFileExtension() const=0;
 
     virtual bool isUseable() const=0;
@@ -17,6 +17,12 @@
 #include "mediaserver.h"
 #include "logger.h"
 
+// Failed in-process streams in a row before going back to child processes
+#define ENGINE_MAX_FAILURES 3
+// Handshake retries start at this interval and double up to the maximum
+#define HANDSHAKE_RETRY_INITIAL 250
+#define HANDSHAKE_RETRY_MAX 3000
+
 namespace Soro {
 
 MediaServer::MediaServer(QString logTag, int mediaId, QString childProcessPath, SocketAddress host, QObject *parent) : QObject(parent) {
@@ -30,6 +36,9 @@ MediaServer::MediaServer(QString logTag, int mediaId, QString childProcessPath,
     _controlChannel->open();
 
     connect(_controlChannel, &Channel::stateChanged, this, &MediaServer::controlChannelStateChanged);
+    connect(_controlChannel, &Channel::messageReceived, this, &MediaServer::controlMessageReceived);
+    memset(&_clientStats, 0, sizeof(_clientStats));
+    memset(&_streamerStats, 0, sizeof(_streamerStats));
 
     _mediaSocket = new QUdpSocket(this);
 
@@ -37,7 +46,9 @@ MediaServer::MediaServer(QString logTag, int mediaId, QString childProcessPath,
     _ipcServer->listen(QHostAddress::LocalHost);
     connect(_ipcServer, &QTcpServer::newConnection, this, &MediaServer::ipcServerClientAvailable);
 
-    _child.setProgram(childProcessPath);
+    _ownChild = new QProcess(this);
+    _ownChild->setProgram(childProcessPath);
+    _child = _ownChild;
 
     _state = IdleState;
 
@@ -60,23 +71,42 @@ MediaServer::~MediaServer() {
 }
 
 void MediaServer::beginStream(SocketAddress address) {
+    // Confirm first so the client is ready for the stream while the streamer starts
+    LOG_I(LOG_TAG, "beginStream(): Sending streaming message to client");
+    sendStreamingMessage();
+
     QStringList args;
     constructChildArguments(args, _host, address, _ipcServer->serverPort());
-    _child.setArguments(args);
+    if (_engine && _engine->isHealthy() && (_engineFailures < ENGINE_MAX_FAILURES)) {
+        _engineHandle = _engine->startStream(_ownChild->program(), args);
+    }
+    QProcess *worker = (_engineHandle < 0) && _pool ? _pool->startWorker(args, this) : nullptr;
+    if (_engineHandle >= 0) {
+        LOG_I(LOG_TAG, "beginStream(): Streaming in process");
+    }
+    else if (worker) {
+        LOG_I(LOG_TAG, "beginStream(): Using a pre-started streaming process");
+        _child = worker;
+        connect(_child, &QProcess::stateChanged, this, &MediaServer::childStateChanged);
+    }
+    else {
+        _child = _ownChild;
+        _child->setArguments(args);
+        connect(_child, &QProcess::stateChanged, this, &MediaServer::childStateChanged);
+        _child->start();
+    }
 
-    connect(&_child, &QProcess::stateChanged, this, &MediaServer::childStateChanged);
-    _child.start();
+    setState(StreamingState);
+}
 
-    LOG_I(LOG_TAG, "beginStream(): Sending streaming message to client");
+void MediaServer::sendStreamingMessage() {
     QByteArray message;
     QDataStream stream(&message, QIODevice::WriteOnly);
     stream.setByteOrder(QDataStream::BigEndian);
-    stream << QString("streaming");
+    MediaControlMessage::writeHeader(stream, MediaControlMessage::Opcode_Streaming, !_clientBinary);
     constructStreamingMessage(stream);
-    LOG_I(LOG_TAG, "beginStream(): Sending stream configuration to client");
+    LOG_I(LOG_TAG, "sendStreamingMessage(): Sending stream configuration to client");
     _controlChannel->sendMessage(message.constData(), message.size());
-
-    setState(StreamingState);
 }
 
 void MediaServer::stop() {
@@ -84,15 +114,22 @@ void MediaServer::stop() {
         LOG_I(LOG_TAG, "stop(): Server is already stopped");
         return;
     }
-    if (_child.state() != QProcess::NotRunning) {
+    KILL_TIMER(_handshakeTimerId);
+    if (_engineHandle >= 0) {
+        // Torn down on the gstreamer thread, the next handshake waits for it to let go of the port
+        LOG_I(LOG_TAG, "stop(): Stopping the in-process stream");
+        _engineStoppingHandle = _engineHandle;
+        _engineHandle = -1;
+        _engine->stopStream(_engineStoppingHandle);
+    }
+    else if (_child->state() != QProcess::NotRunning) {
         LOG_I(LOG_TAG, "stop(): Asking the streaming process to stop");
         if (_ipcSocket) {
-            _ipcSocket->write("stop");
-            _ipcSocket->flush();
-            if (!_child.waitForFinished(1000)) {
+            sendIpcCommand("stop");
+            if (!_child->waitForFinished(1000)) {
                 LOG_E(LOG_TAG, "stop(): Streaming process did not respond to stop request, terminating it");
-                _child.terminate();
-                _child.waitForFinished();
+                _child->terminate();
+                _child->waitForFinished();
                 LOG_I(LOG_TAG, "stop(): Streaming process has been terminated");
             }
             else {
@@ -101,8 +138,8 @@ void MediaServer::stop() {
         }
         else {
             LOG_E(LOG_TAG, "stop(): Streaming process is not connected to the rover process, terminating it");
-            _child.terminate();
-            _child.waitForFinished();
+            _child->terminate();
+            _child->waitForFinished();
             LOG_I(LOG_TAG, "stop(): Streaming process has been terminated");
         }
     }
@@ -119,6 +156,7 @@ void MediaServer::stop() {
         _ipcSocket = nullptr;
     }
 
+    releaseChild();
     onStreamStoppedInternal();
 
     if (_controlChannel->getState() == Channel::ConnectedState) {
@@ -126,13 +164,48 @@ void MediaServer::stop() {
         QByteArray message;
         QDataStream stream(&message, QIODevice::WriteOnly);
         stream.setByteOrder(QDataStream::BigEndian);
-        stream << QString("eos");
+        MediaControlMessage::writeHeader(stream, MediaControlMessage::Opcode_Eos, !_clientBinary);
         _controlChannel->sendMessage(message.constData(), message.size());
     }
     _mediaSocket->abort();
     setState(IdleState);
 }
 
+bool MediaServer::sendIpcCommand(QString command) {
+    if (!_ipcSocket) {
+        return false;
+    }
+    _ipcSocket->write(command.toLatin1() + "\n");
+    _ipcSocket->flush();
+    return true;
+}
+
+void MediaServer::setWorkerPool(StreamerPool *pool) {
+    _pool = pool;
+}
+
+void MediaServer::setStreamEngine(MediaStreamEngine *engine) {
+    if (_engine) {
+        disconnect(_engine, 0, this, 0);
+    }
+    _engine = engine;
+    _engineFailures = 0;
+    _engineStoppingHandle = -1;
+    if (_engine) {
+        connect(_engine, &MediaStreamEngine::streamFinished, this, &MediaServer::engineStreamFinished);
+        connect(_engine, &MediaStreamEngine::streamStopped, this, &MediaServer::engineStreamStopped);
+    }
+}
+
+void MediaServer::releaseChild() {
+    if ((_child != _ownChild) && (_child->state() == QProcess::NotRunning)) {
+        // Pool workers are used for a single stream
+        disconnect(_child, 0, this, 0);
+        _child->deleteLater();
+        _child = _ownChild;
+    }
+}
+
 void MediaServer::initStream() {
     if (_state != IdleState) {
         LOG_I(LOG_TAG, "initStream(): Stream is not idle, but you still want to start it. The stream will be stopped and then restarted with the new configuration.");
@@ -140,45 +213,148 @@ void MediaServer::initStream() {
     }
     LOG_I(LOG_TAG, "initStream(): Starting handshake process");
     setState(WaitingState);
+    _startTiming.start();
+    _handshakeRetryInterval = HANDSHAKE_RETRY_INITIAL;
     beginClientHandshake();
 }
 
 void MediaServer::beginClientHandshake() {
+    KILL_TIMER(_handshakeTimerId);
     if (_state != WaitingState) return;
-    if (_controlChannel->getState() == Channel::ConnectedState) {
+    if (_controlChannel->getState() != Channel::ConnectedState) {
+        // controlChannelStateChanged() continues the handshake as soon as the client connects
+        LOG_I(LOG_TAG, "beginClientHandshake(): Waiting for client to connect...");
+        return;
+    }
+    if (!_startTiming.hasPhase(STREAMSTART_PHASE_CONTROL)) {
+        _startTiming.mark(STREAMSTART_PHASE_CONTROL);
+    }
+    if (_engineStoppingHandle >= 0) {
+        // engineStreamStopped() continues the handshake once the last stream is gone
+        LOG_I(LOG_TAG, "beginClientHandshake(): Waiting for the last in-process stream to release the media port...");
+        return;
+    }
+    if (_mediaSocket->state() != QAbstractSocket::BoundState) {
         _mediaSocket->abort();
         if (!_mediaSocket->bind(_host.host, _host.port)) {
             LOG_E(LOG_TAG, "beginClientHandshake(): Cannot bind to UDP media host " + _host.toString() + ": " + _mediaSocket->errorString());
-            QTimer::singleShot(500, this, SLOT(beginClientHandshake()));
+            scheduleHandshakeRetry();
             return;
         }
-        connect(_mediaSocket, &QUdpSocket::readyRead, this, &MediaServer::mediaSocketReadyRead);
+        connect(_mediaSocket, &QUdpSocket::readyRead, this, &MediaServer::mediaSocketReadyRead, Qt::UniqueConnection);
         _mediaSocket->open(QIODevice::ReadWrite);
-        // notify a connected client that there is about to be a stream change
-        // and they should verify their UDP address
-        LOG_I(LOG_TAG, "beginClientHandshake(): Sending stream start message to client");
-        QByteArray message;
-        QDataStream stream(&message, QIODevice::WriteOnly);
-        stream.setByteOrder(QDataStream::BigEndian);
-        stream << QString("start");
-        _controlChannel->sendMessage(message.constData(), message.size());
-        // client must respond on its UDP address within a certain time or the process will start again
-        QTimer::singleShot(3000, this, SLOT(beginClientHandshake()));
+    }
+    // notify a connected client that there is about to be a stream change
+    // and they should verify their UDP address
+    LOG_I(LOG_TAG, "beginClientHandshake(): Sending stream start message to client");
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::BigEndian);
+    MediaControlMessage::writeHeader(stream, MediaControlMessage::Opcode_Start, !_clientBinary);
+    _controlChannel->sendMessage(message.constData(), message.size());
+    // client must respond on its UDP address, or the start message is sent again
+    scheduleHandshakeRetry();
+}
+
+void MediaServer::scheduleHandshakeRetry() {
+    START_TIMER(_handshakeTimerId, _handshakeRetryInterval);
+    _handshakeRetryInterval = qMin(_handshakeRetryInterval * 2, HANDSHAKE_RETRY_MAX);
+}
 
+void MediaServer::timerEvent(QTimerEvent *e) {
+    if (e->timerId() == _handshakeTimerId) {
+        LOG_I(LOG_TAG, "timerEvent(): Client has not responded, retrying handshake");
+        beginClientHandshake();
     }
     else {
-        LOG_I(LOG_TAG, "beginClientHandshake(): Waiting for client to respond...");
-        QTimer::singleShot(500, this, SLOT(beginClientHandshake()));
+        QObject::timerEvent(e);
     }
 }
 
 void MediaServer::ipcServerClientAvailable() {
     if (!_ipcSocket) {
         _ipcSocket = _ipcServer->nextPendingConnection();
+        connect(_ipcSocket, &QTcpSocket::readyRead, this, &MediaServer::ipcSocketReadyRead);
         LOG_I(LOG_TAG, "ipcServerClientAvailable(): Streaming process is connected to its parent through TCP");
+        if (_startTiming.hasPhase(STREAMSTART_PHASE_PUNCH) && !_startTiming.hasPhase(STREAMSTART_PHASE_STREAMER)) {
+            _startTiming.mark(STREAMSTART_PHASE_STREAMER);
+            LOG_I(LOG_TAG, "ipcServerClientAvailable(): Stream started in " + _startTiming.toString());
+        }
     }
 }
 
+void MediaServer::ipcSocketReadyRead() {
+    char buffer[512];
+    while (_ipcSocket && _ipcSocket->canReadLine()) {
+        _ipcSocket->readLine(buffer, 512);
+        QString line = QString(buffer).trimmed();
+        if (line.startsWith("failed ")) {
+            LOG_W(LOG_TAG, "ipcSocketReadyRead(): Streaming process could not apply '" + line.mid(7) + "'");
+            onIpcCommandFailed(line.mid(7));
+        }
+        else if (line.startsWith("ok ")) {
+            LOG_D(LOG_TAG, "ipcSocketReadyRead(): Streaming process applied '" + line.mid(3) + "'");
+        }
+        else if (line.startsWith("stats ")) {
+            parseStreamerStats(line.mid(6));
+        }
+    }
+}
+
+void MediaServer::parseStreamerStats(QString line) {
+    // key=value pairs, keys this version doesn't know are ignored
+    foreach (QString pair, line.split(' ', QString::SkipEmptyParts)) {
+        int separator = pair.indexOf('=');
+        if (separator < 0) continue;
+        QString key = pair.left(separator);
+        qint64 value = pair.mid(separator + 1).toLongLong();
+        if (key == "captured") _streamerStats.framesCaptured = value;
+        else if (key == "encoded") _streamerStats.framesEncoded = value;
+        else if (key == "dropped") _streamerStats.framesDropped = value;
+        else if (key == "qos") _streamerStats.qosEvents = value;
+        else if (key == "qosdropped") _streamerStats.qosDropped = value;
+        else if (key == "encodetime") _streamerStats.encodeTime = value;
+        else if (key == "bitrate") _streamerStats.bitrate = value;
+        else if (key == "cpu") _streamerStats.cpu = value;
+    }
+    emit streamerStatsReceived(this);
+}
+
+void MediaServer::onIpcCommandFailed(QString command) {
+    Q_UNUSED(command);
+}
+
+void MediaServer::controlMessageReceived(const char *message, Channel::MessageSize size) {
+    QByteArray byteArray = QByteArray::fromRawData(message, size);
+    QDataStream stream(byteArray);
+    stream.setByteOrder(QDataStream::BigEndian);
+    switch (MediaControlMessage::readHeader(stream)) {
+    case MediaControlMessage::Opcode_Hello:
+        LOG_I(LOG_TAG, "controlMessageReceived(): Client supports binary control messages");
+        _clientBinary = true;
+        break;
+    case MediaControlMessage::Opcode_Stats:
+        _clientStats = MediaControlMessage::readStats(stream);
+        emit clientStatsReceived(this);
+        break;
+    case MediaControlMessage::Opcode_Reconfigure: {
+        quint32 bitrate, framerate;
+        stream >> bitrate >> framerate;
+        onReconfigureRequested(bitrate, framerate);
+        break;
+    }
+    default:
+        LOG_E(LOG_TAG, "controlMessageReceived(): Got unknown message from client");
+        break;
+    }
+}
+
+void MediaServer::onReconfigureRequested(quint32 bitrate, quint32 framerate) {
+    Q_UNUSED(bitrate);
+    Q_UNUSED(framerate);
+    LOG_W(LOG_TAG, "onReconfigureRequested(): This stream cannot be reconfigured");
+}
+
 void MediaServer::mediaSocketReadyRead() {
     if (!_mediaSocket | (_state == StreamingState)) return;
     SocketAddress peer;
@@ -187,12 +363,11 @@ void MediaServer::mediaSocketReadyRead() {
 
     QByteArray byteArray = QByteArray::fromRawData(buffer, length);
     QDataStream stream(byteArray);
-    QString tag;
     int mediaId;
-    stream >> tag;
+    MediaControlMessage::Opcode opcode = MediaControlMessage::readHeader(stream);
     stream >> mediaId;
 
-    if (tag.compare("soro_media", Qt::CaseInsensitive) != 0) {
+    if (opcode != MediaControlMessage::Opcode_Punch) {
         LOG_E(LOG_TAG, "mediaSocketReadyRead(): Got invalid handshake packet on UDP media port");
         return;
     }
@@ -201,46 +376,41 @@ void MediaServer::mediaSocketReadyRead() {
         return;
     }
     LOG_I(LOG_TAG, "Client has completed handshake on its UDP address");
+    KILL_TIMER(_handshakeTimerId);
+    _startTiming.mark(STREAMSTART_PHASE_PUNCH);
     // Disconnect the media UDP socket so udpsink can bind to it
     disconnect(_mediaSocket, &QUdpSocket::readyRead, this, &MediaServer::mediaSocketReadyRead);
     _mediaSocket->abort(); // MUST ABORT THE SOCKET!!!!
     beginStream(peer);
 }
 
+void MediaServer::engineStreamFinished(int handle, int exitCode) {
+    if (handle != _engineHandle) return;
+    _engineHandle = -1;
+    if ((exitCode == 0) || (exitCode == STREAMPROCESS_ERR_GSTREAMER_EOS)) {
+        _engineFailures = 0;
+    }
+    else if (++_engineFailures >= ENGINE_MAX_FAILURES) {
+        LOG_W(LOG_TAG, "engineStreamFinished(): In-process streaming has failed " + QString::number(_engineFailures)
+              + " times in a row, using streaming processes from now on");
+    }
+    handleStreamExit(exitCode);
+    stop();
+}
+
+void MediaServer::engineStreamStopped(int handle) {
+    if (handle != _engineStoppingHandle) return;
+    _engineStoppingHandle = -1;
+    if (_state == WaitingState) {
+        beginClientHandshake();
+    }
+}
+
 void MediaServer::childStateChanged(QProcess::ProcessState state) {
     switch (state) {
     case QProcess::NotRunning:
-        disconnect(&_child, &QProcess::stateChanged, this, &MediaServer::childStateChanged);
-
-        switch (_child.exitCode()) {
-        case 0:
-        case STREAMPROCESS_ERR_GSTREAMER_EOS:
-            LOG_I(LOG_TAG, "childStateChanged(): Streaming process has exited normally");
-            emit eos(this);
-            break;
-        case STREAMPROCESS_ERR_FLYCAP_ERROR:
-            LOG_E(LOG_TAG, "childStateChanged(): Streaming processes exited due to an error in FlyCapture2 processing");
-            break;
-        case STREAMPROCESS_ERR_GSTREAMER_ERROR:
-            LOG_E(LOG_TAG, "childStateChanged(): The streaming processes exited due to a gstreamer error");
-            emit error(this, "Streaming process exited due to a gstreamer error");
-            break;
-        case STREAMPROCESS_ERR_INVALID_ARGUMENT:
-        case STREAMPROCESS_ERR_NOT_ENOUGH_ARGUMENTS:
-        case STREAMPROCESS_ERR_UNKNOWN_CODEC:
-            LOG_E(LOG_TAG, "childStateChanged(): Streaming processes exited due to an argument error");
-            emit error(this, "Streaming processes exited due to an argument error");
-            break;
-        case STREAMPROCESS_ERR_SOCKET_ERROR:
-            LOG_E(LOG_TAG, "childStateChanged(): Streaming process exited because it lost contact with the parent cameraprocess");
-            emit error(this, "Streaming process exited because it lost contact with the parent process");
-            break;
-        default:
-            LOG_E(LOG_TAG, "childStateChanged(): Streaming process exited due to an unknown error (exit code " + QString::number(_child.exitCode()) + ")");
-            emit error(this, "Streaming process exited due to an unknown error (exit code " + QString::number(_child.exitCode()) + ")");
-            break;
-        }
-
+        disconnect(_child, &QProcess::stateChanged, this, &MediaServer::childStateChanged);
+        handleStreamExit(_child->exitCode());
         stop();
         break;
     case QProcess::Starting:
@@ -252,10 +422,58 @@ void MediaServer::childStateChanged(QProcess::ProcessState state) {
     }
 }
 
+void MediaServer::handleStreamExit(int exitCode) {
+    switch (exitCode) {
+    case 0:
+    case STREAMPROCESS_ERR_GSTREAMER_EOS:
+        LOG_I(LOG_TAG, "handleStreamExit(): Streaming process has exited normally");
+        emit eos(this);
+        break;
+    case STREAMPROCESS_ERR_FLYCAP_ERROR:
+        LOG_E(LOG_TAG, "handleStreamExit(): Streaming processes exited due to an error in FlyCapture2 processing");
+        break;
+    case STREAMPROCESS_ERR_GSTREAMER_ERROR:
+        LOG_E(LOG_TAG, "handleStreamExit(): The streaming processes exited due to a gstreamer error");
+        emit error(this, "Streaming process exited due to a gstreamer error");
+        break;
+    case STREAMPROCESS_ERR_INVALID_ARGUMENT:
+    case STREAMPROCESS_ERR_NOT_ENOUGH_ARGUMENTS:
+    case STREAMPROCESS_ERR_UNKNOWN_CODEC:
+        LOG_E(LOG_TAG, "handleStreamExit(): Streaming processes exited due to an argument error");
+        emit error(this, "Streaming processes exited due to an argument error");
+        break;
+    case STREAMPROCESS_ERR_SOCKET_ERROR:
+        LOG_E(LOG_TAG, "handleStreamExit(): Streaming process exited because it lost contact with the parent cameraprocess");
+        emit error(this, "Streaming process exited because it lost contact with the parent process");
+        break;
+    default:
+        LOG_E(LOG_TAG, "handleStreamExit(): Streaming process exited due to an unknown error (exit code " + QString::number(exitCode) + ")");
+        emit error(this, "Streaming process exited due to an unknown error (exit code " + QString::number(exitCode) + ")");
+        break;
+    }
+}
+
 void MediaServer::controlChannelStateChanged(Channel::State state) {
     if (state != Channel::ConnectedState) {
+        // The next client might be an older version
+        _clientBinary = false;
         stop();
     }
+    else if (_state == WaitingState) {
+        beginClientHandshake();
+    }
+}
+
+MediaServer::StreamerStats MediaServer::getStreamerStats() const {
+    return _streamerStats;
+}
+
+MediaControlMessage::Stats MediaServer::getClientStats() const {
+    return _clientStats;
+}
+
+const StreamStartTiming& MediaServer::getStartTiming() const {
+    return _startTiming;
 }
 
 int MediaServer::getMediaId() {
@@ -8,6 +8,10 @@
 #include "soro_global.h"
 #include "socketaddress.h"
 #include "channel.h"
+#include "streamerpool.h"
+#include "mediastreamengine.h"
+#include "streamstarttiming.h"
+#include "mediacontrolmessage.h"
 
 namespace Soro {
 
@@ -33,6 +37,19 @@ public:
         StreamingState
     };
 
+    /* Statistics sent by the streamer every second
+     */
+    struct StreamerStats {
+        int framesCaptured;     // frames out of the source
+        int framesEncoded;      // frames out of the encoder
+        int framesDropped;      // frames captured but never encoded
+        int qosEvents;          // QoS messages posted by the pipeline
+        int qosDropped;         // frames dropped according to QoS messages
+        int encodeTime;         // average time a frame spends in the encoder, in microseconds
+        qint64 bitrate;         // encoder output in bits/s
+        int cpu;                // percent of one core used by the streaming process, -1 if in process
+    };
+
     ~MediaServer();
 
     /**
@@ -51,18 +68,61 @@ public:
      */
     MediaServer::State getState() const;
 
+    /**
+     * Sets a pool of pre-started streaming processes to take from when a stream starts.
+     * If the pool has no ready process, one is started as usual.
+     */
+    void setWorkerPool(StreamerPool *pool);
+
+    /**
+     * Sets an engine to run streams inside this process instead of in a child process. After
+     * the engine fails a few streams in a row, or stops responding, streams go back to child processes.
+     */
+    void setStreamEngine(MediaStreamEngine *engine);
+
+    /**
+     * Gets how long each phase of starting the current or last stream took
+     */
+    const StreamStartTiming& getStartTiming() const;
+
+    /**
+     * Gets the last receiver statistics reported by the client
+     */
+    MediaControlMessage::Stats getClientStats() const;
+
+    /**
+     * Gets the last statistics sent by the streamer
+     */
+    MediaServer::StreamerStats getStreamerStats() const;
+
 private:
     int _mediaId;
     SocketAddress _host;
     Channel *_controlChannel = nullptr;
     QUdpSocket *_mediaSocket = nullptr;
     State _state = IdleState;
-    QProcess _child;
+    QProcess *_ownChild = nullptr;
+    QProcess *_child = nullptr;
+    StreamerPool *_pool = nullptr;
+    MediaStreamEngine *_engine = nullptr;
+    int _engineHandle = -1;
+    // In-process stream that was asked to stop and may still hold the media port
+    int _engineStoppingHandle = -1;
+    int _engineFailures = 0;
     QTcpServer *_ipcServer = nullptr;
     QTcpSocket *_ipcSocket = nullptr;
-    int _startInternalTimerId = TIMER_INACTIVE;
+    int _handshakeTimerId = TIMER_INACTIVE;
+    int _handshakeRetryInterval = 0;
+    StreamStartTiming _startTiming;
+    bool _clientBinary = false;
+    MediaControlMessage::Stats _clientStats;
+    StreamerStats _streamerStats;
 
     void beginStream(SocketAddress address);
+    void releaseChild();
+    void handleStreamExit(int exitCode);
+    void scheduleHandshakeRetry();
+    void parseStreamerStats(QString line);
 
     /**
      * Internal state change method
@@ -75,6 +135,10 @@ private slots:
     void beginClientHandshake();
     void childStateChanged(QProcess::ProcessState state);
     void ipcServerClientAvailable();
+    void ipcSocketReadyRead();
+    void engineStreamFinished(int handle, int exitCode);
+    void engineStreamStopped(int handle);
+    void controlMessageReceived(const char *message, Channel::MessageSize size);
 
 signals:
     void stateChanged(MediaServer *server, MediaServer::State state);
@@ -85,10 +149,20 @@ signals:
      * @param message
      */
     void error(MediaServer *server, QString message);
+    /**
+     * Signal emitted when the client reports its receiver statistics
+     */
+    void clientStatsReceived(MediaServer *server);
+    /**
+     * Signal emitted when the streamer sends its encoder statistics
+     */
+    void streamerStatsReceived(MediaServer *server);
 
 protected:
     QString LOG_TAG;
 
+    void timerEvent(QTimerEvent *e) Q_DECL_OVERRIDE;
+
     /**
      * @param logTag Tag that will be used for logging info.
      * @param mediaId Used to identify this particular media stream. Must match on both ends, and should be unique across
@@ -106,6 +180,28 @@ protected:
      */
     void initStream();
 
+    /**
+     * Sends a single line command to the streaming process over the IPC socket. Returns false
+     * if the streaming process is not connected.
+     */
+    bool sendIpcCommand(QString command);
+
+    /**
+     * Sends the "streaming" message with the current stream configuration to the client again,
+     * for when the stream is changed in place.
+     */
+    void sendStreamingMessage();
+
+    /**
+     * Called when the streaming process replies that it could not apply a command
+     */
+    virtual void onIpcCommandFailed(QString command);
+
+    /**
+     * Called when the client asks for the running stream to be changed. Framerate is 0 to leave it as is.
+     */
+    virtual void onReconfigureRequested(quint32 bitrate, quint32 framerate);
+
     virtual void onStreamStoppedInternal() = 0;
     virtual void constructChildArguments(QStringList& outArgs, SocketAddress host, SocketAddress address, quint16 ipcPort)=0;
     virtual void constructStreamingMessage(QDataStream& stream)=0;
@@ -0,0 +1,58 @@
+#ifndef SORO_MEDIASTREAMENGINE_H
+#define SORO_MEDIASTREAMENGINE_H
+
+#include <QObject>
+#include <QStringList>
+
+#include "soro_global.h"
+
+namespace Soro {
+
+/* Runs media streams inside the rover process instead of in a child process.
+ *
+ * A stream is started with the same program and arguments its streaming process would be
+ * started with, and still connects back to its MediaServer over the IPC socket, so a MediaServer
+ * controls it the same way either way. The implementation lives in libsorogst so libsoro
+ * does not have to depend on gstreamer.
+ */
+class LIBSORO_EXPORT MediaStreamEngine : public QObject {
+    Q_OBJECT
+public:
+    /**
+     * Starts a stream. Returns a handle for the stream, or -1 if it could not be started.
+     * @param program The streaming program the stream would otherwise run in (video_streamer, audio_streamer)
+     * @param args The arguments that program would be started with
+     */
+    virtual int startStream(QString program, QStringList args) = 0;
+
+    /**
+     * Asks a stream to stop without waiting for it. streamStopped() is emitted once it has been
+     * torn down and its sockets are released, and streamFinished() is not emitted for it.
+     */
+    virtual void stopStream(int handle) = 0;
+
+    /**
+     * Returns false once the engine has stopped responding, in which case no more streams
+     * should be started on it
+     */
+    virtual bool isHealthy() const = 0;
+
+protected:
+    MediaStreamEngine(QObject *parent = 0) : QObject(parent) { }
+
+signals:
+    /**
+     * Emitted when a stream ends on its own
+     * @param exitCode The code the streaming process would have exited with
+     */
+    void streamFinished(int handle, int exitCode);
+    /**
+     * Emitted when a stream stopped with stopStream() is gone
+     */
+    void streamStopped(int handle);
+    void healthChanged(bool healthy);
+};
+
+} // namespace Soro
+
+#endif // SORO_MEDIASTREAMENGINE_H
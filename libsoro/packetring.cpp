@@ -0,0 +1,87 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "packetring.h"
+
+namespace Soro {
+
+PacketRing::PacketRing(int capacity, QObject *parent) : QObject(parent) {
+    _packets.resize(qMax(1, capacity));
+}
+
+void PacketRing::push(const QByteArray &packet) {
+    _packets[_head % _packets.size()] = packet;
+    _head++;
+}
+
+void PacketRing::publish() {
+    if (_published != _head) {
+        _published = _head;
+        emit packetsAvailable();
+    }
+}
+
+int PacketRing::addReader() {
+    Reader reader;
+    reader.position = _head;
+    _readers.insert(_nextReader, reader);
+    return _nextReader++;
+}
+
+void PacketRing::removeReader(int reader) {
+    _readers.remove(reader);
+    if (_readers.isEmpty()) {
+        // Release the packets so they aren't held until they're overwritten
+        for (int i = 0; i < _packets.size(); i++) {
+            _packets[i].clear();
+        }
+    }
+}
+
+bool PacketRing::hasReaders() const {
+    return !_readers.isEmpty();
+}
+
+bool PacketRing::read(int reader, QByteArray &packet) {
+    QHash<int, Reader>::iterator it = _readers.find(reader);
+    if (it == _readers.end()) return false;
+
+    qint64 oldest = _head - _packets.size();
+    if (it->position < oldest) {
+        // Reader fell behind and its next packets have been overwritten
+        it->dropped += oldest - it->position;
+        it->position = oldest;
+    }
+    if (it->position >= _head) return false;
+
+    packet = _packets[it->position % _packets.size()];
+    it->position++;
+    return true;
+}
+
+qint64 PacketRing::getDropped(int reader) const {
+    return _readers.value(reader).dropped;
+}
+
+int PacketRing::getCapacity() const {
+    return _packets.size();
+}
+
+qint64 PacketRing::getPushCount() const {
+    return _head;
+}
+
+} // namespace Soro
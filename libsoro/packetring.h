@@ -0,0 +1,77 @@
+#ifndef SORO_PACKETRING_H
+#define SORO_PACKETRING_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QVector>
+#include <QHash>
+
+#include "soro_global.h"
+
+#define PACKETRING_DEFAULT_CAPACITY 1024
+
+namespace Soro {
+
+/* Fixed size ring of received packets that can be read by any number of local
+ * consumers, so a stream can be played and recorded in-process without bouncing
+ * it back through the kernel once for each consumer. Packets are stored as implicitly
+ * shared QByteArrays, so handing one to a reader does not copy it.
+ *
+ * Each reader keeps its own position in the ring. A reader that falls more than
+ * the ring's capacity behind skips ahead to the oldest packet still held, and the
+ * skipped packets are counted as dropped for that reader.
+ *
+ * The ring is not thread safe, and should only be used from the thread it lives in.
+ */
+class LIBSORO_EXPORT PacketRing : public QObject {
+    Q_OBJECT
+public:
+    explicit PacketRing(int capacity=PACKETRING_DEFAULT_CAPACITY, QObject *parent=0);
+
+    /* Adds a packet to the ring. Readers are not notified until publish() is called,
+     * so packets read in one batch only wake consumers once.
+     */
+    void push(const QByteArray &packet);
+
+    /* Emits packetsAvailable() if any packets were pushed since the last call
+     */
+    void publish();
+
+    /* Registers a new reader, positioned at the end of the ring so it
+     * only sees packets pushed from now on
+     */
+    int addReader();
+    void removeReader(int reader);
+    bool hasReaders() const;
+
+    /* Reads the next packet for a reader. Returns false if the reader
+     * has already read every packet in the ring.
+     */
+    bool read(int reader, QByteArray &packet);
+
+    /* Gets the number of packets a reader has missed by falling behind
+     */
+    qint64 getDropped(int reader) const;
+
+    int getCapacity() const;
+    qint64 getPushCount() const;
+
+signals:
+    void packetsAvailable();
+
+private:
+    struct Reader {
+        qint64 position = 0;
+        qint64 dropped = 0;
+    };
+
+    QVector<QByteArray> _packets;
+    QHash<int, Reader> _readers;
+    qint64 _head = 0;
+    qint64 _published = 0;
+    int _nextReader = 0;
+};
+
+} // namespace Soro
+
+#endif // SORO_PACKETRING_H
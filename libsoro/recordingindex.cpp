@@ -0,0 +1,121 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "recordingindex.h"
+#include "logger.h"
+
+#include <algorithm>
+
+#define LOG_TAG "RecordingIndex"
+
+#define RECORDINGINDEX_HEADER "wall_time,segment,offset,stream_time"
+
+namespace Soro {
+
+RecordingIndex::RecordingIndex() { }
+
+RecordingIndex::~RecordingIndex() {
+    close();
+}
+
+bool RecordingIndex::open(QString path) {
+    QMutexLocker locker(&_mutex);
+    if (_file.isOpen()) _file.close();
+    _file.setFileName(path);
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        LOG_E(LOG_TAG, "Cannot open index file " + path + ": " + _file.errorString());
+        return false;
+    }
+    _file.write(RECORDINGINDEX_HEADER "\n");
+    _file.flush();
+    _segment = -1;
+    _position = 0;
+    _offset = 0;
+    _lastIndexedSegment = -1;
+    return true;
+}
+
+void RecordingIndex::close() {
+    QMutexLocker locker(&_mutex);
+    if (_file.isOpen()) _file.close();
+}
+
+void RecordingIndex::beginSegment() {
+    QMutexLocker locker(&_mutex);
+    _segment++;
+    _position = 0;
+    _offset = 0;
+}
+
+void RecordingIndex::addBytes(qint64 bytes) {
+    QMutexLocker locker(&_mutex);
+    _position += bytes;
+    _offset = qMax(_offset, _position);
+}
+
+void RecordingIndex::seek(qint64 position) {
+    QMutexLocker locker(&_mutex);
+    _position = position;
+}
+
+void RecordingIndex::addKeyframe(qint64 wallTime, qint64 streamTime) {
+    QMutexLocker locker(&_mutex);
+    if (!_file.isOpen()) return;
+    int segment = qMax(_segment, 0);
+    if ((segment == _lastIndexedSegment) && (wallTime - _lastIndexedTime < RECORDINGINDEX_MIN_INTERVAL)) return;
+    _lastIndexedSegment = segment;
+    _lastIndexedTime = wallTime;
+    // The muxer may still hold some of the data before this keyframe, so the offset
+    // is a point at or shortly before it in the file
+    QString line = QString("%1,%2,%3,%4\n").arg(
+                QString::number(wallTime),
+                QString::number(segment),
+                QString::number(_offset),
+                QString::number(streamTime));
+    _file.write(line.toLatin1());
+    _file.flush();
+}
+
+QVector<RecordingIndexEntry> RecordingIndex::load(QString path) {
+    QVector<RecordingIndexEntry> entries;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        LOG_E(LOG_TAG, "Cannot open index file " + path + ": " + file.errorString());
+        return entries;
+    }
+    while (!file.atEnd()) {
+        QList<QByteArray> fields = file.readLine().trimmed().split(',');
+        // Skips the header, and a partial last line left by a crash
+        if (fields.size() != 4) continue;
+        bool ok, allOk = true;
+        RecordingIndexEntry entry;
+        entry.wallTime = fields[0].toLongLong(&ok); allOk &= ok;
+        entry.segment = fields[1].toInt(&ok); allOk &= ok;
+        entry.offset = fields[2].toLongLong(&ok); allOk &= ok;
+        entry.streamTime = fields[3].toLongLong(&ok); allOk &= ok;
+        if (allOk) entries.append(entry);
+    }
+    return entries;
+}
+
+int RecordingIndex::find(const QVector<RecordingIndexEntry> &entries, qint64 wallTime) {
+    // Entries are written in order, so this is a binary search
+    QVector<RecordingIndexEntry>::const_iterator it = std::upper_bound(entries.constBegin(), entries.constEnd(), wallTime,
+            [](qint64 time, const RecordingIndexEntry &entry) { return time < entry.wallTime; });
+    return (int)(it - entries.constBegin()) - 1;
+}
+
+} // namespace Soro
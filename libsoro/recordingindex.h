@@ -0,0 +1,79 @@
+#ifndef SORO_RECORDINGINDEX_H
+#define SORO_RECORDINGINDEX_H
+
+#include <QFile>
+#include <QMutex>
+#include <QVector>
+
+#include "soro_global.h"
+
+// Least time between indexed keyframes, so intra-only streams don't index every frame
+#define RECORDINGINDEX_MIN_INTERVAL 500
+
+namespace Soro {
+
+/* One keyframe of a segmented recording
+ */
+struct RecordingIndexEntry {
+    // Wall clock time the keyframe was recorded, in ms since epoch
+    qint64 wallTime = 0;
+    // Number of the segment file it is in
+    int segment = 0;
+    // Byte offset into the segment file from which playback can start at or before the keyframe
+    qint64 offset = 0;
+    // Presentation time in the stream in ms, or -1 if unknown
+    qint64 streamTime = -1;
+};
+
+/* Sidecar index for a segmented recording, mapping wall clock time to a position in the
+ * segment files so long recordings can be seeked and cut without scanning them.
+ *
+ * The index is a CSV file with one line per keyframe, flushed as it is written, so it
+ * survives a crash along with the segments. Writing is thread safe, since bytes and
+ * keyframes are reported from different streaming threads.
+ */
+class LIBSORO_EXPORT RecordingIndex {
+public:
+    RecordingIndex();
+    ~RecordingIndex();
+
+    bool open(QString path);
+    void close();
+
+    /* Called when a new segment file is started
+     */
+    void beginSegment();
+
+    /* Called with the number of bytes written to the current segment file
+     */
+    void addBytes(qint64 bytes);
+
+    /* Called when the muxer moves back in the file to rewrite its headers
+     */
+    void seek(qint64 position);
+
+    /* Called when a keyframe reaches the muxer. Keyframes closer together than
+     * RECORDINGINDEX_MIN_INTERVAL are not indexed, except the first of each segment.
+     */
+    void addKeyframe(qint64 wallTime, qint64 streamTime);
+
+    static QVector<RecordingIndexEntry> load(QString path);
+
+    /* Finds the last keyframe at or before a wall clock time, or -1 if there is none
+     */
+    static int find(const QVector<RecordingIndexEntry> &entries, qint64 wallTime);
+
+private:
+    QMutex _mutex;
+    QFile _file;
+    int _segment = -1;
+    // Where the next write goes, and the end of the data written so far
+    qint64 _position = 0;
+    qint64 _offset = 0;
+    int _lastIndexedSegment = -1;
+    qint64 _lastIndexedTime = 0;
+};
+
+} // namespace Soro
+
+#endif // SORO_RECORDINGINDEX_H
@@ -49,6 +49,11 @@ bool SocketAddress::operator==(const SocketAddress& other) const {
             & (port == other.port);
 }
 
+uint qHash(const SocketAddress &address, uint seed) {
+    Q_IPV6ADDR a = address.host.toIPv6Address();
+    return ::qHash(QByteArray::fromRawData(reinterpret_cast<const char*>(a.c), sizeof(Q_IPV6ADDR)), seed) ^ address.port;
+}
+
 QDataStream& operator<<(QDataStream& stream, const SocketAddress& address) {
     stream << address.host.toString();
     stream << address.port;
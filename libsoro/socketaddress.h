@@ -3,6 +3,7 @@
 
 #include <QHostAddress>
 #include <QDataStream>
+#include <QHash>
 
 namespace Soro {
 
@@ -32,6 +33,11 @@ struct SocketAddress {
 
 };
 
+/* Hash function so SocketAddress can be used as a QHash key. This hashes the IPv6
+ * form of the address so it agrees with operator==
+ */
+uint qHash(const SocketAddress &address, uint seed = 0);
+
 }
 
 Q_DECLARE_METATYPE(Soro::SocketAddress)
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sockettuning.h"
+
+#ifdef Q_OS_LINUX
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <linux/sock_diag.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Priority used by the kernel for interactive traffic (TC_PRIO_INTERACTIVE)
+#define INTERACTIVE_SOCKET_PRIORITY 6
+
+namespace Soro {
+
+bool SocketTuning::applyLowLatencyOptions(qintptr fd, int busyPollMicros, int receiveBufferSize) {
+#ifdef Q_OS_LINUX
+    if (fd == -1) return false;
+    bool success = true;
+#ifdef SO_BUSY_POLL
+    success &= setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busyPollMicros, sizeof(busyPollMicros)) == 0;
+#else
+    Q_UNUSED(busyPollMicros);
+    success = false;
+#endif
+    if (receiveBufferSize > 0) {
+        success &= setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof(receiveBufferSize)) == 0;
+    }
+    int priority = INTERACTIVE_SOCKET_PRIORITY;
+    success &= setsockopt(fd, SOL_SOCKET, SO_PRIORITY, &priority, sizeof(priority)) == 0;
+    int tos = IPTOS_LOWDELAY;
+    // Only applies to IPv4 sockets, ignore failure
+    setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+    return success;
+#else
+    Q_UNUSED(fd); Q_UNUSED(busyPollMicros); Q_UNUSED(receiveBufferSize);
+    return false;
+#endif
+}
+
+bool SocketTuning::setKernelTimestamps(qintptr fd, bool enable) {
+#ifdef Q_OS_LINUX
+    if (fd == -1) return false;
+    int value = enable ? 1 : 0;
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &value, sizeof(value)) != 0) {
+        return false;
+    }
+    // Drop reporting is optional, the timestamps are still useful without it
+    setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &value, sizeof(value));
+    return true;
+#else
+    Q_UNUSED(fd); Q_UNUSED(enable);
+    return false;
+#endif
+}
+
+qint64 SocketTuning::receiveWithKernelInfo(qintptr fd, char *data, qint64 maxSize, QHostAddress *host, quint16 *port,
+                                          qint64 *latencyNs, quint32 *droppedPackets) {
+#ifdef Q_OS_LINUX
+    char control[CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(quint32))];
+    struct sockaddr_storage from;
+    struct iovec iov;
+    iov.iov_base = data;
+    iov.iov_len = maxSize;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &from;
+    msg.msg_namelen = sizeof(from);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t length = recvmsg(fd, &msg, MSG_DONTWAIT);
+    if (length < 0) return -1;
+
+    if (host) {
+        host->setAddress(reinterpret_cast<struct sockaddr*>(&from));
+    }
+    if (port) {
+        *port = from.ss_family == AF_INET6
+                ? ntohs(reinterpret_cast<struct sockaddr_in6*>(&from)->sin6_port)
+                : ntohs(reinterpret_cast<struct sockaddr_in*>(&from)->sin_port);
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) continue;
+        if ((cmsg->cmsg_type == SO_TIMESTAMPNS) && latencyNs) {
+            struct timespec kernelTime;
+            struct timespec realTime;
+            memcpy(&kernelTime, CMSG_DATA(cmsg), sizeof(kernelTime));
+            clock_gettime(CLOCK_REALTIME, &realTime);
+            // The kernel stamps with the realtime clock, so only the difference is meaningful
+            *latencyNs = qMax((qint64)0, (qint64)(realTime.tv_sec - kernelTime.tv_sec) * 1000000000
+                    + (realTime.tv_nsec - kernelTime.tv_nsec));
+        }
+        else if ((cmsg->cmsg_type == SO_RXQ_OVFL) && droppedPackets) {
+            memcpy(droppedPackets, CMSG_DATA(cmsg), sizeof(quint32));
+        }
+    }
+    return length;
+#else
+    Q_UNUSED(fd); Q_UNUSED(data); Q_UNUSED(maxSize); Q_UNUSED(host); Q_UNUSED(port);
+    Q_UNUSED(latencyNs); Q_UNUSED(droppedPackets);
+    return -1;
+#endif
+}
+
+qintptr SocketTuning::duplicateDescriptor(qintptr fd) {
+#ifdef Q_OS_LINUX
+    if (fd == -1) return -1;
+    return dup(fd);
+#else
+    Q_UNUSED(fd);
+    return -1;
+#endif
+}
+
+void SocketTuning::closeDescriptor(qintptr fd) {
+#ifdef Q_OS_LINUX
+    if (fd != -1) ::close(fd);
+#else
+    Q_UNUSED(fd);
+#endif
+}
+
+int SocketTuning::getReceiveBufferUsage(qintptr fd) {
+#if defined(Q_OS_LINUX) && defined(SO_MEMINFO)
+    if (fd == -1) return -1;
+    quint32 meminfo[SK_MEMINFO_VARS];
+    socklen_t len = sizeof(meminfo);
+    if ((getsockopt(fd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0) && (meminfo[SK_MEMINFO_RCVBUF] > 0)) {
+        return (int)((quint64)meminfo[SK_MEMINFO_RMEM_ALLOC] * 100 / meminfo[SK_MEMINFO_RCVBUF]);
+    }
+#else
+    Q_UNUSED(fd);
+#endif
+    return -1;
+}
+
+} // namespace Soro
@@ -0,0 +1,48 @@
+#ifndef SORO_SOCKETTUNING_H
+#define SORO_SOCKETTUNING_H
+
+#include <QtCore>
+#include <QHostAddress>
+
+#include "soro_global.h"
+
+namespace Soro {
+
+/* Helpers for setting kernel socket options that Qt does not expose, and for
+ * reading kernel receive timestamps. These only have an effect on Linux, on other
+ * platforms they do nothing and return false.
+ */
+class LIBSORO_EXPORT SocketTuning {
+public:
+    /* Enables busy polling (SO_BUSY_POLL) for the specified number of microseconds, sets the
+     * receive buffer size, and marks the socket's traffic as interactive priority
+     */
+    static bool applyLowLatencyOptions(qintptr fd, int busyPollMicros, int receiveBufferSize);
+
+    /* Enables or disables SO_TIMESTAMPNS and SO_RXQ_OVFL on a datagram socket
+     */
+    static bool setKernelTimestamps(qintptr fd, bool enable);
+
+    /* Reads the next pending datagram without blocking, along with how long ago the kernel
+     * received it (in nanoseconds) and the socket's cumulative kernel drop count, all in one
+     * recvmsg call. Either output is left unchanged if the kernel did not provide it. Returns
+     * the datagram length, or -1 if there was no datagram or it could not be read.
+     */
+    static qint64 receiveWithKernelInfo(qintptr fd, char *data, qint64 maxSize, QHostAddress *host, quint16 *port,
+                                        qint64 *latencyNs, quint32 *droppedPackets);
+
+    /* Duplicates a socket descriptor, so the socket can be watched and read separately from
+     * the object that owns it. Returns -1 on failure.
+     */
+    static qintptr duplicateDescriptor(qintptr fd);
+
+    static void closeDescriptor(qintptr fd);
+
+    /* Gets the percentage of a socket's receive buffer that is in use, or -1
+     */
+    static int getReceiveBufferUsage(qintptr fd);
+};
+
+} // namespace Soro
+
+#endif // SORO_SOCKETTUNING_H
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "storagemanager.h"
+#include "logger.h"
+
+#include <QFileInfo>
+#include <QStorageInfo>
+
+#define LOG_TAG "StorageManager"
+
+namespace Soro {
+
+StorageManager::StorageManager(QString path, QObject *parent) : QObject(parent) {
+    _path = path;
+    check();
+    START_TIMER(_checkTimerId, STORAGEMANAGER_CHECK_INTERVAL);
+}
+
+void StorageManager::setReserve(qint64 bytes) {
+    _reserve = bytes;
+}
+
+void StorageManager::setBandwidth(qint64 bytesPerSecond) {
+    _bandwidth = bytesPerSecond;
+}
+
+int StorageManager::addRecording(QString name, int priority, qint64 budget) {
+    Recording recording;
+    recording.name = name;
+    recording.priority = priority;
+    recording.budget = budget;
+    _recordings.insert(_nextHandle, recording);
+    return _nextHandle++;
+}
+
+void StorageManager::removeRecording(int handle) {
+    _recordings.remove(handle);
+}
+
+void StorageManager::addFile(int handle, QString path) {
+    if (!_recordings.contains(handle)) return;
+    _recordings[handle].files.append(path);
+}
+
+void StorageManager::clearFiles(int handle) {
+    if (!_recordings.contains(handle)) return;
+    _recordings[handle].files.clear();
+    _recordings[handle].lastSize = -1;
+    _recordings[handle].rate = 0;
+}
+
+bool StorageManager::isSuspended(int handle) const {
+    return _recordings.value(handle).suspended;
+}
+
+bool StorageManager::hasSpace() const {
+    // Assume there is room if the free space can't be found
+    return (_freeSpace < 0) || (_freeSpace > _reserve);
+}
+
+qint64 StorageManager::getFreeSpace() const {
+    return _freeSpace;
+}
+
+qint64 StorageManager::getWriteRate() const {
+    return _writeRate;
+}
+
+void StorageManager::timerEvent(QTimerEvent *e) {
+    QObject::timerEvent(e);
+    if (e->timerId() == _checkTimerId) {
+        check();
+    }
+}
+
+void StorageManager::suspend(int handle, QString reason, bool overBudget) {
+    Recording &recording = _recordings[handle];
+    LOG_W(LOG_TAG, "Suspending recording " + recording.name + ": " + reason);
+    recording.suspended = true;
+    recording.overBudget = overBudget;
+    recording.lastSize = -1;
+    recording.rate = 0;
+    emit suspended(handle);
+}
+
+void StorageManager::check() {
+    QStorageInfo storage(_path);
+    _freeSpace = storage.isValid() ? storage.bytesAvailable() : -1;
+
+    _writeRate = 0;
+    for (auto i = _recordings.begin(); i != _recordings.end(); ++i) {
+        if (i->suspended) continue;
+        qint64 size = 0;
+        foreach (QString file, i->files) {
+            size += QFileInfo(file).size();
+        }
+        if (i->lastSize >= 0) {
+            i->rate = qMax<qint64>(size - i->lastSize, 0) * 1000 / STORAGEMANAGER_CHECK_INTERVAL;
+            i->lastRate = i->rate;
+        }
+        else {
+            // Just resumed, expect it to write as fast as it did before
+            i->rate = i->lastRate;
+        }
+        i->lastSize = size;
+        _writeRate += i->rate;
+    }
+    if (_freeSpace < 0) return;
+
+    // Recordings over their own budget go first, whatever their priority
+    foreach (int handle, _recordings.keys()) {
+        Recording recording = _recordings.value(handle);
+        if (!recording.suspended && (recording.budget > 0) && (recording.rate > recording.budget)) {
+            _writeRate -= recording.rate;
+            suspend(handle, "writing " + QString::number(recording.rate) + "B/s, over its budget of "
+                    + QString::number(recording.budget) + "B/s", true);
+        }
+    }
+
+    qint64 usable = _freeSpace - _reserve;
+    QString shortage;
+    if (usable <= 0) {
+        shortage = "less than " + QString::number(_reserve / (1024 * 1024)) + "MB of disk space left";
+    }
+    else if (usable < _writeRate * STORAGEMANAGER_DEFAULT_HORIZON) {
+        shortage = "disk will be full in " + QString::number(usable / _writeRate) + " seconds";
+    }
+    else if ((_bandwidth > 0) && (_writeRate > _bandwidth)) {
+        shortage = "writing " + QString::number(_writeRate) + "B/s, over the disk's budget of " + QString::number(_bandwidth) + "B/s";
+    }
+
+    if (!shortage.isEmpty()) {
+        // Drop one recording at a time, since that may be enough
+        int lowest = -1;
+        for (auto i = _recordings.constBegin(); i != _recordings.constEnd(); ++i) {
+            if (!i->suspended && ((lowest < 0) || (i->priority < _recordings.value(lowest).priority))) {
+                lowest = i.key();
+            }
+        }
+        if (lowest >= 0) {
+            suspend(lowest, shortage);
+        }
+    }
+    else if (usable > _reserve) {
+        // Plenty of room again, bring back the most important recording that fits
+        int highest = -1;
+        for (auto i = _recordings.constBegin(); i != _recordings.constEnd(); ++i) {
+            if (i->suspended && canResume(i.value(), usable)
+                    && ((highest < 0) || (i->priority > _recordings.value(highest).priority))) {
+                highest = i.key();
+            }
+        }
+        if (highest >= 0) {
+            LOG_I(LOG_TAG, "Resuming recording " + _recordings.value(highest).name);
+            _recordings[highest].suspended = false;
+            emit resumed(highest);
+        }
+    }
+}
+
+bool StorageManager::canResume(const Recording &recording, qint64 usable) const {
+    if (recording.overBudget) return false;
+    // Only if it would not immediately cause the shortage it was suspended for
+    qint64 rate = _writeRate + recording.lastRate;
+    return (usable >= rate * STORAGEMANAGER_DEFAULT_HORIZON) && ((_bandwidth <= 0) || (rate <= _bandwidth));
+}
+
+} // namespace Soro
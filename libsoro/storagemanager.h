@@ -0,0 +1,100 @@
+#ifndef SORO_STORAGEMANAGER_H
+#define SORO_STORAGEMANAGER_H
+
+#include <QObject>
+#include <QHash>
+#include <QStringList>
+#include <QTimerEvent>
+
+#include "constants.h"
+#include "soro_global.h"
+
+// How often free space and write rates are checked
+#define STORAGEMANAGER_CHECK_INTERVAL 2000
+// Default free space kept in reserve, so the rest of the system keeps working
+#define STORAGEMANAGER_DEFAULT_RESERVE (512LL * 1024 * 1024)
+// Recordings are suspended if the disk would fill up sooner than this at the current rate, in seconds
+#define STORAGEMANAGER_DEFAULT_HORIZON 120
+
+namespace Soro {
+
+/* Watches the free space and write rate of the disk recordings are made on, and keeps them
+ * from filling it. Each recording is registered with a priority and a write rate budget.
+ * When space or bandwidth runs short, recordings are suspended one at a time starting
+ * with the lowest priority, and resumed highest priority first once there is room again
+ * for the rate they were last writing at. A recording suspended for going over its own
+ * budget is not resumed, since it would only go over again.
+ *
+ * The manager only tells recordings when to stop and start through suspended() and
+ * resumed(); their owners do the stopping.
+ */
+class LIBSORO_EXPORT StorageManager : public QObject {
+    Q_OBJECT
+public:
+    explicit StorageManager(QString path, QObject *parent = 0);
+
+    /* Sets the free space that recordings may not use
+     */
+    void setReserve(qint64 bytes);
+
+    /* Sets the total write rate the disk is trusted with, or 0 for no limit
+     */
+    void setBandwidth(qint64 bytesPerSecond);
+
+    /* Registers a recording. Higher priority recordings are kept longer. Recordings writing
+     * faster than their budget are suspended first, or 0 for no budget.
+     */
+    int addRecording(QString name, int priority, qint64 budget = 0);
+    void removeRecording(int handle);
+
+    /* Adds a file to those whose growth counts towards a recording's write rate
+     */
+    void addFile(int handle, QString path);
+    void clearFiles(int handle);
+
+    bool isSuspended(int handle) const;
+
+    /* Returns true if a recording can start, because the free space is above the reserve
+     */
+    bool hasSpace() const;
+    qint64 getFreeSpace() const;
+    qint64 getWriteRate() const;
+
+signals:
+    void suspended(int handle);
+    void resumed(int handle);
+
+protected:
+    void timerEvent(QTimerEvent *e);
+
+private:
+    struct Recording {
+        QString name;
+        int priority = 0;
+        qint64 budget = 0;
+        QStringList files;
+        qint64 lastSize = -1;
+        qint64 rate = 0;
+        // Last rate measured while running, kept while suspended to decide when it fits again
+        qint64 lastRate = 0;
+        bool suspended = false;
+        bool overBudget = false;
+    };
+
+    QString _path;
+    qint64 _reserve = STORAGEMANAGER_DEFAULT_RESERVE;
+    qint64 _bandwidth = 0;
+    qint64 _freeSpace = -1;
+    qint64 _writeRate = 0;
+    QHash<int, Recording> _recordings;
+    int _nextHandle = 0;
+    int _checkTimerId = TIMER_INACTIVE;
+
+    void check();
+    void suspend(int handle, QString reason, bool overBudget = false);
+    bool canResume(const Recording &recording, qint64 usable) const;
+};
+
+} // namespace Soro
+
+#endif // SORO_STORAGEMANAGER_H
@@ -0,0 +1,212 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "storagewriter.h"
+#include "logger.h"
+
+#include <QThread>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#define LOG_TAG "StorageWriter"
+
+namespace Soro {
+
+class StorageWriterThread : public QThread {
+public:
+    StorageWriterThread(StorageWriter *writer) : _writer(writer) { }
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    StorageWriter *_writer;
+    qint64 _allocated = 0;
+
+    bool writeAll(const char *data, qint64 size);
+};
+
+void StorageWriterThread::run() {
+    QElapsedTimer clock;
+    clock.start();
+    qint64 budget = 0;
+    qint64 lastBudgetTime = 0;
+    _allocated = 0;
+
+    QMutexLocker locker(&_writer->_mutex);
+    forever {
+        if (!_writer->_closing && (_writer->_pending.size() < STORAGEWRITER_BLOCK_SIZE)) {
+            _writer->_dataQueued.wait(&_writer->_mutex, STORAGEWRITER_FLUSH_INTERVAL);
+        }
+        bool closing = _writer->_closing;
+        if (_writer->_failed || (closing && _writer->_pending.isEmpty())) break;
+
+        // Take whole aligned blocks, or whatever is left when flushing or closing
+        int size = qMin(_writer->_pending.size(), STORAGEWRITER_BLOCK_SIZE);
+        if (size >= STORAGEWRITER_ALIGNMENT) {
+            size -= size % STORAGEWRITER_ALIGNMENT;
+        }
+        if (size == 0) continue;
+        QByteArray block = _writer->_pending.left(size);
+        _writer->_pending.remove(0, size);
+        qint64 rateLimit = _writer->_rateLimit;
+        locker.unlock();
+
+        if (rateLimit > 0) {
+            // Token bucket holding at most one second of writes
+            qint64 now = clock.elapsed();
+            budget = qMin(budget + (now - lastBudgetTime) * rateLimit / 1000, rateLimit);
+            lastBudgetTime = now;
+            if (budget < block.size()) {
+                QThread::msleep((block.size() - budget) * 1000 / rateLimit);
+                now = clock.elapsed();
+                budget += (now - lastBudgetTime) * rateLimit / 1000;
+                lastBudgetTime = now;
+            }
+            budget -= block.size();
+        }
+        bool ok = writeAll(block.constData(), block.size());
+
+        locker.relock();
+        if (ok) {
+            _writer->_written += block.size();
+        }
+        else {
+            _writer->_failed = true;
+        }
+    }
+    locker.unlock();
+
+    // Give back the preallocated space past the end of the file
+    if (ftruncate(_writer->_fd, _writer->_written) != 0) {
+        LOG_W(LOG_TAG, "Cannot trim preallocated space: " + QString(strerror(errno)));
+    }
+}
+
+bool StorageWriterThread::writeAll(const char *data, qint64 size) {
+    qint64 offset = _writer->_written;
+    if (offset + size > _allocated) {
+        // Keeping the size means a crash doesn't leave the file padded with zeros
+        qint64 length = qMax<qint64>(STORAGEWRITER_PREALLOCATE_SIZE, size);
+        if (fallocate(_writer->_fd, FALLOC_FL_KEEP_SIZE, _allocated, offset + length - _allocated) == 0) {
+            _allocated = offset + length;
+        }
+        else if (errno == ENOSPC) {
+            QMetaObject::invokeMethod(_writer, "error", Qt::QueuedConnection, Q_ARG(QString, "Disk is full"));
+            return false;
+        }
+        // Otherwise the filesystem just doesn't support it
+    }
+    while (size > 0) {
+        ssize_t result = ::write(_writer->_fd, data, size);
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            QString message = strerror(errno);
+            LOG_E(LOG_TAG, "Write failed: " + message);
+            QMetaObject::invokeMethod(_writer, "error", Qt::QueuedConnection, Q_ARG(QString, message));
+            return false;
+        }
+        data += result;
+        size -= result;
+    }
+    return true;
+}
+
+StorageWriter::StorageWriter(QObject *parent) : QObject(parent) { }
+
+StorageWriter::~StorageWriter() {
+    close();
+}
+
+bool StorageWriter::open(QString path) {
+    close();
+    _fd = ::open(path.toLocal8Bit().constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        LOG_E(LOG_TAG, "Cannot open " + path + ": " + QString(strerror(errno)));
+        return false;
+    }
+    _pending.clear();
+    _pending.reserve(STORAGEWRITER_BLOCK_SIZE * 2);
+    _closing = false;
+    _failed = false;
+    _written = 0;
+    _dropped = 0;
+    _thread = new StorageWriterThread(this);
+    _thread->start();
+    return true;
+}
+
+void StorageWriter::close() {
+    if (!_thread) return;
+    {
+        QMutexLocker locker(&_mutex);
+        _closing = true;
+        _dataQueued.wakeAll();
+    }
+    _thread->wait();
+    delete _thread;
+    _thread = nullptr;
+    ::close(_fd);
+    _fd = -1;
+    if (_dropped > 0) {
+        LOG_W(LOG_TAG, "Dropped " + QString::number(_dropped) + " bytes the disk could not keep up with");
+    }
+}
+
+bool StorageWriter::isOpen() const {
+    return _thread != nullptr;
+}
+
+bool StorageWriter::write(const QByteArray &data) {
+    QMutexLocker locker(&_mutex);
+    if (!_thread || _failed) return false;
+    if (_pending.size() + data.size() > STORAGEWRITER_MAX_PENDING) {
+        _dropped += data.size();
+        return false;
+    }
+    _pending.append(data);
+    if (_pending.size() >= STORAGEWRITER_BLOCK_SIZE) {
+        _dataQueued.wakeAll();
+    }
+    return true;
+}
+
+void StorageWriter::setRateLimit(qint64 bytesPerSecond) {
+    QMutexLocker locker(&_mutex);
+    _rateLimit = qMax<qint64>(bytesPerSecond, 0);
+}
+
+qint64 StorageWriter::getBytesWritten() const {
+    QMutexLocker locker(&_mutex);
+    return _written;
+}
+
+qint64 StorageWriter::getBytesDropped() const {
+    QMutexLocker locker(&_mutex);
+    return _dropped;
+}
+
+qint64 StorageWriter::getBytesPending() const {
+    QMutexLocker locker(&_mutex);
+    return _pending.size();
+}
+
+} // namespace Soro
@@ -0,0 +1,81 @@
+#ifndef SORO_STORAGEWRITER_H
+#define SORO_STORAGEWRITER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "soro_global.h"
+
+// Data is written in multiples of this size, so writes stay aligned to the filesystem's blocks
+#define STORAGEWRITER_ALIGNMENT 4096
+// Largest single write
+#define STORAGEWRITER_BLOCK_SIZE (1024 * 1024)
+// Space reserved for the file at a time ahead of what has been written
+#define STORAGEWRITER_PREALLOCATE_SIZE (16 * 1024 * 1024)
+// Most data that can be waiting to be written before more is dropped
+#define STORAGEWRITER_MAX_PENDING (32 * 1024 * 1024)
+// Longest data waits before it is written even if it doesn't fill a block
+#define STORAGEWRITER_FLUSH_INTERVAL 1000
+
+namespace Soro {
+
+class StorageWriterThread;
+
+/* Writes a file from a background thread, so a slow or busy disk never blocks the caller.
+ * Data is collected into large block-aligned writes, space for the file is preallocated ahead
+ * of it to keep it contiguous, and the write rate can be limited so one writer doesn't take
+ * all of the disk's bandwidth.
+ *
+ * If the disk can't keep up, data beyond STORAGEWRITER_MAX_PENDING is dropped rather than
+ * letting memory grow, and if a write fails the writer stops and emits error().
+ */
+class LIBSORO_EXPORT StorageWriter : public QObject {
+    Q_OBJECT
+public:
+    explicit StorageWriter(QObject *parent = 0);
+    ~StorageWriter();
+
+    bool open(QString path);
+
+    /* Writes out everything queued and closes the file
+     */
+    void close();
+    bool isOpen() const;
+
+    /* Queues data to be written. Returns false if it was dropped.
+     */
+    bool write(const QByteArray &data);
+
+    /* Limits the average rate data is written at, or 0 for no limit
+     */
+    void setRateLimit(qint64 bytesPerSecond);
+
+    qint64 getBytesWritten() const;
+    qint64 getBytesDropped() const;
+    qint64 getBytesPending() const;
+
+signals:
+    /* Emitted when a write fails, for example because the disk is full
+     */
+    void error(QString message);
+
+private:
+    friend class StorageWriterThread;
+
+    mutable QMutex _mutex;
+    QWaitCondition _dataQueued;
+    QByteArray _pending;
+    StorageWriterThread *_thread = nullptr;
+    int _fd = -1;
+    bool _closing = false;
+    bool _failed = false;
+    qint64 _rateLimit = 0;
+    qint64 _written = 0;
+    qint64 _dropped = 0;
+};
+
+} // namespace Soro
+
+#endif // SORO_STORAGEWRITER_H
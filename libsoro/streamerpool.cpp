@@ -0,0 +1,180 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "streamerpool.h"
+#include "logger.h"
+
+#define LOG_TAG "StreamerPool"
+
+// Delay before replacing a worker that died before it was used
+#define RESPAWN_DELAY 1000
+// Give up replacing workers after this many die in a row before becoming ready
+#define MAX_FAILURES 5
+
+namespace Soro {
+
+StreamerPool::StreamerPool(QString program, int size, QObject *parent) : QObject(parent) {
+    _program = program;
+    _size = size;
+
+    _server = new QTcpServer(this);
+    if (!_server->listen(QHostAddress::LocalHost)) {
+        LOG_E(LOG_TAG, "Cannot listen for workers: " + _server->errorString() + ", streams will start without the pool");
+        return;
+    }
+    connect(_server, &QTcpServer::newConnection, this, &StreamerPool::serverNewConnection);
+
+    LOG_I(LOG_TAG, "Keeping " + QString::number(size) + " workers of '" + program + "' ready");
+    fill();
+}
+
+StreamerPool::~StreamerPool() {
+    // Idle workers exit on their own when their socket closes
+    foreach (Worker worker, _ready) {
+        disconnect(worker.process, 0, this, 0);
+        worker.socket->abort();
+        if (!worker.process->waitForFinished(500)) {
+            worker.process->terminate();
+            worker.process->waitForFinished(500);
+        }
+    }
+    foreach (QProcess *process, _starting) {
+        disconnect(process, 0, this, 0);
+        process->terminate();
+        process->waitForFinished(500);
+    }
+}
+
+void StreamerPool::fill() {
+    _respawnScheduled = false;
+    if (!_server->isListening()) return;
+    if (_failures >= MAX_FAILURES) {
+        LOG_E(LOG_TAG, "Workers keep exiting before they are ready, no longer starting them");
+        return;
+    }
+    while (_starting.size() + _ready.size() < _size) {
+        QProcess *process = new QProcess(this);
+        connect(process, static_cast<void (QProcess::*)(int)>(&QProcess::finished), this, &StreamerPool::workerFinished);
+        connect(process, static_cast<void (QProcess::*)(QProcess::ProcessError)>(&QProcess::error), this, &StreamerPool::workerError);
+        process->start(_program, QStringList() << "--worker" << QString::number(_server->serverPort()));
+        _starting.append(process);
+    }
+}
+
+void StreamerPool::serverNewConnection() {
+    while (_server->hasPendingConnections()) {
+        QTcpSocket *socket = _server->nextPendingConnection();
+        connect(socket, &QTcpSocket::readyRead, this, &StreamerPool::workerSocketReadyRead);
+    }
+}
+
+void StreamerPool::workerSocketReadyRead() {
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket || !socket->canReadLine()) return;
+
+    // The worker identifies itself by PID
+    QStringList items = QString(socket->readLine()).trimmed().split(' ');
+    qint64 pid = items.size() == 2 ? items[1].toLongLong() : -1;
+    foreach (QProcess *process, _starting) {
+        if ((items[0] == "ready") && (process->processId() == pid)) {
+            disconnect(socket, &QTcpSocket::readyRead, this, &StreamerPool::workerSocketReadyRead);
+            _starting.removeOne(process);
+            Worker worker;
+            worker.process = process;
+            worker.socket = socket;
+            _ready.append(worker);
+            _failures = 0;
+            LOG_I(LOG_TAG, "Worker " + QString::number(pid) + " is ready");
+            return;
+        }
+    }
+    LOG_W(LOG_TAG, "Got unknown connection to the pool, closing it");
+    socket->abort();
+    socket->deleteLater();
+}
+
+QProcess* StreamerPool::startWorker(const QStringList &args, QObject *newParent) {
+    while (!_ready.isEmpty()) {
+        Worker worker = _ready.takeFirst();
+        disconnect(worker.process, 0, this, 0);
+        if (worker.process->state() != QProcess::Running) {
+            worker.process->deleteLater();
+            worker.socket->deleteLater();
+            continue;
+        }
+        // Arguments are tab separated so they can contain spaces
+        worker.socket->write("start\t" + args.join('\t').toLocal8Bit() + "\n");
+        worker.socket->flush();
+        worker.socket->disconnectFromHost();
+        worker.socket->deleteLater();
+        worker.process->setParent(newParent);
+
+        LOG_I(LOG_TAG, "Handed stream to worker " + QString::number(worker.process->processId()));
+        fill();
+        return worker.process;
+    }
+    fill();
+    return nullptr;
+}
+
+void StreamerPool::workerFinished() {
+    QProcess *process = qobject_cast<QProcess*>(sender());
+    if (!process) return;
+    LOG_W(LOG_TAG, "Idle worker exited with code " + QString::number(process->exitCode()) + ", replacing it");
+    replaceWorker(process);
+}
+
+void StreamerPool::workerError(QProcess::ProcessError error) {
+    QProcess *process = qobject_cast<QProcess*>(sender());
+    // Only a failed start never emits finished(), other errors are followed by it
+    if (!process || (error != QProcess::FailedToStart)) return;
+    LOG_W(LOG_TAG, "Worker failed to start: " + process->errorString() + ", replacing it");
+    replaceWorker(process);
+}
+
+void StreamerPool::replaceWorker(QProcess *process) {
+    disconnect(process, 0, this, 0);
+    if (_starting.contains(process)) {
+        _failures++;
+    }
+    removeWorker(process);
+    if (!_respawnScheduled) {
+        _respawnScheduled = true;
+        QTimer::singleShot(RESPAWN_DELAY, this, SLOT(fill()));
+    }
+}
+
+void StreamerPool::removeWorker(QProcess *process) {
+    _starting.removeOne(process);
+    for (int i = 0; i < _ready.size(); i++) {
+        if (_ready[i].process == process) {
+            _ready[i].socket->deleteLater();
+            _ready.removeAt(i);
+            break;
+        }
+    }
+    process->deleteLater();
+}
+
+int StreamerPool::getReadyCount() const {
+    return _ready.size();
+}
+
+QString StreamerPool::getProgram() const {
+    return _program;
+}
+
+} // namespace Soro
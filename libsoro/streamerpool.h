@@ -0,0 +1,71 @@
+#ifndef SORO_STREAMERPOOL_H
+#define SORO_STREAMERPOOL_H
+
+#include <QObject>
+#include <QProcess>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include "soro_global.h"
+#include "constants.h"
+
+namespace Soro {
+
+/* Keeps a number of streaming processes (video_streamer, audio_streamer) started ahead of time.
+ *
+ * Each worker is started with the arguments "--worker <port>", initializes gstreamer and loads its
+ * plugins, then connects to this pool and waits. When a MediaServer needs a stream it hands a worker
+ * the same arguments it would normally start the process with, so starting a stream only costs building
+ * the pipeline. Workers are used for a single stream so a crash still only takes down that stream,
+ * and a replacement is started as soon as one is taken or dies.
+ */
+class LIBSORO_EXPORT StreamerPool : public QObject {
+    Q_OBJECT
+public:
+    /**
+     * @param program Path to the streaming binary
+     * @param size Number of workers to keep ready
+     */
+    StreamerPool(QString program, int size, QObject *parent = 0);
+    ~StreamerPool();
+
+    /**
+     * Gives a ready worker the arguments for a stream. The worker's process is returned and is
+     * now owned by newParent. Returns nullptr if no worker is ready, in which case the caller should
+     * start the process itself.
+     */
+    QProcess* startWorker(const QStringList &args, QObject *newParent);
+
+    int getReadyCount() const;
+    QString getProgram() const;
+
+private:
+    struct Worker {
+        QProcess *process;
+        QTcpSocket *socket;
+    };
+
+    QString _program;
+    int _size;
+    int _failures = 0;
+    bool _respawnScheduled = false;
+    QTcpServer *_server = nullptr;
+    QList<QProcess*> _starting;
+    QList<Worker> _ready;
+
+    void removeWorker(QProcess *process);
+    /* Drops a worker that exited or never started, counting it as a failure if it was not ready yet
+     */
+    void replaceWorker(QProcess *process);
+
+private slots:
+    void fill();
+    void serverNewConnection();
+    void workerSocketReadyRead();
+    void workerFinished();
+    void workerError(QProcess::ProcessError error);
+};
+
+} // namespace Soro
+
+#endif // SORO_STREAMERPOOL_H
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "streamstarttiming.h"
+
+namespace Soro {
+
+StreamStartTiming::StreamStartTiming() {
+    reset();
+}
+
+void StreamStartTiming::start() {
+    _phases.clear();
+    _lastMark = 0;
+    _timer.start();
+}
+
+void StreamStartTiming::reset() {
+    _phases.clear();
+    _lastMark = 0;
+    _timer.invalidate();
+}
+
+void StreamStartTiming::mark(QString phase) {
+    if (!_timer.isValid()) return;
+    qint64 now = _timer.elapsed();
+    _phases.append(QPair<QString, qint64>(phase, now - _lastMark));
+    _lastMark = now;
+}
+
+bool StreamStartTiming::isStarted() const {
+    return _timer.isValid();
+}
+
+bool StreamStartTiming::hasPhase(QString phase) const {
+    return getPhaseTime(phase) >= 0;
+}
+
+qint64 StreamStartTiming::getPhaseTime(QString phase) const {
+    for (int i = 0; i < _phases.size(); i++) {
+        if (_phases[i].first == phase) return _phases[i].second;
+    }
+    return -1;
+}
+
+qint64 StreamStartTiming::getTotalTime() const {
+    return _lastMark;
+}
+
+QStringList StreamStartTiming::getPhases() const {
+    QStringList phases;
+    for (int i = 0; i < _phases.size(); i++) {
+        phases << _phases[i].first;
+    }
+    return phases;
+}
+
+QString StreamStartTiming::toString() const {
+    QString str = QString::number(_lastMark) + "ms (";
+    for (int i = 0; i < _phases.size(); i++) {
+        if (i > 0) str += ", ";
+        str += _phases[i].first + " " + QString::number(_phases[i].second) + "ms";
+    }
+    return str + ")";
+}
+
+} // namespace Soro
@@ -0,0 +1,57 @@
+#ifndef SORO_STREAMSTARTTIMING_H
+#define SORO_STREAMSTARTTIMING_H
+
+#include <QtCore>
+
+#include "soro_global.h"
+
+/* Phases of starting a media stream, in the order they complete
+ */
+// Server: waiting for the client's control channel to connect
+#define STREAMSTART_PHASE_CONTROL       "control"
+// Server: "start" sent until the client's UDP punch arrives
+#define STREAMSTART_PHASE_PUNCH         "punch"
+// Server: punch received until the streamer has connected back over IPC
+#define STREAMSTART_PHASE_STREAMER      "streamer"
+// Client: "start" received until the server's "streaming" confirmation
+#define STREAMSTART_PHASE_CONFIRM       "confirm"
+// Client: "streaming" received until the first media packet
+#define STREAMSTART_PHASE_FIRST_PACKET  "first_packet"
+
+namespace Soro {
+
+/* Records how long each phase of starting a media stream takes, so stream start
+ * latency can be broken down and measured on both ends. Each mark() records the time
+ * since the previous mark (or since start()) under the given phase name.
+ */
+class LIBSORO_EXPORT StreamStartTiming {
+public:
+    StreamStartTiming();
+
+    void start();
+    void mark(QString phase);
+    void reset();
+
+    bool isStarted() const;
+    bool hasPhase(QString phase) const;
+
+    /* Gets the duration of a phase in milliseconds, or -1 if it has not completed
+     */
+    qint64 getPhaseTime(QString phase) const;
+
+    /* Gets the time from start() until the last mark in milliseconds
+     */
+    qint64 getTotalTime() const;
+
+    QStringList getPhases() const;
+    QString toString() const;
+
+private:
+    QElapsedTimer _timer;
+    qint64 _lastMark;
+    QList<QPair<QString, qint64>> _phases;
+};
+
+} // namespace Soro
+
+#endif // SORO_STREAMSTARTTIMING_H
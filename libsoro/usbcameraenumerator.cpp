@@ -17,63 +17,149 @@
 #include "usbcameraenumerator.h"
 #include "logger.h"
 
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QtConcurrent/QtConcurrentMap>
+
+#ifdef Q_OS_LINUX
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/videodev2.h>
+#endif
+
 #define LOG_TAG "UsbCameraEnumerator"
 
+#define SYSFS_VIDEO_DIR "/sys/class/video4linux/"
 
 namespace Soro {
 
+/* Cameras that have already been opened, by device node. An entry is used for as long as the
+ * node still has the same identity, which changes when the camera is replugged.
+ */
+struct CachedCamera {
+    QString identity;
+    UsbCamera camera;
+};
+static QHash<QString, CachedCamera> _cameraCache;
+static QMutex _cameraCacheMutex;
+
+static QString readSysfsAttribute(const QDir &dir, QString name) {
+    QFile file(dir.filePath(name));
+    if (!file.open(QIODevice::ReadOnly)) return "";
+    return QString(file.readAll()).trimmed();
+}
+
+/* Identifies the physical device behind a node by its place on the bus, device number and
+ * the time the node was created
+ */
+static QString getIdentity(QString file) {
+    QString identity = QFileInfo(SYSFS_VIDEO_DIR + file + "/device").canonicalFilePath();
+#ifdef Q_OS_LINUX
+    struct stat info;
+    if (stat(("/dev/" + file).toLocal8Bit().constData(), &info) == 0) {
+        identity += QString(":%1:%2.%3").arg(
+                    QString::number((qulonglong)info.st_rdev),
+                    QString::number((qlonglong)info.st_ctim.tv_sec),
+                    QString::number((qlonglong)info.st_ctim.tv_nsec));
+    }
+#endif
+    return identity;
+}
+
+/* Reads a camera's details from sysfs, and opens it to find its capabilities and modes.
+ * Run in parallel for each camera, as opening one can wake it up from suspend.
+ */
+static void probeCamera(UsbCamera *camera) {
+    QString file = QFileInfo(camera->device).fileName();
+    QDir node(SYSFS_VIDEO_DIR + file);
+    camera->name = readSysfsAttribute(node, "name");
+
+    // The node belongs to a USB interface, its parent is the USB device
+    QString devicePath = QFileInfo(node.filePath("device")).canonicalFilePath();
+    QDir usb(devicePath);
+    while (!devicePath.isEmpty() && !usb.isRoot() && !usb.exists("idVendor")) {
+        usb.cdUp();
+    }
+    if (!devicePath.isEmpty() && !usb.isRoot()) {
+        camera->vendorId = readSysfsAttribute(usb, "idVendor");
+        camera->productId = readSysfsAttribute(usb, "idProduct");
+        camera->serial = readSysfsAttribute(usb, "serial");
+    }
+
+#ifdef Q_OS_LINUX
+    int fd = open(camera->device.toLocal8Bit().constData(), O_RDWR | O_NONBLOCK);
+    if (fd < 0) return;
+    v4l2_capability caps;
+    memset(&caps, 0, sizeof(caps));
+    if (ioctl(fd, VIDIOC_QUERYCAP, &caps) == 0) {
+        camera->driver = QString((const char*)caps.driver);
+        camera->capabilities = (caps.capabilities & V4L2_CAP_DEVICE_CAPS) ? caps.device_caps : caps.capabilities;
+    }
+    close(fd);
+#endif
+
+    if (camera->isCaptureDevice()) {
+        camera->modes = CaptureMode::probe(camera->device);
+    }
+}
+
 int UsbCameraEnumerator::loadCameras() {
     clearList();
 
     // Search for all /dev/video* devices
-
     QDir dev("/dev");
-    QStringList allFiles = dev.entryList(QDir::NoDotAndDotDot | QDir::System | QDir::Files);
-
-    foreach (QString file, allFiles) {
-        if (file.contains("video")) {
-
-            // Found a new dev device
+    QStringList allFiles = dev.entryList(QStringList() << "video*", QDir::NoDotAndDotDot | QDir::System | QDir::Files);
+
+    QList<UsbCamera*> found;
+    QList<UsbCamera*> unknown;
+    QHash<UsbCamera*, QString> identities;
+    {
+        QMutexLocker locker(&_cameraCacheMutex);
+        foreach (QString file, allFiles) {
             UsbCamera *camera = new UsbCamera;
             camera->device = "/dev/" + file;
-
-            // Use udevadm to get info about each /dev/video* device
-            QProcess udevadm;
-            udevadm.start("udevadm info -a -n " + camera->device);
-            udevadm.waitForFinished();
-            QString udevadmOutput = QString(udevadm.readAllStandardOutput());
-
-            QLatin1String nameToken("{name}==\"");
-            int nameIndex = udevadmOutput.indexOf(nameToken);
-            if (nameIndex >= 0) {
-                nameIndex += nameToken.size();
-                camera->name = udevadmOutput.mid(nameIndex, udevadmOutput.indexOf("\"", nameIndex) - nameIndex);
-            }
-
-            QLatin1String vendorToken("{idVendor}==\"");
-            int vendorIndex = udevadmOutput.indexOf(vendorToken);
-            if (vendorIndex >= 0) {
-                vendorIndex += vendorToken.size();
-                camera->vendorId = udevadmOutput.mid(vendorIndex, udevadmOutput.indexOf("\"", vendorIndex) - vendorIndex);
+            QString identity = getIdentity(file);
+            if (_cameraCache.contains(camera->device) && (_cameraCache[camera->device].identity == identity)) {
+                *camera = _cameraCache[camera->device].camera;
             }
-
-            QLatin1String productToken("{idProduct}==\"");
-            int productIndex = udevadmOutput.indexOf(productToken);
-            if (productIndex >= 0) {
-                productIndex += productToken.size();
-                camera->productId = udevadmOutput.mid(productIndex, udevadmOutput.indexOf("\"", productIndex) - productIndex);
+            else {
+                unknown.append(camera);
+                identities.insert(camera, identity);
             }
+            found.append(camera);
+        }
+    }
 
-            QLatin1String serialToken("{serial}==\"");
-            int serialIndex = udevadmOutput.indexOf(serialToken);
-            if (serialIndex >= 0) {
-                serialIndex += serialToken.size();
-                camera->serial = udevadmOutput.mid(serialIndex, udevadmOutput.indexOf("\"", serialIndex) - serialIndex);
-            }
+    if (!unknown.isEmpty()) {
+        LOG_I(LOG_TAG, "Probing " + QString::number(unknown.size()) + " new video devices");
+        QtConcurrent::blockingMap(unknown, probeCamera);
+
+        QMutexLocker locker(&_cameraCacheMutex);
+        foreach (UsbCamera *camera, unknown) {
+            // Devices that couldn't be opened are tried again next time
+            if (camera->capabilities == 0) continue;
+            CachedCamera &cached = _cameraCache[camera->device];
+            cached.identity = identities.value(camera);
+            cached.camera = *camera;
+        }
+    }
 
-            LOG_I(LOG_TAG, "Found camera " + camera->toString());
-            _cameras.append(camera);
+    foreach (UsbCamera *camera, found) {
+        if (!camera->isCaptureDevice()) {
+            // Metadata nodes, and devices that can't be opened
+            LOG_I(LOG_TAG, "Ignoring " + camera->device + ", it cannot capture video");
+            delete camera;
+            continue;
         }
+        LOG_I(LOG_TAG, "Found camera " + camera->toString() + " (" + camera->driver + ") with "
+              + QString::number(camera->modes.size()) + " capture modes");
+        _cameras.append(camera);
     }
 
     return _cameras.length();
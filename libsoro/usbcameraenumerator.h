@@ -2,7 +2,13 @@
 #define SORO_USBCAMERAENUMERATOR_H
 
 #include <QList>
+#include <QString>
 #include "soro_global.h"
+#include "capturemode.h"
+
+// Same values as V4L2_CAP_VIDEO_CAPTURE and V4L2_CAP_STREAMING
+#define USBCAMERA_CAP_VIDEO_CAPTURE 0x00000001
+#define USBCAMERA_CAP_STREAMING 0x04000000
 
 namespace Soro {
 
@@ -24,6 +30,22 @@ struct UsbCamera {
     /* Camera device file (/dev/video*)
      */
     QString device;
+    /* Name of the kernel driver (such as uvcvideo)
+     */
+    QString driver;
+    /* V4L2 capabilities of the device node (V4L2_CAP_*)
+     */
+    quint32 capabilities = 0;
+    /* Modes the camera can capture in. Empty if the device could not be queried.
+     */
+    QList<CaptureMode> modes;
+
+    /* Returns true if frames can be captured from this node. Cameras often have a second
+     * node that only gives metadata, which is not.
+     */
+    bool isCaptureDevice() const {
+        return capabilities & USBCAMERA_CAP_VIDEO_CAPTURE;
+    }
 
     QString toString() const {
         QString str = "{";
@@ -50,6 +72,8 @@ class LIBSORO_EXPORT UsbCameraEnumerator {
 
 public:
     /* Enumerates all USB cameras connected, and returns the number of cameras detected.
+     * Details are read from sysfs, and cameras not seen before are opened in parallel to find their
+     * capabilities and modes. Cameras are only opened again once they have been replugged.
      */
     int loadCameras();
 
@@ -16,6 +16,8 @@
 
 #include "videoclient.h"
 
+#include <QtEndian>
+
 namespace Soro {
 
 void VideoClient::onServerStreamingMessageInternal(QDataStream& stream) {
@@ -52,4 +54,62 @@ void VideoClient::onServerDisconnectedInternal() {
     _format.setEncoding(VideoFormat::Encoding_Null);
 }
 
+bool VideoClient::isKeyframe(const uchar *payload, int size) const {
+    int type;
+    switch (_format.getEncoding()) {
+    case VideoFormat::Encoding_MJPEG:
+        // Every frame is complete
+        return true;
+    case VideoFormat::Encoding_H264:
+        type = payload[0] & 0x1F;
+        if (type == 28) {
+            // FU-A, the fragmented NAL's type is in the FU header
+            return (size > 1) && (payload[1] & 0x80) && ((payload[1] & 0x1F) == 5);
+        }
+        if (type == 24) {
+            // STAP-A, aggregates parameter sets with the IDR slice
+            for (int i = 1; i + 2 < size; i += 2 + qFromBigEndian<quint16>(payload + i)) {
+                int nal = payload[i + 2] & 0x1F;
+                if ((nal == 5) || (nal == 7)) return true;
+            }
+            return false;
+        }
+        // IDR slice or SPS
+        return (type == 5) || (type == 7);
+    case VideoFormat::Encoding_H265:
+        if (size < 3) return false;
+        type = (payload[0] >> 1) & 0x3F;
+        if (type == 49) {
+            // Fragmentation unit
+            return (payload[2] & 0x80) && ((payload[2] & 0x3F) >= 16) && ((payload[2] & 0x3F) <= 21);
+        }
+        // IRAP slices, or the VPS/SPS/PPS sent ahead of them
+        return ((type >= 16) && (type <= 21)) || ((type >= 32) && (type <= 34)) || (type == 48);
+    case VideoFormat::Encoding_VP8: {
+        // Skip the payload descriptor, the frame header is only in the first partition's first packet
+        int i = 1;
+        if ((payload[0] & 0x17) != 0x10) return false;
+        if (payload[0] & 0x80) {
+            if (size < 2) return false;
+            uchar extension = payload[1];
+            i = 2;
+            if (extension & 0x80) i += (i < size) && (payload[i] & 0x80) ? 2 : 1;
+            if (extension & 0x40) i++;
+            if (extension & 0x30) i++;
+        }
+        return (i < size) && ((payload[i] & 0x01) == 0);
+    }
+    case VideoFormat::Encoding_MPEG4:
+        // Intra coded VOP start code
+        for (int i = 0; i + 4 < size; i++) {
+            if ((payload[i] == 0) && (payload[i + 1] == 0) && (payload[i + 2] == 1) && (payload[i + 3] == 0xB6)) {
+                return (payload[i + 4] >> 6) == 0;
+            }
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
 } // namespace Soro
@@ -37,6 +37,7 @@ protected:
     void onServerErrorMessageInternal() Q_DECL_OVERRIDE;
     void onServerConnectedInternal() Q_DECL_OVERRIDE;
     void onServerDisconnectedInternal() Q_DECL_OVERRIDE;
+    bool isKeyframe(const uchar *payload, int size) const Q_DECL_OVERRIDE;
 };
 
 } // namespace Soro
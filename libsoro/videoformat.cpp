@@ -14,6 +14,7 @@ VideoFormat::VideoFormat() {
     _maxThreads = 3;
     _mjpegQuality = 50;
     _framerate = 0;
+    _keyframeInterval = 0;
 }
 
 VideoFormat::VideoFormat(const VideoFormat &other) {
@@ -24,6 +25,7 @@ VideoFormat::VideoFormat(const VideoFormat &other) {
     _maxThreads = other._maxThreads;
     _mjpegQuality = other._mjpegQuality;
     _framerate = other._framerate;
+    _keyframeInterval = other._keyframeInterval;
 }
 
 VideoFormat::VideoFormat(VideoFormat::Encoding encoding, VideoFormat::Resolution resolution, quint32 bitrate,
@@ -35,6 +37,7 @@ VideoFormat::VideoFormat(VideoFormat::Encoding encoding, VideoFormat::Resolution
     _stereoMode = stereo;
     _maxThreads = maxThreads;
     _mjpegQuality = mjpegQuality;
+    _keyframeInterval = 0;
 }
 
 VideoFormat::~VideoFormat() { }
@@ -71,6 +74,10 @@ quint32 VideoFormat::getMjpegQuality() const {
     return _mjpegQuality;
 }
 
+quint32 VideoFormat::getKeyframeInterval() const {
+    return _keyframeInterval;
+}
+
 void VideoFormat::setEncoding(VideoFormat::Encoding encoding) {
     _encoding = encoding;
 }
@@ -99,6 +106,10 @@ void VideoFormat::setMjpegQuality(quint32 quality) {
     _mjpegQuality = quality;
 }
 
+void VideoFormat::setKeyframeInterval(quint32 frames) {
+    _keyframeInterval = frames;
+}
+
 quint32 VideoFormat::getResolutionWidth() const {
     switch (_resolution) {
     case Resolution_176_144:    return 176;
@@ -196,51 +207,96 @@ QString VideoFormat::toHumanReadableString() const {
 }
 
 QString VideoFormat::createGstEncodingArgs() const {
+    return createGstEncodingArgs(CaptureMode());
+}
+
+QString VideoFormat::createGstEncodingArgs(const CaptureMode &mode) const {
     QString encString = "";
+    QString captureString = "";
+    QString scaleEncString = "";
     QString stereoEncString = "";
     QString framerateEncString = "";
-    int bitrate = _bitrate;
+    QString payloadString = createGstPayloaderArgs();
+
+    if (mode.isValid()) {
+        captureString = QString("capsfilter caps=\"%1\" ! ").arg(mode.createGstCaps());
+        if (mode.isPassthroughFor(*this)) {
+            // The camera already gives us the stream we want, so it only needs to be payloaded
+            encString = captureString;
+            if (_encoding == Encoding_H264) {
+                // Repeats the stream headers on keyframes, so a late receiver can decode
+                encString += "h264parse config-interval=-1 ! ";
+            }
+            encString += payloadString;
+            LOG_I(LOG_TAG, "Requested to create video passthrough string: " + encString);
+            return encString;
+        }
+    }
+
+    QString encoderString = createGstEncoderArgs();
+    if (encoderString.isEmpty()) {
+        return "";
+    }
+
+    // Caps filters and videorate are named so they can be changed on a running pipeline
+    if (!mode.isValid() || ((int)getWidth() != mode.width) || ((int)getHeight() != mode.height)) {
+        scaleEncString = QString("videoscale method=0 ! "
+                                 "capsfilter name=" VIDEOFORMAT_GST_SCALECAPS_NAME " caps=\"%1\" ! ").arg(createGstScaleCaps());
+    }
 
     switch (_stereoMode) {
     case StereoMode_SideBySide:
         stereoEncString = "videoscale method=0 add-borders=false ! "
-                          "video/x-raw,width=%1,height=%2 ! ";
-        stereoEncString = stereoEncString.arg(QString::number(getWidth()),
-                                              QString::number(getHeight()));
-        bitrate /= 2;
+                          "capsfilter name=" VIDEOFORMAT_GST_STEREOCAPS_NAME " caps=\"%1\" ! ";
+        stereoEncString = stereoEncString.arg(createGstStereoCaps());
         break;
     default:
         break;
     }
 
     if (_framerate > 0) {
-        framerateEncString = QString(
-                        "videorate ! "
-                        "video/x-raw,framerate=%1/1 ! "
-                    ).arg(
-                        QString::number(_framerate)
-                    );
+        framerateEncString = "videorate name=" VIDEOFORMAT_GST_RATE_NAME " ! ";
+    }
+    else {
+        // Only drop frames, so max-rate can lower the framerate later
+        framerateEncString = "videorate name=" VIDEOFORMAT_GST_RATE_NAME " drop-only=true ! ";
     }
+    framerateEncString += QString("capsfilter name=" VIDEOFORMAT_GST_RATECAPS_NAME " caps=\"%1\" ! ").arg(createGstFramerateCaps());
 
-    // Common encoding params for all codecs
-    encString = QString(
-                    "videoscale method=0 ! "
-                    "video/x-raw,format=I420,width=%1,height=%2 ! "
-                    "%3" // For stereo
-                    "%4" // For framerate
-                    "videoconvert ! "
-                ).arg(
-                    QString::number(getResolutionWidth()),
-                    QString::number(getResolutionHeight()),
-                    stereoEncString,
-                    framerateEncString
-                );
+    // Common encoding params for all codecs. The camera's native size needs no scaling, and
+    // videoconvert passes frames through untouched when they are already I420.
+    encString = captureString + scaleEncString + stereoEncString + framerateEncString + "videoconvert ! ";
+    encString += encoderString + " ! " + payloadString;
+
+    LOG_I(LOG_TAG, "Requested to create video encoding string: " + encString);
+    return encString;
+}
+
+QString VideoFormat::createGstPayloaderArgs() const {
+    switch (_encoding) {
+    case Encoding_MPEG4:
+        return "rtpmp4vpay config-interval=3 pt=96";
+    case Encoding_MJPEG:
+        return "rtpjpegpay";
+    case Encoding_H264:
+        return "rtph264pay config-interval=3 pt=96";
+    case Encoding_VP8:
+        return "rtpvp8pay pt=96";
+    case Encoding_H265:
+        return "rtph265pay config-interval=3 pt=96";
+    default:
+        return "";
+    }
+}
+
+QString VideoFormat::createGstEncoderArgs(QString name) const {
+    QString encString;
+    int bitrate = getEncoderBitrate();
 
     switch (_encoding) {
     case Encoding_MPEG4: // MPEG4 has no VAAPI encoder
-        encString += QString(
-                        "avenc_mpeg4 bitrate=%1 bitrate-tolerance=%2 max-threads=%3 ! "
-                        "rtpmp4vpay config-interval=3 pt=96"
+        encString = QString(
+                        "avenc_mpeg4 name=" VIDEOFORMAT_GST_ENCODER_NAME " bitrate=%1 bitrate-tolerance=%2 max-threads=%3"
                     ).arg(
                         QString::number(bitrate),  // mpeg4 has bitrate in bit/sec
                         QString::number(bitrate / 4),
@@ -249,66 +305,60 @@ QString VideoFormat::createGstEncodingArgs() const {
         break;
 #ifdef USE_VAAPI_ENCODE
     case Encoding_MJPEG:
-        encString += QString(
-                        "vaapijpegenc quality=%1 ! rtpjpegpay"
+        encString = QString(
+                        "vaapijpegenc name=" VIDEOFORMAT_GST_ENCODER_NAME " quality=%1"
                     ).arg(
                         QString::number(_mjpegQuality)
                     );
         break;
     case Encoding_H264:
-        encString += QString(
-                        "vaapih264enc bitrate=%1 ! "
-                        "rtph264pay config-interval=3 pt=96"
+        encString = QString(
+                        "vaapih264enc name=" VIDEOFORMAT_GST_ENCODER_NAME " bitrate=%1"
                     ).arg(
                         QString::number(bitrate / 1000) // x264 has bitrate in kbit/sec
                     );
         break;
     case Encoding_VP8:
-        encString += QString(
-                        "vaapivp8enc bitrate=%1 ! "
-                        "rtpvp8pay pt=96"
+        encString = QString(
+                        "vaapivp8enc name=" VIDEOFORMAT_GST_ENCODER_NAME " bitrate=%1"
                     ).arg(
                         QString::number(bitrate) // vp8 has bitrate in bit/sec
                     );
         break;
     case Encoding_H265:
-        encString += QString(
-                        "vaapih265enc bitrate=%1 ! "
-                        "rtph265pay config-interval=3 pt=96"
+        encString = QString(
+                        "vaapih265enc name=" VIDEOFORMAT_GST_ENCODER_NAME " bitrate=%1"
                     ).arg(
                         QString::number(bitrate / 1000) // x265 has bitrate in kbit/sec
                     );
         break;
 #else
     case Encoding_MJPEG:
-        encString += QString(
-                        "jpegenc quality=%1 ! rtpjpegpay"
+        encString = QString(
+                        "jpegenc name=" VIDEOFORMAT_GST_ENCODER_NAME " quality=%1"
                     ).arg(
                         QString::number(_mjpegQuality)
                     );
         break;
     case Encoding_H264:
-        encString += QString(
-                        "x264enc tune=zerolatency bitrate=%1 threads=%2 ! "
-                        "rtph264pay config-interval=3 pt=96"
+        encString = QString(
+                        "x264enc name=" VIDEOFORMAT_GST_ENCODER_NAME " tune=zerolatency bitrate=%1 threads=%2"
                     ).arg(
                         QString::number(bitrate / 1000), // x264 has bitrate in kbit/sec
                         QString::number(_maxThreads)
                     );
         break;
     case Encoding_VP8:
-        encString += QString(
-                        "vp8enc target-bitrate=%1 threads=%2 ! "
-                        "rtpvp8pay pt=96"
+        encString = QString(
+                        "vp8enc name=" VIDEOFORMAT_GST_ENCODER_NAME " target-bitrate=%1 threads=%2"
                     ).arg(
                         QString::number(bitrate), // vp8 has bitrate in bit/sec
                         QString::number(_maxThreads)
                     );
         break;
     case Encoding_H265:
-        encString += QString(
-                        "x265enc speed-preset=ultrafast tune=zerolatency bitrate=%1 ! "
-                        "rtph265pay config-interval=3 pt=96"
+        encString = QString(
+                        "x265enc name=" VIDEOFORMAT_GST_ENCODER_NAME " speed-preset=ultrafast tune=zerolatency bitrate=%1"
                     ).arg(
                         QString::number(bitrate / 1000) // x265 has bitrate in kbit/sec
                     );
@@ -320,10 +370,91 @@ QString VideoFormat::createGstEncodingArgs() const {
         return "";
     }
 
-    LOG_I(LOG_TAG, "Requested to create video encoding string: " + encString);
+    QString keyframeProperty = getGstEncoderKeyframeProperty();
+    if ((_keyframeInterval > 0) && !keyframeProperty.isEmpty()) {
+        encString += " " + keyframeProperty + "=" + QString::number(_keyframeInterval);
+    }
+    if (name != VIDEOFORMAT_GST_ENCODER_NAME) {
+        encString.replace("name=" VIDEOFORMAT_GST_ENCODER_NAME, "name=" + name);
+    }
     return encString;
 }
 
+QString VideoFormat::createGstScaleCaps() const {
+    return QString("video/x-raw,format=I420,width=%1,height=%2").arg(
+                QString::number(getResolutionWidth()),
+                QString::number(getResolutionHeight()));
+}
+
+QString VideoFormat::createGstStereoCaps() const {
+    return QString("video/x-raw,width=%1,height=%2").arg(
+                QString::number(getWidth()),
+                QString::number(getHeight()));
+}
+
+QString VideoFormat::createGstFramerateCaps() const {
+    if (_framerate > 0) {
+        return QString("video/x-raw,framerate=%1/1").arg(QString::number(_framerate));
+    }
+    return "video/x-raw";
+}
+
+QString VideoFormat::getGstEncoderKeyframeProperty() const {
+    switch (_encoding) {
+    case Encoding_MPEG4:
+        return "gop-size";
+#ifdef USE_VAAPI_ENCODE
+    case Encoding_H264:
+    case Encoding_VP8:
+    case Encoding_H265:
+        return "keyframe-period";
+#else
+    case Encoding_H264:
+    case Encoding_H265:
+        return "key-int-max";
+    case Encoding_VP8:
+        return "keyframe-max-dist";
+#endif
+    default:
+        // Every MJPEG frame is a keyframe
+        return "";
+    }
+}
+
+quint32 VideoFormat::getEncoderBitrate() const {
+    return _stereoMode == StereoMode_SideBySide ? _bitrate / 2 : _bitrate;
+}
+
+QString VideoFormat::getGstEncoderBitrateProperty() const {
+    switch (_encoding) {
+    case Encoding_MPEG4:
+        return "bitrate";
+    case Encoding_H264:
+    case Encoding_H265:
+        return "bitrate";
+#ifdef USE_VAAPI_ENCODE
+    case Encoding_VP8:
+        return "bitrate";
+#else
+    case Encoding_VP8:
+        return "target-bitrate";
+#endif
+    default:
+        // MJPEG has no bitrate control
+        return "";
+    }
+}
+
+quint32 VideoFormat::getGstEncoderBitrateValue() const {
+    switch (_encoding) {
+    case Encoding_H264:
+    case Encoding_H265:
+        return getEncoderBitrate() / 1000; // kbit/sec
+    default:
+        return getEncoderBitrate(); // bit/sec
+    }
+}
+
 QString VideoFormat::createGstDecodingArgs(VideoFormat::DecodingType type) const {
     QString decString;
     switch (_encoding) {
@@ -434,7 +565,25 @@ QString VideoFormat::createGstFileRecordingArgs(QString fileName) const {
     case Encoding_VP8:
         return QString("queue ! webmmux streamable=true ! queue ! filesink location=%1").arg(fileName);
     case Encoding_H265:
-        return QString("h265parse ! queue ! matroskamux ! queue ! filesink location=%1");
+        return QString("h265parse ! queue ! matroskamux ! queue ! filesink location=%1").arg(fileName);
+    default:
+        return "";
+    }
+}
+
+QString VideoFormat::createGstParserArgs() const {
+    switch (_encoding) {
+    case Encoding_MPEG4:
+        return "mpeg4videoparse";
+    case Encoding_H264:
+        return "h264parse";
+    case Encoding_MJPEG:
+        return "jpegparse";
+    case Encoding_VP8:
+        // VP8 frames can be muxed as they are
+        return "identity";
+    case Encoding_H265:
+        return "h265parse";
     default:
         return "";
     }
@@ -448,7 +597,8 @@ QString VideoFormat::serialize() const {
     serial += QString::number(_framerate) + "_";
     serial += QString::number(_bitrate) + "_";
     serial += QString::number(_maxThreads) + "_";
-    serial += QString::number(_mjpegQuality);
+    serial += QString::number(_mjpegQuality) + "_";
+    serial += QString::number(_keyframeInterval);
     return serial;
 }
 
@@ -488,6 +638,14 @@ void VideoFormat::deserialize(QString serial) {
     if (!ok) {
         LOG_E(LOG_TAG, "deserialize(): Invalid option for mjpeg quality");
     }
+    // Keyframe interval was added later and may not be present
+    _keyframeInterval = 0;
+    if (items.size() > 7) {
+        _keyframeInterval = items[7].toUInt(&ok);
+        if (!ok) {
+            LOG_E(LOG_TAG, "deserialize(): Invalid option for keyframe interval");
+        }
+    }
 }
 
 } // namespace Soro
@@ -3,8 +3,18 @@
 
 #include <QtCore>
 #include "mediaformat.h"
+#include "capturemode.h"
 #include "soro_global.h"
 
+/* Names given to elements in the encoding string, so they can be found
+ * and adjusted on a running pipeline
+ */
+#define VIDEOFORMAT_GST_ENCODER_NAME "encoder"
+#define VIDEOFORMAT_GST_RATE_NAME "rate"
+#define VIDEOFORMAT_GST_RATECAPS_NAME "ratecaps"
+#define VIDEOFORMAT_GST_SCALECAPS_NAME "scalecaps"
+#define VIDEOFORMAT_GST_STEREOCAPS_NAME "stereocaps"
+
 namespace Soro {
 
 class VideoFormat: public MediaFormat {
@@ -50,9 +60,28 @@ public:
 
     QString toHumanReadableString() const Q_DECL_OVERRIDE;
     QString createGstEncodingArgs() const Q_DECL_OVERRIDE;
+
+    /* Creates the encoding string for a camera capturing in the given mode (see CaptureMode::select()),
+     * skipping whatever the mode makes unnecessary. Scaling is left out when the mode is already the
+     * right size, and a mode the camera compresses in the right encoding goes straight to the payloader.
+     * Without scaling or an encoder, the stream can only be changed by restarting it.
+     */
+    QString createGstEncodingArgs(const CaptureMode &mode) const;
+
+    /* Creates the description of the encoder element alone, so it can be
+     * replaced on a running pipeline, or added as a second encoder under another name
+     */
+    QString createGstEncoderArgs(QString name=VIDEOFORMAT_GST_ENCODER_NAME) const;
+
+    /* Creates the caps for each named caps filter in the encoding string
+     */
+    QString createGstScaleCaps() const;
+    QString createGstStereoCaps() const;
+    QString createGstFramerateCaps() const;
     QString createGstDecodingArgs(DecodingType type=DecodingType_Full) const Q_DECL_OVERRIDE;
     QString getEncodingName() const Q_DECL_OVERRIDE;
     QString createGstFileRecordingArgs(QString fileName) const Q_DECL_OVERRIDE;
+    QString createGstParserArgs() const Q_DECL_OVERRIDE;
     QString getFileExtension() const Q_DECL_OVERRIDE;
 
     VideoFormat::Encoding getEncoding() const;
@@ -62,6 +91,7 @@ public:
     VideoFormat::StereoMode getStereoMode() const;
     quint32 getMaxThreads() const;
     quint32 getMjpegQuality() const;
+    quint32 getKeyframeInterval() const;
 
     void setEncoding(VideoFormat::Encoding encoding);
     void setResolution(VideoFormat::Resolution resolution);
@@ -70,10 +100,26 @@ public:
     void setStereoMode(VideoFormat::StereoMode stereo);
     void setMaxThreads(quint32 maxThreads);
     void setMjpegQuality(quint32 quality);
+    void setKeyframeInterval(quint32 frames);
 
     quint32 getWidth() const;
     quint32 getHeight() const;
 
+    /* Gets the bitrate given to each encoder, which is half the total for side-by-side stereo
+     */
+    quint32 getEncoderBitrate() const;
+
+    /* Gets the name and value of the bitrate property on the encoder element, in the
+     * encoder's own units. The name is empty if the encoding has no bitrate control.
+     */
+    QString getGstEncoderBitrateProperty() const;
+    quint32 getGstEncoderBitrateValue() const;
+
+    /* Gets the name of the keyframe interval property on the encoder element, or empty
+     * if it has none
+     */
+    QString getGstEncoderKeyframeProperty() const;
+
     bool isUseable() const Q_DECL_OVERRIDE;
 
     QString serialize() const Q_DECL_OVERRIDE;
@@ -86,7 +132,8 @@ public:
                 (_bitrate == other._bitrate) &&
                 (_framerate == other._framerate) &&
                 (_maxThreads == other._maxThreads) &&
-                (_mjpegQuality == other._mjpegQuality);
+                (_mjpegQuality == other._mjpegQuality) &&
+                (_keyframeInterval == other._keyframeInterval);
     }
 
     inline bool operator!=(const VideoFormat& other) {
@@ -101,9 +148,12 @@ protected:
     quint32 _maxThreads;
     quint32 _framerate;
     qint32 _mjpegQuality;
+    quint32 _keyframeInterval;
 
     quint32 getResolutionHeight() const;
     quint32 getResolutionWidth() const;
+
+    QString createGstPayloaderArgs() const;
 };
 
 } // namespace Soro
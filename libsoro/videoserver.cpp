@@ -31,6 +31,21 @@ void VideoServer::onStreamStoppedInternal() {
 }
 
 void VideoServer::start(QString deviceName, VideoFormat format) {
+    if ((getState() == StreamingState) && (deviceName == _videoDevice)
+            && (format.getEncoding() == _format.getEncoding()) && (format.getStereoMode() == _format.getStereoMode())) {
+        // Same camera and payload type, the running pipeline can be changed in place
+        if (_format == format) {
+            LOG_I(LOG_TAG, "start(): Already streaming " + deviceName + " with this format");
+            return;
+        }
+        if (sendIpcCommand("format " + format.serialize())) {
+            LOG_I(LOG_TAG, "start(): Reconfiguring stream of " + deviceName + " to " + format.toHumanReadableString());
+            _format = format;
+            sendStreamingMessage();
+            return;
+        }
+    }
+
     LOG_I(LOG_TAG, "start(): Streaming " + deviceName + " with format " + format.createGstEncodingArgs());
     _videoDevice = deviceName;
     _format = format;
@@ -50,6 +65,15 @@ void VideoServer::start(QString deviceName, VideoFormat format) {
                         format);
 }*/
 
+void VideoServer::onIpcCommandFailed(QString command) {
+    if (command.startsWith("format ") && (getState() == StreamingState)) {
+        LOG_W(LOG_TAG, "onIpcCommandFailed(): Could not reconfigure the running stream, restarting it");
+        _starting = true;
+        initStream();
+        _starting = false;
+    }
+}
+
 void VideoServer::constructChildArguments(QStringList& outArgs, SocketAddress host, SocketAddress address, quint16 ipcPort) {
     outArgs << _videoDevice;
     outArgs << _format.serialize();
@@ -58,12 +82,71 @@ void VideoServer::constructChildArguments(QStringList& outArgs, SocketAddress ho
     outArgs << QHostAddress(host.host.toIPv4Address()).toString();
     outArgs << QString::number(host.port);
     outArgs << QString::number(ipcPort);
+    if (_localRecording.isEnabled()) {
+        outArgs << "local=" + _localRecording.serialize();
+    }
+    // Modes are only known for device nodes, a shared capture is already in the mode it was opened in
+    _passthrough = false;
+    if (_videoDevice.startsWith("/dev/")) {
+        CaptureMode mode = selectCaptureMode(_format);
+        if (mode.isValid()) {
+            LOG_I(LOG_TAG, "Capturing " + _videoDevice + " in mode " + mode.serialize());
+            outArgs << "capture=" + mode.serialize();
+            _passthrough = mode.isPassthroughFor(_format);
+        }
+    }
+}
+
+CaptureMode VideoServer::selectCaptureMode(const VideoFormat &format) const {
+    // A local recording needs raw frames to encode, so it rules out passthrough
+    return CaptureMode::select(_captureModes, format, _allowPassthrough && !_localRecording.isEnabled());
+}
+
+void VideoServer::setCaptureModes(const QList<CaptureMode> &modes, bool allowPassthrough) {
+    _captureModes = modes;
+    _allowPassthrough = allowPassthrough;
+}
+
+void VideoServer::setLocalRecording(const LocalRecordingSettings &settings) {
+    _localRecording = settings;
+}
+
+LocalRecordingSettings VideoServer::getLocalRecording() const {
+    return _localRecording;
 }
 
 void VideoServer::constructStreamingMessage(QDataStream& stream) {
     stream << _format.serialize();
 }
 
+void VideoServer::onReconfigureRequested(quint32 bitrate, quint32 framerate) {
+    adjustStream(bitrate, framerate);
+}
+
+void VideoServer::adjustStream(quint32 bitrate, quint32 framerate) {
+    if (getState() != StreamingState) {
+        LOG_W(LOG_TAG, "adjustStream(): Not streaming, ignoring request");
+        return;
+    }
+    if (_passthrough) {
+        // There is no encoder, the camera sends whatever bitrate it produces
+        LOG_D(LOG_TAG, "adjustStream(): Stream is passed through from the camera, ignoring request");
+        return;
+    }
+    if ((_format.getFramerate() > 0) && ((framerate == 0) || (framerate > _format.getFramerate()))) {
+        // Cannot go above the framerate the stream was started with
+        framerate = _format.getFramerate();
+    }
+    bool ok = sendIpcCommand("bitrate " + QString::number(bitrate));
+    ok &= sendIpcCommand("maxrate " + QString::number(framerate));
+    if (ok) {
+        LOG_I(LOG_TAG, "adjustStream(): Requested bitrate " + QString::number(bitrate) + " and framerate " + QString::number(framerate));
+    }
+    else {
+        LOG_W(LOG_TAG, "adjustStream(): Streaming process is not connected");
+    }
+}
+
 VideoFormat VideoServer::getVideoFormat() const {
     return _format;
 }
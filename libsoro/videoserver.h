@@ -7,6 +7,8 @@
 #include "socketaddress.h"
 #include "mediaserver.h"
 #include "videoformat.h"
+#include "localrecordingsettings.h"
+#include "capturemode.h"
 
 //#include <flycapture/FlyCapture2.h>
 
@@ -28,10 +30,12 @@ public:
     explicit VideoServer(int mediaId, SocketAddress host, QObject *parent = 0);
 
     /**
-     * Starts a video stream. If the server is already streaming, it will be stopped and restarted to
+     * Starts a video stream. If the server is already streaming the same device with the same encoding
+     * and stereo mode, the running stream is changed in place. Otherwise it will be stopped and restarted to
      * accomodate any configuration changes.
      *
-     * @param deviceName The video device to connect to and start streaming (/dev/video*)
+     * @param deviceName The video device to connect to and start streaming (/dev/video*), or
+     * a device string from a CaptureMultiplexer
      * @param format The video format to stream.
      */
     void start(QString deviceName, VideoFormat format);
@@ -39,8 +43,39 @@ public:
 
     VideoFormat getVideoFormat() const;
 
+    /**
+     * Adjusts the bitrate and maximum framerate of the running stream without restarting it.
+     * The bitrate is for the whole format, as in VideoFormat::setBitrate(), and a framerate of
+     * 0 removes any limit. Does nothing if the server is not streaming.
+     */
+    void adjustStream(quint32 bitrate, quint32 framerate);
+
+    /**
+     * Sets up a second, higher quality encoder that records the camera to the rover's disk
+     * while it is streamed. Takes effect the next time a stream is started.
+     */
+    void setLocalRecording(const LocalRecordingSettings &settings);
+    LocalRecordingSettings getLocalRecording() const;
+
+    /* Sets the modes the camera can capture in, as found by CaptureMode::probe(). Streams are then
+     * captured in whichever mode needs the least work for their format. If passthrough is allowed,
+     * a camera that compresses in the requested encoding is streamed without encoding at all, at
+     * whatever bitrate the camera produces.
+     */
+    void setCaptureModes(const QList<CaptureMode> &modes, bool allowPassthrough = true);
+
+    /* Gets the mode a stream of the given format is captured in when this server opens the camera
+     * itself, or an invalid mode if the camera is left to negotiate
+     */
+    CaptureMode selectCaptureMode(const VideoFormat &format) const;
+
 private:
     VideoFormat _format;
+    LocalRecordingSettings _localRecording;
+    QList<CaptureMode> _captureModes;
+    bool _allowPassthrough = true;
+    // The running stream is sent as the camera compresses it, so its bitrate can't be changed
+    bool _passthrough = false;
     QString _videoDevice;
     bool _starting = false;
 
@@ -53,6 +88,9 @@ protected:
 
     void onStreamStoppedInternal() Q_DECL_OVERRIDE;
 
+    void onIpcCommandFailed(QString command) Q_DECL_OVERRIDE;
+    void onReconfigureRequested(quint32 bitrate, quint32 framerate) Q_DECL_OVERRIDE;
+
     void constructStreamingMessage(QDataStream& stream) Q_DECL_OVERRIDE;
 };
 
@@ -22,7 +22,9 @@
 namespace Soro {
 namespace Gst {
 
-AudioPlayer::AudioPlayer(QObject *parent) : QObject(parent) { }
+AudioPlayer::AudioPlayer(QObject *parent) : QObject(parent) {
+    _ringSource = new RingSource(this);
+}
 
 AudioPlayer::~AudioPlayer() {
     resetPipeline();
@@ -36,6 +38,7 @@ void AudioPlayer::stop() {
 }
 
 void AudioPlayer::resetPipeline() {
+    _ringSource->detach();
     if (_pipeline) {
         _pipeline->setState(QGst::StateNull);
         _pipeline.clear();
@@ -43,20 +46,29 @@ void AudioPlayer::resetPipeline() {
 }
 
 void AudioPlayer::play(SocketAddress address, AudioFormat encoding) {
+    // create a udpsrc to receive the stream
+    playSource(QString("udpsrc address=%1 port=%2 reuse=true").arg(address.host.toString(), QString::number(address.port)),
+               encoding);
+}
+
+void AudioPlayer::play(PacketRing *ring, AudioFormat encoding) {
+    QGst::BinPtr bin = playSource(RingSource::createGstSourceArgs(), encoding);
+    _ringSource->attach(ring, bin);
+}
+
+QGst::BinPtr AudioPlayer::playSource(QString sourceStr, AudioFormat encoding) {
     resetPipeline();
 
     _pipeline = QGst::Pipeline::create();
     _pipeline->bus()->addSignalWatch();
     QGlib::connect(_pipeline->bus(), "message", this, &AudioPlayer::onBusMessage);
 
-    // create a udpsrc to receive the stream
-    QString binStr = "udpsrc address=%1 port=%2 reuse=true ! "
-                     "%3 ! "
+    QString binStr = "%1 ! "
+                     "%2 ! "
                      "audioconvert ! "
                      "alsasink";
 
-    binStr = binStr.arg(address.host.toString(),
-                        QString::number(address.port),
+    binStr = binStr.arg(sourceStr,
                         encoding.createGstDecodingArgs());
 
     // create a gstreamer bin from the description
@@ -66,6 +78,7 @@ void AudioPlayer::play(SocketAddress address, AudioFormat encoding) {
 
     _isPlaying = true;
     _pipeline->setState(QGst::StatePlaying);
+    return bin;
 }
 
 bool AudioPlayer::isPlaying() {
@@ -17,8 +17,10 @@
 #include "libsoro/socketaddress.h"
 #include "libsoro/soro_global.h"
 #include "libsoro/audioformat.h"
+#include "libsoro/packetring.h"
 
 #include "soro_gst_global.h"
+#include "ringsource.h"
 
 namespace Soro {
 namespace Gst {
@@ -34,13 +36,19 @@ public:
     ~AudioPlayer();
 
     void play(SocketAddress address, AudioFormat encoding);
+
+    /* Plays a stream directly from a MediaClient's packet ring
+     */
+    void play(PacketRing *ring, AudioFormat encoding);
     void stop();
     bool isPlaying();
 
 private:
     QGst::PipelinePtr _pipeline;
     bool _isPlaying = false;
+    RingSource *_ringSource;
     void resetPipeline();
+    QGst::BinPtr playSource(QString sourceStr, AudioFormat encoding);
 
 private slots:
     /* Recieves messages from the gstreamer pipeline bus
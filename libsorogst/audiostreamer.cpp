@@ -20,10 +20,10 @@
 #include "libsoro/logger.h"
 
 namespace Soro {
-namespace Rover {
+namespace Gst {
 
 AudioStreamer::AudioStreamer(QString sourceDevice, AudioFormat format, SocketAddress bindAddress, SocketAddress address, quint16 ipcPort, QObject *parent)
-        : Soro::Gst::MediaStreamer("AudioStreamer", parent) {
+        : MediaStreamer("AudioStreamer", parent) {
     if (!connectToParent(ipcPort)) return;
 
     LOG_I(LOG_TAG, "Creating pipeline");
@@ -58,6 +58,6 @@ AudioStreamer::AudioStreamer(QString sourceDevice, AudioFormat format, SocketAdd
 
 }
 
-} // namespace Rover
+} // namespace Gst
 } // namespace Soro
 
@@ -1,11 +1,10 @@
-#ifndef AUDIOSTREAMER_H
-#define AUDIOSTREAMER_H
+#ifndef SORO_GST_AUDIOSTREAMER_H
+#define SORO_GST_AUDIOSTREAMER_H
 
 #include <QObject>
 #include <QCoreApplication>
 #include <QTcpSocket>
 
-#include <Qt5GStreamer/QGst/Ui/VideoWidget>
 #include <Qt5GStreamer/QGst/Pipeline>
 #include <Qt5GStreamer/QGst/Element>
 #include <Qt5GStreamer/QGst/ElementFactory>
@@ -18,19 +17,20 @@
 
 #include "libsoro/socketaddress.h"
 #include "libsoro/audioformat.h"
-#include "libsorogst/mediastreamer.h"
+#include "mediastreamer.h"
+#include "soro_gst_global.h"
 
 namespace Soro {
-namespace Rover {
+namespace Gst {
 
-class AudioStreamer : public Soro::Gst::MediaStreamer {
+class LIBSOROGST_EXPORT AudioStreamer : public MediaStreamer {
     Q_OBJECT
 public:
     AudioStreamer(QString deviceName, AudioFormat format, SocketAddress bindAddress, SocketAddress address, quint16 ipcPort, QObject *parent = 0);
 
 };
 
-} // namespace Rover
+} // namespace Gst
 } // namespace Soro
 
-#endif // AUDIOSTREAMER_H
+#endif // SORO_GST_AUDIOSTREAMER_H
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "branchfinisher.h"
+#include "libsoro/logger.h"
+
+#include <QTimer>
+
+#include <Qt5GStreamer/QGst/Event>
+#include <Qt5GStreamer/QGlib/Connect>
+
+#define LOG_TAG "BranchFinisher"
+
+namespace Soro {
+namespace Gst {
+
+BranchFinisher::BranchFinisher(int timeout, QObject *parent) : QObject(parent) {
+    _timeout = timeout;
+}
+
+BranchFinisher::~BranchFinisher() {
+    while (!_finishing.isEmpty()) {
+        release(_finishing.first());
+    }
+}
+
+void BranchFinisher::detach(QGst::ElementPtr tee, QGst::PadPtr teePad, QGst::BinPtr branch) {
+    QGst::PadPtr sinkPad = branch->getStaticPad("sink");
+    teePad->unlink(sinkPad);
+    if (!tee.isNull()) {
+        tee->releaseRequestPad(teePad);
+    }
+    QGst::BinPtr parent = branch->parent().dynamicCast<QGst::Bin>();
+    if (!parent.isNull()) {
+        parent->remove(branch);
+    }
+
+    QGst::PipelinePtr pipeline = QGst::Pipeline::create();
+    pipeline->add(branch);
+    pipeline->setState(QGst::StatePlaying);
+    // Only the branch's own sink pad gets the EOS, it has no source to send one
+    sinkPad->sendEvent(QGst::EosEvent::create());
+    watch(pipeline);
+}
+
+void BranchFinisher::finish(QGst::PipelinePtr pipeline) {
+    pipeline->sendEvent(QGst::EosEvent::create());
+    watch(pipeline);
+}
+
+void BranchFinisher::watch(QGst::PipelinePtr pipeline) {
+    _finishing.append(pipeline);
+    pipeline->bus()->addSignalWatch();
+    QGlib::connect(pipeline->bus(), "message", this, &BranchFinisher::onBusMessage, QGlib::PassSender);
+    QTimer::singleShot(_timeout, this, [this, pipeline]() {
+        if (_finishing.contains(pipeline)) {
+            LOG_W(LOG_TAG, "Recording did not finish in " + QString::number(_timeout) + "ms, tearing it down");
+            release(pipeline);
+        }
+    });
+}
+
+void BranchFinisher::release(QGst::PipelinePtr pipeline) {
+    if (!_finishing.contains(pipeline)) return;
+    _finishing.removeAll(pipeline);
+    pipeline->bus()->removeSignalWatch();
+    QGlib::disconnect(pipeline->bus(), "message", this, &BranchFinisher::onBusMessage);
+    pipeline->setState(QGst::StateNull);
+}
+
+void BranchFinisher::onBusMessage(const QGst::BusPtr & bus, const QGst::MessagePtr & message) {
+    switch (message->type()) {
+    case QGst::MessageEos:
+    case QGst::MessageError:
+        foreach (QGst::PipelinePtr pipeline, _finishing) {
+            if (pipeline->bus() == bus) {
+                LOG_I(LOG_TAG, "Finished writing recording");
+                release(pipeline);
+                break;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+} // namespace Gst
+} // namespace Soro
@@ -0,0 +1,54 @@
+#ifndef SORO_GST_BRANCHFINISHER_H
+#define SORO_GST_BRANCHFINISHER_H
+
+#include <QObject>
+#include <QList>
+
+#include <Qt5GStreamer/QGst/Pipeline>
+#include <Qt5GStreamer/QGst/Element>
+#include <Qt5GStreamer/QGst/Bin>
+#include <Qt5GStreamer/QGst/Bus>
+#include <Qt5GStreamer/QGst/Message>
+#include <Qt5GStreamer/QGst/Pad>
+
+#include "soro_gst_global.h"
+
+namespace Soro {
+namespace Gst {
+
+/* Lets stopped recordings finish writing their files in the background. Each one is sent EOS so
+ * its muxer can write out its headers, and is torn down once the EOS (or an error) reaches its bus,
+ * or after a timeout if it never does.
+ */
+class LIBSOROGST_EXPORT BranchFinisher : public QObject {
+    Q_OBJECT
+public:
+    /* @param timeout Longest a recording may take to finish, in milliseconds
+     */
+    BranchFinisher(int timeout, QObject *parent = 0);
+    ~BranchFinisher();
+
+    /* Takes a recording branch off the tee it is linked to and finishes it in a pipeline of its own,
+     * so the pipeline it was part of is not held up
+     */
+    void detach(QGst::ElementPtr tee, QGst::PadPtr teePad, QGst::BinPtr branch);
+
+    /* Finishes a whole recording pipeline, which must not be watched by anyone else
+     */
+    void finish(QGst::PipelinePtr pipeline);
+
+private:
+    int _timeout;
+    QList<QGst::PipelinePtr> _finishing;
+
+    void watch(QGst::PipelinePtr pipeline);
+    void release(QGst::PipelinePtr pipeline);
+
+private slots:
+    void onBusMessage(const QGst::BusPtr & bus, const QGst::MessagePtr & message);
+};
+
+} // namespace Gst
+} // namespace Soro
+
+#endif // SORO_GST_BRANCHFINISHER_H
@@ -0,0 +1,230 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "capturemultiplexer.h"
+#include "libsoro/logger.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QCoreApplication>
+
+#include <Qt5GStreamer/QGst/Bin>
+#include <Qt5GStreamer/QGst/Pad>
+#include <Qt5GStreamer/QGst/Caps>
+#include <Qt5GStreamer/QGlib/Connect>
+#include <Qt5GStreamer/QGlib/Error>
+
+#define LOG_TAG "CaptureMultiplexer"
+
+// Name of the shmsink in each capture pipeline
+#define CAPTUREMULTIPLEXER_GST_SINK_NAME "capturesink"
+
+namespace Soro {
+namespace Gst {
+
+CaptureMultiplexer::CaptureMultiplexer(QObject *parent) : QObject(parent) {
+}
+
+CaptureMultiplexer::~CaptureMultiplexer() {
+    foreach (QString device, _captures.keys()) {
+        close(device);
+    }
+}
+
+bool CaptureMultiplexer::isMultiplexedDevice(QString device) {
+    return device.startsWith(CAPTUREMULTIPLEXER_DEVICE_PREFIX);
+}
+
+QString CaptureMultiplexer::createGstSourceArgs(QString device, QString name) {
+    if (!isMultiplexedDevice(device)) {
+        return QString("v4l2src name=%1 device=%2").arg(name, device);
+    }
+    // shm:<device>|<socket path>|<caps>, shmsrc can't tell what the frames are so the caps come along
+    QStringList spec = device.mid(QString(CAPTUREMULTIPLEXER_DEVICE_PREFIX).length()).split('|');
+    if (spec.size() < 3) {
+        LOG_E(LOG_TAG, "Invalid multiplexed device '" + device + "'");
+        return "";
+    }
+    return QString("shmsrc name=%1 socket-path=%2 is-live=true do-timestamp=true ! capsfilter caps=\"%3\"").arg(
+                name,
+                spec[1],
+                QStringList(spec.mid(2)).join('|'));
+}
+
+QString CaptureMultiplexer::getDeviceNode(QString device) {
+    if (!isMultiplexedDevice(device)) {
+        return device;
+    }
+    return device.mid(QString(CAPTUREMULTIPLEXER_DEVICE_PREFIX).length()).section('|', 0, 0);
+}
+
+QString CaptureMultiplexer::acquire(QString device, CaptureMode mode) {
+    if (mode.isCompressed()) {
+        mode = CaptureMode();
+    }
+    if (_captures.contains(device) && !covers(_captures[device].mode, mode)) {
+        if (_captures[device].consumers == 0) {
+            LOG_I(LOG_TAG, "Reopening " + device + " in the larger mode " + mode.serialize());
+            close(device);
+        }
+        else {
+            LOG_W(LOG_TAG, device + " is in use in mode " + _captures[device].mode.serialize()
+                  + ", a consumer needing " + mode.serialize() + " will have to scale it");
+        }
+    }
+    if (!_captures.contains(device) && !open(device, mode)) {
+        emit captureFailed(device, "Cannot create capture pipeline");
+        return "";
+    }
+    Capture &capture = _captures[device];
+    capture.consumers++;
+    return capture.source;
+}
+
+void CaptureMultiplexer::release(QString device) {
+    if (!_captures.contains(device)) return;
+    Capture &capture = _captures[device];
+    if (capture.consumers > 0) {
+        capture.consumers--;
+    }
+    if (capture.consumers == 0) {
+        // Closed by the check timer once it has lingered
+        capture.timer.restart();
+        START_TIMER(_checkTimerId, CAPTUREMULTIPLEXER_CHECK_INTERVAL);
+    }
+}
+
+QString CaptureMultiplexer::getSource(QString device) const {
+    return _captures.contains(device) ? _captures[device].source : QString();
+}
+
+bool CaptureMultiplexer::covers(const CaptureMode &running, const CaptureMode &needed) {
+    if (!needed.isValid()) return true;
+    // A device left to negotiate has an unknown size, so it only covers consumers that don't care
+    if (!running.isValid()) return false;
+    return (running.width >= needed.width) && (running.height >= needed.height)
+            && ((running.framerate == 0) || (running.framerate >= needed.framerate));
+}
+
+bool CaptureMultiplexer::open(QString device, CaptureMode mode) {
+    Capture capture;
+    capture.mode = mode;
+    capture.socketPath = QString("%1/soro_capture_%2_%3").arg(
+                QDir::tempPath(),
+                QFileInfo(device).fileName(),
+                QString::number(QCoreApplication::applicationPid()));
+    // Left behind if the rover crashed, and shmsink won't reuse it
+    QFile::remove(capture.socketPath);
+
+    // Frames are published raw, each consumer scales, converts and encodes for itself. Left alone
+    // v4l2src may settle on a compressed mode the consumers' encoders can't take.
+    QString binStr = QString("v4l2src device=%1 ! %2 ! shmsink name=" CAPTUREMULTIPLEXER_GST_SINK_NAME
+                             " socket-path=%3 shm-size=%4 wait-for-connection=false sync=false").arg(
+                device,
+                mode.isValid() ? mode.createGstCaps() : QString("video/x-raw"),
+                capture.socketPath,
+                QString::number(CAPTUREMULTIPLEXER_SHM_SIZE));
+    LOG_I(LOG_TAG, "Opening " + device + " with bin " + binStr);
+
+    try {
+        capture.pipeline = QGst::Pipeline::create();
+        capture.pipeline->add(QGst::Bin::fromDescription(binStr));
+    }
+    catch (const QGlib::Error &error) {
+        LOG_E(LOG_TAG, "Cannot create capture pipeline for " + device + ": " + error.message());
+        return false;
+    }
+    capture.pipeline->bus()->addSignalWatch();
+    QGlib::connect(capture.pipeline->bus(), "message", this, &CaptureMultiplexer::onBusMessage, QGlib::PassSender);
+    capture.pipeline->setState(QGst::StatePlaying);
+    capture.timer.start();
+    _captures.insert(device, capture);
+
+    START_TIMER(_checkTimerId, CAPTUREMULTIPLEXER_CHECK_INTERVAL);
+    return true;
+}
+
+void CaptureMultiplexer::close(QString device) {
+    if (!_captures.contains(device)) return;
+    Capture capture = _captures.take(device);
+    LOG_I(LOG_TAG, "Closing " + device);
+    capture.pipeline->bus()->removeSignalWatch();
+    QGlib::disconnect(capture.pipeline->bus(), "message", this, &CaptureMultiplexer::onBusMessage);
+    capture.pipeline->setState(QGst::StateNull);
+    QFile::remove(capture.socketPath);
+}
+
+void CaptureMultiplexer::fail(QString device, QString error) {
+    LOG_E(LOG_TAG, "Capture of " + device + " failed: " + error);
+    close(device);
+    emit captureFailed(device, error);
+}
+
+void CaptureMultiplexer::onBusMessage(const QGst::BusPtr &bus, const QGst::MessagePtr &message) {
+    if (message->type() != QGst::MessageError) return;
+    foreach (QString device, _captures.keys()) {
+        if (_captures[device].pipeline->bus() == bus) {
+            fail(device, message.staticCast<QGst::ErrorMessage>()->error().message());
+            break;
+        }
+    }
+}
+
+void CaptureMultiplexer::timerEvent(QTimerEvent *e) {
+    if (e->timerId() == _checkTimerId) {
+        bool waiting = false;
+        foreach (QString device, _captures.keys()) {
+            Capture &capture = _captures[device];
+            if (capture.source.isEmpty()) {
+                // Consumers need the exact frame format, which is known once the camera
+                // has negotiated with the sink
+                QGst::ElementPtr sink = capture.pipeline->getElementByName(CAPTUREMULTIPLEXER_GST_SINK_NAME);
+                QGst::CapsPtr caps = sink ? sink->getStaticPad("sink")->currentCaps() : QGst::CapsPtr();
+                if (caps && caps->isFixed()) {
+                    capture.source = CAPTUREMULTIPLEXER_DEVICE_PREFIX + device + "|" + capture.socketPath + "|" + caps->toString();
+                    LOG_I(LOG_TAG, "Publishing " + device + " as " + capture.source);
+                    emit sourceReady(device, capture.source);
+                    // Check again whether anyone is still using it
+                    waiting = true;
+                }
+                else if (capture.timer.hasExpired(CAPTUREMULTIPLEXER_START_TIMEOUT)) {
+                    fail(device, "No frames from the device");
+                }
+                else {
+                    waiting = true;
+                }
+            }
+            else if (capture.consumers == 0) {
+                if (capture.timer.hasExpired(CAPTUREMULTIPLEXER_LINGER_TIME)) {
+                    close(device);
+                }
+                else {
+                    waiting = true;
+                }
+            }
+        }
+        if (!waiting) {
+            KILL_TIMER(_checkTimerId);
+        }
+    }
+    else {
+        QObject::timerEvent(e);
+    }
+}
+
+} // namespace Gst
+} // namespace Soro
@@ -0,0 +1,110 @@
+#ifndef SORO_GST_CAPTUREMULTIPLEXER_H
+#define SORO_GST_CAPTUREMULTIPLEXER_H
+
+#include <QObject>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QTimerEvent>
+
+#include <Qt5GStreamer/QGst/Pipeline>
+#include <Qt5GStreamer/QGst/Message>
+#include <Qt5GStreamer/QGst/Bus>
+
+#include "libsoro/constants.h"
+#include "libsoro/capturemode.h"
+#include "soro_gst_global.h"
+
+// Devices given to a streamer with this prefix are read from a CaptureMultiplexer
+// instead of being opened directly
+#define CAPTUREMULTIPLEXER_DEVICE_PREFIX "shm:"
+// Size of the shared memory area each device's frames are published in
+#define CAPTUREMULTIPLEXER_SHM_SIZE (64 * 1024 * 1024)
+// How long a device has to start producing frames
+#define CAPTUREMULTIPLEXER_START_TIMEOUT 5000
+// How long a device stays open after its last consumer, so a stream being restarted
+// doesn't reopen it
+#define CAPTUREMULTIPLEXER_LINGER_TIME 3000
+#define CAPTUREMULTIPLEXER_CHECK_INTERVAL 50
+
+namespace Soro {
+namespace Gst {
+
+/* Opens each V4L2 device once and publishes its frames in shared memory through shmsink, so
+ * any number of streamers (mono, stereo, recording, snapshots) can read the same camera at
+ * once. Frames are copied into shared memory once and read from there by every consumer.
+ *
+ * Consumers acquire() a device and are given a device string to pass to a VideoStreamer in
+ * place of the device node. Since the frame format is only known once the camera is running,
+ * the string may not be ready straight away, in which case sourceReady() is emitted with it
+ * later. The device is closed a little while after the last consumer releases it.
+ *
+ * A device is captured in the raw mode its first consumer asks for. A later consumer that needs
+ * a larger mode gets the device reopened in it if nobody else is reading it, otherwise it scales
+ * from the running mode. Compressed modes are never shared, since consumers that encode need
+ * raw frames; a stream sent straight from the camera has to open the device itself.
+ */
+class LIBSOROGST_EXPORT CaptureMultiplexer : public QObject {
+    Q_OBJECT
+public:
+    explicit CaptureMultiplexer(QObject *parent = 0);
+    ~CaptureMultiplexer();
+
+    /* Adds a consumer of a device, opening it if needed. Returns the device string consumers
+     * should use if the device is already running, otherwise an empty string.
+     * @param mode Raw mode the consumer needs, or an invalid mode to let the camera negotiate
+     */
+    QString acquire(QString device, CaptureMode mode = CaptureMode());
+    void release(QString device);
+
+    /* Gets the device string for a running device, or an empty string
+     */
+    QString getSource(QString device) const;
+
+    /* Creates the source part of a pipeline for a device given to a streamer, which is
+     * either a device node or a device string from a CaptureMultiplexer. The source
+     * element is given the provided name.
+     */
+    static QString createGstSourceArgs(QString device, QString name);
+
+    static bool isMultiplexedDevice(QString device);
+
+    /* Gets the device node a device string given to a streamer refers to
+     */
+    static QString getDeviceNode(QString device);
+
+signals:
+    void sourceReady(QString device, QString source);
+    /* Emitted when a device cannot be opened or stops working. Its consumers
+     * have been released, and should fall back to opening it themselves.
+     */
+    void captureFailed(QString device, QString error);
+
+protected:
+    void timerEvent(QTimerEvent *e);
+
+private:
+    struct Capture {
+        QGst::PipelinePtr pipeline;
+        QString socketPath;
+        QString source;
+        CaptureMode mode;
+        int consumers = 0;
+        QElapsedTimer timer;
+    };
+
+    QHash<QString, Capture> _captures;
+    int _checkTimerId = TIMER_INACTIVE;
+
+    bool open(QString device, CaptureMode mode);
+    static bool covers(const CaptureMode &running, const CaptureMode &needed);
+    void close(QString device);
+    void fail(QString device, QString error);
+
+private slots:
+    void onBusMessage(const QGst::BusPtr &bus, const QGst::MessagePtr &message);
+};
+
+} // namespace Gst
+} // namespace Soro
+
+#endif // SORO_GST_CAPTUREMULTIPLEXER_H
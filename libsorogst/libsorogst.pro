@@ -31,16 +31,38 @@ PRECOMPILED_DIR = $$BUILD_DIR
 
 SOURCES +=\
     audioplayer.cpp \
-    mediastreamer.cpp
+    mediastreamer.cpp \
+    videostreamer.cpp \
+    audiostreamer.cpp \
+    streamengine.cpp \
+    ringsource.cpp \
+    segmentedrecording.cpp \
+    sessionrecorder.cpp \
+    replaybuffer.cpp \
+    capturemultiplexer.cpp \
+    branchfinisher.cpp
 
 HEADERS +=\
     soro_gst_global.h \
     audioplayer.h \
-    mediastreamer.h
+    mediastreamer.h \
+    videostreamer.h \
+    audiostreamer.h \
+    streamengine.h \
+    ringsource.h \
+    segmentedrecording.h \
+    sessionrecorder.h \
+    replaybuffer.h \
+    capturemultiplexer.h \
+    branchfinisher.h
 
 INCLUDEPATH += $$PWD/..
 INCLUDEPATH += $$PWD/../..
 
+# The gstreamer C API is used directly for pad probes and feeding appsrc
+CONFIG += link_pkgconfig
+PKGCONFIG += gstreamer-1.0 gstreamer-app-1.0
+
 LIBS += -lQt5GStreamer-1.0 -lQt5GLib-2.0 -lQt5GStreamerUtils-1.0
 #LIBS += -lflycapture
 LIBS += -L../lib -lsoro
@@ -18,9 +18,91 @@
 #include "libsoro/logger.h"
 #include "libsoro/constants.h"
 
+#include <QMutex>
+#include <QElapsedTimer>
+
+#include <sys/resource.h>
+#include <gst/gst.h>
+
+// How often statistics are sent to the parent
+#define STATS_INTERVAL 1000
+// Frames that can be inside the encoder at once before the oldest stop being timed
+#define STATS_MAX_PENDING_FRAMES 128
+
 namespace Soro {
 namespace Gst {
 
+/* Counters updated from the streaming threads by pad probes, and read by the
+ * streamer once per interval
+ */
+struct MediaStreamerStatistics {
+    QAtomicInt captured;
+    QAtomicInt encoderIn;
+    QAtomicInt encoded;
+    QAtomicInt bytes;
+    QAtomicInt qosEvents;
+    QAtomicInt qosDropped;
+
+    QMutex mutex;
+    QHash<quint64, qint64> pendingFrames;   // PTS -> time it entered the encoder (us)
+    qint64 encodeTime = 0;
+    int encodeCount = 0;
+    QHash<GstObject*, guint64> qosLastDropped;  // QoS drop counts are totals per element
+
+    QElapsedTimer interval;
+    qint64 lastCpuTime = 0;
+};
+
+static qint64 processCpuTime() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return (qint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+            + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static GstPadProbeReturn capturedProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    Q_UNUSED(pad);
+    Q_UNUSED(info);
+    reinterpret_cast<QAtomicInt*>(data)->fetchAndAddRelaxed(1);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn encoderInProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    Q_UNUSED(pad);
+    MediaStreamerStatistics *stats = reinterpret_cast<MediaStreamerStatistics*>(data);
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    stats->encoderIn.fetchAndAddRelaxed(1);
+    if (GST_BUFFER_PTS_IS_VALID(buffer)) {
+        QMutexLocker locker(&stats->mutex);
+        if (stats->pendingFrames.size() >= STATS_MAX_PENDING_FRAMES) {
+            // The encoder is dropping frames, don't let them pile up
+            stats->pendingFrames.clear();
+        }
+        stats->pendingFrames.insert(GST_BUFFER_PTS(buffer), g_get_monotonic_time());
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn encoderOutProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    Q_UNUSED(pad);
+    MediaStreamerStatistics *stats = reinterpret_cast<MediaStreamerStatistics*>(data);
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    stats->encoded.fetchAndAddRelaxed(1);
+    stats->bytes.fetchAndAddRelaxed(gst_buffer_get_size(buffer));
+    if (GST_BUFFER_PTS_IS_VALID(buffer)) {
+        QMutexLocker locker(&stats->mutex);
+        QHash<quint64, qint64>::iterator frame = stats->pendingFrames.find(GST_BUFFER_PTS(buffer));
+        if (frame != stats->pendingFrames.end()) {
+            stats->encodeTime += g_get_monotonic_time() - frame.value();
+            stats->encodeCount++;
+            stats->pendingFrames.erase(frame);
+        }
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+bool MediaStreamer::_inProcess = false;
+
 MediaStreamer::MediaStreamer(QString LOG_TAG, QObject *parent) : QObject(parent) {
     this->LOG_TAG = LOG_TAG;
 }
@@ -30,18 +112,125 @@ MediaStreamer::~MediaStreamer() {
 }
 
 void MediaStreamer::stop() {
+    KILL_TIMER(_statsTimerId);
     if (_pipeline) {
         LOG_I(LOG_TAG, "stop(): setting pipeline to StateNull");
         _pipeline->setState(QGst::StateNull);
         _pipeline.clear();
     }
+    if (_stats) {
+        // Streaming threads are stopped, so the probes are done with it
+        delete _stats;
+        _stats = nullptr;
+    }
     if (_ipcSocket) {
         LOG_I(LOG_TAG, "stop(): deleting IPC socket");
-        delete _ipcSocket;
+        // This can be called from one of the socket's own signals
+        disconnect(_ipcSocket, 0, this, 0);
+        _ipcSocket->abort();
+        _ipcSocket->deleteLater();
         _ipcSocket = nullptr;
     }
 }
 
+bool MediaStreamer::waitForWork(quint16 poolPort, QStringList preloadFactories, QStringList& outArgs) {
+    // Creating an element loads its plugin, the element itself is thrown away
+    foreach (QString factory, preloadFactories) {
+        if (!QGst::ElementFactory::make(factory.toLatin1().constData())) {
+            LOG_W("MediaStreamer", "waitForWork(): Element factory " + factory + " is not available");
+        }
+    }
+
+    QTcpSocket pool;
+    pool.connectToHost(QHostAddress::LocalHost, poolPort);
+    if (!pool.waitForConnected(1000)) {
+        LOG_E("MediaStreamer", "waitForWork(): Cannot connect to pool on port " + QString::number(poolPort));
+        return false;
+    }
+    pool.write("ready " + QByteArray::number(QCoreApplication::applicationPid()) + "\n");
+    pool.flush();
+    LOG_I("MediaStreamer", "waitForWork(): Waiting for a stream");
+
+    while (!pool.canReadLine()) {
+        if (!pool.waitForReadyRead(-1) && (pool.state() != QAbstractSocket::ConnectedState) && !pool.canReadLine()) {
+            LOG_I("MediaStreamer", "waitForWork(): Pool closed without giving us a stream");
+            return false;
+        }
+    }
+    QStringList items = QString::fromLocal8Bit(pool.readLine()).remove('\n').split('\t');
+    pool.abort();
+    if (items.takeFirst() != "start") {
+        LOG_E("MediaStreamer", "waitForWork(): Got unknown request from pool");
+        return false;
+    }
+    outArgs = QStringList() << QCoreApplication::applicationFilePath() << items;
+    return true;
+}
+
+int MediaStreamer::parseArguments(const QStringList& args, QString& outDevice, QString& outFormat,
+                                  SocketAddress& outAddress, SocketAddress& outBindAddress, quint16& outIpcPort) {
+    if (args.size() < 8) {
+        LOG_E("MediaStreamer", "parseArguments(): Not enough arguments (expected 8, got " + QString::number(args.size()) + ")");
+        return STREAMPROCESS_ERR_NOT_ENOUGH_ARGUMENTS;
+    }
+    bool ok;
+
+    outDevice = args[1];
+    LOG_I("MediaStreamer", "parseArguments(): Device: " + outDevice);
+
+    outFormat = args[2];
+    LOG_I("MediaStreamer", "parseArguments(): Format: " + outFormat);
+
+    outAddress.host = QHostAddress(args[3]);
+    outAddress.port = args[4].toInt(&ok);
+    if ((outAddress.host == QHostAddress::Null) | (outAddress.host == QHostAddress::Any) | !ok) {
+        LOG_E("MediaStreamer", "parseArguments(): Invalid address '" + args[3] + ":" + args[4] + "'");
+        return STREAMPROCESS_ERR_INVALID_ARGUMENT;
+    }
+    LOG_I("MediaStreamer", "parseArguments(): Address: " + outAddress.toString());
+
+    outBindAddress.host = QHostAddress(args[5]);
+    outBindAddress.port = args[6].toInt(&ok);
+    if ((outBindAddress.host == QHostAddress::Null) | !ok) {
+        LOG_E("MediaStreamer", "parseArguments(): Invalid bind address '" + args[5] + ":" + args[6] + "'");
+        return STREAMPROCESS_ERR_INVALID_ARGUMENT;
+    }
+    LOG_I("MediaStreamer", "parseArguments(): Bind Address: " + outBindAddress.toString());
+
+    outIpcPort = args[7].toInt(&ok);
+    if (!ok) {
+        LOG_E("MediaStreamer", "parseArguments(): Invalid IPC port '" + args[7] + "'");
+        return STREAMPROCESS_ERR_INVALID_ARGUMENT;
+    }
+    LOG_I("MediaStreamer", "parseArguments(): IPC Port: " + QString::number(outIpcPort));
+    return 0;
+}
+
+QString MediaStreamer::getOptionalArgument(const QStringList& args, QString name) {
+    name += "=";
+    for (int i = 8; i < args.size(); ++i) {
+        if (args[i].startsWith(name)) {
+            return args[i].mid(name.length());
+        }
+    }
+    return QString();
+}
+
+void MediaStreamer::setInProcess(bool inProcess) {
+    _inProcess = inProcess;
+}
+
+void MediaStreamer::finish(int code) {
+    if (_inProcess) {
+        stop();
+        // Queued, since this can happen in the constructor before anyone is connected
+        QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection, Q_ARG(int, code));
+    }
+    else {
+        QCoreApplication::exit(code);
+    }
+}
+
 bool MediaStreamer::connectToParent(quint16 port) {
     LOG_I(LOG_TAG, "connectToParent(): Creating new TCP socket on port " + QString::number(port));
     _ipcSocket = new QTcpSocket(this);
@@ -53,7 +242,7 @@ bool MediaStreamer::connectToParent(quint16 port) {
     _ipcSocket->connectToHost(QHostAddress::LocalHost, port);
     if (!_ipcSocket->waitForConnected(1000)) {
         LOG_E(LOG_TAG, "connectToParent(): Unable to connect to parent");
-        QCoreApplication::exit(0);
+        finish(0);
         return false;
     }
     return true;
@@ -61,19 +250,130 @@ bool MediaStreamer::connectToParent(quint16 port) {
 
 void MediaStreamer::ipcSocketReadyRead() {
     char buffer[512];
-    while (_ipcSocket->bytesAvailable() > 0) {
+    while (_ipcSocket && _ipcSocket->canReadLine()) {
         _ipcSocket->readLine(buffer, 512);
-        if (QString(buffer).compare("stop") == 0) {
+        QString line = QString(buffer).trimmed();
+        QStringList args = line.split(' ', QString::SkipEmptyParts);
+        if (args.isEmpty()) continue;
+        QString command = args.takeFirst();
+        if (command.compare("stop") == 0) {
             LOG_I(LOG_TAG, "ipcSocketReadyRead(): Got stop request from parent");
-            stop();
-            QCoreApplication::exit(0);
+            finish(0);
+            return;
+        }
+        // Reply to every other command so the parent can fall back if it could not be applied
+        if (onCommand(command, args)) {
+            writeToParent("ok " + line);
         }
         else {
-            LOG_W(LOG_TAG, "ipcSocketReadyRead(): Got unknown request from parent '" + QString(buffer) + "'");
+            LOG_W(LOG_TAG, "ipcSocketReadyRead(): Could not handle request from parent '" + line + "'");
+            writeToParent("failed " + line);
         }
     }
 }
 
+bool MediaStreamer::onCommand(QString command, QStringList args) {
+    Q_UNUSED(command);
+    Q_UNUSED(args);
+    return false;
+}
+
+void MediaStreamer::writeToParent(QString line) {
+    if (_ipcSocket) {
+        _ipcSocket->write(line.toLatin1() + "\n");
+        _ipcSocket->flush();
+    }
+}
+
+void MediaStreamer::startStatistics(QGst::ElementPtr source, QGst::ElementPtr encoder) {
+    if (_stats || !source) return;
+    _stats = new MediaStreamerStatistics;
+    GstPad *sourcePad = gst_element_get_static_pad(static_cast<GstElement*>(source), "src");
+    if (sourcePad) {
+        gst_pad_add_probe(sourcePad, GST_PAD_PROBE_TYPE_BUFFER, capturedProbe, &_stats->captured, nullptr);
+        gst_object_unref(sourcePad);
+    }
+    watchEncoder(encoder);
+    _stats->lastCpuTime = processCpuTime();
+    _stats->interval.start();
+    START_TIMER(_statsTimerId, STATS_INTERVAL);
+}
+
+void MediaStreamer::watchEncoder(QGst::ElementPtr encoder) {
+    if (!_stats || !encoder) return;
+    {
+        QMutexLocker locker(&_stats->mutex);
+        _stats->pendingFrames.clear();
+    }
+    // Probes on a removed encoder go away with its pads
+    GstPad *sinkPad = gst_element_get_static_pad(static_cast<GstElement*>(encoder), "sink");
+    GstPad *srcPad = gst_element_get_static_pad(static_cast<GstElement*>(encoder), "src");
+    if (sinkPad) {
+        gst_pad_add_probe(sinkPad, GST_PAD_PROBE_TYPE_BUFFER, encoderInProbe, _stats, nullptr);
+        gst_object_unref(sinkPad);
+    }
+    if (srcPad) {
+        gst_pad_add_probe(srcPad, GST_PAD_PROBE_TYPE_BUFFER, encoderOutProbe, _stats, nullptr);
+        gst_object_unref(srcPad);
+    }
+}
+
+void MediaStreamer::timerEvent(QTimerEvent *e) {
+    if (e->timerId() == _statsTimerId) {
+        sendStatistics();
+    }
+    else {
+        QObject::timerEvent(e);
+    }
+}
+
+void MediaStreamer::sendStatistics() {
+    qint64 elapsed = qMax<qint64>(_stats->interval.restart(), 1);
+    int captured = _stats->captured.fetchAndStoreRelaxed(0);
+    int encoderIn = _stats->encoderIn.fetchAndStoreRelaxed(0);
+    int encoded = _stats->encoded.fetchAndStoreRelaxed(0);
+    qint64 bytes = _stats->bytes.fetchAndStoreRelaxed(0);
+    int qosEvents = _stats->qosEvents.fetchAndStoreRelaxed(0);
+    int qosDropped = _stats->qosDropped.fetchAndStoreRelaxed(0);
+    qint64 encodeTime = 0;
+    {
+        QMutexLocker locker(&_stats->mutex);
+        if (_stats->encodeCount > 0) encodeTime = _stats->encodeTime / _stats->encodeCount;
+        _stats->encodeTime = 0;
+        _stats->encodeCount = 0;
+    }
+    // In process, the CPU time would be the whole rover's, which says nothing about this stream
+    int cpu = -1;
+    if (!_inProcess) {
+        qint64 cpuTime = processCpuTime();
+        cpu = (int)((cpuTime - _stats->lastCpuTime) * 100 / (elapsed * 1000));
+        _stats->lastCpuTime = cpuTime;
+    }
+
+    // Frames dropped before the encoder (videorate) and by the encoder itself
+    int dropped = qMax(0, captured - encoderIn) + qMax(0, encoderIn - encoded);
+
+    writeToParent("stats captured=" + QString::number(captured)
+                  + " encoded=" + QString::number(encoded)
+                  + " dropped=" + QString::number(dropped)
+                  + " qos=" + QString::number(qosEvents)
+                  + " qosdropped=" + QString::number(qosDropped)
+                  + " encodetime=" + QString::number(encodeTime)
+                  + " bitrate=" + QString::number(bytes * 8 * 1000 / elapsed)
+                  + " cpu=" + QString::number(cpu));
+    onStatistics(cpu, captured);
+}
+
+void MediaStreamer::onStatistics(int cpu, int captured) {
+    Q_UNUSED(cpu);
+    Q_UNUSED(captured);
+}
+
+bool MediaStreamer::onPipelineError(const QGst::MessagePtr &message) {
+    Q_UNUSED(message);
+    return false;
+}
+
 QGst::PipelinePtr MediaStreamer::createPipeline() {
     QGst::PipelinePtr pipeline = QGst::Pipeline::create();
     pipeline->bus()->addSignalWatch();
@@ -89,12 +389,29 @@ void MediaStreamer::onBusMessage(const QGst::MessagePtr & message) {
     switch (message->type()) {
     case QGst::MessageEos:
         LOG_E(LOG_TAG, "onBusMessage(): Received EOS message from gstreamer");
-        QCoreApplication::exit(STREAMPROCESS_ERR_GSTREAMER_EOS);
+        finish(STREAMPROCESS_ERR_GSTREAMER_EOS);
+        break;
+    case QGst::MessageQos:
+        if (_stats) {
+            guint64 processed, dropped;
+            GstFormat format;
+            gst_message_parse_qos_stats(static_cast<GstMessage*>(message), &format, &processed, &dropped);
+            _stats->qosEvents.fetchAndAddRelaxed(1);
+            if (format == GST_FORMAT_BUFFERS) {
+                QMutexLocker locker(&_stats->mutex);
+                GstObject *source = GST_MESSAGE_SRC(static_cast<GstMessage*>(message));
+                guint64 last = _stats->qosLastDropped.value(source, 0);
+                // A lower count means the element was replaced (such as by swapEncoder) and started over
+                _stats->qosDropped.fetchAndAddRelaxed((int)(dropped >= last ? dropped - last : dropped));
+                _stats->qosLastDropped.insert(source, dropped);
+            }
+        }
         break;
     case QGst::MessageError:
         errorMessage = message.staticCast<QGst::ErrorMessage>()->error().message().toLatin1();
         LOG_E(LOG_TAG, "onBusMessage(): Received error message from gstreamer '" + errorMessage + "'");
-        QCoreApplication::exit(STREAMPROCESS_ERR_GSTREAMER_ERROR);
+        if (onPipelineError(message)) break;
+        finish(STREAMPROCESS_ERR_GSTREAMER_ERROR);
         break;
     default:
         break;
@@ -104,14 +421,12 @@ void MediaStreamer::onBusMessage(const QGst::MessagePtr & message) {
 void MediaStreamer::ipcSocketError(QAbstractSocket::SocketError error) {
     Q_UNUSED(error);
     LOG_E(LOG_TAG, "ipcSocketError(): Socket error");
-    stop();
-    QCoreApplication::exit(STREAMPROCESS_ERR_SOCKET_ERROR);
+    finish(STREAMPROCESS_ERR_SOCKET_ERROR);
 }
 
 void MediaStreamer::ipcSocketDisconnected() {
     LOG_E(LOG_TAG, "ipcSocketDisconnected(): Socket disconnected");
-    stop();
-    QCoreApplication::exit(STREAMPROCESS_ERR_SOCKET_ERROR);
+    finish(STREAMPROCESS_ERR_SOCKET_ERROR);
 }
 
 } // namespace Gst
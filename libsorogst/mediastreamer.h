@@ -16,11 +16,17 @@
 #include <Qt5GStreamer/QGst/Message>
 
 #include "libsoro/socketaddress.h"
+#include "libsoro/constants.h"
 #include "soro_gst_global.h"
 
+// Name given to the capture element of a pipeline, so statistics can find it
+#define MEDIASTREAMER_GST_SOURCE_NAME "source"
+
 namespace Soro {
 namespace Gst {
 
+struct MediaStreamerStatistics;
+
 /**
  * Uses a gstreamer backend to stream media to a remote address. This class does not run in the main process,
  * instead it runs in a child process is controlled by a corresponding MediaServer in the main process.
@@ -30,6 +36,34 @@ class LIBSOROGST_EXPORT MediaStreamer : public QObject {
 public:
     ~MediaStreamer();
 
+    /**
+     * Used when the process is started as a pre-started worker of a StreamerPool. Loads the given
+     * gstreamer element factories so their plugins are ready, then connects to the pool and blocks until
+     * it is given a stream. The stream's arguments are returned in outArgs in the same form as the
+     * process arguments. Returns false if the pool went away without giving it a stream.
+     */
+    static bool waitForWork(quint16 poolPort, QStringList preloadFactories, QStringList& outArgs);
+
+    /**
+     * Parses the arguments a streaming process is started with (the program, device, format,
+     * address, port, bind address, bind port and IPC port). Returns 0 if they are valid, otherwise
+     * the STREAMPROCESS_ERR code the process should exit with.
+     */
+    static int parseArguments(const QStringList& args, QString& outDevice, QString& outFormat,
+                              SocketAddress& outAddress, SocketAddress& outBindAddress, quint16& outIpcPort);
+
+    /**
+     * Returns the value of an optional 'name=value' argument following the standard ones,
+     * or an empty string if it was not given.
+     */
+    static QString getOptionalArgument(const QStringList& args, QString name);
+
+    /**
+     * Sets whether streamers are running inside the rover process instead of in their own process.
+     * When they are, a streamer emits finished() instead of exiting the application.
+     */
+    static void setInProcess(bool inProcess);
+
 protected:
     MediaStreamer(QString LOG_TAG, QObject *parent = 0);
 
@@ -45,6 +79,52 @@ protected:
     bool connectToParent(quint16 port);
     void stop();
 
+    /**
+     * Ends the stream with the given STREAMPROCESS_ERR code (or 0), either by exiting the
+     * streaming process or by emitting finished() if running inside the rover process
+     */
+    void finish(int code);
+
+    /**
+     * Called for each command line received from the parent other than "stop", such as
+     * "bitrate 500000". Subclasses should apply the command to the running pipeline and
+     * return true, or return false if it is unknown or could not be applied.
+     */
+    virtual bool onCommand(QString command, QStringList args);
+
+    /**
+     * Sends a single line to the parent over the IPC socket
+     */
+    void writeToParent(QString line);
+
+    /**
+     * Starts sampling statistics for the pipeline every second and sending them to the parent
+     * as a "stats" line. Frames are counted leaving the source and on both sides of the encoder,
+     * which is also timed per frame. CPU time is for the whole process, and is reported as -1
+     * when running in process since it would include the rover.
+     */
+    void startStatistics(QGst::ElementPtr source, QGst::ElementPtr encoder);
+
+    /**
+     * Moves the encoder statistics to a new encoder element, after the old one was replaced
+     */
+    void watchEncoder(QGst::ElementPtr encoder);
+
+    /**
+     * Called after each statistics sample is sent, with the CPU time used over the last
+     * second in percent of one core (or -1 if unknown) and the number of frames captured in that time
+     */
+    virtual void onStatistics(int cpu, int captured);
+
+    /**
+     * Called for each error message on the pipeline's bus. Subclasses can return true if the
+     * error came from a part of the pipeline the stream can do without, in which case the stream
+     * keeps running.
+     */
+    virtual bool onPipelineError(const QGst::MessagePtr &message);
+
+    void timerEvent(QTimerEvent *e) Q_DECL_OVERRIDE;
+
 private slots:
     void onBusMessage(const QGst::MessagePtr & message);
     void ipcSocketReadyRead();
@@ -61,6 +141,19 @@ signals:
      * @param message The error message
      */
     void error(QString message);
+    /**
+     * Signal emitted when the stream ends while running inside the rover process
+     * @param code The code the streaming process would have exited with
+     */
+    void finished(int code);
+
+private:
+    static bool _inProcess;
+
+    MediaStreamerStatistics *_stats = nullptr;
+    int _statsTimerId = TIMER_INACTIVE;
+
+    void sendStatistics();
 };
 
 } // namespace Gst
@@ -0,0 +1,226 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "replaybuffer.h"
+#include "libsoro/logger.h"
+
+#include <QDateTime>
+#include <QtEndian>
+
+#include <Qt5GStreamer/QGst/Bin>
+#include <Qt5GStreamer/QGlib/Connect>
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+
+#define LOG_TAG "ReplayBuffer"
+
+// Name of the appsrc in a replay saving pipeline
+#define REPLAYBUFFER_GST_ELEMENT_NAME "replaysrc"
+
+namespace Soro {
+namespace Gst {
+
+static void releasePacket(gpointer packet) {
+    delete reinterpret_cast<QByteArray*>(packet);
+}
+
+ReplayBuffer::ReplayBuffer(MediaClient *client, QObject *parent) : QObject(parent) {
+    _client = client;
+    connect(_client, &MediaClient::stateChanged, this, &ReplayBuffer::clientStateChanged);
+}
+
+ReplayBuffer::~ReplayBuffer() {
+    stop();
+    while (!_saving.isEmpty()) {
+        _saving.first().first->bus()->removeSignalWatch();
+        _saving.first().first->setState(QGst::StateNull);
+        _saving.removeFirst();
+    }
+}
+
+void ReplayBuffer::setLimits(int duration, qint64 maxBytes) {
+    _duration = duration;
+    _maxBytes = maxBytes;
+    trim();
+}
+
+void ReplayBuffer::start() {
+    if (isRunning()) return;
+    _reader = _client->getPacketRing()->addReader();
+    connect(_client->getPacketRing(), &PacketRing::packetsAvailable, this, &ReplayBuffer::packetsAvailable);
+}
+
+void ReplayBuffer::stop() {
+    if (!isRunning()) return;
+    disconnect(_client->getPacketRing(), &PacketRing::packetsAvailable, this, &ReplayBuffer::packetsAvailable);
+    _client->getPacketRing()->removeReader(_reader);
+    _reader = -1;
+    // Whatever arrives next may not follow on from what is kept
+    clear();
+}
+
+void ReplayBuffer::clear() {
+    _packets.clear();
+    _keyframes.clear();
+    _bytes = 0;
+}
+
+void ReplayBuffer::clientStateChanged(MediaClient *client, MediaClient::State state) {
+    Q_UNUSED(client);
+    if (state != MediaClient::StreamingState) {
+        // The next stream may have another format, and a replay must not span the gap
+        clear();
+    }
+}
+
+bool ReplayBuffer::isRunning() const {
+    return _reader >= 0;
+}
+
+int ReplayBuffer::getBufferedDuration() const {
+    return _packets.isEmpty() ? 0 : _packets.last().time - _packets.first().time;
+}
+
+qint64 ReplayBuffer::getBufferedBytes() const {
+    return _bytes;
+}
+
+void ReplayBuffer::packetsAvailable() {
+    QByteArray data;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    while (_client->getPacketRing()->read(_reader, data)) {
+        if ((data.size() < 12) || ((data.at(0) & 0xC0) != 0x80)) continue;
+        quint32 rtpTimestamp = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(data.constData()) + 4);
+        // A keyframe usually spans several packets, only its first one starts an interval
+        if (_client->isKeyframePacket(data.constData(), data.size())
+                && (_keyframes.isEmpty() || (_keyframes.last().rtpTimestamp != rtpTimestamp))) {
+            Keyframe keyframe;
+            keyframe.index = _pushed;
+            keyframe.time = now;
+            keyframe.rtpTimestamp = rtpTimestamp;
+            _keyframes.enqueue(keyframe);
+        }
+        else if (_keyframes.isEmpty()) {
+            // Can't decode anything before the first keyframe
+            continue;
+        }
+        Packet packet;
+        packet.data = data;
+        packet.time = now;
+        _packets.enqueue(packet);
+        _bytes += data.size();
+        _pushed++;
+    }
+    trim();
+}
+
+void ReplayBuffer::dropFront(qint64 count) {
+    for (qint64 i = 0; (i < count) && !_packets.isEmpty(); i++) {
+        _bytes -= _packets.dequeue().data.size();
+    }
+}
+
+void ReplayBuffer::trim() {
+    if (_packets.isEmpty()) return;
+    qint64 newest = _packets.last().time;
+    while ((_keyframes.size() > 1) &&
+           ((_bytes > _maxBytes) || (newest - _keyframes.at(1).time >= _duration))) {
+        dropFront(_keyframes.at(1).index - _keyframes.first().index);
+        _keyframes.dequeue();
+    }
+    if (_bytes > _maxBytes) {
+        // A single keyframe interval is over the limit, so start again at the next one
+        LOG_W(LOG_TAG, "Keyframe interval is larger than the replay buffer, dropping it");
+        clear();
+    }
+}
+
+bool ReplayBuffer::save(const MediaFormat &format, int seconds, QString fileName) {
+    if (_keyframes.isEmpty()) {
+        LOG_W(LOG_TAG, "Nothing to save");
+        return false;
+    }
+    // Start from the last keyframe at or before the requested point
+    qint64 cutoff = _packets.last().time - (qint64)seconds * 1000;
+    int start = 0;
+    while ((start + 1 < _keyframes.size()) && (_keyframes.at(start + 1).time <= cutoff)) {
+        start++;
+    }
+    int first = _keyframes.at(start).index - _keyframes.first().index;
+
+    QString binStr = QString("appsrc name=%1 format=time block=false max-bytes=0 ! %2 ! %3 ! matroskamux ! filesink location=\"%4\"").arg(
+                REPLAYBUFFER_GST_ELEMENT_NAME,
+                format.createGstDecodingArgs(MediaFormat::DecodingType_RtpDecodeOnly),
+                format.createGstParserArgs(),
+                fileName);
+    LOG_I(LOG_TAG, "Saving " + QString::number(_packets.last().time - _packets.at(first).time)
+          + "ms of stream with bin string " + binStr);
+
+    QGst::PipelinePtr pipeline = QGst::Pipeline::create();
+    QGst::BinPtr bin = QGst::Bin::fromDescription(binStr);
+    pipeline->add(bin);
+    GstElement *appsrc = static_cast<GstElement*>(bin->getElementByName(REPLAYBUFFER_GST_ELEMENT_NAME));
+
+    // The packets are shared with the buffer, so queueing them all up front costs no copies
+    qint64 base = _packets.at(first).time;
+    for (int i = first; i < _packets.size(); i++) {
+        QByteArray *data = new QByteArray(_packets.at(i).data);
+        GstBuffer *buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY,
+                                                        const_cast<char*>(data->constData()), data->size(),
+                                                        0, data->size(), data, releasePacket);
+        GST_BUFFER_PTS(buffer) = (_packets.at(i).time - base) * GST_MSECOND;
+        gst_app_src_push_buffer(GST_APP_SRC(appsrc), buffer);
+    }
+    gst_app_src_end_of_stream(GST_APP_SRC(appsrc));
+
+    pipeline->bus()->addSignalWatch();
+    QGlib::connect(pipeline->bus(), "message", this, &ReplayBuffer::onSaveBusMessage, QGlib::PassSender);
+    _saving.append(qMakePair(pipeline, fileName));
+    pipeline->setState(QGst::StatePlaying);
+    return true;
+}
+
+void ReplayBuffer::onSaveBusMessage(const QGst::BusPtr & bus, const QGst::MessagePtr & message) {
+    bool success;
+    switch (message->type()) {
+    case QGst::MessageEos:
+        success = true;
+        break;
+    case QGst::MessageError:
+        LOG_E(LOG_TAG, "Error saving replay: " + message.staticCast<QGst::ErrorMessage>()->error().message());
+        success = false;
+        break;
+    default:
+        return;
+    }
+    for (int i = 0; i < _saving.size(); i++) {
+        if (_saving.at(i).first->bus() == bus) {
+            QGst::PipelinePtr pipeline = _saving.at(i).first;
+            QString fileName = _saving.at(i).second;
+            _saving.removeAt(i);
+            bus->removeSignalWatch();
+            QGlib::disconnect(bus, "message", this, &ReplayBuffer::onSaveBusMessage);
+            pipeline->setState(QGst::StateNull);
+            LOG_I(LOG_TAG, (success ? "Saved replay " : "Could not save replay ") + fileName);
+            emit saved(fileName, success);
+            break;
+        }
+    }
+}
+
+} // namespace Gst
+} // namespace Soro
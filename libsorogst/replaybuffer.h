@@ -0,0 +1,96 @@
+#ifndef SORO_GST_REPLAYBUFFER_H
+#define SORO_GST_REPLAYBUFFER_H
+
+#include <QObject>
+#include <QQueue>
+#include <QList>
+#include <QPair>
+
+#include <Qt5GStreamer/QGst/Pipeline>
+#include <Qt5GStreamer/QGst/Message>
+#include <Qt5GStreamer/QGst/Bus>
+
+#include "libsoro/mediaclient.h"
+#include "libsoro/mediaformat.h"
+#include "soro_gst_global.h"
+
+// Default length of stream kept, in ms
+#define REPLAYBUFFER_DEFAULT_DURATION 60000
+// Default limit on the memory used by the packets kept
+#define REPLAYBUFFER_DEFAULT_MAX_BYTES (64 * 1024 * 1024)
+
+namespace Soro {
+namespace Gst {
+
+/* Keeps the last part of a stream in memory as the encoded packets received by its MediaClient,
+ * so it can be saved after something interesting happens without recording all the time.
+ *
+ * The buffer always starts at a keyframe and is trimmed a whole keyframe interval at a time,
+ * so a saved replay can be decoded from its first frame. It is emptied whenever the client
+ * stops streaming.
+ */
+class LIBSOROGST_EXPORT ReplayBuffer : public QObject {
+    Q_OBJECT
+public:
+    explicit ReplayBuffer(MediaClient *client, QObject *parent = 0);
+    ~ReplayBuffer();
+
+    /* Sets how much of the stream is kept. The oldest keyframe interval is dropped once the
+     * rest covers the duration, or as soon as the buffer exceeds its memory limit.
+     */
+    void setLimits(int duration, qint64 maxBytes);
+
+    void start();
+    void stop();
+    void clear();
+    bool isRunning() const;
+
+    /* Gets the length in ms and size of the stream currently kept
+     */
+    int getBufferedDuration() const;
+    qint64 getBufferedBytes() const;
+
+    /* Writes the last given seconds of the stream to a file, starting from the keyframe at or
+     * before that point. The file is written in the background and saved() is emitted when
+     * it is finished.
+     */
+    bool save(const MediaFormat &format, int seconds, QString fileName);
+
+signals:
+    void saved(QString fileName, bool success);
+
+private:
+    struct Packet {
+        QByteArray data;
+        qint64 time;
+    };
+    struct Keyframe {
+        qint64 index;
+        qint64 time;
+        quint32 rtpTimestamp;
+    };
+
+    MediaClient *_client;
+    int _reader = -1;
+    QQueue<Packet> _packets;
+    QQueue<Keyframe> _keyframes;
+    // Number of packets ever added, used to find a keyframe's packet in the queue
+    qint64 _pushed = 0;
+    qint64 _bytes = 0;
+    int _duration = REPLAYBUFFER_DEFAULT_DURATION;
+    qint64 _maxBytes = REPLAYBUFFER_DEFAULT_MAX_BYTES;
+    QList<QPair<QGst::PipelinePtr, QString>> _saving;
+
+    void trim();
+    void dropFront(qint64 count);
+
+private slots:
+    void packetsAvailable();
+    void clientStateChanged(MediaClient *client, MediaClient::State state);
+    void onSaveBusMessage(const QGst::BusPtr & bus, const QGst::MessagePtr & message);
+};
+
+} // namespace Gst
+} // namespace Soro
+
+#endif // SORO_GST_REPLAYBUFFER_H
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ringsource.h"
+#include "libsoro/logger.h"
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+
+#define LOG_TAG "RingSource"
+
+namespace Soro {
+namespace Gst {
+
+/* Releases the packet a gstreamer buffer was wrapping once the pipeline is done with it.
+ * May be called from a streaming thread, which is fine since QByteArray's reference
+ * count is atomic.
+ */
+static void releasePacket(gpointer packet) {
+    delete reinterpret_cast<QByteArray*>(packet);
+}
+
+RingSource::RingSource(QObject *parent) : QObject(parent) { }
+
+RingSource::~RingSource() {
+    detach();
+}
+
+QString RingSource::createGstSourceArgs() {
+    return QString("appsrc name=%1 is-live=true do-timestamp=true format=time block=false max-bytes=%2").arg(
+                RINGSOURCE_GST_ELEMENT_NAME,
+                QString::number(RINGSOURCE_MAX_QUEUED_BYTES));
+}
+
+bool RingSource::attach(PacketRing *ring, QGst::BinPtr bin) {
+    detach();
+    _appsrc = bin->getElementByName(RINGSOURCE_GST_ELEMENT_NAME);
+    if (_appsrc.isNull()) {
+        LOG_E(LOG_TAG, "attach(): Pipeline has no element named " RINGSOURCE_GST_ELEMENT_NAME);
+        return false;
+    }
+    _ring = ring;
+    _reader = _ring->addReader();
+    _dropped = 0;
+    connect(_ring, &PacketRing::packetsAvailable, this, &RingSource::packetsAvailable);
+    return true;
+}
+
+void RingSource::detach() {
+    if (_ring) {
+        disconnect(_ring, &PacketRing::packetsAvailable, this, &RingSource::packetsAvailable);
+        _dropped += _ring->getDropped(_reader);
+        _ring->removeReader(_reader);
+        _ring = nullptr;
+        _reader = -1;
+    }
+    _appsrc.clear();
+}
+
+bool RingSource::isAttached() const {
+    return _ring != nullptr;
+}
+
+qint64 RingSource::getDropped() const {
+    return _ring ? _dropped + _ring->getDropped(_reader) : _dropped;
+}
+
+void RingSource::packetsAvailable() {
+    GstAppSrc *appsrc = GST_APP_SRC(static_cast<GstElement*>(_appsrc));
+    QByteArray packet;
+    while (_ring->read(_reader, packet)) {
+        if (gst_app_src_get_current_level_bytes(appsrc) > RINGSOURCE_MAX_QUEUED_BYTES) {
+            // Pipeline isn't keeping up, drop rather than let the queue grow
+            _dropped++;
+            continue;
+        }
+        // The buffer holds its own reference to the packet data until it is freed
+        QByteArray *held = new QByteArray(packet);
+        GstBuffer *buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY,
+                                                        const_cast<char*>(held->constData()),
+                                                        held->size(), 0, held->size(),
+                                                        held, releasePacket);
+        if (gst_app_src_push_buffer(appsrc, buffer) != GST_FLOW_OK) {
+            // Pipeline is shutting down
+            break;
+        }
+    }
+}
+
+} // namespace Gst
+} // namespace Soro
@@ -0,0 +1,59 @@
+#ifndef SORO_GST_RINGSOURCE_H
+#define SORO_GST_RINGSOURCE_H
+
+#include <QObject>
+
+#include <Qt5GStreamer/QGst/Element>
+#include <Qt5GStreamer/QGst/Bin>
+
+#include "libsoro/packetring.h"
+#include "soro_gst_global.h"
+
+// Name of the appsrc element in a pipeline created with RingSource::createGstSourceArgs()
+#define RINGSOURCE_GST_ELEMENT_NAME "ringsrc"
+// Bytes that can be queued in the appsrc before packets are dropped
+#define RINGSOURCE_MAX_QUEUED_BYTES (4 * 1024 * 1024)
+
+namespace Soro {
+namespace Gst {
+
+/* Feeds the packets received by a MediaClient into an appsrc element, so a pipeline
+ * can play or record a stream in-process instead of receiving it from a udpsrc. Packets
+ * are wrapped in gstreamer buffers without being copied.
+ */
+class LIBSOROGST_EXPORT RingSource : public QObject {
+    Q_OBJECT
+public:
+    explicit RingSource(QObject *parent = 0);
+    ~RingSource();
+
+    /* Gets the pipeline description for the appsrc, to be used in place of a udpsrc
+     */
+    static QString createGstSourceArgs();
+
+    /* Starts reading packets from the ring into the named appsrc in the bin. Any
+     * previous attachment is detached first.
+     */
+    bool attach(PacketRing *ring, QGst::BinPtr bin);
+    void detach();
+
+    bool isAttached() const;
+
+    /* Gets the number of packets dropped because the pipeline could not keep up
+     */
+    qint64 getDropped() const;
+
+private:
+    PacketRing *_ring = nullptr;
+    QGst::ElementPtr _appsrc;
+    int _reader = -1;
+    qint64 _dropped = 0;
+
+private slots:
+    void packetsAvailable();
+};
+
+} // namespace Gst
+} // namespace Soro
+
+#endif // SORO_GST_RINGSOURCE_H
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "segmentedrecording.h"
+#include "libsoro/logger.h"
+#include "libsoro/recordingindex.h"
+#include "libsoro/storagewriter.h"
+
+#include <QDateTime>
+#include <QPointer>
+
+#include <gst/gst.h>
+
+#define LOG_TAG "SegmentedRecording"
+
+namespace Soro {
+namespace Gst {
+
+/* Shared by the signal handlers and pad probes of one recording. Owned by the
+ * splitmuxsink, so it lives as long as anything that can call into it.
+ */
+struct SegmentedRecordingState {
+    RecordingIndex index;
+    QByteArray locationPattern;
+    QPointer<QObject> receiver;
+    QByteArray newFileSlot;
+};
+
+static void freeState(gpointer state) {
+    delete reinterpret_cast<SegmentedRecordingState*>(state);
+}
+
+/* Called by splitmuxsink from its streaming thread before each segment is opened
+ */
+static gchar* formatLocation(GstElement *splitmux, guint fragment, gpointer data) {
+    Q_UNUSED(splitmux);
+    SegmentedRecordingState *state = reinterpret_cast<SegmentedRecordingState*>(data);
+    state->index.beginSegment();
+    gchar *location = g_strdup_printf(state->locationPattern.constData(), fragment);
+    if (state->receiver) {
+        QMetaObject::invokeMethod(state->receiver, state->newFileSlot.constData(), Qt::QueuedConnection,
+                                  Q_ARG(QString, QString::fromLocal8Bit(location)));
+    }
+    return location;
+}
+
+/* Counts the bytes written to the segment file, following the muxer when it
+ * seeks back to rewrite headers
+ */
+static GstPadProbeReturn fileProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    Q_UNUSED(pad);
+    SegmentedRecordingState *state = reinterpret_cast<SegmentedRecordingState*>(data);
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+        state->index.addBytes(gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info)));
+    }
+    else if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+        for (guint i = 0; i < gst_buffer_list_length(list); i++) {
+            state->index.addBytes(gst_buffer_get_size(gst_buffer_list_get(list, i)));
+        }
+    }
+    else if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_SEGMENT) {
+        const GstSegment *segment;
+        gst_event_parse_segment(GST_PAD_PROBE_INFO_EVENT(info), &segment);
+        if (segment->format == GST_FORMAT_BYTES) {
+            state->index.seek(segment->start);
+        }
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+/* Indexes keyframes as they reach the muxer, after splitmuxsink has decided
+ * which segment they belong in
+ */
+static GstPadProbeReturn keyframeProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    Q_UNUSED(pad);
+    SegmentedRecordingState *state = reinterpret_cast<SegmentedRecordingState*>(data);
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        qint64 streamTime = GST_BUFFER_PTS_IS_VALID(buffer) ? (qint64)(GST_BUFFER_PTS(buffer) / GST_MSECOND) : -1;
+        state->index.addKeyframe(QDateTime::currentMSecsSinceEpoch(), streamTime);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static void muxerPadAdded(GstElement *muxer, GstPad *pad, gpointer data) {
+    Q_UNUSED(muxer);
+    if (GST_PAD_IS_SINK(pad)) {
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, keyframeProbe, data, nullptr);
+    }
+}
+
+QString SegmentedRecording::createGstArgs(const VideoFormat &format, int segmentSeconds, qint64 segmentBytes) {
+    return QString("%1 ! splitmuxsink name=%2 max-size-time=%3 max-size-bytes=%4").arg(
+                format.createGstParserArgs(),
+                SEGMENTEDRECORDING_GST_ELEMENT_NAME,
+                QString::number((quint64)segmentSeconds * GST_SECOND),
+                QString::number(segmentBytes));
+}
+
+bool SegmentedRecording::prepare(QGst::BinPtr bin, QString basePath, QObject *receiver, const char *newFileSlot) {
+    QGst::ElementPtr splitmuxPtr = bin->getElementByName(SEGMENTEDRECORDING_GST_ELEMENT_NAME);
+    if (splitmuxPtr.isNull()) {
+        LOG_E(LOG_TAG, "prepare(): Bin has no element named " SEGMENTEDRECORDING_GST_ELEMENT_NAME);
+        return false;
+    }
+    GstElement *splitmux = static_cast<GstElement*>(splitmuxPtr);
+    GstElement *muxer = gst_element_factory_make("matroskamux", nullptr);
+    GstElement *sink = gst_element_factory_make("filesink", nullptr);
+    if (!muxer || !sink) {
+        LOG_E(LOG_TAG, "prepare(): Cannot create matroskamux or filesink");
+        if (muxer) gst_object_unref(muxer);
+        if (sink) gst_object_unref(sink);
+        return false;
+    }
+
+    SegmentedRecordingState *state = new SegmentedRecordingState;
+    // The path goes through printf, so a '%' in a directory name must not be read as a conversion
+    state->locationPattern = QString(basePath).replace("%", "%%").toLocal8Bit() + "_%05d.mkv";
+    if (receiver && newFileSlot) {
+        state->receiver = receiver;
+        state->newFileSlot = newFileSlot;
+    }
+    if (!state->index.open(basePath + ".idx")) {
+        LOG_W(LOG_TAG, "Recording without an index");
+    }
+    g_object_set_data_full(G_OBJECT(splitmux), "soro-segmented-recording", state, freeState);
+
+    g_signal_connect(muxer, "pad-added", G_CALLBACK(muxerPadAdded), state);
+    GstPad *sinkPad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(sinkPad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                      fileProbe, state, nullptr);
+    gst_object_unref(sinkPad);
+
+    // Written in large blocks from the sink's own thread
+    gst_util_set_object_arg(G_OBJECT(sink), "buffer-mode", "full");
+    g_object_set(sink, "buffer-size", (guint)STORAGEWRITER_BLOCK_SIZE, NULL);
+
+    g_signal_connect(splitmux, "format-location", G_CALLBACK(formatLocation), state);
+    // splitmuxsink takes ownership of both
+    g_object_set(splitmux, "muxer", muxer, "sink", sink, NULL);
+    return true;
+}
+
+} // namespace Gst
+} // namespace Soro
@@ -0,0 +1,45 @@
+#ifndef SORO_GST_SEGMENTEDRECORDING_H
+#define SORO_GST_SEGMENTEDRECORDING_H
+
+#include <QString>
+#include <QObject>
+
+#include <Qt5GStreamer/QGst/Bin>
+
+#include "libsoro/videoformat.h"
+#include "soro_gst_global.h"
+
+// Name of the splitmuxsink in a pipeline created with SegmentedRecording::createGstArgs()
+#define SEGMENTEDRECORDING_GST_ELEMENT_NAME "segmentsink"
+// Default limits after which a new segment is started
+#define SEGMENTEDRECORDING_DEFAULT_DURATION 300
+#define SEGMENTEDRECORDING_DEFAULT_SIZE (1024LL * 1024 * 1024)
+
+namespace Soro {
+namespace Gst {
+
+/* Writes an encoded video stream as a series of Matroska segments with a sidecar
+ * RecordingIndex. Each segment is finished when the next one starts, and a Matroska
+ * file cut short by a crash still plays up to where it ends, so a crash costs at most
+ * the tail of the last segment.
+ */
+class LIBSOROGST_EXPORT SegmentedRecording {
+public:
+    /* Creates a pipeline description that parses a depayloaded video stream and
+     * starts a new segment after the given duration or size, whichever comes first
+     */
+    static QString createGstArgs(const VideoFormat &format, int segmentSeconds, qint64 segmentBytes);
+
+    /* Finishes setting up the segment writer in a bin created from createGstArgs(). Segments
+     * are written to basePath followed by their number (basePath_00000.mkv, ...) and the index
+     * to basePath.idx. Must be called before the bin leaves the NULL state.
+     * If a receiver is given, its newFileSlot (by name, taking a QString) is invoked with the path
+     * of each segment as it is opened.
+     */
+    static bool prepare(QGst::BinPtr bin, QString basePath, QObject *receiver = nullptr, const char *newFileSlot = nullptr);
+};
+
+} // namespace Gst
+} // namespace Soro
+
+#endif // SORO_GST_SEGMENTEDRECORDING_H
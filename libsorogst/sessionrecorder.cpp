@@ -0,0 +1,215 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sessionrecorder.h"
+#include "libsoro/logger.h"
+
+#include <QCoreApplication>
+#include <QTimer>
+
+#include <Qt5GStreamer/QGst/Bin>
+#include <Qt5GStreamer/QGst/Event>
+#include <Qt5GStreamer/QGst/Pad>
+#include <Qt5GStreamer/QGlib/Connect>
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+
+#define LOG_TAG "SessionRecorder"
+
+namespace Soro {
+namespace Gst {
+
+SessionRecorder::SessionRecorder(QObject *parent) : QObject(parent) { }
+
+SessionRecorder::~SessionRecorder() {
+    stop();
+    release();
+}
+
+void SessionRecorder::addVideoTrack(PacketRing *ring, const VideoFormat &format, QString name) {
+    Track track;
+    track.ring = ring;
+    track.name = name;
+    track.args = format.createGstDecodingArgs(MediaFormat::DecodingType_RtpDecodeOnly) + " ! " + format.createGstParserArgs();
+    // splitmuxsink cuts segments on its one primary video pad, the others are auxiliary
+    track.padTemplate = "video";
+    foreach (const Track &other, _tracks) {
+        if (other.padTemplate == "video") {
+            track.padTemplate = "video_aux_%u";
+            break;
+        }
+    }
+    _tracks.append(track);
+}
+
+void SessionRecorder::addAudioTrack(PacketRing *ring, const AudioFormat &format, QString name) {
+    Track track;
+    track.ring = ring;
+    track.name = name;
+    track.args = format.createGstDecodingArgs(MediaFormat::DecodingType_RtpDecodeOnly) + " ! " + format.createGstParserArgs();
+    track.padTemplate = "audio_%u";
+    _tracks.append(track);
+}
+
+void SessionRecorder::clearTracks() {
+    if (isRecording()) {
+        LOG_E(LOG_TAG, "Cannot change tracks while recording");
+        return;
+    }
+    _tracks.clear();
+}
+
+int SessionRecorder::getTrackCount() const {
+    return _tracks.size();
+}
+
+bool SessionRecorder::isRecording() const {
+    return !_pipeline.isNull();
+}
+
+QString SessionRecorder::getFileName() const {
+    return _fileName;
+}
+
+bool SessionRecorder::begin(qint64 timestamp, QString metadataHeader) {
+    stop();
+    if (_tracks.isEmpty()) {
+        LOG_W(LOG_TAG, "No tracks to record");
+        return false;
+    }
+
+    QString basePath = QString("%1/../research_media/%2_session").arg(
+                QCoreApplication::applicationDirPath(),
+                QString::number(timestamp));
+    // The metadata track is sparse, so the muxer doesn't wait on it between entries
+    QString binStr = QString("splitmuxsink name=%1 max-size-time=%2 max-size-bytes=%3 "
+                             "appsrc name=%4 caps=text/x-raw,format=utf8 is-live=true do-timestamp=true format=time "
+                             "! queue ! %1.subtitle_%u").arg(
+                SEGMENTEDRECORDING_GST_ELEMENT_NAME,
+                QString::number((quint64)SEGMENTEDRECORDING_DEFAULT_DURATION * GST_SECOND),
+                QString::number(SEGMENTEDRECORDING_DEFAULT_SIZE),
+                SESSIONRECORDER_METADATA_NAME);
+    LOG_I(LOG_TAG, "Starting session recording to " + basePath + " with bin string " + binStr);
+
+    QGst::BinPtr bin = QGst::Bin::fromDescription(binStr);
+    if (!SegmentedRecording::prepare(bin, basePath, this, "onSegmentStarted")) {
+        LOG_E(LOG_TAG, "Cannot set up segmented recording");
+        return false;
+    }
+    _pipeline = QGst::Pipeline::create();
+    _pipeline->bus()->addSignalWatch();
+    QGlib::connect(_pipeline->bus(), "message", this, &SessionRecorder::onBusMessage, QGlib::PassSender);
+    _pipeline->add(bin);
+    QGst::ElementPtr mux = bin->getElementByName(SEGMENTEDRECORDING_GST_ELEMENT_NAME);
+    _metadataSource = bin->getElementByName(SESSIONRECORDER_METADATA_NAME);
+
+    QStringList names;
+    foreach (const Track &track, _tracks) {
+        // Each track gets its own bin so their appsrcs can share the name RingSource looks for
+        QString trackStr = RingSource::createGstSourceArgs() + " ! " + track.args + " ! queue";
+        LOG_I(LOG_TAG, "Adding track " + track.name + " with bin string " + trackStr);
+        QGst::PadPtr muxPad = mux->getRequestPad(track.padTemplate.toLatin1().constData());
+        if (muxPad.isNull()) {
+            LOG_E(LOG_TAG, "Cannot get a " + track.padTemplate + " pad for track " + track.name + ", leaving it out");
+            continue;
+        }
+        QGst::BinPtr trackBin = QGst::Bin::fromDescription(trackStr);
+        _pipeline->add(trackBin);
+        trackBin->getStaticPad("src")->link(muxPad);
+        RingSource *ringSource = new RingSource(this);
+        ringSource->attach(track.ring, trackBin);
+        _ringSources.append(ringSource);
+        names.append(track.name);
+    }
+
+    _pipeline->setState(QGst::StatePlaying);
+    addMetadata(names.join(",") + (metadataHeader.isEmpty() ? "" : "\n" + metadataHeader));
+    return true;
+}
+
+void SessionRecorder::addMetadata(QString entry) {
+    if (_metadataSource.isNull()) return;
+    QByteArray utf8 = entry.toUtf8();
+    GstBuffer *buffer = gst_buffer_new_allocate(nullptr, utf8.size(), nullptr);
+    gst_buffer_fill(buffer, 0, utf8.constData(), utf8.size());
+    gst_app_src_push_buffer(GST_APP_SRC(static_cast<GstElement*>(_metadataSource)), buffer);
+}
+
+void SessionRecorder::stop() {
+    if (_pipeline.isNull()) return;
+    LOG_I(LOG_TAG, "Stopping session recording");
+    foreach (RingSource *ringSource, _ringSources) {
+        delete ringSource;
+    }
+    _ringSources.clear();
+    _metadataSource.clear();
+    _fileName = "";
+
+    // Only one session is finished at a time
+    release();
+    // End the stream so the last segment gets its headers and cues
+    _pipeline->sendEvent(QGst::EosEvent::create());
+    _finishing = _pipeline;
+    _pipeline.clear();
+    QGst::PipelinePtr finishing = _finishing;
+    QTimer::singleShot(SESSIONRECORDER_FINISH_TIMEOUT, this, [this, finishing]() {
+        if (_finishing == finishing) release();
+    });
+}
+
+void SessionRecorder::release() {
+    if (_finishing.isNull()) return;
+    _finishing->bus()->removeSignalWatch();
+    QGlib::disconnect(_finishing->bus(), "message", this, &SessionRecorder::onBusMessage);
+    _finishing->setState(QGst::StateNull);
+    _finishing.clear();
+}
+
+void SessionRecorder::onSegmentStarted(QString path) {
+    if (_pipeline.isNull()) return;
+    LOG_I(LOG_TAG, "Recording session segment " + path);
+    _fileName = path;
+    emit segmentStarted(path);
+}
+
+void SessionRecorder::onBusMessage(const QGst::BusPtr & bus, const QGst::MessagePtr & message) {
+    bool finishing = !_finishing.isNull() && (_finishing->bus() == bus);
+    switch (message->type()) {
+    case QGst::MessageEos:
+        if (finishing) {
+            LOG_I(LOG_TAG, "Finished writing session recording");
+            release();
+        }
+        break;
+    case QGst::MessageError: {
+        QString errorMessage = message.staticCast<QGst::ErrorMessage>()->error().message().toLatin1();
+        LOG_E(LOG_TAG, "onBusMessage(): Received error message from gstreamer '" + errorMessage + "'");
+        if (finishing) {
+            release();
+        }
+        else {
+            stop();
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+} // namespace Gst
+} // namespace Soro
@@ -0,0 +1,101 @@
+#ifndef SORO_GST_SESSIONRECORDER_H
+#define SORO_GST_SESSIONRECORDER_H
+
+#include <QObject>
+#include <QList>
+
+#include <Qt5GStreamer/QGst/Pipeline>
+#include <Qt5GStreamer/QGst/Message>
+#include <Qt5GStreamer/QGst/Bus>
+
+#include "libsoro/packetring.h"
+#include "libsoro/videoformat.h"
+#include "libsoro/audioformat.h"
+#include "libsoro/storagewriter.h"
+#include "ringsource.h"
+#include "segmentedrecording.h"
+#include "soro_gst_global.h"
+
+// Name of the appsrc carrying the metadata track
+#define SESSIONRECORDER_METADATA_NAME "sessionmeta"
+// How long a stopped session has to finish writing its file before it is torn down anyway
+#define SESSIONRECORDER_FINISH_TIMEOUT 3000
+
+namespace Soro {
+namespace Gst {
+
+/* Records every stream of a session into one series of Matroska segments from a single
+ * pipeline, so all tracks share the pipeline clock and line up without per-file offsets.
+ * Segments and their index are written as a SegmentedRecording. Streams are read from
+ * their MediaClients' packet rings, and a text track carries timed metadata such as
+ * the rows of a CsvRecorder.
+ *
+ * Tracks are fixed once recording begins, so when the set of streams changes the session
+ * should be stopped and begun again.
+ */
+class LIBSOROGST_EXPORT SessionRecorder : public QObject {
+    Q_OBJECT
+public:
+    explicit SessionRecorder(QObject *parent = 0);
+    ~SessionRecorder();
+
+    /* Adds a track to the next recording. Tracks are muxed in the order they are added,
+     * and segments are cut on keyframes of the first video track.
+     */
+    void addVideoTrack(PacketRing *ring, const VideoFormat &format, QString name);
+    void addAudioTrack(PacketRing *ring, const AudioFormat &format, QString name);
+    void clearTracks();
+    int getTrackCount() const;
+
+    /* Starts recording the tracks to <timestamp>_session_00000.mkv and on, indexed in
+     * <timestamp>_session.idx. The first entry on the metadata track lists the track names
+     * followed by the metadata header, if there is one.
+     */
+    bool begin(qint64 timestamp, QString metadataHeader = "");
+
+    /* Stops recording. The file is finished in the background.
+     */
+    void stop();
+
+    bool isRecording() const;
+
+    /* Gets the segment being recorded to, or an empty string if not recording
+     */
+    QString getFileName() const;
+
+signals:
+    /* Emitted with the path of each segment as it is opened
+     */
+    void segmentStarted(QString path);
+
+public slots:
+    /* Adds an entry to the metadata track, timed by when it is added
+     */
+    void addMetadata(QString entry);
+
+private slots:
+    void onBusMessage(const QGst::BusPtr & bus, const QGst::MessagePtr & message);
+    void onSegmentStarted(QString path);
+
+private:
+    struct Track {
+        PacketRing *ring;
+        QString name;
+        QString args;
+        QString padTemplate;
+    };
+
+    QList<Track> _tracks;
+    QList<RingSource*> _ringSources;
+    QGst::PipelinePtr _pipeline;
+    QGst::PipelinePtr _finishing;
+    QGst::ElementPtr _metadataSource;
+    QString _fileName;
+
+    void release();
+};
+
+} // namespace Gst
+} // namespace Soro
+
+#endif // SORO_GST_SESSIONRECORDER_H
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "streamengine.h"
+#include "videostreamer.h"
+#include "audiostreamer.h"
+#include "libsoro/logger.h"
+
+#include <QFileInfo>
+
+#include <Qt5GStreamer/QGst/Init>
+
+#define LOG_TAG "StreamEngine"
+
+// How often the gstreamer thread is pinged
+#define WATCHDOG_INTERVAL 1000
+// Pings the thread can miss before it is considered stuck
+#define WATCHDOG_MAX_MISSED 3
+// How long to wait for the gstreamer thread to exit
+#define STOP_TIMEOUT 1000
+
+namespace Soro {
+namespace Gst {
+
+StreamEngineWorker::StreamEngineWorker() : QObject() {
+}
+
+StreamEngineWorker::~StreamEngineWorker() {
+    foreach (MediaStreamer *streamer, _streamers.keys()) {
+        delete streamer;
+    }
+}
+
+void StreamEngineWorker::createStream(int handle, QString program, QStringList args) {
+    QString device;
+    QString formatSerial;
+    SocketAddress address;
+    SocketAddress bindAddress;
+    quint16 ipcPort;
+    int result = MediaStreamer::parseArguments(args, device, formatSerial, address, bindAddress, ipcPort);
+    if (result != 0) {
+        emit streamFinished(handle, result);
+        return;
+    }
+
+    MediaStreamer *streamer;
+    if (program == "video_streamer") {
+        VideoFormat format;
+        format.deserialize(formatSerial);
+        streamer = new VideoStreamer(device, format, bindAddress, address, ipcPort, this,
+                                     MediaStreamer::getOptionalArgument(args, "local"),
+                                     MediaStreamer::getOptionalArgument(args, "capture"));
+    }
+    else if (program == "audio_streamer") {
+        AudioFormat format;
+        format.deserialize(formatSerial);
+        streamer = new AudioStreamer(device, format, bindAddress, address, ipcPort, this);
+    }
+    else {
+        LOG_E(LOG_TAG, "createStream(): Don't know how to run '" + program + "' in process");
+        emit streamFinished(handle, STREAMPROCESS_ERR_INVALID_ARGUMENT);
+        return;
+    }
+    _streamers.insert(streamer, handle);
+    connect(streamer, &MediaStreamer::finished, this, &StreamEngineWorker::streamerFinished);
+    LOG_I(LOG_TAG, "createStream(): Started in-process stream " + QString::number(handle) + " for " + device);
+}
+
+void StreamEngineWorker::destroyStream(int handle) {
+    MediaStreamer *streamer = _streamers.key(handle, nullptr);
+    if (streamer) {
+        _streamers.remove(streamer);
+        delete streamer;
+        LOG_I(LOG_TAG, "destroyStream(): Stopped in-process stream " + QString::number(handle));
+    }
+    // Acknowledges the stop, the stream's sockets are closed by now
+    emit streamFinished(handle, 0);
+}
+
+void StreamEngineWorker::ping() {
+    emit pong();
+}
+
+void StreamEngineWorker::streamerFinished(int code) {
+    MediaStreamer *streamer = qobject_cast<MediaStreamer*>(sender());
+    if (!_streamers.contains(streamer)) return;
+    int handle = _streamers.take(streamer);
+    streamer->deleteLater();
+    LOG_I(LOG_TAG, "streamerFinished(): In-process stream " + QString::number(handle) + " ended with code " + QString::number(code));
+    emit streamFinished(handle, code);
+}
+
+StreamEngine::StreamEngine(QObject *parent) : MediaStreamEngine(parent) {
+    QGst::init();
+    MediaStreamer::setInProcess(true);
+
+    _worker = new StreamEngineWorker();
+    _worker->moveToThread(&_thread);
+    connect(&_thread, &QThread::finished, _worker, &QObject::deleteLater);
+    connect(_worker, &StreamEngineWorker::streamFinished, this, &StreamEngine::workerStreamFinished);
+    connect(_worker, &StreamEngineWorker::pong, this, &StreamEngine::workerPong);
+    _thread.setObjectName("gstreamer");
+    _thread.start();
+
+    START_TIMER(_watchdogTimerId, WATCHDOG_INTERVAL);
+    LOG_I(LOG_TAG, "StreamEngine(): gstreamer thread started");
+}
+
+StreamEngine::~StreamEngine() {
+    KILL_TIMER(_watchdogTimerId);
+    _thread.quit();
+    if (!_thread.wait(STOP_TIMEOUT)) {
+        LOG_E(LOG_TAG, "~StreamEngine(): gstreamer thread did not exit, terminating it");
+        _thread.terminate();
+        _thread.wait();
+    }
+}
+
+int StreamEngine::startStream(QString program, QStringList args) {
+    if (!_healthy) return -1;
+    int handle = _nextHandle++;
+    _handles.insert(handle);
+    // The streamer expects the program in front like the process arguments
+    QMetaObject::invokeMethod(_worker, "createStream", Qt::QueuedConnection,
+                              Q_ARG(int, handle),
+                              Q_ARG(QString, QFileInfo(program).baseName()),
+                              Q_ARG(QStringList, QStringList() << program << args));
+    return handle;
+}
+
+void StreamEngine::stopStream(int handle) {
+    if (!_handles.remove(handle) || !_healthy) {
+        // Already gone, queued so the caller always hears back after this returns
+        QMetaObject::invokeMethod(this, "streamStopped", Qt::QueuedConnection, Q_ARG(int, handle));
+        return;
+    }
+    _stopping.insert(handle);
+    QMetaObject::invokeMethod(_worker, "destroyStream", Qt::QueuedConnection, Q_ARG(int, handle));
+}
+
+bool StreamEngine::isHealthy() const {
+    return _healthy;
+}
+
+void StreamEngine::timerEvent(QTimerEvent *e) {
+    if (e->timerId() == _watchdogTimerId) {
+        if (_pingOutstanding) {
+            if (++_missedPings >= WATCHDOG_MAX_MISSED) {
+                LOG_E(LOG_TAG, "gstreamer thread has not responded in " + QString::number(_missedPings * WATCHDOG_INTERVAL) + "ms");
+                setUnhealthy();
+            }
+            return;
+        }
+        _pingOutstanding = true;
+        QMetaObject::invokeMethod(_worker, "ping", Qt::QueuedConnection);
+    }
+    else {
+        QObject::timerEvent(e);
+    }
+}
+
+void StreamEngine::setUnhealthy() {
+    if (!_healthy) return;
+    _healthy = false;
+    KILL_TIMER(_watchdogTimerId);
+    LOG_E(LOG_TAG, "setUnhealthy(): In-process streaming is disabled, streams will run in child processes");
+    emit healthChanged(false);
+    foreach (int handle, _handles) {
+        emit streamFinished(handle, STREAMPROCESS_ERR_GSTREAMER_ERROR);
+    }
+    _handles.clear();
+    // These will never be acknowledged. Whoever waits on them finds out if the stuck stream still
+    // holds its socket when binding it again
+    foreach (int handle, _stopping) {
+        emit streamStopped(handle);
+    }
+    _stopping.clear();
+}
+
+void StreamEngine::workerStreamFinished(int handle, int exitCode) {
+    if (_stopping.remove(handle)) {
+        emit streamStopped(handle);
+    }
+    else if (_handles.remove(handle)) {
+        emit streamFinished(handle, exitCode);
+    }
+}
+
+void StreamEngine::workerPong() {
+    _pingOutstanding = false;
+    _missedPings = 0;
+}
+
+} // namespace Gst
+} // namespace Soro
@@ -0,0 +1,86 @@
+#ifndef SORO_GST_STREAMENGINE_H
+#define SORO_GST_STREAMENGINE_H
+
+#include <QObject>
+#include <QThread>
+#include <QHash>
+#include <QSet>
+#include <QTimerEvent>
+
+#include "libsoro/mediastreamengine.h"
+#include "libsoro/constants.h"
+#include "mediastreamer.h"
+#include "soro_gst_global.h"
+
+namespace Soro {
+namespace Gst {
+
+/* Lives on the engine's gstreamer thread and owns the streamers running there
+ */
+class LIBSOROGST_EXPORT StreamEngineWorker : public QObject {
+    Q_OBJECT
+public:
+    StreamEngineWorker();
+    ~StreamEngineWorker();
+
+public slots:
+    void createStream(int handle, QString program, QStringList args);
+    void destroyStream(int handle);
+    void ping();
+
+private:
+    QHash<MediaStreamer*, int> _streamers;
+
+private slots:
+    void streamerFinished(int code);
+
+signals:
+    void streamFinished(int handle, int exitCode);
+    void pong();
+};
+
+/* Runs VideoStreamer and AudioStreamer pipelines on a dedicated gstreamer thread inside the
+ * rover process, which saves starting a process for every stream.
+ *
+ * The thread is pinged every second. If it stops answering it is assumed to be stuck in gstreamer,
+ * every stream on it is reported as failed, and the engine marks itself unhealthy so the MediaServers
+ * go back to streaming from child processes.
+ *
+ * Streams are stopped asynchronously, the worker answers a stop with streamFinished() once the
+ * stream is destroyed, which the engine passes on as streamStopped().
+ */
+class LIBSOROGST_EXPORT StreamEngine : public MediaStreamEngine {
+    Q_OBJECT
+public:
+    StreamEngine(QObject *parent = 0);
+    ~StreamEngine();
+
+    int startStream(QString program, QStringList args) Q_DECL_OVERRIDE;
+    void stopStream(int handle) Q_DECL_OVERRIDE;
+    bool isHealthy() const Q_DECL_OVERRIDE;
+
+protected:
+    void timerEvent(QTimerEvent *e) Q_DECL_OVERRIDE;
+
+private:
+    QThread _thread;
+    StreamEngineWorker *_worker = nullptr;
+    QSet<int> _handles;
+    QSet<int> _stopping;
+    int _nextHandle = 0;
+    bool _healthy = true;
+    bool _pingOutstanding = false;
+    int _missedPings = 0;
+    int _watchdogTimerId = TIMER_INACTIVE;
+
+    void setUnhealthy();
+
+private slots:
+    void workerStreamFinished(int handle, int exitCode);
+    void workerPong();
+};
+
+} // namespace Gst
+} // namespace Soro
+
+#endif // SORO_GST_STREAMENGINE_H
@@ -0,0 +1,482 @@
+/*
+ * Copyright 2016 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "videostreamer.h"
+#include "segmentedrecording.h"
+#include "capturemultiplexer.h"
+#include "libsoro/logger.h"
+#include "libsoro/constants.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QAtomicInt>
+#include <QSemaphore>
+#include <QSharedPointer>
+
+#include <gst/gst.h>
+
+namespace Soro {
+namespace Gst {
+
+/* Handed from swapEncoder() to the probe that replaces the encoder, which may run on
+ * the camera's streaming thread. Whichever side claims it first decides if the swap happens.
+ */
+struct EncoderSwap {
+    QGst::ElementPtr encoder;
+    QGst::ElementPtr replacement;
+    QGst::PadPtr upstream;
+    QGst::PadPtr downstream;
+    QGst::BinPtr bin;
+    QAtomicInt claimed;
+    QSemaphore done;
+    bool swapped = false;
+    bool relinked = false;
+};
+typedef QSharedPointer<EncoderSwap> EncoderSwapPtr;
+
+static void freeEncoderSwap(gpointer data) {
+    delete reinterpret_cast<EncoderSwapPtr*>(data);
+}
+
+static bool linkEncoder(QGst::PadPtr upstream, QGst::ElementPtr encoder, QGst::PadPtr downstream) {
+    return (upstream->link(encoder->getStaticPad("sink")) == QGst::PadLinkOk) &&
+            (encoder->getStaticPad("src")->link(downstream) == QGst::PadLinkOk);
+}
+
+static void unlinkEncoder(EncoderSwap *swap, QGst::ElementPtr encoder) {
+    swap->upstream->unlink(encoder->getStaticPad("sink"));
+    encoder->getStaticPad("src")->unlink(swap->downstream);
+    encoder->setState(QGst::StateNull);
+    swap->bin->remove(encoder);
+}
+
+/* Called once nothing is flowing into the encoder, no frame can reach it until this returns
+ */
+static GstPadProbeReturn swapEncoderProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    Q_UNUSED(pad);
+    Q_UNUSED(info);
+    EncoderSwap *swap = reinterpret_cast<EncoderSwapPtr*>(data)->data();
+    if (!swap->claimed.testAndSetOrdered(0, 1)) {
+        // swapEncoder() gave up waiting
+        return GST_PAD_PROBE_REMOVE;
+    }
+    unlinkEncoder(swap, swap->encoder);
+    swap->bin->add(swap->replacement);
+    if (linkEncoder(swap->upstream, swap->replacement, swap->downstream)) {
+        swap->replacement->syncStateWithParent();
+        swap->swapped = true;
+    }
+    else {
+        unlinkEncoder(swap, swap->replacement);
+        swap->bin->add(swap->encoder);
+        swap->relinked = linkEncoder(swap->upstream, swap->encoder, swap->downstream);
+        if (swap->relinked) {
+            swap->encoder->syncStateWithParent();
+        }
+    }
+    swap->done.release();
+    return GST_PAD_PROBE_REMOVE;
+}
+
+VideoStreamer::VideoStreamer(QGst::ElementPtr source, VideoFormat format, SocketAddress bindAddress, SocketAddress address, quint16 ipcPort, QObject *parent)
+        : MediaStreamer("VideoStreamer", parent) {
+    _format = format;
+    if (!connectToParent(ipcPort)) return;
+
+    LOG_I(LOG_TAG, "Creating pipeline");
+    _pipeline = createPipeline();
+
+    // create gstreamer command
+    QString binStr = "%1 ! udpsink bind-address=%2 bind-port=%3 host=%4 port=%5";
+    binStr = binStr.arg(format.createGstEncodingArgs(),
+                        bindAddress.host.toString(),
+                        QString::number(bindAddress.port),
+                        address.host.toString(),
+                        QString::number(address.port));
+
+    QGst::BinPtr encoder = QGst::Bin::fromDescription(binStr);
+
+    LOG_I(LOG_TAG, "Created gstreamer bin <source> ! " + binStr);
+
+    // link elements
+    _pipeline->add(source, encoder);
+    source->link(encoder);
+
+    LOG_I(LOG_TAG, "Elements linked on pipeline");
+
+    // play<source> ! " +
+    _pipeline->setState(QGst::StatePlaying);
+    startStatistics(source, _pipeline->getElementByName(VIDEOFORMAT_GST_ENCODER_NAME));
+
+    LOG_I(LOG_TAG, "Stream started");
+}
+
+VideoStreamer::VideoStreamer(QString sourceDevice, VideoFormat format, SocketAddress bindAddress, SocketAddress address, quint16 ipcPort,
+                             QObject *parent, QString localRecording, QString captureMode)
+        : MediaStreamer("VideoStreamer", parent) {
+    _format = format;
+    _deviceName = sourceDevice;
+    _local.deserialize(localRecording);
+    CaptureMode mode;
+    if (!captureMode.isEmpty()) {
+        mode.deserialize(captureMode);
+        if (!mode.isValid()) {
+            LOG_W(LOG_TAG, "Ignoring invalid capture mode '" + captureMode + "'");
+        }
+    }
+    if (!connectToParent(ipcPort)) return;
+
+     LOG_I(LOG_TAG, "Creating pipeline");
+    _pipeline = createPipeline();
+
+    // create gstreamer command
+    // The camera is either opened here or read from the rover's CaptureMultiplexer
+    QString binStr = "%1 ! %2 ! udpsink bind-address=%3 bind-port=%4 host=%5 port=%6";
+    if (_local.isEnabled()) {
+        // The stream gets its own thread behind the tee, so it never waits on the local encoder
+        binStr = "%1 ! tee name=" VIDEOSTREAMER_GST_TEE_NAME " ! "
+                 "queue max-size-buffers=3 max-size-bytes=0 max-size-time=0 ! "
+                 "%2 ! udpsink bind-address=%3 bind-port=%4 host=%5 port=%6";
+    }
+    binStr = binStr.arg(CaptureMultiplexer::createGstSourceArgs(sourceDevice, MEDIASTREAMER_GST_SOURCE_NAME),
+                        format.createGstEncodingArgs(mode),
+                        bindAddress.host.toString(),
+                        QString::number(bindAddress.port),
+                        address.host.toString(),
+                        QString::number(address.port));
+
+    QGst::BinPtr encoder = QGst::Bin::fromDescription(binStr);
+
+    LOG_I(LOG_TAG, "Created gstreamer bin " + binStr);
+
+    _pipeline->add(encoder);
+
+    LOG_I(LOG_TAG, "Elements linked on pipeline");
+
+    if (_local.isEnabled()) {
+        QDir().mkpath(_local.directory);
+        _localStorage = new StorageManager(_local.directory, this);
+        _localFinisher = new BranchFinisher(VIDEOSTREAMER_LOCAL_FINISH_TIMEOUT, this);
+        _localStorage->setReserve(_local.reserveBytes);
+        _localStorageHandle = _localStorage->addRecording("Local recording of " + sourceDevice, 0);
+        connect(_localStorage, &StorageManager::suspended, this, &VideoStreamer::storageSuspended);
+        connect(_localStorage, &StorageManager::resumed, this, &VideoStreamer::storageResumed);
+        if (_localStorage->hasSpace()) {
+            startLocalRecording();
+        }
+        else {
+            LOG_W(LOG_TAG, "Not enough space in " + _local.directory + " to record locally");
+        }
+    }
+
+    // play
+    _pipeline->setState(QGst::StatePlaying);
+    startStatistics(_pipeline->getElementByName(MEDIASTREAMER_GST_SOURCE_NAME),
+                    _pipeline->getElementByName(VIDEOFORMAT_GST_ENCODER_NAME));
+
+    LOG_I(LOG_TAG, "Stream started");
+
+}
+
+bool VideoStreamer::startLocalRecording() {
+    if (!_pipeline || _localBin) return false;
+    QGst::ElementPtr tee = _pipeline->getElementByName(VIDEOSTREAMER_GST_TEE_NAME);
+    if (!tee) return false;
+
+    // The leaky queue drops frames the local encoder cannot keep up with instead of
+    // holding up the tee, and videorate lets the framerate be lowered to save CPU
+    QString binStr = QString(
+                "queue leaky=downstream max-size-buffers=2 max-size-bytes=0 max-size-time=0 ! "
+                "videorate name=" VIDEOSTREAMER_GST_LOCAL_RATE_NAME " drop-only=true ! "
+                "videoscale method=0 ! capsfilter caps=\"%1\" ! videoconvert ! "
+                "%2 ! %3"
+            ).arg(
+                _local.format.createGstScaleCaps(),
+                _local.format.createGstEncoderArgs(VIDEOSTREAMER_GST_LOCAL_ENCODER_NAME),
+                SegmentedRecording::createGstArgs(_local.format, _local.segmentSeconds, _local.segmentBytes));
+
+    QGst::BinPtr bin;
+    try {
+        bin = QGst::Bin::fromDescription(binStr);
+    }
+    catch (const QGlib::Error &error) {
+        LOG_E(LOG_TAG, "startLocalRecording(): Cannot create recording branch: " + error.message());
+        return false;
+    }
+    QString device = QFileInfo(CaptureMultiplexer::getDeviceNode(_deviceName)).fileName();
+    QString base = QString("%1/%2_%3").arg(
+                _local.directory,
+                QString::number(QDateTime::currentMSecsSinceEpoch()),
+                device);
+    // Its segments count towards the recording's write rate as they are opened
+    _localStorage->clearFiles(_localStorageHandle);
+    if (!SegmentedRecording::prepare(bin, base, this, "localSegmentStarted")) {
+        LOG_E(LOG_TAG, "startLocalRecording(): Cannot set up segmented recording");
+        return false;
+    }
+
+    LOG_I(LOG_TAG, "startLocalRecording(): Recording to " + base + " with bin " + binStr);
+    _pipeline->add(bin);
+    _localTeePad = tee->getRequestPad("src_%u");
+    _localTeePad->link(bin->getStaticPad("sink"));
+    bin->syncStateWithParent();
+    _localBin = bin;
+    _localMaxRate = 0;
+    return true;
+}
+
+void VideoStreamer::stopLocalRecording(QString reason) {
+    if (!_localBin) return;
+    LOG_W(LOG_TAG, "stopLocalRecording(): Stopping local recording: " + reason);
+    // Finish the last segment in a pipeline of its own, so the stream is not held up
+    _localFinisher->detach(_pipeline->getElementByName(VIDEOSTREAMER_GST_TEE_NAME), _localTeePad, _localBin);
+
+    _localBin.clear();
+    _localTeePad.clear();
+    _localMaxRate = 0;
+}
+
+void VideoStreamer::setLocalMaxFramerate(int framerate) {
+    if (!_localBin || (framerate == _localMaxRate)) return;
+    QGst::ElementPtr rate = _localBin->getElementByName(VIDEOSTREAMER_GST_LOCAL_RATE_NAME);
+    if (!rate) return;
+    rate->setProperty("max-rate", framerate > 0 ? framerate : G_MAXINT);
+    _localMaxRate = framerate;
+    LOG_I(LOG_TAG, "setLocalMaxFramerate(): Local recording framerate limited to "
+          + (framerate > 0 ? QString::number(framerate) : QString("unlimited")));
+}
+
+void VideoStreamer::onStatistics(int cpu, int captured) {
+    // No budget to keep to if the streamer's own CPU time is not known
+    if (!_localBin || (_local.cpuBudget <= 0) || (cpu < 0)) return;
+    if (cpu > _local.cpuBudget) {
+        // Halve the recording's framerate until the streamer is back under budget
+        int current = _localMaxRate > 0 ? _localMaxRate : captured;
+        if (current <= VIDEOSTREAMER_LOCAL_MIN_FRAMERATE) {
+            stopLocalRecording("Over CPU budget at " + QString::number(cpu) + "%");
+            return;
+        }
+        setLocalMaxFramerate(qMax(current / 2, VIDEOSTREAMER_LOCAL_MIN_FRAMERATE));
+    }
+    else if ((_localMaxRate > 0) && (cpu < _local.cpuBudget * 3 / 4)) {
+        // Raise it again slowly, so it does not swing back over
+        int raised = _localMaxRate + qMax(1, _localMaxRate / 4);
+        setLocalMaxFramerate(raised >= captured ? 0 : raised);
+    }
+}
+
+bool VideoStreamer::onPipelineError(const QGst::MessagePtr &message) {
+    if (!_localBin) return false;
+    GstObject *source = GST_MESSAGE_SRC(static_cast<GstMessage*>(message));
+    if (!source || !gst_object_has_as_ancestor(source, GST_OBJECT(static_cast<GstElement*>(_localBin)))) {
+        return false;
+    }
+    // A full or failing disk should not take the stream down with it
+    stopLocalRecording("Error in recording branch");
+    return true;
+}
+
+void VideoStreamer::storageSuspended(int handle) {
+    if (handle != _localStorageHandle) return;
+    stopLocalRecording("Disk is running out of space");
+}
+
+void VideoStreamer::localSegmentStarted(QString path) {
+    if (_localStorage) {
+        _localStorage->addFile(_localStorageHandle, path);
+    }
+}
+
+void VideoStreamer::storageResumed(int handle) {
+    if (handle != _localStorageHandle) return;
+    LOG_I(LOG_TAG, "storageResumed(): Space is available again, resuming local recording");
+    startLocalRecording();
+}
+
+bool VideoStreamer::onCommand(QString command, QStringList args) {
+    bool ok = args.size() == 1;
+    VideoFormat format = _format;
+    if (command.compare("format") == 0) {
+        if (!ok) return false;
+        format.deserialize(args[0]);
+        return reconfigure(format);
+    }
+    quint32 value = ok ? args[0].toUInt(&ok) : 0;
+    if (!ok) return false;
+
+    if (command.compare("bitrate") == 0) {
+        format.setBitrate(value);
+    }
+    else if (command.compare("framerate") == 0) {
+        format.setFramerate(value);
+    }
+    else if (command.compare("quality") == 0) {
+        format.setMjpegQuality(value);
+    }
+    else if (command.compare("keyframe") == 0) {
+        format.setKeyframeInterval(value);
+    }
+    else if (command.compare("resolution") == 0) {
+        format.setResolution(static_cast<VideoFormat::Resolution>(value));
+    }
+    else if (command.compare("maxrate") == 0) {
+        return setMaxFramerate(value);
+    }
+    else {
+        return false;
+    }
+    return reconfigure(format);
+}
+
+bool VideoStreamer::reconfigure(VideoFormat format) {
+    if (!_pipeline) return false;
+    if ((format.getEncoding() != _format.getEncoding()) || (format.getStereoMode() != _format.getStereoMode())) {
+        // Needs a different payloader and decoder, the stream must be restarted
+        LOG_W(LOG_TAG, "reconfigure(): Cannot change encoding or stereo mode on a running stream");
+        return false;
+    }
+
+    // Find everything that has to change first, so a missing element leaves the stream as it was
+    bool resolutionChanged = format.getResolution() != _format.getResolution();
+    bool framerateChanged = format.getFramerate() != _format.getFramerate();
+    QGst::ElementPtr scaleCaps, stereoCaps, rate, rateCaps;
+    if (resolutionChanged) {
+        scaleCaps = findElement(VIDEOFORMAT_GST_SCALECAPS_NAME);
+        if (!scaleCaps) return false;
+        if (format.getStereoMode() == VideoFormat::StereoMode_SideBySide) {
+            stereoCaps = findElement(VIDEOFORMAT_GST_STEREOCAPS_NAME);
+            if (!stereoCaps) return false;
+        }
+    }
+    if (framerateChanged) {
+        rate = findElement(VIDEOFORMAT_GST_RATE_NAME);
+        rateCaps = findElement(VIDEOFORMAT_GST_RATECAPS_NAME);
+        if (!rate || !rateCaps) return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if ((format.getKeyframeInterval() != _format.getKeyframeInterval()) || (format.getMaxThreads() != _format.getMaxThreads())) {
+        // Encoders only read these when they start, so replace it. This is the only step that
+        // can fail, so it goes before the caps change
+        if (!swapEncoder(format)) return false;
+    }
+    else {
+        QGst::ElementPtr encoder = findElement(VIDEOFORMAT_GST_ENCODER_NAME);
+        if (!encoder) return false;
+        if (format.getEncoderBitrate() != _format.getEncoderBitrate()) {
+            QString property = format.getGstEncoderBitrateProperty();
+            if (!property.isEmpty()) {
+                encoder->setProperty(property.toLatin1().constData(), format.getGstEncoderBitrateValue());
+            }
+        }
+        if ((format.getMjpegQuality() != _format.getMjpegQuality()) && (format.getEncoding() == VideoFormat::Encoding_MJPEG)) {
+            encoder->setProperty("quality", (int)format.getMjpegQuality());
+        }
+    }
+
+    if (resolutionChanged) {
+        scaleCaps->setProperty("caps", QGst::Caps::fromString(format.createGstScaleCaps()));
+        if (stereoCaps) {
+            stereoCaps->setProperty("caps", QGst::Caps::fromString(format.createGstStereoCaps()));
+        }
+    }
+    if (framerateChanged) {
+        // Without a fixed framerate videorate only drops, so it never asks the camera for more
+        rate->setProperty("drop-only", format.getFramerate() == 0);
+        rateCaps->setProperty("caps", QGst::Caps::fromString(format.createGstFramerateCaps()));
+    }
+
+    _format = format;
+    LOG_I(LOG_TAG, "reconfigure(): Changed to " + format.toHumanReadableString() + " in "
+          + QString::number(timer.elapsed()) + "ms");
+    return true;
+}
+
+bool VideoStreamer::swapEncoder(const VideoFormat &format) {
+    QGst::ElementPtr encoder = _pipeline->getElementByName(VIDEOFORMAT_GST_ENCODER_NAME);
+    if (!encoder) return false;
+    EncoderSwapPtr swap(new EncoderSwap);
+    swap->encoder = encoder;
+    swap->upstream = encoder->getStaticPad("sink")->peer();
+    swap->downstream = encoder->getStaticPad("src")->peer();
+    swap->bin = encoder->parent().dynamicCast<QGst::Bin>();
+    if (!swap->upstream || !swap->downstream || !swap->bin) {
+        LOG_E(LOG_TAG, "swapEncoder(): Encoder is not linked as expected");
+        return false;
+    }
+    try {
+        swap->replacement = QGst::Parse::launch(format.createGstEncoderArgs());
+    }
+    catch (const QGlib::Error &error) {
+        LOG_E(LOG_TAG, "swapEncoder(): Cannot create encoder: " + error.message());
+        return false;
+    }
+
+    // The pipeline keeps playing, the probe holds back the camera's next frame while the
+    // encoder is replaced. It runs right away if no frame is being pushed
+    GstPad *upstream = static_cast<GstPad*>(swap->upstream);
+    gulong probe = gst_pad_add_probe(upstream, GST_PAD_PROBE_TYPE_IDLE, swapEncoderProbe,
+                                     new EncoderSwapPtr(swap), freeEncoderSwap);
+    if (!swap->done.tryAcquire(1, VIDEOSTREAMER_ENCODER_SWAP_TIMEOUT)) {
+        if (swap->claimed.testAndSetOrdered(0, 1)) {
+            gst_pad_remove_probe(upstream, probe);
+            LOG_E(LOG_TAG, "swapEncoder(): Encoder input never went idle, keeping the old encoder");
+            return false;
+        }
+        // The probe started just as the wait ran out
+        swap->done.acquire();
+    }
+
+    if (!swap->swapped) {
+        if (!swap->relinked) {
+            LOG_E(LOG_TAG, "swapEncoder(): Cannot link new encoder or relink the old one, ending stream");
+            finish(STREAMPROCESS_ERR_GSTREAMER_ERROR);
+            return false;
+        }
+        LOG_E(LOG_TAG, "swapEncoder(): Cannot link new encoder, put the old one back");
+        return false;
+    }
+    watchEncoder(swap->replacement);
+    return true;
+}
+
+QGst::ElementPtr VideoStreamer::findElement(const char *name) {
+    QGst::ElementPtr element = _pipeline->getElementByName(name);
+    if (!element) {
+        LOG_E(LOG_TAG, "findElement(): No element named " + QString(name) + " in pipeline");
+    }
+    return element;
+}
+
+bool VideoStreamer::setMaxFramerate(quint32 framerate) {
+    if (!_pipeline) return false;
+    QGst::ElementPtr rate = _pipeline->getElementByName(VIDEOFORMAT_GST_RATE_NAME);
+    if (!rate) {
+        return false;
+    }
+    // max-rate can only lower the framerate below what the caps allow, 0 removes the limit
+    rate->setProperty("max-rate", framerate > 0 ? (int)framerate : G_MAXINT);
+
+    LOG_I(LOG_TAG, "setMaxFramerate(): Maximum framerate changed to " + (framerate > 0 ? QString::number(framerate) : QString("unlimited")));
+    return true;
+}
+
+} // namespace Gst
+} // namespace Soro
+
@@ -0,0 +1,109 @@
+#ifndef SORO_GST_VIDEOSTREAMER_H
+#define SORO_GST_VIDEOSTREAMER_H
+
+#include <QObject>
+#include <QCoreApplication>
+#include <QTcpSocket>
+
+#include <Qt5GStreamer/QGst/Pipeline>
+#include <Qt5GStreamer/QGst/Element>
+#include <Qt5GStreamer/QGst/ElementFactory>
+#include <Qt5GStreamer/QGst/Bin>
+#include <Qt5GStreamer/QGst/Bus>
+#include <Qt5GStreamer/QGlib/RefPointer>
+#include <Qt5GStreamer/QGlib/Error>
+#include <Qt5GStreamer/QGlib/Connect>
+#include <Qt5GStreamer/QGst/Message>
+#include <Qt5GStreamer/QGst/Pad>
+#include <Qt5GStreamer/QGst/Caps>
+#include <Qt5GStreamer/QGst/Parse>
+
+//#include <flycapture/FlyCapture2.h>
+
+#include "libsoro/socketaddress.h"
+#include "libsoro/videoformat.h"
+#include "libsoro/localrecordingsettings.h"
+#include "libsoro/storagemanager.h"
+#include "mediastreamer.h"
+#include "branchfinisher.h"
+#include "soro_gst_global.h"
+
+// Name of the tee splitting the camera between the stream and the local recording
+#define VIDEOSTREAMER_GST_TEE_NAME "capturetee"
+// Name of the videorate element in the local recording branch
+#define VIDEOSTREAMER_GST_LOCAL_RATE_NAME "localrate"
+#define VIDEOSTREAMER_GST_LOCAL_ENCODER_NAME "localencoder"
+// Lowest framerate the local recording is throttled to before it is stopped
+#define VIDEOSTREAMER_LOCAL_MIN_FRAMERATE 2
+// How long a stopped local recording has to finish its last segment
+#define VIDEOSTREAMER_LOCAL_FINISH_TIMEOUT 5000
+// How long reconfigure() waits for the encoder's input to go idle before giving up on a swap
+#define VIDEOSTREAMER_ENCODER_SWAP_TIMEOUT 1000
+
+namespace Soro {
+namespace Gst {
+
+class LIBSOROGST_EXPORT VideoStreamer : public MediaStreamer {
+    Q_OBJECT
+public:
+    VideoStreamer(QGst::ElementPtr source, VideoFormat format, SocketAddress bindAddress, SocketAddress address, quint16 ipcPort, QObject *parent = 0);
+    /**
+     * Streams a camera device, which is either a device node or a device string from a
+     * CaptureMultiplexer. If localRecording holds enabled LocalRecordingSettings, the camera
+     * is also encoded a second time and recorded to the rover's disk. The recording branch only
+     * gets frames the stream has no use for: it sits behind a leaky queue, and its framerate is
+     * lowered while the streamer is over its CPU budget.
+     * If captureMode holds a serialized CaptureMode, the camera is asked for exactly that mode, and
+     * if it is already compressed in the stream's encoding it is sent on without being re-encoded.
+     */
+    VideoStreamer(QString deviceName, VideoFormat format, SocketAddress bindAddress, SocketAddress address, quint16 ipcPort,
+                  QObject *parent = 0, QString localRecording = "", QString captureMode = "");
+
+protected:
+    bool onCommand(QString command, QStringList args) Q_DECL_OVERRIDE;
+    void onStatistics(int cpu, int captured) Q_DECL_OVERRIDE;
+    bool onPipelineError(const QGst::MessagePtr &message) Q_DECL_OVERRIDE;
+
+private slots:
+    void storageSuspended(int handle);
+    void storageResumed(int handle);
+    void localSegmentStarted(QString path);
+
+private:
+    VideoFormat _format;
+    QString _deviceName;
+
+    LocalRecordingSettings _local;
+    QGst::BinPtr _localBin;
+    QGst::PadPtr _localTeePad;
+    StorageManager *_localStorage = nullptr;
+    int _localStorageHandle = -1;
+    int _localMaxRate = 0;
+    BranchFinisher *_localFinisher = nullptr;
+
+    /* Adds the local recording branch to the tee, starting a new set of segments
+     */
+    bool startLocalRecording();
+    /* Takes the local recording branch off the tee and lets it finish its last segment
+     */
+    void stopLocalRecording(QString reason);
+    void setLocalMaxFramerate(int framerate);
+
+    /* Changes the running pipeline to a new format with the same encoding and stereo mode.
+     * Properties the encoder accepts while playing are set directly, caps filters are updated
+     * for resolution and framerate, and anything else replaces only the encoder element.
+     * Either the whole format is applied, or the stream is left as it was.
+     */
+    bool reconfigure(VideoFormat format);
+    bool setMaxFramerate(quint32 framerate);
+    /* Replaces the encoder element from an idle probe on its input while the pipeline keeps
+     * playing, putting the old one back if the new one cannot be linked
+     */
+    bool swapEncoder(const VideoFormat &format);
+    QGst::ElementPtr findElement(const char *name);
+};
+
+} // namespace Gst
+} // namespace Soro
+
+#endif // SORO_GST_VIDEOSTREAMER_H
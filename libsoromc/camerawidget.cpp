@@ -28,6 +28,7 @@ namespace MissionControl {
 
 CameraWidget::CameraWidget(QWidget *parent) : QWidget(parent), ui(new Ui::CameraWidget) {
     ui->setupUi(this);
+    _ringSource = new Soro::Gst::RingSource(this);
 
     ui->messageLabel->setVisible(false);
     addWidgetShadow(ui->controlsWidget, 10, 0);
@@ -41,13 +42,26 @@ CameraWidget::~CameraWidget() {
 }
 
 void CameraWidget::play(SocketAddress address, VideoFormat format) {
+    // create a udpsrc to receive the stream
+    playSource(QString("udpsrc address=%1 port=%2 reuse=true").arg(address.host.toString(), QString::number(address.port)),
+               format);
+}
+
+void CameraWidget::play(PacketRing *ring, VideoFormat format) {
+    QGst::BinPtr source = playSource(Soro::Gst::RingSource::createGstSourceArgs(), format);
+    if (!source.isNull()) {
+        _ringSource->attach(ring, source);
+    }
+}
+
+QGst::BinPtr CameraWidget::playSource(QString sourceStr, VideoFormat format) {
     resetPipeline();
     ui->messageLabel->setVisible(false);
 
     if (!format.isUseable()) {
         LOG_E(LOG_TAG, "play(): Given unusable format, refusing to play");
         stop();
-        return;
+        return QGst::BinPtr();
     }
     _videoFormat = format;
 
@@ -55,10 +69,8 @@ void CameraWidget::play(SocketAddress address, VideoFormat format) {
     _pipeline->bus()->addSignalWatch();
     QGlib::connect(_pipeline->bus(), "message", this, &CameraWidget::onBusMessage);
 
-    // create a udpsrc to receive the stream
-    QString binStr = "udpsrc address=%1 port=%2 reuse=true ! %3 ! videoscale ! video/x-raw,width=%4,height=%5 ! videoconvert";
-    binStr = binStr.arg(address.host.toString(),
-                        QString::number(address.port),
+    QString binStr = "%1 ! %2 ! videoscale ! video/x-raw,width=%3,height=%4 ! videoconvert";
+    binStr = binStr.arg(sourceStr,
                         format.createGstDecodingArgs(),
                         QString::number(format.getWidth()),
                         QString::number(format.getHeight()));
@@ -75,6 +87,7 @@ void CameraWidget::play(SocketAddress address, VideoFormat format) {
     _isPlaying = true;
     _pipeline->setState(QGst::StatePlaying);
     adjustVideoSize();
+    return source;
 }
 
 QGst::ElementPtr CameraWidget::createSink() {
@@ -114,6 +127,7 @@ void CameraWidget::stop(QString reason, CameraWidget::Pattern pattern) {
 }
 
 void CameraWidget::resetPipeline() {
+    _ringSource->detach();
     if (_pipeline) {
         _pipeline->bus()->removeSignalWatch();
         _pipeline->setState(QGst::StateNull);
@@ -20,6 +20,8 @@
 #include "libsoro/socketaddress.h"
 #include "libsoro/enums.h"
 #include "libsoro/videoformat.h"
+#include "libsoro/packetring.h"
+#include "libsorogst/ringsource.h"
 
 #include "soro_missioncontrol_global.h"
 
@@ -72,6 +74,11 @@ public:
      */
     void play(SocketAddress address, VideoFormat format);
 
+    /* Plays a video stream directly from a MediaClient's packet ring, without
+     * it being forwarded through a local UDP socket.
+     */
+    void play(PacketRing *ring, VideoFormat format);
+
     /* Stops video playback, and displays they reason why
      * if one is provided.
      */
@@ -97,9 +104,11 @@ private:
     bool _showLabel = true;
     bool _showText = true;
     VideoFormat _videoFormat;
+    Soro::Gst::RingSource *_ringSource;
 
     QGst::ElementPtr createSink();
     void resetPipeline();
+    QGst::BinPtr playSource(QString sourceStr, VideoFormat format);
 
 private slots:
     /* Recieves messages from the gstreamer pipeline bus
@@ -42,8 +42,7 @@ SOURCES +=\
         missioncontrolnetwork.cpp \
         videocontrolwidget.cpp \
     stereocamerawidget.cpp \
-    qquickgstreamersurface.cpp \
-    gstreamerrecorder.cpp
+    qquickgstreamersurface.cpp
 
 HEADERS +=\
         soro_missioncontrol_global.h \
@@ -61,8 +60,7 @@ HEADERS +=\
         videocontrolwidget.h \
         util.h \
     stereocamerawidget.h \
-    qquickgstreamersurface.h \
-    gstreamerrecorder.h
+    qquickgstreamersurface.h
 
 FORMS   +=\
         audiocontrolwidget.ui \
@@ -76,6 +74,7 @@ INCLUDEPATH += $$PWD/../..
 LIBS += -lSDL2 -lQt5GStreamer-1.0 -lQt5GLib-2.0 -lQt5GStreamerUi-1.0 -lQt5GStreamerUtils-1.0
 #LIBS += -lflycapture
 LIBS += -L../lib -lsoro
+LIBS += -L../lib -lsorogst
 
 RESOURCES += \
     libsoromc_assets.qrc \
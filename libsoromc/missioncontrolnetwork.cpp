@@ -21,9 +21,9 @@
 #define MSG_REQUEST_ROLE 2
 #define MSG_DENY_ROLE 3
 #define MSG_ACCEPT_ROLE 4
-#define MSG_REQUEST_CONNECTION 5
 
 #define LOG_TAG "MissionControlNetwork"
+#define CHANNEL_NAME "MissionControlNetwork"
 
 #define NAME_LENGTH 32
 
@@ -59,11 +59,14 @@ void MissionControlNetwork::clearConnections() {
         delete _clientChannel;
         _clientChannel = nullptr;
     }
-    foreach (Connection *connection, _brokerConnections) {
-        disconnect(connection->channel, 0, this, 0);
-        delete connection->channel;
+    if (_brokerChannel) {
+        disconnect(_brokerChannel, 0, this, 0);
+        delete _brokerChannel;
+        _brokerChannel = nullptr;
     }
+    qDeleteAll(_brokerConnections);
     _brokerConnections.clear();
+    _pendingRoleRequests.clear();
 }
 
 bool MissionControlNetwork::startNegotiation() {
@@ -71,7 +74,6 @@ bool MissionControlNetwork::startNegotiation() {
 
     KILL_TIMER(_broadcastStateTimerId);
     KILL_TIMER(_broadcastIntentTimerId);
-    KILL_TIMER(_requestConnectionTimerId);
     KILL_TIMER(_requestRoleTimerId);
 
     clearConnections();
@@ -99,6 +101,12 @@ void MissionControlNetwork::endNegotiation() {
     KILL_TIMER(_broadcastIntentTimerId);
     disconnect(_broadcastSocket, &QUdpSocket::readyRead, this, 0);
     if (_isBroker) {
+        // All other mission controls connect to this one channel
+        _brokerChannel = Channel::createMultiPeerServer(this, NETWORK_MC_BROADCAST_PORT, CHANNEL_NAME, Channel::TcpProtocol);
+        connect(_brokerChannel, &Channel::peerConnected, this, &MissionControlNetwork::broker_peerConnected);
+        connect(_brokerChannel, &Channel::peerDisconnected, this, &MissionControlNetwork::broker_peerDisconnected);
+        connect(_brokerChannel, &Channel::peerMessageReceived, this, &MissionControlNetwork::broker_peerMessageReceived);
+        _brokerChannel->open();
         START_TIMER(_broadcastStateTimerId, 500);
         _connected = true;
         connect(_broadcastSocket, &QUdpSocket::readyRead, this, &MissionControlNetwork::broker_broadcastSocketReadyRead);
@@ -109,12 +117,12 @@ void MissionControlNetwork::endNegotiation() {
             LOG_W(LOG_TAG, "Client channel was not null post-negotiation");
             clearConnections();
         }
-        _clientChannel = Channel::createServer(this, NETWORK_MC_BROADCAST_PORT, _name, Channel::TcpProtocol);
+        _clientChannel = Channel::createClient(this, SocketAddress(_brokerAddress.host, NETWORK_MC_BROADCAST_PORT),
+                                               CHANNEL_NAME, Channel::TcpProtocol);
         connect(_clientChannel, &Channel::messageReceived, this, &MissionControlNetwork::client_channelMessageReceived);
         connect(_clientChannel, &Channel::stateChanged, this, &MissionControlNetwork::client_channelStateChanged);
         connect(_broadcastSocket, &QUdpSocket::readyRead, this, &MissionControlNetwork::client_broadcastSocketReadyRead);
         _clientChannel->open();
-        START_TIMER(_requestConnectionTimerId, 100);
         QTimer::singleShot(3000, this, SLOT(ensureConnection()));
     }
 }
@@ -133,7 +141,6 @@ void MissionControlNetwork::client_channelStateChanged(Channel::State state) {
     }
     else if (state == Channel::ConnectedState) {
         LOG_I(LOG_TAG, "Connected to broker at " + _clientChannel->getPeerAddress().toString());
-        KILL_TIMER(_requestConnectionTimerId);
         _connected = true;
         emit connected(false);
     }
@@ -184,12 +191,17 @@ void MissionControlNetwork::sendSharedMessage(const char *message, Channel::Mess
     if (_clientChannel) {
         _clientChannel->sendMessage(message, size);
     }
+    else if (_brokerChannel) {
+        _brokerChannel->sendMessage(message, size);
+    }
+}
+
+void MissionControlNetwork::sendSharedMessageToPeer(const SocketAddress &peer, const char *message, Channel::MessageSize size) {
+    if (_brokerChannel) {
+        _brokerChannel->sendMessageToPeer(peer, message, size);
+    }
     else {
-        foreach (Connection *connection, _brokerConnections) {
-            if (connection->channel) {
-                connection->channel->sendMessage(message, size);
-            }
-        }
+        LOG_W(LOG_TAG, "sendSharedMessageToPeer() called on a mission control that is not the broker");
     }
 }
 
@@ -213,15 +225,6 @@ void MissionControlNetwork::timerEvent(QTimerEvent *e) {
         _broadcastSocket->writeDatagram(message, QHostAddress::Broadcast, NETWORK_MC_BROADCAST_PORT);
         emit statisticsUpdate(_brokerConnections.size() + 1);
     }
-    else if (e->timerId() == _requestConnectionTimerId) {
-        LOG_I(LOG_TAG, "Sending MSG_REQUEST_CONNECTION");
-        QByteArray message;
-        QDataStream stream(&message, QIODevice::WriteOnly);
-        stream << (quint8)MSG_REQUEST_CONNECTION;
-        stream << _name;
-
-        _broadcastSocket->writeDatagram(message, QHostAddress::Broadcast, NETWORK_MC_BROADCAST_PORT);
-    }
     else if (e->timerId() == _requestRoleTimerId) {
         LOG_I(LOG_TAG, "Sending MSG_REQUEST_ROLE");
         QByteArray message;
@@ -229,6 +232,8 @@ void MissionControlNetwork::timerEvent(QTimerEvent *e) {
         stream << (quint8)MSG_REQUEST_ROLE;
         stream << _name;
         stream << static_cast<qint32>(_pendingRole);
+        // The broker knows us by the address of our channel connection, not our broadcast socket
+        stream << (quint16)(_clientChannel ? _clientChannel->getHostAddress().port : 0);
 
         _broadcastSocket->writeDatagram(message, QHostAddress::Broadcast, NETWORK_MC_BROADCAST_PORT);
     }
@@ -263,7 +268,7 @@ void MissionControlNetwork::negotiation_broadcastSocketReadyRead() {
     }
 }
 
-void MissionControlNetwork::acceptClientRole(SocketAddress address, Role role, QString name) {
+void MissionControlNetwork::acceptClientRole(SocketAddress address, Role role) {
     LOG_I(LOG_TAG, "Accepting client role request");
     QByteArray response;
     QDataStream responseStream(&response, QIODevice::WriteOnly);
@@ -271,15 +276,6 @@ void MissionControlNetwork::acceptClientRole(SocketAddress address, Role role, Q
     responseStream << _name;
     responseStream << static_cast<qint32>(role);
     _broadcastSocket->writeDatagram(response, address.host, address.port);
-    // update client's role information
-    foreach (Connection *connection, _brokerConnections) {
-        if (connection->channel->getName().compare(name) == 0) {
-            connection->role = role;
-            return;
-        }
-    }
-    // Didn't find the client in the list
-    LOG_E(LOG_TAG, "Could not find client with name " + name + " in connection list for role change");
 }
 
 void MissionControlNetwork::denyClientRole(SocketAddress address, Role role) {
@@ -318,48 +314,26 @@ void MissionControlNetwork::broker_broadcastSocketReadyRead() {
             }
             break;
         }
-        case MSG_REQUEST_ROLE:
+        case MSG_REQUEST_ROLE: {
             // Client is requesting to fill a role on the network
-            Role requestRole;
-            stream >> reinterpret_cast<qint32&>(requestRole);
-            if (requestRole != SpectatorRole) {
-                if (_role == requestRole) {
-                    // Request denied
-                    denyClientRole(address, requestRole);
-                    return;
-                }
-                foreach (Connection *connection, _brokerConnections) {
-                    if (connection->channel->getName().compare(requestName) == 0) continue;
-                    if (connection->role == requestRole) {
-                        // Request denied
-                        denyClientRole(address, requestRole);
-                        return;
-                    }
-                }
-            }
-            // Request accepted
-            acceptClientRole(address, requestRole, requestName);
-            break;
-        case MSG_REQUEST_CONNECTION:
-            // Ensure the client is not already in the list
-            foreach (Connection *connection, _brokerConnections) {
-                if (connection->channel->getName().compare(requestName) == 0) {
-                    return;
-                }
+            RoleRequest request;
+            quint16 channelPort = 0;
+            request.replyAddress = address;
+            request.name = requestName;
+            stream >> reinterpret_cast<qint32&>(request.role);
+            stream >> channelPort;
+            SocketAddress peer(address.host, channelPort);
+            if (!findConnection(peer)) {
+                // The request can beat the client's connection to the broker channel,
+                // it is answered once the connection is there
+                LOG_I(LOG_TAG, "Holding role request from " + peer.toString() + " until it connects");
+                _pendingRoleRequests.insert(peer, request);
+                break;
             }
-            // Create a channel for the new client
-            Connection *connection = new Connection;
-            connection->channel = Channel::createClient(this, address, requestName, Channel::TcpProtocol);
-            connect(connection->channel, &Channel::stateChanged, [=](Channel::State state) {
-                broker_clientChannelStateChanged(connection->channel, state);
-            });
-            connect(connection->channel, &Channel::messageReceived, [=](const char* message, Channel::MessageSize size) {
-                broker_clientChannelMessageReceived(connection->channel, message, size);
-            });
-            connection->channel->open();
-            _brokerConnections.append(connection);
+            handleRoleRequest(peer, request);
             break;
         }
+        }
     }
 }
 
@@ -408,29 +382,68 @@ void MissionControlNetwork::client_broadcastSocketReadyRead() {
     }
 }
 
-void MissionControlNetwork::broker_clientChannelStateChanged(Channel *channel, Channel::State state) {
-    if (state == Channel::ConnectedState) {
-        emit newClientConnected(channel);
-    }
-    else if(channel->wasConnected()) {
-        for (int i = 0; i < _brokerConnections.length(); ++i) {
-            if (_brokerConnections[i]->channel == channel) {
-                LOG_I(LOG_TAG, "Removing inactive client " + channel->getName() + " from list");
-                disconnect(channel, 0, this, 0);
-                delete _brokerConnections[i];
-                _brokerConnections.removeAt(i);
-                break;
-            }
+MissionControlNetwork::Connection* MissionControlNetwork::findConnection(const SocketAddress &peer) {
+    foreach (Connection *connection, _brokerConnections) {
+        if (connection->address == peer) {
+            return connection;
         }
     }
+    return nullptr;
 }
 
-void MissionControlNetwork::broker_clientChannelMessageReceived(Channel *channel, const char *message, Channel::MessageSize size) {
+bool MissionControlNetwork::isRoleTaken(Role role, const Connection *requester) {
+    if (_role == role) return true;
     foreach (Connection *connection, _brokerConnections) {
-        if (connection->channel && (connection->channel != channel)) {
-            connection->channel->sendMessage(message, size);
+        // A client that reconnected keeps its name, its old connection may not be dropped yet
+        if ((connection == requester) || (connection->name == requester->name)) continue;
+        if (connection->role == role) return true;
+    }
+    return false;
+}
+
+void MissionControlNetwork::handleRoleRequest(const SocketAddress &peer, const RoleRequest &request) {
+    Connection *connection = findConnection(peer);
+    if (!connection) return;
+    if ((request.role != SpectatorRole) && isRoleTaken(request.role, connection)) {
+        denyClientRole(request.replyAddress, request.role);
+        return;
+    }
+    // The role is reserved as soon as it is granted
+    connection->name = request.name;
+    connection->role = request.role;
+    acceptClientRole(request.replyAddress, request.role);
+}
+
+void MissionControlNetwork::broker_peerConnected(const SocketAddress &peer) {
+    LOG_I(LOG_TAG, "Client " + peer.toString() + " connected to the broker channel");
+    Connection *connection = findConnection(peer);
+    if (!connection) {
+        connection = new Connection;
+        connection->address = peer;
+        _brokerConnections.append(connection);
+    }
+    emit newClientConnected(peer);
+    if (_pendingRoleRequests.contains(peer)) {
+        handleRoleRequest(peer, _pendingRoleRequests.take(peer));
+    }
+}
+
+void MissionControlNetwork::broker_peerDisconnected(const SocketAddress &peer) {
+    _pendingRoleRequests.remove(peer);
+    for (int i = 0; i < _brokerConnections.length(); ++i) {
+        if (_brokerConnections[i]->address == peer) {
+            LOG_I(LOG_TAG, "Removing inactive client " + _brokerConnections[i]->name + " from list");
+            delete _brokerConnections[i];
+            _brokerConnections.removeAt(i);
+            break;
         }
     }
+    emit clientDisconnected(peer);
+}
+
+void MissionControlNetwork::broker_peerMessageReceived(const SocketAddress &peer, const char *message, Channel::MessageSize size) {
+    // Relay to every other client, the message is only framed once
+    _brokerChannel->broadcastMessage(message, size, peer);
     emit sharedMessageReceived(message, size);
 }
 
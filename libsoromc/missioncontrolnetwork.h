@@ -4,6 +4,7 @@
 #include <QObject>
 #include <QUdpSocket>
 #include <QDataStream>
+#include <QHash>
 
 #include "libsoro/channel.h"
 #include "libsoro/logger.h"
@@ -14,7 +15,9 @@
 namespace Soro {
 namespace MissionControl {
 
-/* Manages a
+/* Manages the network of mission control computers. One mission control is negotiated as the
+ * broker, and it hosts a single multi-peer channel that every other mission control connects to.
+ * Shared messages received by the broker are relayed to all other peers.
  */
 class LIBSOROMC_EXPORT MissionControlNetwork : public QObject {
     Q_OBJECT
@@ -27,6 +30,7 @@ public:
     Role getRole() const;
     bool isBroker() const;
     void sendSharedMessage(const char *message, Channel::MessageSize size);
+    void sendSharedMessageToPeer(const SocketAddress &peer, const char *message, Channel::MessageSize size);
     QHostAddress getBrokerAddress() const;
 
 signals:
@@ -36,19 +40,24 @@ signals:
     void roleDenied(Role role);
     void statisticsUpdate(quint16 networkSize);
     void sharedMessageReceived(const char *message, Channel::MessageSize size);
-    void newClientConnected(Channel *channel);
+    void newClientConnected(SocketAddress peer);
+    void clientDisconnected(SocketAddress peer);
 
 protected:
     void timerEvent(QTimerEvent *e);
 
 private:
     struct Connection {
-        Channel *channel = nullptr;
+        SocketAddress address;
+        QString name;
+        Role role = SpectatorRole;
+    };
+    /* A role request from a client, which is answered on the broadcast socket it came from
+     */
+    struct RoleRequest {
+        SocketAddress replyAddress;
+        QString name;
         Role role = SpectatorRole;
-
-        ~Connection() {
-            delete channel;
-        }
     };
     char _buffer[100];
     bool _isBroker = false;
@@ -56,19 +65,23 @@ private:
     bool _connected = false;
     QUdpSocket *_broadcastSocket = nullptr;
     QList<Connection*> _brokerConnections;
+    QHash<SocketAddress, RoleRequest> _pendingRoleRequests;
+    Channel *_brokerChannel = nullptr;
     Channel *_clientChannel = nullptr;
     Role _role = SpectatorRole;
     Role _pendingRole;
     int _broadcastIntentTimerId = TIMER_INACTIVE;
     int _broadcastStateTimerId = TIMER_INACTIVE;
     int _requestRoleTimerId = TIMER_INACTIVE;
-    int _requestConnectionTimerId = TIMER_INACTIVE;
     QString _name;
 
     void clearConnections();
     QString generateName();
+    Connection* findConnection(const SocketAddress &peer);
+    bool isRoleTaken(Role role, const Connection *requester);
+    void handleRoleRequest(const SocketAddress &peer, const RoleRequest &request);
     void denyClientRole(SocketAddress address, Role role);
-    void acceptClientRole(SocketAddress address, Role role, QString name);
+    void acceptClientRole(SocketAddress address, Role role);
 
 private slots:
     void endNegotiation();
@@ -78,8 +91,9 @@ private slots:
     void broker_broadcastSocketReadyRead();
     void client_broadcastSocketReadyRead();
     void client_channelStateChanged(Channel::State state);
-    void broker_clientChannelStateChanged(Channel *channel, Channel::State state);
-    void broker_clientChannelMessageReceived(Channel *channel, const char* message, Channel::MessageSize size);
+    void broker_peerConnected(const SocketAddress &peer);
+    void broker_peerDisconnected(const SocketAddress &peer);
+    void broker_peerMessageReceived(const SocketAddress &peer, const char* message, Channel::MessageSize size);
     void client_channelMessageReceived(const char* message, Channel::MessageSize size);
     void socketError(QAbstractSocket::SocketError err);
 };
@@ -64,10 +64,10 @@ VideoFormat::StereoMode StereoCameraWidget::getStereoMode() const {
     return _stereoMode;
 }
 
-void StereoCameraWidget::playStereo(SocketAddress addressL, VideoFormat encodingL, SocketAddress addressR, VideoFormat encodingR) {
+bool StereoCameraWidget::prepareStereo(VideoFormat &encodingL, VideoFormat &encodingR) {
     if (_stereoMode == VideoFormat::StereoMode_None) {
         LOG_E(LOG_TAG, "playStereo(): Stereo mode is not set on widget. Please specify which stereo configuration you want.");
-        return;
+        return false;
     }
 
     if (ui->monoCameraWidget->isVisible()) {
@@ -75,18 +75,14 @@ void StereoCameraWidget::playStereo(SocketAddress addressL, VideoFormat encoding
         ui->monoCameraWidget->stop("", NO_VIDEO_PATTERN);
         ui->monoCameraWidget->hide();
     }
-    // Play stereo
     encodingL.setStereoMode(_stereoMode);
     encodingR.setStereoMode(_stereoMode);
     ui->stereoRCameraWidget->show();
-    ui->stereoRCameraWidget->play(addressR, encodingR);
     ui->stereoLCameraWidget->show();
-    ui->stereoLCameraWidget->play(addressL, encodingL);
-    _isStereo = true;
-    emit videoChanged();
+    return true;
 }
 
-void StereoCameraWidget::playMono(SocketAddress address, VideoFormat encoding) {
+void StereoCameraWidget::prepareMono() {
     if (!ui->monoCameraWidget->isVisible()) {
         // Stop and hide stereo
         ui->stereoLCameraWidget->stop("", NO_VIDEO_PATTERN);
@@ -94,13 +90,43 @@ void StereoCameraWidget::playMono(SocketAddress address, VideoFormat encoding) {
         ui->stereoRCameraWidget->stop("", NO_VIDEO_PATTERN);
         ui->stereoRCameraWidget->hide();
     }
-    // Play mono
     ui->monoCameraWidget->show();
+}
+
+void StereoCameraWidget::playStereo(SocketAddress addressL, VideoFormat encodingL, SocketAddress addressR, VideoFormat encodingR) {
+    if (!prepareStereo(encodingL, encodingR)) return;
+    // Play stereo
+    ui->stereoRCameraWidget->play(addressR, encodingR);
+    ui->stereoLCameraWidget->play(addressL, encodingL);
+    _isStereo = true;
+    emit videoChanged();
+}
+
+void StereoCameraWidget::playStereo(PacketRing *ringL, VideoFormat encodingL, PacketRing *ringR, VideoFormat encodingR) {
+    if (!prepareStereo(encodingL, encodingR)) return;
+    // Play stereo
+    ui->stereoRCameraWidget->play(ringR, encodingR);
+    ui->stereoLCameraWidget->play(ringL, encodingL);
+    _isStereo = true;
+    emit videoChanged();
+}
+
+void StereoCameraWidget::playMono(SocketAddress address, VideoFormat encoding) {
+    prepareMono();
+    // Play mono
     ui->monoCameraWidget->play(address, encoding);
     _isStereo = false;
     emit videoChanged();
 }
 
+void StereoCameraWidget::playMono(PacketRing *ring, VideoFormat encoding) {
+    prepareMono();
+    // Play mono
+    ui->monoCameraWidget->play(ring, encoding);
+    _isStereo = false;
+    emit videoChanged();
+}
+
 void StereoCameraWidget::stop(bool stereo) {
     if (stereo && (_stereoMode == VideoFormat::StereoMode_None)) {
         LOG_E(LOG_TAG, "stop(): Stereo mode is not set, cannot stop with stereo visualization. Please specify which stereo mode you want");
@@ -5,6 +5,7 @@
 
 #include "libsoro/socketaddress.h"
 #include "libsoro/videoformat.h"
+#include "libsoro/packetring.h"
 
 namespace Ui {
 class StereoCameraWidget;
@@ -29,6 +30,12 @@ public:
     void playStereo(SocketAddress addressL, VideoFormat encodingL, SocketAddress addressR, VideoFormat encodingR);
     void playMono(SocketAddress address, VideoFormat encoding);
 
+    /* Play streams directly from MediaClient packet rings. The same ring
+     * may be given for both sides.
+     */
+    void playStereo(PacketRing *ringL, VideoFormat encodingL, PacketRing *ringR, VideoFormat encodingR);
+    void playMono(PacketRing *ring, VideoFormat encoding);
+
     bool isPlaying() const;
 
     /* Gets the stereo mode set on the widget
@@ -50,6 +57,9 @@ private:
     Ui::StereoCameraWidget *ui;
     VideoFormat::StereoMode _stereoMode;
     bool _isStereo = false;
+
+    bool prepareStereo(VideoFormat &encodingL, VideoFormat &encodingR);
+    void prepareMono();
 };
 
 } // namespace MissionControl
@@ -65,6 +65,7 @@ MissionControlProcess::MissionControlProcess(QHostAddress roverAddress, GamepadM
     connect(_ui, &MissionControlMainWindow::audioStreamMuteChanged, this, &MissionControlProcess::audioStreamMuteSelected);
 
     connect(_mcNetwork, &MissionControlNetwork::newClientConnected, this, &MissionControlProcess::onNewMissionControlClient);
+    connect(_mcNetwork, &MissionControlNetwork::clientDisconnected, this, &MissionControlProcess::onMissionControlClientDisconnected);
 
     LOG_I(LOG_TAG, "****************Initializing connections*******************");
 
@@ -86,13 +87,15 @@ MissionControlProcess::MissionControlProcess(QHostAddress roverAddress, GamepadM
 
     if (_mcNetwork->isBroker()) {
         LOG_I(LOG_TAG, "Creating video clients for rover");
+        _forwardingEngine = new ForwardingEngine(this);
         for (int i = 0; i < MAX_CAMERAS; i++) {
             VideoClient *client = new VideoClient(i, SocketAddress(_roverAddress, NETWORK_ALL_CAMERA_PORT_1 + i), QHostAddress::Any, this);
 
             connect(client, &VideoClient::stateChanged, this, &MissionControlProcess::videoClientStateChanged);
 
-            // add localhost bounce to the video stream so the in-app player can display it from a udpsrc
-            client->addForwardingAddress(SocketAddress(QHostAddress::LocalHost, client->getServerAddress().port));
+            // the in-app player reads the stream from the client's packet ring, and
+            // relaying it to other mission controls happens on the engine's thread
+            client->setForwardingEngine(_forwardingEngine);
             _videoClients.append(client);
         }
     }
@@ -105,8 +108,7 @@ MissionControlProcess::MissionControlProcess(QHostAddress roverAddress, GamepadM
 
     if (_mcNetwork->isBroker()) {
         _audioClient = new AudioClient(MEDIAID_AUDIO, SocketAddress(_roverAddress, NETWORK_ALL_AUDIO_PORT), QHostAddress::Any, this);
-        // forward audio stream through localhost
-        _audioClient->addForwardingAddress(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_AUDIO_PORT));
+        _audioClient->setForwardingEngine(_forwardingEngine);
         connect(_audioClient, &AudioClient::stateChanged, this, &MissionControlProcess::audioClientStateChanged);
     }
 
@@ -214,7 +216,7 @@ void MissionControlProcess::playAudio() {
     if (_audioFormat.isUseable()) {
         if (_mcNetwork->isBroker()) {
             // Play direct rover audio stream
-            _audioPlayer->play(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_AUDIO_PORT), _audioFormat);
+            _audioPlayer->play(_audioClient->getPacketRing(), _audioFormat);
         }
         else {
             // Play audio forwarded by the broker
@@ -284,7 +286,7 @@ void MissionControlProcess::playStreamOnWidget(int cameraID, CameraWidget *widge
     _videoFormats.replace(cameraID, formatIndex);
     _ui->onCameraFormatChanged(cameraID, formatIndex);
     if (_mcNetwork->isBroker()) {
-        _assignedCameraWidgets.value(cameraID)->play(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_CAMERA_PORT_1 + cameraID),
+        _assignedCameraWidgets.value(cameraID)->play(_videoClients.at(cameraID)->getPacketRing(),
                                                      _availableVideoFormts.at(formatIndex));
     }
     else {
@@ -428,7 +430,13 @@ void MissionControlProcess::roverSharedChannelMessageReceived(const char *messag
 /* Receives the new client connected signal from the MissionControlNetwork module.
  * Only applicable to the broker.
  */
-void MissionControlProcess::onNewMissionControlClient(Channel *channel) {
+void MissionControlProcess::onNewMissionControlClient(SocketAddress peer) {
+    // relay the rover's media streams to the new mission control
+    for (int i = 0; i < _videoClients.size(); i++) {
+        _videoClients[i]->addForwardingAddress(SocketAddress(peer.host, NETWORK_ALL_CAMERA_PORT_1 + i));
+    }
+    _audioClient->addForwardingAddress(SocketAddress(peer.host, NETWORK_ALL_AUDIO_PORT));
+
     // send the new mission controls all the information it needs to get up to date
 
     // send rover connection state
@@ -440,7 +448,7 @@ void MissionControlProcess::onNewMissionControlClient(Channel *channel) {
     stream << static_cast<qint32>(messageType);
     stream << static_cast<qint32>(roverState);
 
-    channel->sendMessage(roverConnectionMessage);
+    _mcNetwork->sendSharedMessageToPeer(peer, roverConnectionMessage.constData(), roverConnectionMessage.size());
 
     // send rover subsystem state
 
@@ -453,7 +461,7 @@ void MissionControlProcess::onNewMissionControlClient(Channel *channel) {
     stream2 << (_lastDriveGimbalSubsystemState == NormalSubsystemState);
     stream2 << (_lastArmSubsystemState == NormalSubsystemState);
 
-    channel->sendMessage(roverSubsystemMessage);
+    _mcNetwork->sendSharedMessageToPeer(peer, roverSubsystemMessage.constData(), roverSubsystemMessage.size());
 
     // send video states
 
@@ -470,7 +478,7 @@ void MissionControlProcess::onNewMissionControlClient(Channel *channel) {
         stream3 << format.serialize();
         stream3 << client->getErrorString();
 
-        channel->sendMessage(videoClientMessage);
+        _mcNetwork->sendSharedMessageToPeer(peer, videoClientMessage.constData(), videoClientMessage.size());
     }
 
     // send audio state
@@ -486,7 +494,7 @@ void MissionControlProcess::onNewMissionControlClient(Channel *channel) {
     stream4 << format.serialize();
     stream4 << _audioClient->getErrorString();
 
-    channel->sendMessage(audioClientState);
+    _mcNetwork->sendSharedMessageToPeer(peer, audioClientState.constData(), audioClientState.size());
 
     // send camera names
 
@@ -500,7 +508,7 @@ void MissionControlProcess::onNewMissionControlClient(Channel *channel) {
         stream << static_cast<qint32>(i);
         stream << _cameraNames.at(i);
 
-        channel->sendMessage(message.constData(), message.size());
+        _mcNetwork->sendSharedMessageToPeer(peer, message.constData(), message.size());
     }
 
     // send gps locations
@@ -514,8 +522,18 @@ void MissionControlProcess::onNewMissionControlClient(Channel *channel) {
         stream << static_cast<qint32>(messageType);
         stream << *nmeaMessage;
 
-        channel->sendMessage(message.constData(), message.size());
+        _mcNetwork->sendSharedMessageToPeer(peer, message.constData(), message.size());
+    }
+}
+
+/* Receives the client disconnected signal from the MissionControlNetwork module.
+ * Only applicable to the broker.
+ */
+void MissionControlProcess::onMissionControlClientDisconnected(SocketAddress peer) {
+    for (int i = 0; i < _videoClients.size(); i++) {
+        _videoClients[i]->removeForwardingAddress(SocketAddress(peer.host, NETWORK_ALL_CAMERA_PORT_1 + i));
     }
+    _audioClient->removeForwardingAddress(SocketAddress(peer.host, NETWORK_ALL_AUDIO_PORT));
 }
 
 /* Receives the signal from the UI when a new camera format is selected
@@ -21,6 +21,7 @@
 #include "libsoro/audioclient.h"
 #include "libsoro/videoformat.h"
 #include "libsoro/audioformat.h"
+#include "libsoro/forwardingengine.h"
 
 #include "libsorogst/audioplayer.h"
 
@@ -75,6 +76,9 @@ private:
     int _droppedPacketTimerId = TIMER_INACTIVE;
     int _bitrateUpdateTimerId = TIMER_INACTIVE;
 
+    // Relays the rover's media streams to the other mission controls when broker
+    ForwardingEngine *_forwardingEngine = nullptr;
+
     // These hold the video clients when in master configuration
     QList<VideoClient*> _videoClients; // camera ID is by index
     QList<int> _videoFormats; // camera ID is by index, format ID is by value
@@ -111,7 +115,8 @@ private:
     void playAudio();
 
 private slots:
-    void onNewMissionControlClient(Channel *channel);
+    void onNewMissionControlClient(SocketAddress peer);
+    void onMissionControlClientDisconnected(SocketAddress peer);
     void roverSharedChannelStateChanged(Channel::State state);
     void roverSharedChannelMessageReceived(const char *message, Channel::MessageSize size);
     void videoClientStateChanged(MediaClient *client, MediaClient::State state);
@@ -118,6 +118,7 @@ ApplicationWindow {
     signal settingsApplied()
     signal logCommentEntered(string comment)
     signal recordButtonClicked()
+    signal saveReplayButtonClicked()
     signal zeroOrientationButtonClicked()
     signal closed()
 
@@ -897,7 +898,7 @@ ApplicationWindow {
 
                     SpinBox {
                         id: videoBitrateSpinBox
-                        enabled: enableVideoSwitch.enabled & enableVideoSwitch.checked & videoEncodingCombo.currentText !== "MJPEG"
+                        enabled: enableVideoSwitch.enabled & enableVideoSwitch.checked & videoEncodingCombo.currentText !== "MJPEG" & videoResolutionCombo.currentText !== "Auto"
                         stepSize: 10
                         to: 10000
                         from: 1
@@ -1352,6 +1353,14 @@ ApplicationWindow {
             }
         }
 
+        ToolbarButton {
+            id: replayToolbarButton
+            anchors.right: recordToolbarButton.left
+            tooltip.text: "Save Last 30 Seconds"
+            image.source: "qrc:/icons/ic_replay_white_48px.svg"
+            onClicked: saveReplayButtonClicked()
+        }
+
         RecordButton {
             id: recordToolbarButton
             anchors.right: fullscreenToolbarButton.left
@@ -37,7 +37,8 @@ SOURCES += main.cpp\
     abstracthudorientationimpl.cpp \
     latencycsvseries.cpp \
     commentcsvseries.cpp \
-    connectioneventcsvseries.cpp
+    connectioneventcsvseries.cpp \
+    streamstatscsvseries.cpp
 
 HEADERS  += \
     researchprocess.h \
@@ -50,7 +51,8 @@ HEADERS  += \
     abstracthudorientationimpl.h \
     latencycsvseries.h \
     commentcsvseries.h \
-    connectioneventcsvseries.h
+    connectioneventcsvseries.h \
+    streamstatscsvseries.h
 
 FORMS    += \
     researchmainwindow.ui
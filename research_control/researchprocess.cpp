@@ -19,6 +19,8 @@
 #define LOG_TAG "Research Control"
 
 #define DEFAULT_VIDEO_STEREO_MODE VideoFormat::StereoMode_SideBySide
+// Length of video saved by the save replay button, in seconds
+#define REPLAY_SAVE_LENGTH 30
 
 namespace Soro {
 namespace MissionControl {
@@ -76,43 +78,52 @@ void ResearchControlProcess::init() {
     connect(_aux1VideoClient, &VideoClient::stateChanged, this, &ResearchControlProcess::videoClientStateChanged);
     connect(_monoVideoClient, &VideoClient::stateChanged, this, &ResearchControlProcess::videoClientStateChanged);
 
-    // add localhost bounce to the video stream so the in-app player can display it from a udpsrc
-    _stereoLVideoClient->addForwardingAddress(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_SL_CAMERA_PORT));
-    _stereoRVideoClient->addForwardingAddress(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_SR_CAMERA_PORT));
-    _aux1VideoClient->addForwardingAddress(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_A1L_CAMERA_PORT));
-    _aux1VideoClient->addForwardingAddress(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_A1R_CAMERA_PORT));
-    _monoVideoClient->addForwardingAddress(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_ML_CAMERA_PORT));
-    _monoVideoClient->addForwardingAddress(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_MR_CAMERA_PORT));
-
-    // add localhost bounce to the video stream so they can be recorded to file
-    _stereoLVideoClient->addForwardingAddress(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_SL_CAMERA_PORT_R));
-    _stereoRVideoClient->addForwardingAddress(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_SR_CAMERA_PORT_R));
-    _aux1VideoClient->addForwardingAddress(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_A1_CAMERA_PORT_R));
-    _monoVideoClient->addForwardingAddress(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_M_CAMERA_PORT_R));
-
-    // Create file recorders
-    _stereoLGStreamerRecorder = new GStreamerRecorder(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_SL_CAMERA_PORT_R), "StereoLeft", this);
-    _stereoRGStreamerRecorder = new GStreamerRecorder(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_SR_CAMERA_PORT_R), "StereoRight", this);
-    _aux1GStreamerRecorder = new GStreamerRecorder(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_A1_CAMERA_PORT_R), "Aux1", this);
-    _monoGStreamerRecorder = new GStreamerRecorder(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_M_CAMERA_PORT_R), "Mono", this);
+    foreach (VideoClient *client, QList<VideoClient*>() << _stereoLVideoClient << _stereoRVideoClient << _aux1VideoClient << _monoVideoClient) {
+        BitrateController *controller = new BitrateController(client, _driveSystem->getChannel(), this);
+        connect(controller, &BitrateController::targetChanged, this, &ResearchControlProcess::bitrateTargetChanged);
+        connect(client, &VideoClient::streamChanged, this, &ResearchControlProcess::videoClientStreamChanged);
+        _bitrateControllers.append(controller);
+        // Lets the rover log how its streams are being received
+        client->setReceiverReportsEnabled(true);
+    }
+
+    // Create the session recorder. It and the in-app players read straight from each client's
+    // packet ring, rather than having every packet forwarded back through a localhost socket
+    _sessionRecorder = new Soro::Gst::SessionRecorder(this);
+    foreach (VideoClient *client, QList<VideoClient*>() << _stereoLVideoClient << _stereoRVideoClient << _aux1VideoClient << _monoVideoClient) {
+        Soro::Gst::ReplayBuffer *replayBuffer = new Soro::Gst::ReplayBuffer(client, this);
+        connect(replayBuffer, &Soro::Gst::ReplayBuffer::saved, this, &ResearchControlProcess::replaySaved);
+        replayBuffer->start();
+        _replayBuffers.insert(client, replayBuffer);
+    }
 
     LOG_I(LOG_TAG, "***************Initializing Audio system******************");
 
     _audioClient = new AudioClient(MEDIAID_AUDIO, SocketAddress(_settings.roverAddress, NETWORK_ALL_AUDIO_PORT), QHostAddress::Any, this);
-    // forward audio stream through localhost
-    _audioClient->addForwardingAddress(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_AUDIO_PORT));
     connect(_audioClient, &AudioClient::stateChanged, this, &ResearchControlProcess::audioClientStateChanged);
 
     _audioPlayer = new Soro::Gst::AudioPlayer(this);
-    _audioGStreamerRecorder = new GStreamerRecorder(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_AUDIO_PORT), "Audio", this);
 
     LOG_I(LOG_TAG, "***************Initializing Data Recording system******************");
 
     _sensorDataSeries = new SensorDataParser(this);
     _gpsDataSeries = new GpsCsvSeries(this);
+    // Estimates link capacity for automatic video format selection
+    _bandwidthEstimator = new BandwidthEstimator(_driveSystem->getChannel(), this);
+    _bandwidthEstimator->addPassiveSource(_stereoLVideoClient);
+    _bandwidthEstimator->addPassiveSource(_stereoRVideoClient);
+    _bandwidthEstimator->addPassiveSource(_aux1VideoClient);
+    _bandwidthEstimator->addPassiveSource(_monoVideoClient);
+    _bandwidthEstimator->addPassiveSource(_audioClient);
+    _bandwidthEstimator->addPassiveSource(_roverChannel);
+
     _connectionEventSeries = new ConnectionEventCsvSeries(_driveSystem->getChannel(), _roverChannel, this);
     _latencyDataSeries = new LatencyCsvSeries(this);
     _commentDataSeries = new CommentCsvSeries(this);
+    _streamStatsSeries.insert(_stereoLVideoClient, new StreamStatsCsvSeries("Stereo Left", this));
+    _streamStatsSeries.insert(_stereoRVideoClient, new StreamStatsCsvSeries("Stereo Right", this));
+    _streamStatsSeries.insert(_aux1VideoClient, new StreamStatsCsvSeries("Aux1", this));
+    _streamStatsSeries.insert(_monoVideoClient, new StreamStatsCsvSeries("Mono", this));
 
     _dataRecorder = new CsvRecorder(this);
     _dataRecorder->setUpdateInterval(50);
@@ -135,6 +146,33 @@ void ResearchControlProcess::init() {
     _dataRecorder->addColumn(_latencyDataSeries->getRealLatencySeries());
     _dataRecorder->addColumn(_latencyDataSeries->getSimulatedLatencySeries());
     _dataRecorder->addColumn(_commentDataSeries);
+    foreach (VideoClient *client, QList<VideoClient*>() << _stereoLVideoClient << _stereoRVideoClient << _aux1VideoClient << _monoVideoClient) {
+        StreamStatsCsvSeries *series = _streamStatsSeries.value(client);
+        _dataRecorder->addColumn(series->getPacketLossSeries());
+        _dataRecorder->addColumn(series->getJitterSeries());
+        _dataRecorder->addColumn(series->getFramerateSeries());
+        _dataRecorder->addColumn(series->getKeyframeIntervalSeries());
+    }
+    // Logged rows also go on the session recording's metadata track, timed with the video
+    connect(_dataRecorder, &CsvRecorder::rowRecorded, _sessionRecorder, &Soro::Gst::SessionRecorder::addMetadata);
+    connect(_dataRecorder, &CsvRecorder::logFailed, this, &ResearchControlProcess::dataRecordingFailed);
+
+    // The data log is small and the most valuable, so it is kept over the video
+    _storageManager = new StorageManager(QCoreApplication::applicationDirPath() + "/..", this);
+    _sessionStorageHandle = _storageManager->addRecording("Session", 1);
+    _dataStorageHandle = _storageManager->addRecording("Data log", 2);
+    connect(_storageManager, &StorageManager::suspended, this, &ResearchControlProcess::storageSuspended);
+    connect(_storageManager, &StorageManager::resumed, this, &ResearchControlProcess::storageResumed);
+    connect(_sessionRecorder, &Soro::Gst::SessionRecorder::segmentStarted, this, [this](QString path) {
+        _storageManager->addFile(_sessionStorageHandle, path);
+    });
+    connect(_dataRecorder, &CsvRecorder::logStarted, this, [this]() {
+        _storageManager->clearFiles(_dataStorageHandle);
+        _storageManager->addFile(_dataStorageHandle, _dataRecorder->getFilePath());
+    });
+
+    // The rover sends its own data logs and log files between tests
+    _bulkTransferReceiver = new BulkTransferReceiver(_roverChannel, QCoreApplication::applicationDirPath() + "/../research_data/rover", this);
 
     LOG_I(LOG_TAG, "***************Initializing UI******************");
 
@@ -165,6 +203,7 @@ void ResearchControlProcess::init() {
     connect(_controlUi, SIGNAL(requestUiSync()), this, SLOT(ui_requestUiSync()));
     connect(_controlUi, SIGNAL(settingsApplied()), this, SLOT(ui_settingsApplied()));
     connect (_controlUi, SIGNAL(recordButtonClicked()), this, SLOT(ui_toggleDataRecordButtonClicked()));
+    connect (_controlUi, SIGNAL(saveReplayButtonClicked()), this, SLOT(ui_saveReplayButtonClicked()));
     connect(_controlUi, SIGNAL(zeroOrientationButtonClicked()), _mainUi, SLOT(zeroHudOrientation()));
     connect (_commentsUi, SIGNAL(recordButtonClicked()), this, SLOT(ui_toggleDataRecordButtonClicked()));
 
@@ -198,6 +237,14 @@ void ResearchControlProcess::roverDataRecordResponseWatchdog() {
 }
 
 void ResearchControlProcess::startDataRecording() {
+    if (!_storageManager->hasSpace() || _storageManager->isSuspended(_dataStorageHandle)) {
+        QMetaObject::invokeMethod(_controlUi,
+                                  "notify",
+                                  Q_ARG(QVariant, "error"),
+                                  Q_ARG(QVariant, "Cannot Record Data"),
+                                  Q_ARG(QVariant, "There is not enough free disk space to record."));
+        return;
+    }
     _recordStartTime = QDateTime::currentDateTime().toMSecsSinceEpoch();
     sendStartRecordCommandToRover();
     _controlUi->setProperty("recordingState", "waiting");
@@ -219,6 +266,64 @@ void ResearchControlProcess::stopDataRecording() {
     _roverChannel->sendMessage(byteArray);
 }
 
+void ResearchControlProcess::updateSessionRecording() {
+    // Tracks can't be added to a running recording, so start a new one with the current streams
+    _sessionRecorder->stop();
+    _sessionRecorder->clearTracks();
+    QList<QPair<VideoClient*, QString>> videoTracks;
+    videoTracks << qMakePair(_stereoLVideoClient, QString("StereoLeft"))
+                << qMakePair(_stereoRVideoClient, QString("StereoRight"))
+                << qMakePair(_monoVideoClient, QString("Mono"))
+                << qMakePair(_aux1VideoClient, QString("Aux1"));
+    for (auto track : videoTracks) {
+        if (track.first->getState() == MediaClient::StreamingState) {
+            _sessionRecorder->addVideoTrack(track.first->getPacketRing(), track.first->getVideoFormat(), track.second);
+        }
+    }
+    if (_audioClient->getState() == MediaClient::StreamingState) {
+        _sessionRecorder->addAudioTrack(_audioClient->getPacketRing(), _audioClient->getAudioFormat(), "Audio");
+    }
+    _storageManager->clearFiles(_sessionStorageHandle);
+    if ((_sessionRecorder->getTrackCount() > 0) && !_storageManager->isSuspended(_sessionStorageHandle)
+            && _sessionRecorder->begin(QDateTime::currentDateTime().toMSecsSinceEpoch(), _dataRecorder->getColumnHeader())) {
+        LOG_I(LOG_TAG, "Started session recording with " + QString::number(_sessionRecorder->getTrackCount()) + " tracks");
+    }
+}
+
+void ResearchControlProcess::storageSuspended(int handle) {
+    if (handle == _sessionStorageHandle) {
+        _sessionRecorder->stop();
+        QMetaObject::invokeMethod(_controlUi,
+                                  "notify",
+                                  Q_ARG(QVariant, "warning"),
+                                  Q_ARG(QVariant, "Video Recording Paused"),
+                                  Q_ARG(QVariant, "The disk is running out of space or can't keep up. Video will be recorded again once there is room."));
+    }
+    else if ((handle == _dataStorageHandle) && _dataRecorder->isRecording()) {
+        stopDataRecording();
+        QMetaObject::invokeMethod(_controlUi,
+                                  "notify",
+                                  Q_ARG(QVariant, "error"),
+                                  Q_ARG(QVariant, "Data Recording Stopped"),
+                                  Q_ARG(QVariant, "The disk is out of space."));
+    }
+}
+
+void ResearchControlProcess::storageResumed(int handle) {
+    if (handle == _sessionStorageHandle) {
+        updateSessionRecording();
+    }
+}
+
+void ResearchControlProcess::dataRecordingFailed(QString message) {
+    stopDataRecording();
+    QMetaObject::invokeMethod(_controlUi,
+                              "notify",
+                              Q_ARG(QVariant, "error"),
+                              Q_ARG(QVariant, "Data Recording Stopped"),
+                              Q_ARG(QVariant, "The data log could not be written: " + message));
+}
+
 void ResearchControlProcess::gamepadChanged(bool connected, QString name) {
     _controlUi->setProperty("gamepad", name);
     if (connected) {
@@ -257,11 +362,52 @@ void ResearchControlProcess::ui_toggleDataRecordButtonClicked() {
     }
 }
 
+void ResearchControlProcess::ui_saveReplayButtonClicked() {
+    if (!_storageManager->hasSpace()) {
+        QMetaObject::invokeMethod(_controlUi,
+                                  "notify",
+                                  Q_ARG(QVariant, "error"),
+                                  Q_ARG(QVariant, "Cannot Save Replay"),
+                                  Q_ARG(QVariant, "There is not enough free disk space."));
+        return;
+    }
+    qint64 timestamp = QDateTime::currentDateTime().toMSecsSinceEpoch();
+    QString dir = QCoreApplication::applicationDirPath() + "/../research_media";
+    QDir().mkpath(dir);
+    bool saving = false;
+    foreach (VideoClient *client, _replayBuffers.keys()) {
+        if (client->getState() != MediaClient::StreamingState) continue;
+        QString fileName = QString("%1/%2_replay_%3.mkv").arg(dir, QString::number(timestamp), QString::number(client->getMediaId()));
+        saving |= _replayBuffers.value(client)->save(client->getVideoFormat(), REPLAY_SAVE_LENGTH, fileName);
+    }
+    if (!saving) {
+        QMetaObject::invokeMethod(_controlUi,
+                                  "notify",
+                                  Q_ARG(QVariant, "warning"),
+                                  Q_ARG(QVariant, "No Replay"),
+                                  Q_ARG(QVariant, "There is no video to save yet."));
+    }
+}
+
+void ResearchControlProcess::replaySaved(QString fileName, bool success) {
+    QMetaObject::invokeMethod(_controlUi,
+                              "notify",
+                              Q_ARG(QVariant, success ? "information" : "error"),
+                              Q_ARG(QVariant, success ? "Replay Saved" : "Cannot Save Replay"),
+                              Q_ARG(QVariant, QFileInfo(fileName).fileName()));
+}
+
 void ResearchControlProcess::ui_settingsApplied() {
     _settings.syncModel(_controlUi);
 
     if (_settings.enableVideo) {
-        VideoFormat format = _settings.getSelectedVideoFormat();
+        int streams = (_settings.selectedCamera == _settings.mainCameraIndex)
+                && _settings.enableStereoUi && _settings.enableStereoVideo ? 2 : 1;
+        VideoFormat format = _settings.getSelectedVideoFormat(_bandwidthEstimator->getCapacity(), streams);
+        if (_settings.isAutoVideoFormatSelected()) {
+            LOG_I(LOG_TAG, "Automatically selected video format " + format.toHumanReadableString()
+                  + " for a measured capacity of " + QString::number(_bandwidthEstimator->getCapacity()) + "bps");
+        }
         if (format.isUseable()) {
             if (_settings.selectedCamera == _settings.mainCameraIndex) {
                 if (_settings.enableStereoUi) {
@@ -325,11 +471,16 @@ void ResearchControlProcess::ui_settingsApplied() {
 }
 
 void ResearchControlProcess::videoClientStateChanged(MediaClient *client, MediaClient::State state) {
-    // Stop all file recordings
-    _stereoLGStreamerRecorder->stop();
-    _stereoRGStreamerRecorder->stop();
-    _monoGStreamerRecorder->stop();
-    _aux1GStreamerRecorder->stop();
+    foreach (BitrateController *controller, _bitrateControllers) {
+        if (controller->getClient() == client) {
+            if (state == MediaClient::StreamingState) {
+                controller->setFormat(qobject_cast<VideoClient*>(client)->getVideoFormat());
+            }
+            else {
+                controller->stop();
+            }
+        }
+    }
 
     if ((client == _stereoLVideoClient) || (client == _stereoRVideoClient)) {
         if ((_stereoLVideoClient->getState() == MediaClient::StreamingState) &&
@@ -338,14 +489,10 @@ void ResearchControlProcess::videoClientStateChanged(MediaClient *client, MediaC
 
             VideoFormat stereoLFormat = _stereoLVideoClient->getVideoFormat();
             VideoFormat stereoRFormat = _stereoRVideoClient->getVideoFormat();
-            _mainUi->getCameraWidget()->playStereo(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_SL_CAMERA_PORT),
+            _mainUi->getCameraWidget()->playStereo(_stereoLVideoClient->getPacketRing(),
                                                stereoLFormat,
-                                               SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_SR_CAMERA_PORT),
+                                               _stereoRVideoClient->getPacketRing(),
                                                stereoRFormat);
-            // Record streams
-            qint64 timestamp = QDateTime::currentDateTime().toMSecsSinceEpoch();
-            _stereoLGStreamerRecorder->begin(&stereoLFormat, timestamp);
-            _stereoRGStreamerRecorder->begin(&stereoRFormat, timestamp);
 
             if (!_settings.enableStereoUi || !_settings.enableStereoVideo) {
                 LOG_E(LOG_TAG, "Video clients are playing stereo, but UI is not in stereo mode");
@@ -360,37 +507,32 @@ void ResearchControlProcess::videoClientStateChanged(MediaClient *client, MediaC
 
         VideoFormat aux1Format = _aux1VideoClient->getVideoFormat();
         if (_settings.enableStereoUi) {
-            _mainUi->getCameraWidget()->playStereo(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_A1L_CAMERA_PORT),
+            _mainUi->getCameraWidget()->playStereo(_aux1VideoClient->getPacketRing(),
                                              aux1Format,
-                                             SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_A1R_CAMERA_PORT),
+                                             _aux1VideoClient->getPacketRing(),
                                              aux1Format);
         }
         else {
-            _mainUi->getCameraWidget()->playMono(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_A1L_CAMERA_PORT),
+            _mainUi->getCameraWidget()->playMono(_aux1VideoClient->getPacketRing(),
                                              aux1Format);
         }
-
-        // Record stream
-        _aux1GStreamerRecorder->begin(&aux1Format, QDateTime::currentDateTime().toMSecsSinceEpoch());
     }
     else if ((client == _monoVideoClient) && (_monoVideoClient->getState() == MediaClient::StreamingState)) {
         // Mono camera is streaming
 
         VideoFormat monoFormat = _monoVideoClient->getVideoFormat();
         if (_settings.enableStereoUi) {
-            _mainUi->getCameraWidget()->playStereo(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_ML_CAMERA_PORT),
+            _mainUi->getCameraWidget()->playStereo(_monoVideoClient->getPacketRing(),
                                              monoFormat,
-                                             SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_MR_CAMERA_PORT),
+                                             _monoVideoClient->getPacketRing(),
                                              monoFormat);
         }
         else {
-            _mainUi->getCameraWidget()->playMono(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_RESEARCH_ML_CAMERA_PORT),
+            _mainUi->getCameraWidget()->playMono(_monoVideoClient->getPacketRing(),
                                              monoFormat);
         }
-
-        // Record stream
-        _monoGStreamerRecorder->begin(&monoFormat, QDateTime::currentDateTime().toMSecsSinceEpoch());
     }
+    updateSessionRecording();
 
     if (state == MediaClient::StreamingState) {
         _settings.enableVideo = true;
@@ -407,22 +549,49 @@ void ResearchControlProcess::videoClientStateChanged(MediaClient *client, MediaC
     }
 }
 
+void ResearchControlProcess::videoClientStreamChanged(MediaClient *client) {
+    // The stream was reconfigured in place, so the controller needs the new ceiling
+    foreach (BitrateController *controller, _bitrateControllers) {
+        if (controller->getClient() == client) {
+            controller->setFormat(qobject_cast<VideoClient*>(client)->getVideoFormat());
+        }
+    }
+}
+
+void ResearchControlProcess::bitrateTargetChanged(BitrateController *controller, quint32 bitrate, quint32 framerate) {
+    LOG_I(LOG_TAG, "Adjusting camera " + QString::number(controller->getClient()->getMediaId()) + " to "
+          + QString::number(bitrate) + "bps" + (framerate > 0 ? " at " + QString::number(framerate) + "fps" : QString("")));
+
+    if (controller->getClient()->requestReconfigure(bitrate, framerate)) {
+        // Sent directly to the stream's server
+        return;
+    }
+    // Older rovers only take this through the shared channel
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    SharedMessageType messageType = SharedMessage_Research_AdjustVideoStream;
+    stream << static_cast<qint32>(messageType);
+    stream << static_cast<qint32>(controller->getClient()->getMediaId());
+    stream << bitrate;
+    stream << framerate;
+    _roverChannel->sendMessage(message);
+}
+
 void ResearchControlProcess::audioClientStateChanged(MediaClient *client, MediaClient::State state) {
     Q_UNUSED(client);
 
     switch (state) {
     case AudioClient::StreamingState: {
         AudioFormat audioFormat = _audioClient->getAudioFormat();
-        _audioPlayer->play(SocketAddress(QHostAddress::LocalHost, NETWORK_ALL_AUDIO_PORT),
-                           audioFormat);
-        //_audioGStreamerRecorder->begin(&audioFormat, QDateTime::currentDateTime().toMSecsSinceEpoch());
+        _audioPlayer->play(_audioClient->getPacketRing(), audioFormat);
+        updateSessionRecording();
         _settings.enableAudio = true;
         _settings.syncUi(_controlUi);
         break;
     }
     case AudioClient::ConnectingState:
         _audioPlayer->stop();
-        //_audioGStreamerRecorder->stop();
+        updateSessionRecording();
         _settings.enableAudio = false;
         _settings.syncUi(_controlUi);
         break;
@@ -492,6 +661,11 @@ void ResearchControlProcess::timerEvent(QTimerEvent *e) {
                                   "updateBitrate",
                                   Q_ARG(QVariant, bpsRoverUp),
                                   Q_ARG(QVariant, bpsRoverDown));
+
+        // The client statistics are also calculated once per second
+        foreach (VideoClient *client, _streamStatsSeries.keys()) {
+            _streamStatsSeries.value(client)->update(client);
+        }
     }
     else {
         QObject::timerEvent(e);
@@ -619,6 +793,11 @@ void ResearchControlProcess::roverSharedChannelMessageReceived(const char *messa
         _commentsUi->setProperty("recordingState", "recording");
         break;
     }
+    case SharedMessage_BulkTransferOffer:
+    case SharedMessage_BulkTransferChunk:
+    case SharedMessage_BulkTransferEnd:
+        _bulkTransferReceiver->handleMessage(messageType, stream);
+        break;
     default:
         LOG_E(LOG_TAG, "Got unknown message header on shared channel");
         break;
@@ -666,8 +845,19 @@ void ResearchControlProcess::stopAllRoverCameras() {
     _roverChannel->sendMessage(message);
 }
 
+bool ResearchControlProcess::canChangeStreamInPlace(VideoClient *client, const VideoFormat &format) {
+    // The rover changes a running stream in place if only these stay the same,
+    // in which case the stream and player should be left running
+    VideoFormat current = client->getVideoFormat();
+    return (client->getState() == MediaClient::StreamingState)
+            && (current.getEncoding() == format.getEncoding())
+            && (current.getStereoMode() == format.getStereoMode());
+}
+
 void ResearchControlProcess::startMonoCameraStream(VideoFormat format) {
-    stopAllRoverCameras();
+    if (!canChangeStreamInPlace(_monoVideoClient, format)) {
+        stopAllRoverCameras();
+    }
 
     if (format.isUseable()) {
         // Start mono stream
@@ -685,7 +875,9 @@ void ResearchControlProcess::startMonoCameraStream(VideoFormat format) {
 }
 
 void ResearchControlProcess::startStereoCameraStream(VideoFormat format) {
-    stopAllRoverCameras();
+    if (!(canChangeStreamInPlace(_stereoLVideoClient, format) && canChangeStreamInPlace(_stereoRVideoClient, format))) {
+        stopAllRoverCameras();
+    }
 
     if (format.isUseable()) {
         // Start stereo stream
@@ -703,7 +895,9 @@ void ResearchControlProcess::startStereoCameraStream(VideoFormat format) {
 }
 
 void ResearchControlProcess::startAux1CameraStream(VideoFormat format) {
-    stopAllRoverCameras();
+    if (!canChangeStreamInPlace(_aux1VideoClient, format)) {
+        stopAllRoverCameras();
+    }
 
     if (format.isUseable()) {
         // Start stereo stream
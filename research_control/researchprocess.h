@@ -25,18 +25,24 @@
 #include "libsoro/sensordataparser.h"
 #include "libsoro/gpscsvseries.h"
 #include "libsoro/csvrecorder.h"
+#include "libsoro/bandwidthestimator.h"
+#include "libsoro/bitratecontroller.h"
+#include "libsoro/storagemanager.h"
+#include "libsoro/bulktransferreceiver.h"
 
 #include "libsorogst/audioplayer.h"
+#include "libsorogst/sessionrecorder.h"
+#include "libsorogst/replaybuffer.h"
 
 #include "libsoromc/camerawidget.h"
 #include "libsoromc/drivecontrolsystem.h"
 #include "libsoromc/cameracontrolsystem.h"
-#include "libsoromc/gstreamerrecorder.h"
 
 #include "researchmainwindow.h"
 #include "latencycsvseries.h"
 #include "connectioneventcsvseries.h"
 #include "commentcsvseries.h"
+#include "streamstatscsvseries.h"
 #include "settingsmodel.h"
 
 namespace Soro {
@@ -76,27 +82,40 @@ private:
     VideoClient *_monoVideoClient = nullptr;
     VideoClient *_aux1VideoClient = nullptr;
 
-    GStreamerRecorder *_stereoLGStreamerRecorder = nullptr;
-    GStreamerRecorder *_stereoRGStreamerRecorder = nullptr;
-    GStreamerRecorder *_monoGStreamerRecorder = nullptr;
-    GStreamerRecorder *_aux1GStreamerRecorder = nullptr;
+    // Adapt the bitrate of each running video stream to the link
+    QList<BitrateController*> _bitrateControllers;
 
     // Audio stream subsystem
     AudioClient *_audioClient = nullptr;
+    BandwidthEstimator *_bandwidthEstimator = nullptr;
     Soro::Gst::AudioPlayer *_audioPlayer = nullptr;
-    GStreamerRecorder *_audioGStreamerRecorder = nullptr;
+
+    // Records all active streams and the data log into one file
+    Soro::Gst::SessionRecorder *_sessionRecorder = nullptr;
+    // Keep the last part of each video stream so it can be saved after the fact
+    QHash<VideoClient*, Soro::Gst::ReplayBuffer*> _replayBuffers;
 
     SensorDataParser *_sensorDataSeries = nullptr;
     GpsCsvSeries *_gpsDataSeries = nullptr;
     ConnectionEventCsvSeries *_connectionEventSeries = nullptr;
     LatencyCsvSeries *_latencyDataSeries = nullptr;
     CommentCsvSeries *_commentDataSeries = nullptr;
+    QHash<VideoClient*, StreamStatsCsvSeries*> _streamStatsSeries;
 
     CsvRecorder *_dataRecorder = nullptr;
     qint64 _recordStartTime;
 
+    // Keeps recordings from filling the disk
+    StorageManager *_storageManager = nullptr;
+    int _sessionStorageHandle = -1;
+    int _dataStorageHandle = -1;
+
+    // Receives the rover's data logs and log files after each test
+    BulkTransferReceiver *_bulkTransferReceiver = nullptr;
+
 private:
     void stopAllRoverCameras();
+    bool canChangeStreamInPlace(VideoClient *client, const VideoFormat &format);
     void startMonoCameraStream(VideoFormat format);
     void startStereoCameraStream(VideoFormat format);
     void startAux1CameraStream(VideoFormat format);
@@ -104,6 +123,7 @@ private:
     void stopAudio();
     void startDataRecording();
     void stopDataRecording();
+    void updateSessionRecording();
     void sendStartRecordCommandToRover();
     void sendStopRecordCommandToRover();
 
@@ -113,6 +133,8 @@ private slots:
     void roverSharedChannelMessageReceived(const char *message, Channel::MessageSize size);
     void videoClientStateChanged(MediaClient *client, MediaClient::State state);
     void audioClientStateChanged(MediaClient *client, MediaClient::State state);
+    void videoClientStreamChanged(MediaClient *client);
+    void bitrateTargetChanged(BitrateController *controller, quint32 bitrate, quint32 framerate);
     void driveConnectionStateChanged(Channel::State state);
     void gamepadChanged(bool connected, QString name);
     void roverDataRecordResponseWatchdog();
@@ -133,6 +155,11 @@ private slots:
      * Receives the signal from the UI when the test start/stop button is clicked
      */
     void ui_toggleDataRecordButtonClicked();
+    void ui_saveReplayButtonClicked();
+    void replaySaved(QString fileName, bool success);
+    void storageSuspended(int handle);
+    void storageResumed(int handle);
+    void dataRecordingFailed(QString message);
 
 protected:
     void timerEvent(QTimerEvent *e);
@@ -16,6 +16,9 @@
 
 #include "settingsmodel.h"
 
+// Fraction of the measured capacity left unused when choosing a format automatically
+#define AUTO_VIDEO_HEADROOM 0.3
+
 namespace Soro {
 namespace MissionControl {
 
@@ -50,6 +53,7 @@ SettingsModel SettingsModel::Default(QHostAddress roverAddress) {
     model.videoResolutionNames << "1152x648";
     model.videoResolutionNames << "1280x720";
     model.videoResolutionNames << "1600x900";
+    model.videoResolutionNames << "Auto";       model.autoVideoResolutionIndex = model.videoResolutionNames.size() - 1;
 
     model.videoEncodingNames << "MP4";
     model.videoEncodingNames << "MJPEG";
@@ -125,7 +129,29 @@ void SettingsModel::setSelectedCamera(int mediaId) {
     }
 }
 
-VideoFormat SettingsModel::getSelectedVideoFormat() {
+bool SettingsModel::isAutoVideoFormatSelected() const {
+    return selectedVideoResolution == autoVideoResolutionIndex;
+}
+
+VideoFormat SettingsModel::getSelectedVideoFormat(qint64 measuredCapacity, int streams) {
+    if (isAutoVideoFormatSelected()) {
+        // MJPEG has no bitrate control, so auto selection always uses a bitrate controlled encoder
+        VideoFormat::Encoding encoding = static_cast<VideoFormat::Encoding>(selectedVideoEncoding);
+        if (encoding == VideoFormat::Encoding_MJPEG) {
+            encoding = VideoFormat::Encoding_H264;
+        }
+        QList<VideoFormat> candidates;
+        candidates << VideoFormat(encoding, VideoFormat::Resolution_176_144, 150000, selectedVideoFramerate);
+        candidates << VideoFormat(encoding, VideoFormat::Resolution_432_240, 400000, selectedVideoFramerate);
+        candidates << VideoFormat(encoding, VideoFormat::Resolution_640x360, 800000, selectedVideoFramerate);
+        candidates << VideoFormat(encoding, VideoFormat::Resolution_1024x576, 1500000, selectedVideoFramerate);
+        candidates << VideoFormat(encoding, VideoFormat::Resolution_1152x648, 2000000, selectedVideoFramerate);
+        candidates << VideoFormat(encoding, VideoFormat::Resolution_1280x720, 2500000, selectedVideoFramerate);
+        candidates << VideoFormat(encoding, VideoFormat::Resolution_1600x900, 4000000, selectedVideoFramerate);
+        VideoFormat format = BandwidthEstimator::selectVideoFormat(measuredCapacity, AUTO_VIDEO_HEADROOM, candidates, streams);
+        format.setMaxThreads(3);
+        return format;
+    }
     VideoFormat format;
     format.setEncoding(static_cast<VideoFormat::Encoding>(selectedVideoEncoding));
     format.setResolution(static_cast<VideoFormat::Resolution>(selectedVideoResolution));
@@ -8,6 +8,7 @@
 #include "libsoro/videoformat.h"
 #include "libsoro/audioformat.h"
 #include "libsoro/constants.h"
+#include "libsoro/bandwidthestimator.h"
 
 namespace Soro {
 namespace MissionControl {
@@ -33,6 +34,7 @@ struct SettingsModel {
 
     int mainCameraIndex;
     int aux1CameraIndex;
+    int autoVideoResolutionIndex;
 
     QHostAddress roverAddress;
 
@@ -46,7 +48,11 @@ struct SettingsModel {
     void syncUi(QQuickWindow *window);
     void syncModel(const QQuickWindow *window);
     void setSelectedCamera(int mediaId);
-    VideoFormat getSelectedVideoFormat();
+    bool isAutoVideoFormatSelected() const;
+    /* Gets the selected video format. If "Auto" is selected, the format is chosen to fit the
+     * measured link capacity (bits per second, -1 if unknown) split between the given number of streams.
+     */
+    VideoFormat getSelectedVideoFormat(qint64 measuredCapacity = -1, int streams = 1);
 };
 
 } // namespace MissionControl
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2017 The University of Oklahoma.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "streamstatscsvseries.h"
+
+namespace Soro {
+namespace MissionControl {
+
+StreamStatsCsvSeries::StreamStatsCsvSeries(QString streamName, QObject *parent) : QObject(parent) {
+    _packetLossSeries._name = streamName + " Packet Loss";
+    _jitterSeries._name = streamName + " Jitter";
+    _framerateSeries._name = streamName + " Framerate";
+    _keyframeIntervalSeries._name = streamName + " Keyframe Interval";
+}
+
+const StreamStatsCsvSeries::StatCsvSeries* StreamStatsCsvSeries::getPacketLossSeries() const {
+    return &_packetLossSeries;
+}
+
+const StreamStatsCsvSeries::StatCsvSeries* StreamStatsCsvSeries::getJitterSeries() const {
+    return &_jitterSeries;
+}
+
+const StreamStatsCsvSeries::StatCsvSeries* StreamStatsCsvSeries::getFramerateSeries() const {
+    return &_framerateSeries;
+}
+
+const StreamStatsCsvSeries::StatCsvSeries* StreamStatsCsvSeries::getKeyframeIntervalSeries() const {
+    return &_keyframeIntervalSeries;
+}
+
+void StreamStatsCsvSeries::update(const MediaClient *client) {
+    if (client->getState() != MediaClient::StreamingState) return;
+    _packetLossSeries.update(QVariant(client->getPacketLoss()));
+    _jitterSeries.update(QVariant(client->getJitter()));
+    _framerateSeries.update(QVariant(client->getFramerate()));
+    _keyframeIntervalSeries.update(QVariant(client->getKeyframeInterval()));
+}
+
+} // namespace MissionControl
+} // namespace Soro
@@ -0,0 +1,44 @@
+#ifndef STREAMSTATSCSVSERIES_H
+#define STREAMSTATSCSVSERIES_H
+
+#include <QObject>
+
+#include "libsoro/mediaclient.h"
+#include "libsoro/csvrecorder.h"
+
+namespace Soro {
+namespace MissionControl {
+
+/* Receiver statistics of a single media stream, one column for each statistic
+ */
+class StreamStatsCsvSeries : public QObject
+{
+    Q_OBJECT
+public:
+    StreamStatsCsvSeries(QString streamName, QObject *parent = 0);
+
+    class StatCsvSeries : public CsvDataSeries { friend class StreamStatsCsvSeries;
+    public: QString getSeriesName() const { return _name; }
+            bool shouldKeepOldValues() const { return true; }
+    private: QString _name;
+    };
+
+    const StatCsvSeries* getPacketLossSeries() const;
+    const StatCsvSeries* getJitterSeries() const;
+    const StatCsvSeries* getFramerateSeries() const;
+    const StatCsvSeries* getKeyframeIntervalSeries() const;
+
+public slots:
+    void update(const MediaClient *client);
+
+private:
+    StatCsvSeries _packetLossSeries;
+    StatCsvSeries _jitterSeries;
+    StatCsvSeries _framerateSeries;
+    StatCsvSeries _keyframeIntervalSeries;
+};
+
+} // namespace MissionControl
+} // namespace Soro
+
+#endif // STREAMSTATSCSVSERIES_H
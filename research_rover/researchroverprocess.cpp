@@ -23,6 +23,9 @@
 
 #define DEFAULT_AUDIO_DEVICE "hw:1"
 
+// Interval to log drive path wake-up latency when low latency mode is enabled
+#define LATENCY_REPORT_INTERVAL 10000
+
 namespace Soro {
 namespace Rover {
 
@@ -69,6 +72,54 @@ void ResearchRoverProcess::init() {
     connect(_mbed, &MbedChannel::messageReceived, this, &ResearchRoverProcess::mbedMessageReceived);
     connect(_mbed, &MbedChannel::stateChanged, this, &ResearchRoverProcess::mbedChannelStateChanged);
 
+    // optional low latency mode for the drive path, configured in ../config/research_rover.conf
+    QFile roverConfFile(QCoreApplication::applicationDirPath() + "/../config/research_rover.conf");
+    bool inProcessStreaming = false;
+    // The multiplexer runs in this process, so a camera that hangs or crashes it takes down the rover
+    bool sharedCapture = false;
+    bool cameraPassthrough = true;
+    LocalRecordingSettings localRecording;
+    if (roverConfFile.exists()) {
+        ConfLoader roverConfig;
+        roverConfig.load(roverConfFile);
+        roverConfig.valueAsBool("InProcessStreaming", &inProcessStreaming);
+        roverConfig.valueAsBool("SharedCapture", &sharedCapture);
+        roverConfig.valueAsBool("CameraPassthrough", &cameraPassthrough);
+        bool lowLatency = false;
+        if (roverConfig.valueAsBool("LowLatencyDrive", &lowLatency) && lowLatency) {
+            LOG_I(LOG_TAG, "Enabling low latency mode on the drive path");
+            _driveChannel->setLowLatencyMode(true);
+            _mbed->setLowLatencyMode(true);
+            QTimer *latencyReportTimer = new QTimer(this);
+            connect(latencyReportTimer, &QTimer::timeout, this, &ResearchRoverProcess::logDriveLatency);
+            latencyReportTimer->start(LATENCY_REPORT_INTERVAL);
+        }
+        bool local = false;
+        if (roverConfig.valueAsBool("LocalRecording", &local) && local) {
+            // A second, higher quality encode of each camera recorded on the rover's own disk
+            int bitrate = 8000000;
+            int resolution = VideoFormat::Resolution_1920x1080;
+            int segmentMB = 1024;
+            int reserveMB = 512;
+            roverConfig.valueAsInt("LocalRecordingBitrate", &bitrate);
+            roverConfig.valueAsInt("LocalRecordingResolution", &resolution);
+            roverConfig.valueAsInt("LocalRecordingCpuBudget", &localRecording.cpuBudget);
+            roverConfig.valueAsInt("LocalRecordingSegmentSeconds", &localRecording.segmentSeconds);
+            roverConfig.valueAsInt("LocalRecordingSegmentMB", &segmentMB);
+            roverConfig.valueAsInt("LocalRecordingReserveMB", &reserveMB);
+            localRecording.format = VideoFormat(VideoFormat::Encoding_H264,
+                                                static_cast<VideoFormat::Resolution>(resolution),
+                                                bitrate, 0, VideoFormat::StereoMode_None, 50, 1);
+            // Segments can only start on a keyframe
+            localRecording.format.setKeyframeInterval(60);
+            localRecording.segmentBytes = (qint64)segmentMB * 1024 * 1024;
+            localRecording.reserveBytes = (qint64)reserveMB * 1024 * 1024;
+            localRecording.directory = QCoreApplication::applicationDirPath() + "/../research_media_local";
+            LOG_I(LOG_TAG, "Recording cameras locally as " + localRecording.format.toHumanReadableString()
+                  + " within " + QString::number(localRecording.cpuBudget) + "% CPU");
+        }
+    }
+
     // observers for network channels message received
     connect(_driveChannel, &Channel::messageReceived, this, &ResearchRoverProcess::driveChannelMessageReceived);
     connect(_sharedChannel, &Channel::messageReceived, this, &ResearchRoverProcess::sharedChannelMessageReceived);
@@ -84,11 +135,47 @@ void ResearchRoverProcess::init() {
     _stereoLCameraServer = new VideoServer(MEDIAID_RESEARCH_SL_CAMERA, SocketAddress(QHostAddress::Any, NETWORK_ALL_RESEARCH_SL_CAMERA_PORT), this);
     _aux1CameraServer = new VideoServer(MEDIAID_RESEARCH_A1_CAMERA, SocketAddress(QHostAddress::Any, NETWORK_ALL_RESEARCH_A1L_CAMERA_PORT), this);
     _monoCameraServer = new VideoServer(MEDIAID_RESEARCH_M_CAMERA, SocketAddress(QHostAddress::Any, NETWORK_ALL_RESEARCH_ML_CAMERA_PORT), this);
+    _stereoRCameraServer->setLocalRecording(localRecording);
+    _stereoLCameraServer->setLocalRecording(localRecording);
+    _aux1CameraServer->setLocalRecording(localRecording);
+    _monoCameraServer->setLocalRecording(localRecording);
+
+    // Only one camera streams at a time, except for the two stereo cameras
+    _videoWorkerPool = new StreamerPool(QCoreApplication::applicationDirPath() + "/video_streamer", 2, this);
+    _stereoRCameraServer->setWorkerPool(_videoWorkerPool);
+    _stereoLCameraServer->setWorkerPool(_videoWorkerPool);
+    _aux1CameraServer->setWorkerPool(_videoWorkerPool);
+    _monoCameraServer->setWorkerPool(_videoWorkerPool);
+
+    if (sharedCapture) {
+        // The mono camera is one of the stereo cameras, so they must share the device
+        _captureMultiplexer = new Soro::Gst::CaptureMultiplexer(this);
+        connect(_captureMultiplexer, &Soro::Gst::CaptureMultiplexer::sourceReady, this, &ResearchRoverProcess::captureSourceReady);
+        connect(_captureMultiplexer, &Soro::Gst::CaptureMultiplexer::captureFailed, this, &ResearchRoverProcess::captureFailed);
+    }
+
+    if (inProcessStreaming) {
+        // Streams run on a gstreamer thread in this process, the pools are still used if it fails
+        LOG_I(LOG_TAG, "Streaming in process");
+        _streamEngine = new Soro::Gst::StreamEngine(this);
+        _stereoRCameraServer->setStreamEngine(_streamEngine);
+        _stereoLCameraServer->setStreamEngine(_streamEngine);
+        _aux1CameraServer->setStreamEngine(_streamEngine);
+        _monoCameraServer->setStreamEngine(_streamEngine);
+    }
 
     connect(_stereoRCameraServer, &VideoServer::error, this, &ResearchRoverProcess::mediaServerError);
     connect(_stereoLCameraServer, &VideoServer::error, this, &ResearchRoverProcess::mediaServerError);
     connect(_aux1CameraServer, &VideoServer::error, this, &ResearchRoverProcess::mediaServerError);
     connect(_monoCameraServer, &VideoServer::error, this, &ResearchRoverProcess::mediaServerError);
+    connect(_stereoRCameraServer, &VideoServer::clientStatsReceived, this, &ResearchRoverProcess::mediaClientStatsReceived);
+    connect(_stereoLCameraServer, &VideoServer::clientStatsReceived, this, &ResearchRoverProcess::mediaClientStatsReceived);
+    connect(_aux1CameraServer, &VideoServer::clientStatsReceived, this, &ResearchRoverProcess::mediaClientStatsReceived);
+    connect(_monoCameraServer, &VideoServer::clientStatsReceived, this, &ResearchRoverProcess::mediaClientStatsReceived);
+    connect(_stereoRCameraServer, &VideoServer::streamerStatsReceived, this, &ResearchRoverProcess::mediaStreamerStatsReceived);
+    connect(_stereoLCameraServer, &VideoServer::streamerStatsReceived, this, &ResearchRoverProcess::mediaStreamerStatsReceived);
+    connect(_aux1CameraServer, &VideoServer::streamerStatsReceived, this, &ResearchRoverProcess::mediaStreamerStatsReceived);
+    connect(_monoCameraServer, &VideoServer::streamerStatsReceived, this, &ResearchRoverProcess::mediaStreamerStatsReceived);
 
     UsbCameraEnumerator cameras;
     cameras.loadCameras();
@@ -119,9 +206,12 @@ void ResearchRoverProcess::init() {
                                         camConfig.value("a1_matchProductId"),
                                         camConfig.value("a1_matchSerial"));
 
+        // Cameras opened directly are captured in the mode closest to what is streamed
         if (stereoRight) {
             _stereoRCameraDevice = stereoRight->device;
             _monoCameraDevice = _stereoRCameraDevice;
+            _stereoRCameraServer->setCaptureModes(stereoRight->modes, cameraPassthrough);
+            _monoCameraServer->setCaptureModes(stereoRight->modes, cameraPassthrough);
             LOG_I(LOG_TAG, "Right stereo camera found: " + stereoRight->toString());
         }
         else {
@@ -129,8 +219,10 @@ void ResearchRoverProcess::init() {
         }
         if (stereoLeft) {
             _stereoLCameraDevice = stereoLeft->device;
+            _stereoLCameraServer->setCaptureModes(stereoLeft->modes, cameraPassthrough);
             if (!stereoRight) {
                 _monoCameraDevice = _stereoLCameraDevice;
+                _monoCameraServer->setCaptureModes(stereoLeft->modes, cameraPassthrough);
             }
             LOG_I(LOG_TAG, "Left stereo camera found: " + stereoLeft->toString());
         }
@@ -139,6 +231,7 @@ void ResearchRoverProcess::init() {
         }
         if (aux1) {
             _aux1CameraDevice = aux1->device;
+            _aux1CameraServer->setCaptureModes(aux1->modes, cameraPassthrough);
             LOG_I(LOG_TAG, "Aux1 camera found: " + aux1->toString());
         }
         else {
@@ -151,6 +244,12 @@ void ResearchRoverProcess::init() {
 
     _audioServer = new AudioServer(MEDIAID_AUDIO, SocketAddress(QHostAddress::Any, NETWORK_ALL_AUDIO_PORT), this);
 
+    _audioWorkerPool = new StreamerPool(QCoreApplication::applicationDirPath() + "/audio_streamer", 1, this);
+    _audioServer->setWorkerPool(_audioWorkerPool);
+    if (_streamEngine) {
+        _audioServer->setStreamEngine(_streamEngine);
+    }
+
     connect(_audioServer, &AudioServer::error, this, &ResearchRoverProcess::mediaServerError);
 
     LOG_I(LOG_TAG, "*****************Initializing Data Recording System*******************");
@@ -177,6 +276,12 @@ void ResearchRoverProcess::init() {
     connect(_gpsServer, &GpsServer::gpsUpdate, _gpsDataSeries, &GpsCsvSeries::addLocation);
     connect(_mbed, &MbedChannel::messageReceived, _sensorDataSeries, &SensorDataParser::newData);
 
+    // Mission control gets the rover's copy of each test and its logs afterwards, over the
+    // shared channel behind live traffic
+    _bulkTransferSender = new BulkTransferSender(_sharedChannel, this);
+    _bulkTransferSender->addDirectory(QCoreApplication::applicationDirPath() + "/../research_data", "research_data");
+    _bulkTransferSender->addDirectory(QCoreApplication::applicationDirPath() + "/../log", "log");
+
     LOG_I(LOG_TAG, "-------------------------------------------------------");
     LOG_I(LOG_TAG, "-------------------------------------------------------");
     LOG_I(LOG_TAG, "-------------------------------------------------------");
@@ -209,13 +314,20 @@ void ResearchRoverProcess::sendSystemStatusMessage() {
 bool ResearchRoverProcess::startDataRecording(QDateTime startTime) {
     LOG_I(LOG_TAG, "Starting test log with start time of " + QString::number(startTime.toMSecsSinceEpoch()));
 
-    return _dataRecorder->startLog(startTime);
+    // Leave the link to live data while the test runs
+    _bulkTransferSender->setPaused(true);
+    if (!_dataRecorder->startLog(startTime)) {
+        _bulkTransferSender->setPaused(false);
+        return false;
+    }
+    return true;
 }
 
 void ResearchRoverProcess::stopDataRecording() {
     LOG_I(LOG_TAG, "Ending test log");
 
     _dataRecorder->stopLog();
+    _bulkTransferSender->setPaused(false);
 }
 
 void ResearchRoverProcess::driveChannelStateChanged(Channel::State state) {
@@ -227,6 +339,14 @@ void ResearchRoverProcess::driveChannelStateChanged(Channel::State state) {
     }
 }
 
+void ResearchRoverProcess::logDriveLatency() {
+    LOG_I(LOG_TAG, "Drive channel wake-up latency: " + _driveChannel->getWakeupLatencyHistogram().toString()
+          + ", kernel drops: " + QString::number(_driveChannel->getKernelDroppedPackets()));
+    LOG_I(LOG_TAG, "Mbed wake-up latency: " + _mbed->getWakeupLatencyHistogram().toString());
+    _driveChannel->resetWakeupLatencyHistogram();
+    _mbed->resetWakeupLatencyHistogram();
+}
+
 void ResearchRoverProcess::mbedChannelStateChanged(MbedChannel::State state) {
     Q_UNUSED(state);
     sendSystemStatusMessage();
@@ -246,6 +366,31 @@ void ResearchRoverProcess::driveChannelMessageReceived(const char* message, Chan
     }
 }
 
+void ResearchRoverProcess::mediaClientStatsReceived(MediaServer *server) {
+    MediaControlMessage::Stats stats = server->getClientStats();
+    LOG_D(LOG_TAG, "Receiver report for media " + QString::number(server->getMediaId()) + ": "
+          + QString::number(stats.bitrate) + "bps, " + QString::number(stats.packetLoss) + "% loss, "
+          + QString::number(stats.reordered) + " reordered, " + QString::number(stats.jitter) + "us jitter, "
+          + QString::number(stats.framerate) + "fps, keyframe every " + QString::number(stats.keyframeInterval) + " frames");
+}
+
+void ResearchRoverProcess::mediaStreamerStatsReceived(MediaServer *server) {
+    MediaServer::StreamerStats stats = server->getStreamerStats();
+    QString summary = QString::number(stats.framesCaptured) + " captured, " + QString::number(stats.framesEncoded) + " encoded, "
+            + QString::number(stats.framesDropped) + " dropped, " + QString::number(stats.qosEvents) + " QoS events, "
+            + QString::number(stats.encodeTime) + "us/frame, " + QString::number(stats.bitrate) + "bps, "
+            + (stats.cpu >= 0 ? QString::number(stats.cpu) + "% CPU" : QString("in process"));
+    // An encoder that can't keep up drops frames or takes most of a frame's time to encode one
+    bool overloaded = (stats.qosDropped > 0)
+            || ((stats.framesEncoded > 0) && (stats.encodeTime > 1000000 / stats.framesEncoded * 3 / 4));
+    if (overloaded) {
+        LOG_W(LOG_TAG, "Encoder for media " + QString::number(server->getMediaId()) + " looks overloaded: " + summary);
+    }
+    else {
+        LOG_D(LOG_TAG, "Encoder for media " + QString::number(server->getMediaId()) + ": " + summary);
+    }
+}
+
 void ResearchRoverProcess::mediaServerError(MediaServer *server, QString message) {
     QByteArray byeArray;
     QDataStream stream(&byeArray, QIODevice::WriteOnly);
@@ -281,33 +426,27 @@ void ResearchRoverProcess::sharedChannelMessageReceived(const char* message, Cha
         VideoFormat format;
         stream >> formatString;
         format.deserialize(formatString);
-        if (!_stereoRCameraDevice.isEmpty()) {
-            _stereoRCameraServer->start(_stereoRCameraDevice, format);
-        }
-        if (!_stereoLCameraDevice.isEmpty()) {
-            _stereoLCameraServer->start(_stereoLCameraDevice, format);
-        }
+        startCamera(_stereoRCameraServer, _stereoRCameraDevice, format);
+        startCamera(_stereoLCameraServer, _stereoLCameraDevice, format);
     }
         break;
     case SharedMessage_Research_EndStereoAndMonoCameraStream:
-        _stereoRCameraServer->stop();
-        _stereoLCameraServer->stop();
-        _monoCameraServer->stop();
+        stopCamera(_stereoRCameraServer);
+        stopCamera(_stereoLCameraServer);
+        stopCamera(_monoCameraServer);
         break;
     case SharedMessage_Research_StopAllCameraStreams:
-        _stereoRCameraServer->stop();
-        _stereoLCameraServer->stop();
-        _monoCameraServer->stop();
-        _aux1CameraServer->stop();
+        stopCamera(_stereoRCameraServer);
+        stopCamera(_stereoLCameraServer);
+        stopCamera(_monoCameraServer);
+        stopCamera(_aux1CameraServer);
         break;
     case SharedMessage_Research_StartMonoCameraStream: {
         QString formatString;
         VideoFormat format;
         stream >> formatString;
         format.deserialize(formatString);
-        if (!_monoCameraDevice.isEmpty()) {
-            _monoCameraServer->start(_monoCameraDevice, format);
-        }
+        startCamera(_monoCameraServer, _monoCameraDevice, format);
     }
         break;
     case SharedMessage_Research_StartAux1CameraStream:{
@@ -315,13 +454,11 @@ void ResearchRoverProcess::sharedChannelMessageReceived(const char* message, Cha
         VideoFormat format;
         stream >> formatString;
         format.deserialize(formatString);
-        if (!_aux1CameraDevice.isEmpty()) {
-            _aux1CameraServer->start(_aux1CameraDevice, format);
-        }
+        startCamera(_aux1CameraServer, _aux1CameraDevice, format);
     }
         break;
     case SharedMessage_Research_EndAux1CameraStream:
-        _aux1CameraServer->stop();
+        stopCamera(_aux1CameraServer);
         break;
     case SharedMessage_Research_StartDataRecording: {
         qint64 startTime;
@@ -339,12 +476,106 @@ void ResearchRoverProcess::sharedChannelMessageReceived(const char* message, Cha
     case SharedMessage_Research_StopDataRecording:
         stopDataRecording();
         break;
+    case SharedMessage_BulkTransferAck:
+    case SharedMessage_BulkTransferResult:
+        _bulkTransferSender->handleMessage(messageType, stream);
+        break;
+    case SharedMessage_Research_AdjustVideoStream: {
+        // Live bitrate/framerate change from mission control's bitrate controller
+        qint32 mediaId;
+        quint32 bitrate;
+        quint32 framerate;
+        stream >> mediaId;
+        stream >> bitrate;
+        stream >> framerate;
+        VideoServer *server = findVideoServer(mediaId);
+        if (server) {
+            server->adjustStream(bitrate, framerate);
+        }
+        else {
+            LOG_W(LOG_TAG, "Got stream adjustment for unknown media ID " + QString::number(mediaId));
+        }
+    }
+        break;
     default:
         LOG_W(LOG_TAG, "Got unknown shared channel message");
         break;
     }
 }
 
+VideoServer* ResearchRoverProcess::findVideoServer(int mediaId) {
+    if (_stereoRCameraServer->getMediaId() == mediaId) return _stereoRCameraServer;
+    if (_stereoLCameraServer->getMediaId() == mediaId) return _stereoLCameraServer;
+    if (_aux1CameraServer->getMediaId() == mediaId) return _aux1CameraServer;
+    if (_monoCameraServer->getMediaId() == mediaId) return _monoCameraServer;
+    return nullptr;
+}
+
+void ResearchRoverProcess::startCamera(VideoServer *server, QString device, VideoFormat format) {
+    if (device.isEmpty()) return;
+    CaptureMode mode = server->selectCaptureMode(format);
+    if (!_captureMultiplexer || mode.isPassthroughFor(format)) {
+        // Frames the camera compresses itself can't be shared, so passthrough opens the device directly
+        if (_captureMultiplexer && _cameraDevices.contains(server)) {
+            _pendingCameraFormats.remove(server);
+            _captureMultiplexer->release(_cameraDevices.take(server));
+        }
+        server->start(device, format);
+        return;
+    }
+    // Wait for the device if it isn't running yet, this is also how a failure to open it is handled
+    _pendingCameraFormats.insert(server, format);
+    // Acquired again even for the same device, in case the new format needs a larger mode
+    if (_cameraDevices.contains(server)) {
+        _captureMultiplexer->release(_cameraDevices.take(server));
+    }
+    _cameraDevices.insert(server, device);
+    QString source = _captureMultiplexer->acquire(device, mode);
+    if (!_pendingCameraFormats.contains(server)) {
+        // Already started directly by captureFailed()
+        return;
+    }
+    if (!source.isEmpty()) {
+        _pendingCameraFormats.remove(server);
+        server->start(source, format);
+    }
+    else if (server->getState() != MediaServer::IdleState) {
+        // The device is being (re)opened, a stream still reading the old capture is about to lose it
+        server->stop();
+    }
+}
+
+void ResearchRoverProcess::stopCamera(VideoServer *server) {
+    server->stop();
+    _pendingCameraFormats.remove(server);
+    if (_captureMultiplexer && _cameraDevices.contains(server)) {
+        _captureMultiplexer->release(_cameraDevices.take(server));
+    }
+}
+
+void ResearchRoverProcess::captureSourceReady(QString device, QString source) {
+    foreach (VideoServer *server, _pendingCameraFormats.keys()) {
+        if (_cameraDevices.value(server) == device) {
+            server->start(source, _pendingCameraFormats.take(server));
+        }
+    }
+}
+
+void ResearchRoverProcess::captureFailed(QString device, QString error) {
+    // Open the device directly instead, which works as long as only one server needs it
+    LOG_W(LOG_TAG, "Shared capture of " + device + " failed (" + error + "), opening it directly");
+    foreach (VideoServer *server, _cameraDevices.keys()) {
+        if (_cameraDevices.value(server) != device) continue;
+        _cameraDevices.remove(server);
+        if (_pendingCameraFormats.contains(server)) {
+            server->start(device, _pendingCameraFormats.take(server));
+        }
+        else if (server->getState() != MediaServer::IdleState) {
+            server->start(device, server->getVideoFormat());
+        }
+    }
+}
+
 void ResearchRoverProcess::mbedMessageReceived(const char* message, int size) {
     // Forward the message to mission control (MbedDataParser instance will take care of logging it)
 
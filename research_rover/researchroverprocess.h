@@ -10,10 +10,15 @@
 #include "libsoro/nmeamessage.h"
 #include "libsoro/videoserver.h"
 #include "libsoro/videoformat.h"
+#include "libsoro/streamerpool.h"
 #include "libsoro/enums.h"
 #include "libsoro/sensordataparser.h"
 #include "libsoro/gpscsvseries.h"
 #include "libsoro/drivemessage.h"
+#include "libsoro/bulktransfersender.h"
+
+#include "libsorogst/streamengine.h"
+#include "libsorogst/capturemultiplexer.h"
 
 namespace Soro {
 namespace Rover {
@@ -50,21 +55,55 @@ private:
     VideoServer *_monoCameraServer = nullptr;
     QString _monoCameraDevice;
 
+    /* Pre-started streaming processes, so streams start without waiting for a process to start
+     */
+    StreamerPool *_videoWorkerPool = nullptr;
+    StreamerPool *_audioWorkerPool = nullptr;
+
+    /* Runs streams inside this process when InProcessStreaming is set in research_rover.conf
+     */
+    Soro::Gst::StreamEngine *_streamEngine = nullptr;
+
+    /* Opens each camera once and shares it between the servers streaming it, if
+     * SharedCapture is enabled in research_rover.conf
+     */
+    Soro::Gst::CaptureMultiplexer *_captureMultiplexer = nullptr;
+    // Device each server has acquired from the multiplexer
+    QHash<VideoServer*, QString> _cameraDevices;
+    // Servers waiting for their device to start, with the format to stream once it has
+    QHash<VideoServer*, VideoFormat> _pendingCameraFormats;
+
     CsvRecorder *_dataRecorder;
     GpsCsvSeries *_gpsDataSeries;
     SensorDataParser *_sensorDataSeries;
 
+    /* Sends data logs and log files to mission control while no test is being recorded
+     */
+    BulkTransferSender *_bulkTransferSender = nullptr;
+
+    VideoServer* findVideoServer(int mediaId);
+
+    /* Starts or stops a camera server, reading the device through the capture multiplexer
+     */
+    void startCamera(VideoServer *server, QString device, VideoFormat format);
+    void stopCamera(VideoServer *server);
+
 private slots:
     void init();
     void sendSystemStatusMessage();
     void sharedChannelStateChanged(Channel::State state);
     void driveChannelStateChanged(Channel::State state);
     void mbedChannelStateChanged(MbedChannel::State state);
+    void logDriveLatency();
     void mbedMessageReceived(const char* message, int size);
     void driveChannelMessageReceived(const char* message, Channel::MessageSize size);
     void sharedChannelMessageReceived(const char* message, Channel::MessageSize size);
     void gpsUpdate(NmeaMessage message);
     void mediaServerError(MediaServer* server, QString message);
+    void mediaClientStatsReceived(MediaServer* server);
+    void mediaStreamerStatsReceived(MediaServer* server);
+    void captureSourceReady(QString device, QString source);
+    void captureFailed(QString device, QString error);
     bool startDataRecording(QDateTime startTime);
     void stopDataRecording();
 
@@ -30,12 +30,12 @@
 #include "libsoro/logger.h"
 //#include "libsoro/flycapcamera.h"
 
-#include "videostreamer.h"
+#include "libsorogst/videostreamer.h"
 
 #define LOG_TAG "Main"
 
 using namespace Soro;
-using namespace Soro::Rover;
+using namespace Soro::Gst;
 
 int main(int argc, char *argv[]) {
     QCoreApplication a(argc, argv);
@@ -48,65 +48,29 @@ int main(int argc, char *argv[]) {
     LOG_I(LOG_TAG, "Starting...");
     QGst::init();
 
-    if (argc < 8) {
-        LOG_E(LOG_TAG, "Not enough arguments (expected 8, got " + QString::number(argc) + ")");
-        return STREAMPROCESS_ERR_NOT_ENOUGH_ARGUMENTS;
+    QStringList args = a.arguments();
+    if ((args.size() == 3) && (args[1] == "--worker")) {
+        // Pre-started by a StreamerPool, wait for the stream to send
+        QStringList preload;
+        preload << "v4l2src" << "videoscale" << "videorate" << "videoconvert" << "capsfilter"
+                << "x264enc" << "jpegenc" << "vp8enc" << "rtph264pay" << "rtpjpegpay" << "rtpvp8pay" << "udpsink"
+                << "shmsrc" << "tee" << "queue" << "h264parse" << "splitmuxsink" << "matroskamux" << "filesink";
+        if (!MediaStreamer::waitForWork(args[2].toUShort(), preload, args)) {
+            return 0;
+        }
     }
 
-    bool ok;
-    VideoFormat format;
     QString device;
+    QString formatSerial;
     SocketAddress address;
     SocketAddress bindAddress;
     quint16 ipcPort;
-
-    /*
-     * Parse device
-     */
-    device = argv[1];
-    LOG_I(LOG_TAG, "Device: " + device);
-
-    /*
-     * Parse format
-     */
-    QString formatSerial = QString(argv[2]);
-    LOG_I(LOG_TAG, "Format: " + formatSerial);
-    format.deserialize(formatSerial);
-
-    /*
-     * Parse destination address
-     */
-    address.host = QHostAddress(argv[3]);
-    address.port = QString(argv[4]).toInt(&ok);
-    if ((address.host == QHostAddress::Null) | (address.host == QHostAddress::Any) | !ok) {
-        LOG_E(LOG_TAG, "Invalid address '" + QString(argv[3]) + ":" + QString(argv[4]) + "'");
-        // invalid address
-        return STREAMPROCESS_ERR_INVALID_ARGUMENT;
+    int result = MediaStreamer::parseArguments(args, device, formatSerial, address, bindAddress, ipcPort);
+    if (result != 0) {
+        return result;
     }
-    LOG_I(LOG_TAG, "Address: " + address.toString());
-
-    /*
-     * Parse bind address
-     */
-    bindAddress.host = QHostAddress(argv[5]);
-    bindAddress.port = QString(argv[6]).toInt(&ok);
-    if ((bindAddress.host == QHostAddress::Null) | !ok) {
-        // invalid host
-         LOG_E(LOG_TAG, "Invalid bind address '" + QString(argv[5]) + ":" + QString(argv[6]) + "'");
-        return STREAMPROCESS_ERR_INVALID_ARGUMENT;
-    }
-    LOG_I(LOG_TAG, "Bind Address: " + address.toString());
-
-    /*
-     * Parse IPC Port
-     */
-    ipcPort = QString(argv[7]).toInt(&ok);
-    if (!ok) {
-        // invalid IPC port
-        LOG_E(LOG_TAG, "Invalid IPC port '" + QString(argv[7]) + "'");
-        return STREAMPROCESS_ERR_INVALID_ARGUMENT;
-    }
-    LOG_I(LOG_TAG, "IPC Port: " + QString::number(ipcPort));
+    VideoFormat format;
+    format.deserialize(formatSerial);
 
     a.setApplicationName("VideoStream for " + device + " to " + address.toString());
 
@@ -137,7 +101,10 @@ int main(int argc, char *argv[]) {
     }
     else {*/
         LOG_I(LOG_TAG, "Creating stream object");
-        VideoStreamer stream(device, format, bindAddress, address, ipcPort, &a);
+        // Settings for a local recording and the capture mode follow the standard arguments when given
+        VideoStreamer stream(device, format, bindAddress, address, ipcPort, &a,
+                             MediaStreamer::getOptionalArgument(args, "local"),
+                             MediaStreamer::getOptionalArgument(args, "capture"));
         LOG_I(LOG_TAG, "Stream object created");
         return a.exec();
     //}
@@ -33,13 +33,10 @@ PRECOMPILED_DIR = $$BUILD_DIR
 
 SOURCES += \
     #flycapcamera.cpp \
-    videostreamer.cpp \
     main.cpp
 
 HEADERS += \
-    videostreamer.h \
-    #flycapcamera.h \
-    videostreamer.h
+    #flycapcamera.h
 
 INCLUDEPATH += $$PWD/..
 INCLUDEPATH += $$PWD/../..